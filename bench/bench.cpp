@@ -0,0 +1,408 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <schip/config.h>
+#include <schip/machine.h>
+#include <schip/scaler.h>
+
+/**
+ * Microbenchmarks for the hot paths of the emulator.
+ *
+ * Every benchmark is calibrated to run for a few milliseconds per repetition
+ * and then repeated, so that the median and the spread can be reported. The
+ * results can be written as JSON and compared against an earlier run.
+ */
+
+namespace {
+
+using clock = std::chrono::steady_clock;
+
+// Results are added to this so that the compiler cannot drop the work
+volatile uint64_t sink;
+
+struct Benchmark {
+    std::string name;
+    // Operations per iteration
+    unsigned ops;
+    std::function<void(Machine&)> setup;
+    std::function<void(Machine&, uint64_t)> body;
+};
+
+struct Result {
+    std::string name;
+    uint64_t iterations;
+    unsigned reps;
+    double median;
+    double mean;
+    double stddev;
+    double min;
+};
+
+struct Options {
+    unsigned reps{10};
+    double min_rep_ms{5};
+    std::string filter;
+    std::string json;
+    std::string baseline;
+    double threshold{10};
+};
+
+// Sets Vx = nn for every register and points I at 0x300
+void setup_registers(Machine& machine) {
+    for (uint16_t x = 0; x < 16; x++)
+        machine.chip.execute(0x6000 | x << 8 | (x * 17));
+    machine.chip.execute(0xa300);
+}
+
+// Fills 0x300.. with a pattern to draw
+void setup_sprites(Machine& machine) {
+    setup_registers(machine);
+    for (Addr addr = 0x300; addr < 0x340; addr++)
+        machine.bus.write(addr, static_cast<Byte>(addr * 37));
+}
+
+Benchmark decode(std::string name, std::vector<uint16_t> opcodes) {
+    return {
+        "decode/" + name,
+        static_cast<unsigned>(opcodes.size()),
+        setup_sprites,
+        [opcodes](Machine& machine, uint64_t iterations) {
+            for (uint64_t n = 0; n < iterations; n++) {
+                for (uint16_t opcode : opcodes)
+                    machine.chip.execute(opcode);
+            }
+        }
+    };
+}
+
+Benchmark sprite(std::string name, bool extended, unsigned lines, unsigned x, unsigned y) {
+    return {
+        "ppu/draw_sprite_at/" + name,
+        1,
+        [extended](Machine& machine) {
+            setup_sprites(machine);
+            if (extended)
+                machine.ppu.enable_extended();
+        },
+        [lines, x, y](Machine& machine, uint64_t iterations) {
+            uint64_t collisions = 0;
+            for (uint64_t n = 0; n < iterations; n++)
+                collisions += machine.ppu.draw_sprite_at(0x300, lines, x, y);
+            sink = sink + collisions;
+        }
+    };
+}
+
+// Scales a screen full of sprites up to about the size of a 1080p window
+Benchmark upscale(std::string name, ScaleFilter filter, unsigned scale, ScaleKernel kernel) {
+    auto scaler = std::make_shared<FrameScaler>(ScaleOptions{filter, scale, 0xffffffff, 0xff000000, kernel});
+
+    return {
+        "scaler/" + name + "/" + FrameScaler::kernel_name(kernel),
+        1,
+        [](Machine& machine) {
+            setup_sprites(machine);
+            machine.ppu.enable_extended();
+            for (unsigned n = 0; n < 64; n++)
+                machine.ppu.draw_sprite_at(0x300, 0, (n * 23) % 120, (n * 11) % 56);
+        },
+        [scaler](Machine& machine, uint64_t iterations) {
+            uint64_t sum = 0;
+            for (uint64_t n = 0; n < iterations; n++)
+                sum += scaler->scale(machine.ppu.pixels(), true)[n % 1024];
+            sink = sink + sum;
+        }
+    };
+}
+
+std::vector<Benchmark> make_benchmarks() {
+    std::vector<Benchmark> benchmarks = {
+        decode("00EE+2nnn call_ret", {0x2300, 0x00ee}),
+        decode("1nnn jmp", {0x1300}),
+        decode("3xnn seq_imm", {0x3a00}),
+        decode("4xnn sne_imm", {0x4a00}),
+        decode("5xy0 seq", {0x5ab0}),
+        decode("6xnn ld", {0x6a12}),
+        decode("7xnn add_imm", {0x7a01}),
+        decode("8xy0 mov", {0x8ab0}),
+        decode("8xy1 or", {0x8ab1}),
+        decode("8xy2 and", {0x8ab2}),
+        decode("8xy3 xor", {0x8ab3}),
+        decode("8xy4 add", {0x8ab4}),
+        decode("8xy5 sub", {0x8ab5}),
+        decode("8xy6 shr", {0x8ab6}),
+        decode("8xy7 sbr", {0x8ab7}),
+        decode("8xyE shl", {0x8abe}),
+        decode("9xy0 sne", {0x9ab0}),
+        decode("Annn ldi", {0xa300}),
+        decode("Bnnn jmpr", {0xb300}),
+        decode("Cxnn rand", {0xcaff}),
+        decode("Dxyn draw", {0xd015}),
+        decode("Ex9E skp", {0xea9e}),
+        decode("ExA1 sknp", {0xeaa1}),
+        decode("Fx07 get_delay", {0xfa07}),
+        decode("Fx15 set_delay", {0xfa15}),
+        decode("Fx18 set_stimer", {0xfa18}),
+        decode("Fx1E addi", {0xf01e}),
+        decode("Fx29 ld_sprite", {0xfa29}),
+        decode("Fx30 ld_esprite", {0xf930}),
+        decode("Fx33 set_bcd", {0xfa33}),
+        decode("Fx55 reg_dump", {0xff55}),
+        decode("Fx65 reg_store", {0xff65}),
+        decode("Fx75 reg_dump_rpl", {0xf775}),
+        decode("Fx85 reg_store_rpl", {0xf785}),
+
+        {"bus/read", 1, setup_sprites, [](Machine& machine, uint64_t iterations) {
+            uint64_t sum = 0;
+            for (uint64_t n = 0; n < iterations; n++)
+                sum += machine.bus.read(USERCODE_BEG + n % USERCODE_SIZE);
+            sink = sink + sum;
+        }},
+        {"bus/write", 1, setup_sprites, [](Machine& machine, uint64_t iterations) {
+            for (uint64_t n = 0; n < iterations; n++)
+                machine.bus.write(USERCODE_BEG + n % USERCODE_SIZE, static_cast<Byte>(n));
+        }},
+
+        sprite("8x8 lores", false, 8, 10, 10),
+        sprite("16x16 hires", true, 0, 40, 20),
+        sprite("16x16 hires clipped", true, 0, 120, 56),
+        sprite("8x15 colliding", false, 15, 0, 0),
+
+        {"ppu/scroll_down", 1, setup_sprites, [](Machine& machine, uint64_t iterations) {
+            for (uint64_t n = 0; n < iterations; n++)
+                machine.ppu.scroll_down(4);
+        }},
+        {"ppu/scroll_left", 1, setup_sprites, [](Machine& machine, uint64_t iterations) {
+            for (uint64_t n = 0; n < iterations; n++)
+                machine.ppu.scroll_left();
+        }},
+        {"ppu/scroll_right", 1, setup_sprites, [](Machine& machine, uint64_t iterations) {
+            for (uint64_t n = 0; n < iterations; n++)
+                machine.ppu.scroll_right();
+        }},
+        {"ppu/clear_screen", 1, setup_sprites, [](Machine& machine, uint64_t iterations) {
+            for (uint64_t n = 0; n < iterations; n++)
+                machine.ppu.clear_screen();
+        }},
+    };
+
+    for (ScaleKernel kernel : {SCALE_KERNEL_SCALAR, SCALE_KERNEL_SSE2, SCALE_KERNEL_AVX2}) {
+        if (!FrameScaler::supports(kernel))
+            continue;
+
+        benchmarks.push_back(upscale("nearest 15x", SCALE_NEAREST, 15, kernel));
+        benchmarks.push_back(upscale("scale2x 14x", SCALE_2X, 14, kernel));
+    }
+
+    return benchmarks;
+}
+
+double run_once(const Benchmark& benchmark, Machine& machine, uint64_t iterations) {
+    auto start = clock::now();
+    benchmark.body(machine, iterations);
+    std::chrono::duration<double, std::nano> elapsed = clock::now() - start;
+    return elapsed.count();
+}
+
+Result measure(const Benchmark& benchmark, const Options& options) {
+    auto machine = std::make_unique<Machine>();
+    machine->chip.seed(1);
+    benchmark.setup(*machine);
+
+    // Find an iteration count that takes long enough to time reliably
+    uint64_t iterations = 1;
+    while (run_once(benchmark, *machine, iterations) < options.min_rep_ms * 1e6 && iterations < (uint64_t{1} << 40))
+        iterations *= 2;
+
+    std::vector<double> samples;
+    for (unsigned r = 0; r < options.reps; r++)
+        samples.push_back(run_once(benchmark, *machine, iterations) / (iterations * benchmark.ops));
+
+    std::sort(samples.begin(), samples.end());
+
+    Result result;
+    result.name = benchmark.name;
+    result.iterations = iterations;
+    result.reps = options.reps;
+    result.min = samples.front();
+    result.median = samples.size() % 2
+        ? samples[samples.size() / 2]
+        : (samples[samples.size() / 2 - 1] + samples[samples.size() / 2]) / 2;
+
+    double sum = 0;
+    for (double s : samples)
+        sum += s;
+    result.mean = sum / samples.size();
+
+    double var = 0;
+    for (double s : samples)
+        var += (s - result.mean) * (s - result.mean);
+    result.stddev = samples.size() > 1 ? std::sqrt(var / (samples.size() - 1)) : 0;
+
+    return result;
+}
+
+std::string escape(std::string_view text) {
+    std::string out;
+    for (char c : text) {
+        if (c == '"' || c == '\\')
+            out += '\\';
+        out += c;
+    }
+    return out;
+}
+
+void write_json(const std::string& filename, const std::vector<Result>& results) {
+    std::ofstream file{filename};
+    if (!file)
+        throw std::runtime_error("Cannot create " + filename);
+
+    file << "{\n";
+    file << "  \"project\": \"" << PROJECT_NAME << "\",\n";
+    file << "  \"version\": \"" << PROJECT_VER << "\",\n";
+    file << "  \"unit\": \"ns/op\",\n";
+    file << "  \"benchmarks\": [\n";
+
+    for (size_t i = 0; i < results.size(); i++) {
+        const Result& r = results[i];
+        file << "    {\"name\": \"" << escape(r.name) << "\", \"median\": " << r.median
+             << ", \"mean\": " << r.mean << ", \"stddev\": " << r.stddev << ", \"min\": " << r.min
+             << ", \"iterations\": " << r.iterations << ", \"reps\": " << r.reps << "}"
+             << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+
+    file << "  ]\n}\n";
+}
+
+// Reads the medians back from a file written by write_json()
+std::map<std::string, double> read_baseline(const std::string& filename) {
+    std::ifstream file{filename};
+    if (!file)
+        throw std::runtime_error("Cannot open " + filename);
+
+    std::map<std::string, double> medians;
+    std::string line;
+
+    while (std::getline(file, line)) {
+        auto name = line.find("\"name\": \"");
+        auto median = line.find("\"median\": ");
+        if (name == std::string::npos || median == std::string::npos)
+            continue;
+
+        name += 9;
+        std::string key;
+        for (size_t i = name; i < line.size() && line[i] != '"'; i++) {
+            if (line[i] == '\\' && i + 1 < line.size())
+                i++;
+            key += line[i];
+        }
+
+        medians[key] = std::stod(line.substr(median + 10));
+    }
+
+    return medians;
+}
+
+void print_help(const char* program) {
+    std::cerr << "Usage: " << program << " [options]" << std::endl << std::endl;
+    std::cerr << "Options:" << std::endl;
+    std::cerr << "  --filter <text>      Only run benchmarks whose name contains the text" << std::endl;
+    std::cerr << "  --reps <n>           Repetitions per benchmark (default: 10)" << std::endl;
+    std::cerr << "  --min-time <ms>      Minimum time per repetition (default: 5)" << std::endl;
+    std::cerr << "  --json <file>        Write the results as JSON" << std::endl;
+    std::cerr << "  --baseline <file>    Compare against the JSON of an earlier run" << std::endl;
+    std::cerr << "  --threshold <pct>    Fail if a median is this much slower than the baseline (default: 10)" << std::endl;
+}
+
+}
+
+int main(int argc, char** argv) {
+    Options options;
+
+    try {
+        for (int i = 1; i < argc; i++) {
+            std::string_view arg{argv[i]};
+            bool has_value = i + 1 < argc;
+
+            if (arg == "--filter" && has_value)
+                options.filter = argv[++i];
+            else if (arg == "--reps" && has_value)
+                options.reps = std::max(1ul, std::stoul(argv[++i]));
+            else if (arg == "--min-time" && has_value)
+                options.min_rep_ms = std::stod(argv[++i]);
+            else if (arg == "--json" && has_value)
+                options.json = argv[++i];
+            else if (arg == "--baseline" && has_value)
+                options.baseline = argv[++i];
+            else if (arg == "--threshold" && has_value)
+                options.threshold = std::stod(argv[++i]);
+            else
+                throw std::invalid_argument("Unknown option " + std::string(arg));
+        }
+    } catch (std::exception& err) {
+        std::cerr << "Error: " << err.what() << std::endl << std::endl;
+        print_help(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    try {
+        std::map<std::string, double> baseline;
+        if (!options.baseline.empty())
+            baseline = read_baseline(options.baseline);
+
+        std::vector<Result> results;
+        unsigned regressions = 0;
+
+        std::cout << std::left << std::setw(40) << "benchmark" << std::right
+                  << std::setw(12) << "median" << std::setw(12) << "stddev"
+                  << std::setw(12) << "min" << std::setw(12) << "change" << std::endl;
+
+        for (const Benchmark& benchmark : make_benchmarks()) {
+            if (benchmark.name.find(options.filter) == std::string::npos)
+                continue;
+
+            Result r = measure(benchmark, options);
+            results.push_back(r);
+
+            std::cout << std::left << std::setw(40) << r.name << std::right << std::fixed << std::setprecision(2)
+                      << std::setw(9) << r.median << " ns" << std::setw(9) << r.stddev << " ns"
+                      << std::setw(9) << r.min << " ns";
+
+            if (auto it = baseline.find(r.name); it != baseline.end() && it->second > 0) {
+                double change = (r.median / it->second - 1) * 100;
+                std::cout << std::showpos << std::setw(11) << change << "%" << std::noshowpos;
+
+                if (change > options.threshold) {
+                    std::cout << "  REGRESSION";
+                    regressions++;
+                }
+            }
+
+            std::cout << std::endl;
+        }
+
+        if (!options.json.empty())
+            write_json(options.json, results);
+
+        if (regressions) {
+            std::cout << regressions << " benchmarks regressed by more than " << options.threshold << "%" << std::endl;
+            return EXIT_FAILURE;
+        }
+    } catch (std::exception& err) {
+        std::cerr << "Error: " << err.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
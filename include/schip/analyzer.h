@@ -0,0 +1,148 @@
+#pragma once
+
+#ifndef ANALYZER_H
+#define ANALYZER_H
+
+#include <cstdint>
+#include <cstddef>
+#include <algorithm>
+#include <filesystem>
+#include <span>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include <schip/memory.h>
+
+/**
+ * What a byte of a ROM was found to be. A byte can be several of these.
+ */
+enum RomByteFlags : uint8_t {
+    // Part of an instruction that can be reached from the entry point
+    MAP_CODE = 1 << 0,
+
+    // The first byte of an instruction that a jump, call or skip leads to
+    MAP_BLOCK = 1 << 1,
+
+    // Drawn as part of a sprite
+    MAP_SPRITE = 1 << 2,
+
+    // Loaded into registers by Fx65
+    MAP_READ = 1 << 3,
+
+    // Stored to by Fx33 or Fx55
+    MAP_WRITTEN = 1 << 4
+};
+
+enum RomMapFlags : uint16_t {
+    // An instruction writes into bytes that are code
+    MAP_WRITES_CODE = 1 << 0,
+
+    // An instruction writes through an I that could not be worked out
+    MAP_UNKNOWN_WRITES = 1 << 1,
+
+    // A Bnnn jumps somewhere that could not be worked out
+    MAP_UNRESOLVED_JUMPS = 1 << 2,
+
+    // An invalid opcode can be reached
+    MAP_INVALID_CODE = 1 << 3
+};
+
+/**
+ * Which bytes of a ROM are code and which are data, as far as can be told
+ * without running it.
+ */
+struct RomMap {
+    // hash_block() of the ROM
+    uint64_t hash{0};
+    uint16_t flags{0};
+
+    // RomByteFlags for every byte of the ROM, the first of which is at USERCODE_BEG
+    std::vector<uint8_t> bytes;
+
+    // The instructions that write into code, or through an unknown I
+    std::vector<Addr> code_writes;
+
+    /**
+     * @return true if the program may change its own code.
+     */
+    bool self_modifying() const { return flags & (MAP_WRITES_CODE | MAP_UNKNOWN_WRITES); }
+};
+
+/**
+ * Disassembles a ROM by recursive descent from its entry point.
+ *
+ * Every jump, call and skip is followed, with the opcodes decoded by
+ * classify() exactly like the chip does. On the way, the values loaded into
+ * the registers and I by immediate instructions are tracked, which finds the
+ * sprites that are drawn, the memory that is loaded and stored, and the
+ * targets of Bnnn. Like the chip, Bnnn jumps to nnn plus the register named
+ * by the top nibble of nnn. If that register is not known, nnn is taken to be
+ * a table of jumps, and every jump in a row from nnn on is followed.
+ *
+ * Values are only tracked along the first path that reaches an instruction,
+ * and forgotten after a call, so this errs on the side of not knowing. Dxy0
+ * only marks a 16x16 sprite after a 00FF on that path, as it draws nothing
+ * in low resolution.
+ *
+ * @param rom	The bytes of the ROM.
+ * @return		The map of the ROM.
+ * @throw std::invalid_argument if the ROM does not fit into memory.
+ */
+RomMap analyze_rom(std::span<const Byte> rom);
+
+/**
+ * Writes a map file.
+ *
+ * The file starts with the magic "SCHIPMAP", a 32-bit version, the 16-bit
+ * size of the ROM, the 16-bit RomMapFlags, the 64-bit hash of the ROM, the
+ * 32-bit number of code writes and 32 reserved bits. Then follow the
+ * addresses of the code writes, 16 bits each, and one byte of RomByteFlags
+ * per byte of the ROM, all in the byte order of a little endian host.
+ *
+ * @param filename			 The file to write.
+ * @param map				 The map.
+ * @throw std::runtime_error if the file cannot be written.
+ */
+void write_rom_map(const std::filesystem::path& filename, const RomMap& map);
+
+/**
+ * Reads a map file back.
+ *
+ * @param filename			 The file written by write_rom_map().
+ * @return					 The map.
+ * @throw std::runtime_error if the file cannot be read or is damaged.
+ */
+RomMap read_rom_map(const std::filesystem::path& filename);
+
+struct AnalyzeOptions {
+    // The number of threads to analyze the ROMs with
+    unsigned threads{std::max(1u, std::thread::hardware_concurrency())};
+};
+
+struct AnalyzeStats {
+    size_t files{0};
+    size_t roms{0};
+    size_t duplicates{0};
+
+    // Files that are empty or too big to be a ROM
+    size_t skipped{0};
+
+    // ROMs that may change their own code
+    size_t self_modifying{0};
+};
+
+/**
+ * Analyzes every distinct ROM among files and directories, and writes the
+ * map of each as <hash>.map into a directory, with the hash in 16 hex digits.
+ *
+ * @param inputs			 ROM files and directories, which are searched recursively.
+ * @param outdir			 The directory to write the maps into.
+ * @param options			 How to analyze them.
+ * @return					 What was found.
+ * @throw std::runtime_error if a file cannot be read or a map cannot be written.
+ */
+AnalyzeStats analyze_roms(const std::vector<std::filesystem::path>& inputs, const std::filesystem::path& outdir,
+                          const AnalyzeOptions& options);
+
+#endif
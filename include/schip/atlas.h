@@ -0,0 +1,90 @@
+#pragma once
+
+#ifndef ATLAS_H
+#define ATLAS_H
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+#include <schip/recorder.h>
+
+/**
+ * The screens of many machines laid out as tiles in one image, to be uploaded
+ * into a single texture and drawn in one pass.
+ *
+ * Every tile holds a frame scaled to 128x64 and is surrounded by a one texel
+ * border. Frames are only written into the image when they differ from what
+ * the tile already shows, and the tiles written since the last call to
+ * take_dirty() are kept, so that only those need to be uploaded.
+ */
+class TileAtlas {
+public:
+    // The border between tiles, as a texel value
+    static constexpr uint8_t border = 0x30;
+
+    // The size of a tile including its border
+    static constexpr int cell_width = PPU::screen_width + 2;
+    static constexpr int cell_height = PPU::screen_height + 2;
+
+    /**
+     * Lays the tiles out in a grid that is about as wide as it is high.
+     *
+     * @param tiles	The number of tiles.
+     */
+    explicit TileAtlas(size_t tiles);
+
+    /**
+     * Shows a frame in a tile.
+     *
+     * @param tile		The index of the tile.
+     * @param frame		The frame, as the PPU keeps it.
+     * @param extended	true if the frame is in high resolution.
+     * @return			true if the tile changed.
+     */
+    bool update(size_t tile, const FramePixels& frame, bool extended);
+
+    /**
+     * Returns and clears the tiles changed since the last call. Every tile
+     * counts as changed at first.
+     *
+     * @return The indices of the tiles, in ascending order.
+     */
+    const std::vector<size_t>& take_dirty();
+
+    /**
+     * @param tile	The index of a tile.
+     * @return		The column of the top left texel of the tile, without the border.
+     */
+    int tile_x(size_t tile) const { return static_cast<int>(tile % m_columns) * cell_width + 1; }
+
+    /**
+     * @param tile	The index of a tile.
+     * @return		The row of the top left texel of the tile, without the border.
+     */
+    int tile_y(size_t tile) const { return static_cast<int>(tile / m_columns) * cell_height + 1; }
+
+    size_t tiles() const { return m_frames.size(); }
+    int columns() const { return m_columns; }
+    int rows() const { return m_rows; }
+    int width() const { return m_columns * cell_width; }
+    int height() const { return m_rows * cell_height; }
+
+    /**
+     * @return The image, width() * height() texels of 8 bits, row by row.
+     */
+    const uint8_t* texels() const { return m_texels.data(); }
+
+private:
+    int m_columns;
+    int m_rows;
+    std::vector<uint8_t> m_texels;
+
+    // What each tile shows, to tell whether a frame changes it
+    std::vector<FramePixels> m_frames;
+    std::vector<bool> m_extended;
+    std::vector<bool> m_dirty;
+    std::vector<size_t> m_taken;
+};
+
+#endif
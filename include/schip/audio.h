@@ -0,0 +1,161 @@
+#pragma once
+
+#ifndef AUDIO_H
+#define AUDIO_H
+
+#include <cstdint>
+#include <cstddef>
+#include <array>
+#include <atomic>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include <schip/chip.h>
+#include <schip/spsc.h>
+
+using AudioSample = int16_t;
+
+/**
+ * Turns the state of the sound timer into a square wave, one frame of
+ * samples at a time.
+ *
+ * The tone fades in and out over a few samples, so that switching it on and
+ * off does not click, and its phase carries over from frame to frame.
+ */
+class Buzzer {
+public:
+    static constexpr unsigned sample_rate = 44100;
+    static constexpr unsigned samples_per_frame = sample_rate / Chip::frame_rate;
+
+    static constexpr unsigned frequency = 440;
+    static constexpr AudioSample amplitude = 6000;
+
+    // How many samples the tone takes to fade in or out
+    static constexpr unsigned fade = 64;
+
+    /**
+     * Generates the samples of one frame.
+     *
+     * @param on	true if the sound timer was running during the frame.
+     * @param out	Receives samples_per_frame samples.
+     */
+    void render(bool on, AudioSample* out);
+
+private:
+    // The position within one period of the wave, in samples times the frequency
+    uint32_t m_phase{0};
+    unsigned m_gain{0};
+};
+
+enum AudioSinkType {
+    // Throws the samples away, to run the audio path without a device or a file
+    AUDIO_NULL = 0,
+
+    // Writes the samples into a 16-bit mono WAV file
+    AUDIO_WAV
+};
+
+/**
+ * Plays the buzzer into a sink from a thread of its own.
+ *
+ * The chip hands every frame of samples over through a wait-free ring, so the
+ * emulation thread takes no locks and allocates nothing. The sink thread
+ * drains the ring in one of two ways:
+ *
+ * - In real time it consumes samples at the sample rate, like a sound card
+ *   would. When the ring runs dry it plays silence for the missing samples and
+ *   counts them as an underrun, and when the ring is full the chip's samples
+ *   are dropped and counted as an overrun.
+ * - Otherwise it writes every sample as soon as it arrives, and push_wait()
+ *   waits for room, so that nothing is lost when running without a display.
+ */
+class AudioOutput {
+public:
+    // About 370 ms of samples
+    static constexpr size_t queue_size = 16384;
+
+    // How many samples are queued before the real time clock starts
+    static constexpr size_t prebuffer = Buzzer::samples_per_frame * 3;
+
+    /**
+     * Opens the sink and starts the sink thread.
+     *
+     * @param sink				 Where the samples go.
+     * @param filename			 The WAV file to write, for AUDIO_WAV.
+     * @param realtime			 Consume the samples at the sample rate.
+     * @throw std::runtime_error if the file cannot be created.
+     */
+    AudioOutput(AudioSinkType sink, const std::filesystem::path& filename, bool realtime);
+
+    /**
+     * Calls finish().
+     */
+    ~AudioOutput();
+
+    AudioOutput(const AudioOutput&) = delete;
+    AudioOutput& operator=(const AudioOutput&) = delete;
+
+    /**
+     * Queues the samples of one frame. This never blocks. Only one thread may
+     * push samples.
+     *
+     * @param on	true if the sound timer was running during the frame.
+     * @return		false if the queue was full and samples were dropped.
+     */
+    bool push(bool on);
+
+    /**
+     * Queues the samples of one frame, waiting for room if the queue is full.
+     *
+     * @param on	true if the sound timer was running during the frame.
+     */
+    void push_wait(bool on);
+
+    /**
+     * Writes the samples that are still queued, stops the sink thread and
+     * completes the file. No samples may be pushed after this.
+     */
+    void finish();
+
+    /**
+     * @return The number of samples the sink has been given, including silence.
+     */
+    uint64_t written() const { return m_written.load(std::memory_order_relaxed); }
+
+    /**
+     * @return The number of samples of silence played because the queue ran dry.
+     */
+    uint64_t underruns() const { return m_underruns.load(std::memory_order_relaxed); }
+
+    /**
+     * @return The number of samples dropped because the queue was full.
+     */
+    uint64_t overruns() const { return m_overruns.load(std::memory_order_relaxed); }
+
+private:
+    void drain();
+
+    void write(const AudioSample* samples, size_t count);
+
+    AudioSinkType m_sink;
+    bool m_realtime;
+    std::ofstream m_file;
+
+    Buzzer m_buzzer;
+    std::array<AudioSample, Buzzer::samples_per_frame> m_frame{};
+
+    std::unique_ptr<SpscRing<AudioSample, queue_size>> m_queue;
+    std::vector<AudioSample> m_chunk;
+
+    std::atomic<bool> m_done{false};
+    std::atomic<uint64_t> m_written{0};
+    std::atomic<uint64_t> m_underruns{0};
+    std::atomic<uint64_t> m_overruns{0};
+
+    std::thread m_thread;
+};
+
+#endif
@@ -7,8 +7,24 @@
 #include <array>
 #include <chrono>
 #include <atomic>
+#include <filesystem>
+#include <memory>
+#include <string_view>
 
 #include <schip/memory.h>
+#include <schip/state.h>
+#include <schip/opcodes.h>
+#include <schip/stats.h>
+#include <schip/trace.h>
+
+class PPU;
+class Rewind;
+class MovieWriter;
+class Profiler;
+class FramePacing;
+class FrameRecorder;
+class AudioOutput;
+class Debugger;
 
 using Reg = uint16_t;
 using GPReg = uint8_t;
@@ -26,6 +42,34 @@ enum ChipState {
     CHIP_STOPPED
 };
 
+/**
+ * The time the run loop spends in each phase, summed over many frames.
+ */
+struct FrameProfile {
+    uint64_t frames{0};
+    uint64_t instructions{0};
+
+    // Fetching, decoding and executing instructions
+    std::chrono::nanoseconds exec{0};
+
+    // Ticking the timers at the end of a frame
+    std::chrono::nanoseconds timers{0};
+
+    // Publishing the framebuffer to the display
+    std::chrono::nanoseconds present{0};
+};
+
+/**
+ * The ways the chip can find the handler of an opcode.
+ */
+enum ChipEngine {
+    // The switch in decode(), which is the reference
+    ENGINE_SWITCH = 0,
+
+    // A table from every possible opcode to its handler
+    ENGINE_TABLE
+};
+
 #pragma pack(push, 2)
 union Opcode {
 #ifdef __BIG_ENDIAN__
@@ -72,10 +116,17 @@ union Opcode {
  */
 class Chip {
 public:
-    static Chip& get_instance() {
-        static Chip instance;
-        return instance;
-    }
+    static Chip& get_instance();
+
+    /**
+     * Creates a chip that runs on its own memory and screen.
+     *
+     * @param bus	The memory of this chip.
+     * @param ppu	The screen of this chip.
+     */
+    Chip(Bus& bus, PPU& ppu) : m_bus(bus), m_ppu(ppu) { reset(); }
+    Chip(const Chip&) = delete;
+    Chip& operator=(const Chip&) = delete;
 
 	/**
     * Runs the emulator (starts a run loop).
@@ -102,6 +153,252 @@ public:
 	 */
 	void reset();
 
+    /**
+     * Executes one frame worth of instructions and then ticks the timers.
+     *
+     * @param keys	A bitmask of the keys held down during this frame.
+     * @throws see run().
+     */
+    void run_frame(uint16_t keys);
+
+    /**
+     * Publishes the framebuffer the way the run loop does after every frame.
+     */
+    void present();
+
+    /**
+     * Starts a frame. run_frame() is begin_frame(), instructions_per_frame
+     * calls to step() as long as the program has not exited, and end_frame().
+     *
+     * @param keys	A bitmask of the keys held down during this frame.
+     */
+    void begin_frame(uint16_t keys);
+
+    /**
+     * Ends a frame by ticking the timers.
+     */
+    void end_frame();
+
+    /**
+     * Executes a single instruction.
+     *
+     * @throws see run().
+     */
+    void step();
+
+    /**
+     * Executes an opcode as if it had just been fetched.
+     *
+     * @param opcode	The opcode to execute.
+     * @throws see run().
+     */
+    void execute(uint16_t opcode);
+
+    /**
+     * Copies the registers, the memory and the framebuffer into a state.
+     *
+     * @param state	The state to be filled in.
+     */
+    void save_state(MachineState& state) const;
+
+    /**
+     * Copies only the registers into a state.
+     *
+     * @param regs	The registers to be filled in.
+     */
+    void save_registers(RegisterState& regs) const;
+
+    /**
+     * Restores the registers, the memory and the framebuffer from a state.
+     *
+     * @param state	The state to be restored.
+     */
+    void load_state(const MachineState& state);
+
+    /**
+     * Chooses how opcodes are dispatched to their handlers. Every engine must
+     * behave exactly like ENGINE_SWITCH, which --lockstep checks.
+     *
+     * @param engine	The engine to use from the next instruction on.
+     */
+    void set_engine(ChipEngine engine) { m_engine = engine; }
+
+    ChipEngine engine() const { return m_engine; }
+
+    /**
+     * Attaches a rewind buffer that the run loop records every frame into.
+     *
+     * Must be called before run().
+     *
+     * @param rewind	The rewind buffer, or nullptr to detach it.
+     */
+    void set_rewind(Rewind* rewind) { m_rewind = rewind; }
+
+    /**
+     * Attaches a movie that the run loop records every keypad change into.
+     *
+     * Must be called before run().
+     *
+     * @param movie	The movie writer, or nullptr to detach it.
+     */
+    void set_movie(MovieWriter* movie) { m_movie = movie; }
+
+    /**
+     * Hides input latency by presenting frames from the future.
+     *
+     * After every frame the run loop saves the machine state, runs the given
+     * number of frames ahead with the current input, presents the result and
+     * then restores the saved state. The profilers, statistics, coverage,
+     * trace and debugger only see the frames that really ran, and the
+     * recorder gets the presented frame under the number of the last of them.
+     *
+     * Must be called before run().
+     *
+     * @param frames	The number of frames to run ahead, or 0 to disable it.
+     */
+    void set_run_ahead(unsigned frames) { m_run_ahead = frames; }
+
+    /**
+     * Records guest edge coverage into a bitmap while running.
+     *
+     * Every executed instruction bumps the counter of the edge between the
+     * address of the previous instruction and its own, in the style of AFL.
+     *
+     * @param bitmap	coverage_size counters, or nullptr to stop recording.
+     */
+    void set_coverage(uint8_t* bitmap) {
+        m_coverage = bitmap;
+        m_prev_loc = 0;
+    }
+
+    static constexpr size_t coverage_size = 1 << 16;
+
+    /**
+     * Measures how long every frame spends executing, ticking the timers and
+     * presenting, and adds it to a profile.
+     *
+     * @param profile	The profile to add to, or nullptr to stop measuring.
+     */
+    void set_profile(FrameProfile* profile) { m_profile = profile; }
+
+    /**
+     * Attaches a measurement of how evenly the run loop wakes up for frames.
+     *
+     * Must be called before run().
+     *
+     * @param pacing	The measurement, or nullptr to detach it.
+     */
+    void set_pacing(FramePacing* pacing) { m_pacing = pacing; }
+
+    /**
+     * Attaches a recorder that every presented frame is handed to.
+     *
+     * @param recorder	The recorder, or nullptr to detach it.
+     */
+    void set_recorder(FrameRecorder* recorder) { m_recorder = recorder; }
+
+    /**
+     * Attaches an audio output that the run loop hands the buzzer to after
+     * every frame.
+     *
+     * Must be called before run().
+     *
+     * @param audio	The audio output, or nullptr to detach it.
+     */
+    void set_audio(AudioOutput* audio) { m_audio = audio; }
+
+    /**
+     * Attaches a debugger that is asked before every instruction whether to
+     * stop. Without one, frames run an instruction loop that has no trace of
+     * the debugger in it. Frames that are run ahead are not debugged.
+     *
+     * @param debugger	The debugger, or nullptr to detach it.
+     */
+    void set_debugger(Debugger* debugger) { m_debugger = debugger; }
+
+    /**
+     * Attaches a sampling profiler that is ticked before every instruction.
+     * Frames that are run ahead are not sampled.
+     *
+     * @param profiler	The profiler, or nullptr to detach it.
+     */
+    void set_profiler(Profiler* profiler) { m_profiler = profiler; }
+
+    /**
+     * @return The most recently executed instructions.
+     */
+    TraceRing& trace() { return *m_trace_ring; }
+
+    /**
+     * Makes the run loop write the trace when the chip faults or when
+     * TraceRing::take_request() says so.
+     *
+     * Must be called before run().
+     *
+     * @param filename	The trace file, or empty to not write it.
+     */
+    void set_trace_file(std::filesystem::path filename) { m_trace_file = std::move(filename); }
+
+    /**
+     * Writes the trace to the trace file, if there is one. Errors are printed
+     * rather than thrown, as this is called while handling other errors.
+     *
+     * @param error	Why the chip stopped, or empty if it did not fault.
+     */
+    void write_trace(std::string_view error) const;
+
+    /**
+     * @return The counts and timings per instruction handler, or nullptr if
+     *		   the chip was built without SCHIP_STATS.
+     */
+    const OpStats* stats() const {
+#if(SCHIP_STATS)
+        return &m_stats;
+#else
+        return nullptr;
+#endif
+    }
+
+    /**
+     * Seeds the random number generator, making runs reproducible.
+     *
+     * @param seed	The seed.
+     */
+    void seed(uint32_t seed);
+
+    /**
+     * @return true if the sound timer was running during the last frame.
+     */
+    bool is_buzzing() const { return m_buzzing; }
+
+    /**
+     * @return true if the program has exited by itself.
+     */
+    bool has_exited() const { return m_chipstate == CHIP_STOPPED; }
+
+    /**
+     * @return The number of frames run since the last reset.
+     */
+    uint64_t frame() const { return m_frame; }
+
+    /**
+     * Asks the run loop to go back in time. This is thread safe.
+     *
+     * @param frames	The number of frames to step back.
+     */
+    void rewind(unsigned frames) { m_rewind_request.fetch_add(frames); }
+
+    static constexpr unsigned frame_rate = 60;
+
+    // The time the run loop aims to spend on each frame
+    static constexpr std::chrono::microseconds frame_time{1'000'000 / frame_rate};
+
+    // The stack grows upwards from here, two bytes per return address
+    static constexpr Addr stack_base = 0xea0;
+
+    // 200 us for each instruction was arbitrarily chosen. Idk how fast it should be..
+    static constexpr unsigned instructions_per_frame = 1'000'000 / 200 / frame_rate;
+
 private:
 	// General purpose registers
     std::array<GPReg, 16> m_v{};
@@ -119,26 +416,81 @@ private:
     TimerReg m_dtimer{};
     TimerReg m_stimer{};
 
+    // Whether the sound timer was running when the timers were last updated
+    bool m_buzzing{false};
+
     // RPL user flags (S-CHIP)
     std::array<Byte, 8> m_rpl{};
 
+    // State of the random number generator
+    uint32_t m_rng{1};
+
+    // The keys held down during the current frame
+    uint16_t m_keys{0};
+
+    uint64_t m_frame{0};
+
     std::atomic<bool> m_stopflag{false};
-    std::chrono::high_resolution_clock::time_point m_lasttick{};
+
+    Rewind* m_rewind{nullptr};
+    MovieWriter* m_movie{nullptr};
+    unsigned m_run_ahead{0};
+
+    uint8_t* m_coverage{nullptr};
+    FrameProfile* m_profile{nullptr};
+    Profiler* m_profiler{nullptr};
+    FramePacing* m_pacing{nullptr};
+    FrameRecorder* m_recorder{nullptr};
+    AudioOutput* m_audio{nullptr};
+    Debugger* m_debugger{nullptr};
+
+    // The ring is detached while running ahead, so that it only ever holds
+    // instructions that really ran
+    std::unique_ptr<TraceRing> m_trace_ring{std::make_unique<TraceRing>()};
+    TraceRing* m_trace{m_trace_ring.get()};
+    std::filesystem::path m_trace_file;
+
+#if(SCHIP_STATS)
+    OpStats m_stats;
+#endif
+    Addr m_prev_loc{0};
+    std::atomic<unsigned> m_rewind_request{0};
 
     // Contains the current opcode
     Opcode m_opc{};
 
     Bus& m_bus;
+    PPU& m_ppu;
 
+    ChipEngine m_engine{ENGINE_SWITCH};
     ChipState m_chipstate{CHIP_READY};
     GKState m_key_state{GK_NOTHING};
 
-    Chip() : m_bus(Bus::get_instance()) { reset(); }
-
     void not_implemented() const;
 
+    void exit() { m_chipstate = CHIP_STOPPED; }
+
+    bool key_down(GPReg key) const { return key < 16 && (m_keys >> key) & 1; }
+
+    void run_ahead(uint16_t keys, MachineState& state);
+
+    template <bool debugged>
+    unsigned run_instructions();
+
+    void record_edge();
+
     void fetch();
     void decode();
+    void decode_table();
+    void execute_opcode() {
+        if (m_engine == ENGINE_TABLE)
+            decode_table();
+        else
+            decode();
+    }
+
+    template <Op op, void (Chip::*handler)()>
+    void dispatch();
     void update_timers();
 
     void push(Addr address);
@@ -188,6 +540,7 @@ private:
     inline void op_reg_store();
     inline void op_reg_dump_rpl();
     inline void op_reg_store_rpl();
+    inline void op_invalid();
 };
 
 #endif
@@ -0,0 +1,12 @@
+#ifndef CONFIG_H
+#define CONFIG_H
+
+#define PROJECT_NAME "SCHIP++"
+#define PROJECT_VER  "1.2.0"
+#define PROJECT_VER_MAJOR "1"
+#define PROJECT_VER_MINOR "2"
+#define PTOJECT_VER_PATCH "0"
+
+/* #undef __apple__ */
+
+#endif
@@ -0,0 +1,258 @@
+#pragma once
+
+#ifndef CONTROL_H
+#define CONTROL_H
+
+#include <cstdint>
+#include <cstddef>
+#include <atomic>
+#include <filesystem>
+#include <memory>
+#include <span>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+enum ControlCommand : uint8_t {
+    // Makes a new machine and answers with its number in the instance field
+    CONTROL_CREATE = 1,
+
+    CONTROL_DESTROY,
+
+    // Puts the machine back to how it was created and loads the ROM in the body
+    CONTROL_LOAD,
+
+    // Sets the keys that are held from now on, a 16-bit mask
+    CONTROL_SET_KEYS,
+
+    // Runs a 32-bit number of frames and answers with the 64-bit frame count,
+    // stopping early if the program exits
+    CONTROL_STEP,
+
+    // Answers with the RegisterState of the machine
+    CONTROL_REGISTERS,
+
+    // Reads a 16-bit length of memory from a 16-bit address
+    CONTROL_READ_MEMORY,
+
+    // Answers with the 64-bit hash_block() of the framebuffer and an 8-bit
+    // flag that is 1 in high resolution
+    CONTROL_FRAME_HASH
+};
+
+enum ControlStatus : uint8_t {
+    CONTROL_OK = 0,
+    CONTROL_UNKNOWN_COMMAND,
+    CONTROL_NO_INSTANCE,
+
+    // The body has the wrong size, or asks for memory that does not exist
+    CONTROL_BAD_REQUEST,
+
+    // The program faulted, and the body says why
+    CONTROL_FAULT,
+
+    // There are as many machines as there are instance numbers
+    CONTROL_FULL
+};
+
+/**
+ * The start of every request and response on a control socket, followed by
+ * size bytes of body.
+ *
+ * A response has the tag, instance and command of its request. Requests
+ * leave status at 0.
+ */
+struct ControlHeader {
+    uint32_t size;
+    uint32_t tag;
+    uint16_t instance;
+    uint8_t command;
+    uint8_t status;
+};
+
+static_assert(sizeof(ControlHeader) == 12 && std::has_unique_object_representations_v<ControlHeader>,
+              "ControlHeader is sent as is and must not contain padding");
+
+struct ControlResponse {
+    ControlHeader header{};
+    std::vector<uint8_t> body;
+};
+
+/**
+ * Serves machines to other processes on a Unix domain socket, for test
+ * harnesses that drive many headless emulators at once.
+ *
+ * The protocol is a stream of ControlHeader and body pairs in both
+ * directions, with every number in the byte order of a little endian host.
+ * Clients may send as many requests as they like without waiting, addressed
+ * to any machine, and get one response per request in the same order.
+ *
+ * One thread does all of the socket I/O. It takes every complete request
+ * that has arrived on a connection as one batch and hands it out to worker
+ * threads, each of which owns the machines whose number modulo the number of
+ * workers is its own. Requests for one machine therefore run in the order
+ * they were sent, and machines on different workers run in parallel. Once a
+ * batch is done its responses are sent back in a single write.
+ *
+ * A worker runs its requests one after another, whichever connection they
+ * came from, and a CONTROL_STEP runs all of its frames at once. A long step
+ * therefore holds up every machine on the same worker, on every connection,
+ * and every other response in its batch. Clients that care about latency
+ * step in small numbers of frames.
+ *
+ * A client that shuts down its side of the connection after sending its
+ * requests still gets every response, and the server closes the connection
+ * once the last one is sent.
+ *
+ * Only available on POSIX systems.
+ */
+class ControlServer {
+public:
+    static constexpr uint32_t max_body = 64 * 1024;
+
+    /**
+     * Creates the socket, replacing a file of the same name, and starts the
+     * workers.
+     *
+     * @param socket			 The path of the socket.
+     * @param threads			 How many workers run the machines.
+     * @throw std::runtime_error if the socket cannot be created.
+     */
+    ControlServer(std::filesystem::path socket, unsigned threads);
+
+    /**
+     * Stops the workers, closes every connection and removes the socket.
+     */
+    ~ControlServer();
+
+    ControlServer(const ControlServer&) = delete;
+    ControlServer& operator=(const ControlServer&) = delete;
+
+    /**
+     * Serves clients until stop() is called.
+     */
+    void run();
+
+    /**
+     * Makes run() return. This is thread safe and may be called from a
+     * signal handler.
+     */
+    void stop();
+
+    /**
+     * @return The number of requests that were answered.
+     */
+    uint64_t requests() const { return m_requests; }
+
+    /**
+     * @return The number of batches the requests came in.
+     */
+    uint64_t batches() const { return m_batches; }
+
+private:
+    struct Instance;
+    struct Reply;
+    struct Batch;
+    struct Job;
+    struct Worker;
+    struct Connection;
+
+    // Finds a free instance number, or returns 0 if there is none
+    uint16_t take_instance();
+
+    void accept_connections();
+    bool read_requests(Connection& connection);
+    void start_batch(Connection& connection);
+    void finish_batch(Connection& connection);
+    bool write_replies(Connection& connection);
+
+    void work(Worker& worker);
+    void execute(const Job& job);
+
+    std::filesystem::path m_path;
+    int m_listener{-1};
+
+    // Workers write to this pipe when they finish a batch, and stop() when
+    // it is time to return
+    int m_wake[2]{-1, -1};
+    std::atomic<bool> m_stopping{false};
+
+    std::vector<std::unique_ptr<Worker>> m_workers;
+    std::vector<std::unique_ptr<Connection>> m_connections;
+
+    // A slot per instance number. Whether a number is taken is only known to
+    // the I/O thread, and the machine in a slot only to the worker it belongs to.
+    std::vector<std::unique_ptr<Instance>> m_instances;
+    std::vector<bool> m_taken;
+    uint16_t m_next_instance{1};
+
+    uint64_t m_requests{0};
+    uint64_t m_batches{0};
+};
+
+/**
+ * A connection to a ControlServer.
+ *
+ * Requests are queued and sent together by flush(), so that a whole batch
+ * goes out in one write and the server sees it at once.
+ */
+class ControlClient {
+public:
+    /**
+     * @param socket			 The path the server was created with.
+     * @throw std::runtime_error if the server cannot be reached.
+     */
+    explicit ControlClient(const std::filesystem::path& socket);
+
+    ~ControlClient();
+
+    ControlClient(const ControlClient&) = delete;
+    ControlClient& operator=(const ControlClient&) = delete;
+
+    /**
+     * Queues a request.
+     *
+     * @param instance	The machine, or 0 for CONTROL_CREATE.
+     * @param command	What to do.
+     * @param body		The arguments of the command.
+     * @return			The tag of the request, which its response carries.
+     */
+    uint32_t queue(uint16_t instance, ControlCommand command, std::span<const uint8_t> body = {});
+
+    /**
+     * Sends every queued request.
+     *
+     * @throw std::runtime_error if the connection is lost.
+     */
+    void flush();
+
+    /**
+     * Sends every queued request and tells the server that no more follow.
+     * The server still answers every request that was sent, and closes the
+     * connection after the last response.
+     *
+     * @throw std::runtime_error if the connection is lost.
+     */
+    void finish();
+
+    /**
+     * Waits for the next response.
+     *
+     * @param response			 Receives the response.
+     * @throw std::runtime_error if the connection is lost.
+     */
+    void receive(ControlResponse& response);
+
+    /**
+     * Sends one request and waits for its response. Every request queued
+     * before must have been answered already.
+     */
+    ControlResponse call(uint16_t instance, ControlCommand command, std::span<const uint8_t> body = {});
+
+private:
+    int m_socket{-1};
+    uint32_t m_next_tag{1};
+    std::vector<uint8_t> m_out;
+};
+
+#endif
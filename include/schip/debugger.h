@@ -0,0 +1,225 @@
+#pragma once
+
+#ifndef DEBUGGER_H
+#define DEBUGGER_H
+
+#include <cstdint>
+#include <cstddef>
+#include <atomic>
+#include <bitset>
+#include <condition_variable>
+#include <deque>
+#include <iosfwd>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <schip/memory.h>
+#include <schip/state.h>
+
+class Chip;
+
+enum WatchAccess : uint8_t {
+    WATCH_READ = 1 << 0,
+    WATCH_WRITE = 1 << 1
+};
+
+/**
+ * A comparison of a register with a value, e.g. "v3 == 0x10".
+ */
+struct DebugCondition {
+    enum Register : uint8_t { REG_V0 = 0, REG_I = 16, REG_SP, REG_DT, REG_ST };
+    enum Compare : uint8_t { CMP_EQ, CMP_NE, CMP_LT, CMP_LE, CMP_GT, CMP_GE };
+
+    Register reg;
+    Compare compare;
+    uint16_t value;
+
+    bool holds(const RegisterState& regs) const;
+};
+
+struct Breakpoint {
+    unsigned id;
+
+    // Stop at this address, or before every instruction if there is none
+    std::optional<Addr> address;
+
+    // Only stop if this holds
+    std::optional<DebugCondition> condition;
+};
+
+struct Watchpoint {
+    unsigned id;
+    Addr first;
+    Addr last;
+    uint8_t access;
+};
+
+/**
+ * An interactive debugger for the machine a chip runs.
+ *
+ * The chip only calls into the debugger while one is attached, and then only
+ * through before_step(), which checks a bit for the address of the next
+ * instruction and a flag for everything else. Without a debugger the chip
+ * runs the same instruction loop as before, see Chip::set_debugger().
+ *
+ * Commands are lines of text, read from a stream by a console thread. They
+ * are executed in order on the thread that runs the chip while it is stopped,
+ * so they see and change the machine between two instructions and nothing
+ * needs to be locked. Commands that arrive while the chip runs wait for it to
+ * stop, except for pause, which stops it.
+ *
+ * Watchpoints stop before an instruction that is going to read or write a
+ * watched address, which is known from the opcode and the registers before it
+ * runs. Fetching instructions does not count as reading them.
+ */
+class Debugger {
+public:
+    /**
+     * @param chip	The chip to debug.
+     * @param bus	The memory of the chip.
+     * @param out	Where the output of commands goes.
+     */
+    Debugger(Chip& chip, const Bus& bus, std::ostream& out);
+
+    ~Debugger();
+
+    Debugger(const Debugger&) = delete;
+    Debugger& operator=(const Debugger&) = delete;
+
+    /**
+     * Starts a thread that reads commands from a stream. At the end of the
+     * stream every breakpoint and watchpoint is removed and the chip goes on.
+     *
+     * @param in	The stream, which must outlive the process if it may still
+     *				be blocked in a read when the debugger is destroyed, like
+     *				std::cin.
+     */
+    void start_console(std::istream& in);
+
+    /**
+     * Stops before the next instruction, as if a breakpoint were hit. This is
+     * thread safe.
+     */
+    void interrupt() { m_queue->interrupt.store(true); }
+
+    /**
+     * Queues a command, which runs the next time the chip is stopped. This is
+     * thread safe.
+     *
+     * @param command	A line of the console.
+     */
+    void post(std::string command);
+
+    /**
+     * Executes a command on the calling thread, which must be the one that
+     * runs the chip.
+     *
+     * @param command	A line of the console.
+     * @return			true if the chip should go on running.
+     */
+    bool execute(std::string_view command);
+
+    /**
+     * Lets a chip that is stopped go on and stops no more. This is thread
+     * safe, and is called before joining the thread that runs the chip.
+     */
+    void shutdown();
+
+    /**
+     * Called by the chip before every instruction.
+     *
+     * @param pc		The address of the instruction.
+     * @param fetching	false if the chip is waiting for a key and runs the
+     *					last instruction again without fetching it.
+     */
+    void before_step(Addr pc, bool fetching) {
+        if (m_check_all || (fetching && m_breakpoints.test(pc & 0xfff))
+            || m_queue->interrupt.load(std::memory_order_relaxed)) [[unlikely]]
+            check(pc, fetching);
+    }
+
+    /**
+     * Called by the chip when an instruction faults, before the error leaves
+     * the chip, so that the machine can be looked at where it failed.
+     *
+     * @param pc		The address of the instruction that faulted.
+     * @param error	What went wrong.
+     */
+    void fault(Addr pc, std::string_view error);
+
+    /**
+     * @return Every breakpoint, in the order they were set.
+     */
+    const std::vector<Breakpoint>& breakpoints() const { return m_breakpoint_list; }
+
+    /**
+     * @return Every watchpoint, in the order they were set.
+     */
+    const std::vector<Watchpoint>& watchpoints() const { return m_watchpoint_list; }
+
+    /**
+     * @return true if the chip is stopped in the debugger.
+     */
+    bool is_stopped() const { return m_stopped.load(); }
+
+    /**
+     * @return true if the quit command has stopped the chip.
+     */
+    bool has_quit() const { return m_quit; }
+
+private:
+    // The command queue is shared with the console thread, which may outlive
+    // the debugger while it is blocked reading
+    struct Queue {
+        std::mutex mutex;
+        std::condition_variable ready;
+        std::deque<std::string> commands;
+        std::atomic<bool> interrupt{false};
+        bool closed{false};
+    };
+
+    void check(Addr pc, bool fetching);
+
+    // Finds the memory the instruction at pc is about to access
+    bool touches_watch(Addr pc, const RegisterState& regs, std::string& what) const;
+
+    void stop(std::string_view reason, Addr pc);
+    void detach();
+    void update();
+
+    void print_registers();
+    void print_memory(Addr address, size_t length);
+    void print_disassembly(Addr address, size_t count);
+    void print_trace(size_t count);
+    void print_points();
+
+    Chip& m_chip;
+    const Bus& m_bus;
+    std::ostream& m_out;
+
+    std::shared_ptr<Queue> m_queue{std::make_shared<Queue>()};
+    std::atomic<bool> m_stopped{false};
+    std::atomic<bool> m_shutdown{false};
+
+    // Set if before_step() has to look at every instruction: while stepping,
+    // or with watchpoints or breakpoints without an address
+    bool m_check_all{false};
+
+    std::bitset<0x1000> m_breakpoints;
+    std::bitset<0x1000> m_watch_read;
+    std::bitset<0x1000> m_watch_write;
+    std::vector<Breakpoint> m_breakpoint_list;
+    std::vector<Watchpoint> m_watchpoint_list;
+    unsigned m_next_id{1};
+
+    // The number of instructions to run before stopping, while stepping
+    uint64_t m_steps{0};
+
+    bool m_quit{false};
+};
+
+#endif
@@ -13,56 +13,66 @@
 #include <GL/glut.h>
 #endif
 
-#include <cstdint>
-#include <array>
+#include <functional>
+#include <vector>
 
 #include <schip/keypad.h>
-#include <schip/memory.h>
-
-class PPU final {
-public:
-    static PPU& get_instance();
-
-    void enable_extended();
-
-    void disable_extended();
-
-    void clear_screen();
-
-    void scroll_down(unsigned lines);
-
-    void scroll_left();
-
-    void scroll_right();
-
-    void render();
-
-    bool draw_sprite_at(Addr loc, unsigned lines, unsigned x, unsigned y);
-
-    void make_test_pattern(); // Debugging
-
-    static constexpr int screen_width = 128;
-    static constexpr int screen_height = 64;
-    static constexpr int zoom = 5;
-
-private:
-    PPU() {}
-
-    void lock();
-
-    void release();
-
-    std::array<char, screen_width * screen_height> m_pixels{};
-    std::atomic<bool> m_busy{false};
-    bool m_is_extended{false};
-};
+#include <schip/ppu.h>
+#include <schip/recorder.h>
+#include <schip/scaler.h>
 
 namespace Display {
 
-void init();
-void run();
-
+constexpr int zoom = 5;
+
+// The widest the tiled window is made at first, in screen pixels
+constexpr int max_tiled_width = 1536;
+
+/**
+ * Where a tile of the tiled view gets its frames from. It is called once per
+ * repaint, fills in the newest frame and whether it is in high resolution,
+ * and returns false if it has no frame to show.
+ */
+using TileSource = std::function<bool(FramePixels& frame, bool& extended)>;
+
+/**
+ * Opens the window of the machine.
+ *
+ * Frames are scaled up on the CPU by a FrameScaler, to the largest whole
+ * multiple of the screen that fits into the window, and drawn as one textured
+ * quad. A frame is only scaled and uploaded again when it has changed.
+ *
+ * @param filter	How frames are scaled up.
+ */
+void init(ScaleFilter filter = SCALE_NEAREST);
+
+/**
+ * Opens one window that shows the screens of many machines as a grid.
+ *
+ * The screens are kept in one texture atlas. On every repaint each source is
+ * asked for its frame, only the tiles that changed are uploaded, and the
+ * whole grid is drawn as a single textured quad.
+ *
+ * @param sources				One source per tile.
+ * @throw std::runtime_error	if the atlas does not fit into a texture.
+ */
+void init_tiled(std::vector<TileSource> sources);
+
+/**
+ * Runs the window until it is closed, then calls on_close.
+ *
+ * With freeglut the main loop returns when the window is closed, and
+ * on_close runs right after it. Other GLUT implementations exit the process
+ * from the main loop instead, so there on_close runs from an exit handler.
+ *
+ * @param on_close	Stops whatever runs behind the window and cleans up.
+ */
+void run(std::function<void()> on_close);
+
+void render();
+void render_tiled();
 void reshape(int w, int h);
+void reshape_tiled(int w, int h);
 void repaint();
 void keydown(unsigned char key, int x, int y);
 void keyup(unsigned char key, int x, int y);
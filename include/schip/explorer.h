@@ -0,0 +1,140 @@
+#pragma once
+
+#ifndef EXPLORER_H
+#define EXPLORER_H
+
+#include <cstdint>
+#include <cstddef>
+#include <algorithm>
+#include <atomic>
+#include <filesystem>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include <schip/state.h>
+
+/**
+ * A fixed size set of 64-bit hashes that many threads can insert into at once.
+ *
+ * This is an open addressing table with linear probing. Slots are claimed with
+ * a compare-and-swap, so inserting never takes a lock.
+ */
+class VisitedSet {
+public:
+    /**
+     * @param capacity	The number of hashes the set must be able to hold.
+     */
+    explicit VisitedSet(size_t capacity);
+
+    /**
+     * Adds a hash to the set.
+     *
+     * @param hash	The hash to be added.
+     * @return		true if the hash was not in the set before, false if it was or
+     *				if the set is full.
+     */
+    bool insert(uint64_t hash);
+
+    /**
+     * @return true if an insertion has failed because the set was full.
+     */
+    bool full() const { return m_full.load(std::memory_order_relaxed); }
+
+private:
+    std::unique_ptr<std::atomic<uint64_t>[]> m_slots;
+    size_t m_mask;
+    std::atomic<bool> m_full{false};
+};
+
+struct ExploreOptions {
+    // The number of worker threads
+    unsigned threads{std::max(1u, std::thread::hardware_concurrency())};
+
+    // The number of steps to search
+    unsigned max_depth{60};
+
+    // The number of states to record before giving up
+    size_t max_states{1 << 20};
+
+    // The number of frames each input is held down for
+    unsigned hold_frames{1};
+};
+
+struct ExploreStats {
+    size_t states{0};
+    size_t screens{0};
+    unsigned depth{0};
+    size_t exits{0};
+    size_t faults{0};
+};
+
+/**
+ * Searches the states a program can reach under different keypad inputs.
+ *
+ * Starting from a root state, the explorer does a breadth first search where
+ * every state is expanded with 17 inputs: no key and each of the 16 keys on
+ * its own. Each input is applied by restoring the parent from a snapshot and
+ * running hold_frames frames. The resulting machines are hashed incrementally
+ * and only states that have not been seen before are expanded further.
+ *
+ * Every level of the search is spread over a pool of threads that share one
+ * VisitedSet.
+ */
+class Explorer {
+public:
+    /**
+     * @param root		The state to start the search from.
+     * @param options	How to search.
+     */
+    Explorer(const MachineState& root, const ExploreOptions& options);
+
+    /**
+     * Runs the search.
+     *
+     * @return Statistics about the states that were found.
+     */
+    ExploreStats run();
+
+    /**
+     * Writes every reachable state to an index file.
+     *
+     * The file starts with the magic "SCHIPIDX", a 32-bit version, a 32-bit entry
+     * count and the 64-bit hash of the root memory. Then follows one 24 byte
+     * entry per state in the order the states were found, all little endian:
+     * the state hash, the screen hash, the 32-bit index of the parent entry, the
+     * 16-bit depth and the 16-bit key mask that led from the parent to it. The
+     * root has itself as its parent.
+     *
+     * @param filename			 The file to be written.
+     * @throw std::runtime_error if the file cannot be written.
+     */
+    void write_index(std::filesystem::path filename) const;
+
+private:
+    struct Entry {
+        uint64_t hash;
+        uint64_t screen;
+        uint32_t parent;
+        uint16_t depth;
+        uint16_t keys;
+    };
+
+    struct Node {
+        uint32_t id;
+        std::vector<Byte> delta; // Against the root
+    };
+
+    void expand(const std::vector<Node>& frontier, std::vector<Node>& next, unsigned depth);
+
+    std::unique_ptr<MachineState> m_root;
+    ExploreOptions m_options;
+    VisitedSet m_visited;
+
+    std::vector<Entry> m_entries;
+    std::atomic<size_t> m_count{0};
+    std::atomic<size_t> m_exits{0};
+    std::atomic<size_t> m_faults{0};
+};
+
+#endif
@@ -0,0 +1,116 @@
+#pragma once
+
+#ifndef FUZZER_H
+#define FUZZER_H
+
+#include <cstdint>
+#include <cstddef>
+#include <algorithm>
+#include <atomic>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <schip/state.h>
+
+struct Machine;
+
+struct FuzzOptions {
+    // The number of worker threads
+    unsigned threads{std::max(1u, std::thread::hardware_concurrency())};
+
+    // The number of frames each input runs for
+    unsigned frames{600};
+
+    // When to stop. Zero means no limit.
+    uint64_t max_execs{0};
+    double max_seconds{60};
+
+    // Seeds both the machine and the mutators
+    uint32_t seed{0};
+};
+
+struct FuzzStats {
+    uint64_t execs{0};
+    uint64_t frames{0};
+    size_t corpus{0};
+    size_t crashes{0};
+    size_t edges{0};
+    double seconds{0};
+};
+
+/**
+ * A coverage guided fuzzer for keypad input.
+ *
+ * An input is a list of keypad changes, each tied to a frame. Every execution
+ * restores the machine from the boot snapshot, runs the input and records the
+ * edges between consecutive instruction addresses into a bitmap. Inputs that
+ * hit new edges, or new hit count buckets of known edges, are added to the
+ * corpus. Inputs that make the chip throw are saved as crashes, one per kind
+ * of error and address.
+ *
+ * Both kinds are written to the output directory as movie files, in queue/ and
+ * crashes/, so they can be reproduced with --replay. Every crash also gets a
+ * trace file with the instructions that led up to it.
+ */
+class Fuzzer {
+public:
+    /**
+     * @param boot		The state every execution starts from. Its random number
+     *					generator state must come from Chip::seed(options.seed).
+     * @param outdir	The directory to save inputs into.
+     * @param options	How to fuzz.
+     */
+    Fuzzer(const MachineState& boot, std::filesystem::path outdir, const FuzzOptions& options);
+
+    /**
+     * Fuzzes until one of the limits is reached.
+     *
+     * @return Statistics about the run.
+     */
+    FuzzStats run();
+
+private:
+    struct KeyEvent {
+        uint32_t frame;
+        uint16_t keys;
+    };
+
+    using Input = std::vector<KeyEvent>;
+
+    struct Result {
+        uint64_t frames{0};
+        uint64_t state_hash{0};
+        std::string error;
+        Addr pc{0};
+    };
+
+    void work(unsigned thread);
+
+    Result execute(Machine& machine, const Input& input, uint8_t* trace) const;
+
+    bool has_new_bits(const uint8_t* trace);
+
+    void save(const std::filesystem::path& filename, const Input& input, const Result& result) const;
+
+    std::unique_ptr<MachineState> m_boot;
+    std::filesystem::path m_outdir;
+    FuzzOptions m_options;
+
+    // One bit per hit count bucket per edge, cleared once seen
+    std::unique_ptr<std::atomic<uint8_t>[]> m_virgin;
+
+    std::mutex m_mutex;
+    std::vector<Input> m_corpus;
+    std::set<std::pair<std::string, Addr>> m_crashes;
+
+    std::atomic<bool> m_done{false};
+    std::atomic<uint64_t> m_execs{0};
+    std::atomic<uint64_t> m_frames{0};
+};
+
+#endif
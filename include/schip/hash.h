@@ -0,0 +1,72 @@
+#pragma once
+
+#ifndef HASH_H
+#define HASH_H
+
+#include <cstdint>
+#include <cstddef>
+#include <array>
+
+#include <schip/memory.h>
+#include <schip/ppu.h>
+
+struct Machine;
+
+/**
+ * Hashes a block of bytes, eight bytes at a time.
+ *
+ * This is much faster than hash_bytes() but has no streaming interface.
+ *
+ * @param data	The bytes to be hashed.
+ * @param size	The number of bytes.
+ * @return		A 64-bit hash of the bytes.
+ */
+uint64_t hash_block(const void* data, size_t size);
+
+/**
+ * Keeps a hash of a whole machine up to date as it runs.
+ *
+ * The registers, every memory page and every framebuffer row are hashed as
+ * separate blocks and the block hashes are combined with XOR. An update only
+ * rehashes the registers and the blocks that the Bus and the PPU have marked
+ * dirty since the previous update.
+ */
+class StateHasher {
+public:
+    /**
+     * Hashes every block of a machine from scratch.
+     *
+     * @param machine	The machine to be hashed. Its dirty marks are cleared.
+     */
+    void rehash(Machine& machine);
+
+    /**
+     * Rehashes the blocks that have changed since the last update.
+     *
+     * @param machine	The machine to be hashed. Its dirty marks are cleared.
+     */
+    void update(Machine& machine);
+
+    /**
+     * @return The hash of the whole machine.
+     */
+    uint64_t value() const { return m_regs ^ m_memory ^ m_screen; }
+
+    /**
+     * @return The hash of the framebuffer alone.
+     */
+    uint64_t screen() const { return m_screen; }
+
+private:
+    static constexpr size_t ROWS = PPU::screen_height;
+
+    void update_blocks(Machine& machine, uint64_t pages, uint64_t rows);
+
+    std::array<uint64_t, MEMORY_PAGES> m_pages{};
+    std::array<uint64_t, ROWS> m_rows{};
+    uint64_t m_regs{0};
+    uint64_t m_memory{0};
+    uint64_t m_screen{0};
+};
+
+#endif
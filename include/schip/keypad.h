@@ -21,38 +21,62 @@ public:
     void release_key(unsigned char key) { set_key(key, false); }
 
     bool is_pressed(uint8_t key) {
-        return m_key.load() == key;
+        return key < 16 && (m_keys.load() >> key) & 1;
     }
 
     uint8_t wait_keypress() {
         int k;
 
-        for (k = NO_KEY; k < 0; k = m_key.load())
+        for (k = NO_KEY; k < 0; k = get_key())
             std::this_thread::yield();
 
-        m_key.store(NO_KEY);
-
         return k;
     }
 
-    int get_key() { return m_key.load(); }
+    int get_key() { return first_key(m_keys.load()); }
+
+    /**
+     * @return A bitmask of the pressed keys, where bit n is set if key n is down.
+     */
+    uint16_t get_mask() { return m_keys.load(); }
+
+    /**
+     * Replaces the state of every key at once.
+     *
+     * @param mask	A bitmask of the pressed keys.
+     */
+    void set_mask(uint16_t mask) { m_keys.store(mask); }
+
+    /**
+     * @return The lowest key set in a mask, or NO_KEY if the mask is empty.
+     */
+    static int first_key(uint16_t mask) {
+        for (int k = 0; k < 16; k++) {
+            if ((mask >> k) & 1)
+                return k;
+        }
+        return NO_KEY;
+    }
 
     static constexpr int NO_KEY = -1;
 
 private:
     static constexpr std::string_view m_keymap{"x123qweasdzc4rfv"};
 
-    std::atomic<int> m_key{NO_KEY};
+    std::atomic<uint16_t> m_keys{0};
 
     KeyPad() {}
 
     void set_key(unsigned char key, bool pressed) {
-        int index = m_keymap.find_first_of(key);
-        int keyval = (pressed) ? index : NO_KEY;
+        auto index = m_keymap.find_first_of(key);
 
-        if (index != std::string_view::npos && m_key.load() != keyval) {
-            m_key.store(keyval);
-        }
+        if (index == std::string_view::npos)
+            return;
+
+        if (pressed)
+            m_keys.fetch_or(1 << index);
+        else
+            m_keys.fetch_and(~(1 << index));
     }
 };
 
@@ -0,0 +1,217 @@
+#pragma once
+
+#ifndef LIBRARY_H
+#define LIBRARY_H
+
+#include <cstdint>
+#include <cstddef>
+#include <filesystem>
+#include <span>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include <schip/memory.h>
+
+enum RomFlags : uint16_t {
+    // The program switched to high resolution while it was profiled
+    ROM_HIRES = 1 << 0,
+
+    // The program exited by itself while it was profiled
+    ROM_EXITS = 1 << 1,
+
+    // The program faulted while it was profiled
+    ROM_FAULTS = 1 << 2
+};
+
+/**
+ * What is known about one ROM in a library, as it is stored in the archive.
+ */
+struct RomEntry {
+    // hash_block() of the ROM, which the index is sorted by
+    uint64_t hash;
+
+    // hash_block() of the framebuffer after running golden_frames frames
+    uint64_t golden;
+
+    // Where the ROM and its NUL terminated name are, from the start of the archive
+    uint32_t offset;
+    uint32_t name;
+
+    uint16_t size;
+    uint16_t flags;
+
+    // The speed the ROM is meant to run at, and the quirks it needs (none are
+    // implemented yet, so this is always 0)
+    uint16_t instructions_per_frame;
+    uint16_t quirks;
+
+    uint32_t golden_frames;
+    uint32_t reserved;
+};
+
+static_assert(sizeof(RomEntry) == 40 && std::has_unique_object_representations_v<RomEntry>,
+              "RomEntry is stored as is and must not contain padding");
+
+/**
+ * One file name a ROM was found under, as it is stored in the archive. A ROM
+ * found in several files has a RomName for each of them.
+ */
+struct RomName {
+    // Where the NUL terminated name is, from the start of the archive
+    uint32_t name;
+
+    // The position of the ROM in the index
+    uint32_t rom;
+};
+
+static_assert(sizeof(RomName) == 8 && std::has_unique_object_representations_v<RomName>,
+              "RomName is stored as is and must not contain padding");
+
+/**
+ * Reads a whole file.
+ *
+ * @param path				 The file.
+ * @return					 Its bytes.
+ * @throw std::runtime_error if the file cannot be read.
+ */
+std::vector<Byte> read_rom_file(const std::filesystem::path& path);
+
+/**
+ * Collects the files among files and directories, searching the directories
+ * recursively.
+ *
+ * @param inputs	Files and directories.
+ * @return			Every file, sorted so that the same inputs give the same order.
+ */
+std::vector<std::filesystem::path> find_rom_files(const std::vector<std::filesystem::path>& inputs);
+
+/**
+ * What running a ROM without input shows about it.
+ */
+struct RomProfile {
+    uint16_t flags{0};
+    uint64_t golden{0};
+};
+
+/**
+ * Runs a ROM on a fresh machine with a fixed seed and no keys pressed.
+ *
+ * @param rom		The bytes of the ROM.
+ * @param frames	The number of frames to run, unless it stops earlier.
+ * @return			The flags and the hash of the last framebuffer.
+ * @throw std::invalid_argument if the ROM does not fit into memory.
+ */
+RomProfile profile_rom(std::span<const Byte> rom, uint32_t frames);
+
+struct LibraryBuildOptions {
+    // The number of threads to profile the ROMs with
+    unsigned threads{std::max(1u, std::thread::hardware_concurrency())};
+
+    // How many frames each ROM is run for to find its golden hash
+    uint32_t frames{300};
+};
+
+struct LibraryBuildStats {
+    size_t files{0};
+    size_t roms{0};
+    size_t duplicates{0};
+
+    // Files that are empty or too big to be a ROM
+    size_t skipped{0};
+};
+
+/**
+ * Packs ROMs into a library archive, once per distinct content, and profiles
+ * every one of them.
+ *
+ * @param inputs			 ROM files and directories, which are searched recursively.
+ * @param archive			 The archive to write.
+ * @param options			 How to build it.
+ * @return					 What was found.
+ * @throw std::runtime_error if a file cannot be read or the archive cannot be written.
+ */
+LibraryBuildStats build_library(const std::vector<std::filesystem::path>& inputs,
+                                const std::filesystem::path& archive, const LibraryBuildOptions& options);
+
+/**
+ * A library archive, mapped into memory.
+ *
+ * The archive starts with the magic "SCHIPLIB", a 32-bit version, the 32-bit
+ * number of ROMs, the 64-bit offset of the index, the 32-bit number of names,
+ * 32 reserved bits and the 64-bit offset of the name index. The index is an
+ * array of RomEntry sorted by hash and the name index an array of RomName
+ * sorted by name, followed by the names and the ROMs themselves, all in the
+ * byte order of a little endian host. Looking a ROM up is a binary search in
+ * the mapping, and loading it a copy out of it, so no file is opened per ROM.
+ */
+class RomLibrary {
+public:
+    /**
+     * Maps an archive.
+     *
+     * @param archive			 The archive written by build_library().
+     * @throw std::runtime_error if the archive cannot be mapped or is damaged.
+     */
+    explicit RomLibrary(const std::filesystem::path& archive);
+
+    ~RomLibrary();
+
+    RomLibrary(const RomLibrary&) = delete;
+    RomLibrary& operator=(const RomLibrary&) = delete;
+
+    /**
+     * @param hash	The hash of a ROM.
+     * @return		The ROM, or nullptr if it is not in the library.
+     */
+    const RomEntry* find(uint64_t hash) const;
+
+    /**
+     * Finds a ROM by the name of any file it was found in, or by its hash or
+     * a unique prefix of it in hexadecimal.
+     *
+     * @param key	The name or the hash.
+     * @return		The ROM, or nullptr if there is no single match.
+     */
+    const RomEntry* find(std::string_view key) const;
+
+    /**
+     * @return The bytes of a ROM, straight out of the mapping.
+     */
+    std::span<const Byte> rom(const RomEntry& entry) const;
+
+    /**
+     * @return The name of the file a ROM was first found in.
+     */
+    std::string_view name(const RomEntry& entry) const;
+
+    /**
+     * @return The file name an entry of the name index stands for.
+     */
+    std::string_view name(const RomName& name) const;
+
+    /**
+     * @return Every file name in the library, sorted by name.
+     */
+    std::span<const RomName> names() const { return m_names; }
+
+    /**
+     * @return Every ROM in the library, sorted by hash.
+     */
+    std::span<const RomEntry> entries() const { return m_entries; }
+
+private:
+    void release();
+
+    const uint8_t* m_data{nullptr};
+    size_t m_size{0};
+    bool m_mapped{false};
+    std::vector<uint8_t> m_copy;
+
+    std::span<const RomEntry> m_entries;
+    std::span<const RomName> m_names;
+};
+
+#endif
@@ -0,0 +1,91 @@
+#pragma once
+
+#ifndef LOCKSTEP_H
+#define LOCKSTEP_H
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <string>
+
+#include <schip/chip.h>
+#include <schip/state.h>
+
+struct Machine;
+
+struct LockstepOptions {
+    // The number of frames to run
+    uint64_t frames{600};
+
+    // Compare after every instruction rather than after every frame
+    bool every_instruction{true};
+};
+
+struct Divergence {
+    uint64_t frame{0};
+
+    // The number of instructions both engines had run when they diverged
+    uint64_t instructions{0};
+
+    // A readable description of what differs
+    std::string report;
+};
+
+/**
+ * Runs two execution engines side by side and checks that they agree.
+ *
+ * Both machines start from the same state and get the same keys. After every
+ * instruction, or after every frame, the registers are compared, and so are
+ * the memory pages and framebuffer rows that either machine has touched since
+ * the previous comparison. Faults must match too: both engines must throw the
+ * same error at the same instruction.
+ */
+class Lockstep {
+public:
+    /**
+     * @param boot			The state both machines start from.
+     * @param reference		The engine that is trusted.
+     * @param candidate		The engine under test.
+     * @param options		How to run.
+     */
+    Lockstep(const MachineState& boot, ChipEngine reference, ChipEngine candidate, const LockstepOptions& options);
+    ~Lockstep();
+
+    /**
+     * Runs both engines until they diverge, the program exits or faults, or
+     * the frames run out.
+     *
+     * @param keys	Gives the keys held down during a frame.
+     * @return		The first divergence, or nothing if the engines agreed.
+     */
+    std::optional<Divergence> run(const std::function<uint16_t(uint64_t)>& keys);
+
+    /**
+     * @return The number of frames both engines have run.
+     */
+    uint64_t frames() const { return m_frames; }
+
+    /**
+     * @return The number of instructions both engines have run.
+     */
+    uint64_t instructions() const { return m_instructions; }
+
+    /**
+     * @return The error both engines stopped with, or empty if they did not fault.
+     */
+    const std::string& error() const { return m_error; }
+
+private:
+    std::optional<std::string> compare();
+
+    std::unique_ptr<Machine> m_reference;
+    std::unique_ptr<Machine> m_candidate;
+    LockstepOptions m_options;
+
+    uint64_t m_frames{0};
+    uint64_t m_instructions{0};
+    std::string m_error;
+};
+
+#endif
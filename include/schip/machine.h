@@ -0,0 +1,22 @@
+#pragma once
+
+#ifndef MACHINE_H
+#define MACHINE_H
+
+#include <schip/memory.h>
+#include <schip/ppu.h>
+#include <schip/chip.h>
+
+/**
+ * A complete machine with its own memory, screen and chip.
+ *
+ * The singletons make up the machine shown in the window. Tools that run many
+ * machines side by side, or on several threads, create instances of this.
+ */
+struct Machine {
+    Bus bus;
+    PPU ppu{bus};
+    Chip chip{bus, ppu};
+};
+
+#endif
@@ -4,11 +4,29 @@
 #define MEMORY_H
 
 #include <cstdint>
+#include <array>
 #include <filesystem>
+#include <span>
+#include <stdexcept>
+#include <utility>
 
 using Addr = uint16_t;
 using Byte = uint8_t;
 
+constexpr Addr USERCODE_BEG = 0x200;
+constexpr Addr USERCODE_END = 0x1000;
+constexpr size_t USERCODE_SIZE = USERCODE_END - USERCODE_BEG;
+
+// The whole address space, including the fonts below the user memory
+constexpr size_t MEMORY_SIZE = USERCODE_END;
+
+// The granularity of the dirty page tracking
+constexpr size_t MEMORY_PAGE_SIZE = 64;
+constexpr size_t MEMORY_PAGES = USERCODE_SIZE / MEMORY_PAGE_SIZE;
+static_assert(MEMORY_PAGES <= 64, "The dirty pages must fit in a 64-bit mask");
+
+struct MachineState;
+
 /**
  * This class emulates memory for SChip/Chip8.
  * 
@@ -22,6 +40,10 @@ public:
         return instance;
     }
 
+    Bus();
+    Bus(const Bus&) = delete;
+    Bus& operator=(const Bus&) = delete;
+
 	/**
 	 * Reads one byte from memory.
 	 *
@@ -33,6 +55,24 @@ public:
 	 */
     [[nodiscard]] Byte read(Addr) const;
 
+	/**
+	 * Returns a range of memory to read from, checking the range once.
+	 *
+	 * The range may start in the fonts below the user memory, and is only
+	 * valid until the next write.
+	 *
+	 * @param address				The 16-bit address of the first byte.
+	 * @param length				The number of bytes.
+	 * @return						The bytes, in one contiguous block.
+	 * @throw std::out_of_range		if the range does not end within memory.
+	 */
+    [[nodiscard]] std::span<const Byte> read_span(Addr address, size_t length) const {
+        if (address + length > MEMORY_SIZE)
+            throw std::out_of_range("Bus read: Address is out of range");
+
+        return {m_memory.data() + address, length};
+    }
+
 	/**
 	 * Writes one byte to memory.
 	 *
@@ -44,6 +84,16 @@ public:
 	 */
     void write(Addr, Byte);
 
+	/**
+	 * Writes a range of bytes to memory, checking the range once. Nothing is
+	 * written if any of the bytes would fall outside the user memory.
+	 *
+	 * @param address			The 16-bit address of the first byte.
+	 * @param bytes				The bytes to be written.
+	 * @throw std::out_of_range	if the range is not within the user memory.
+	 */
+    void write_span(Addr address, std::span<const Byte> bytes);
+
 	/**
 	 * Loads a program into memory.
 	 *
@@ -56,11 +106,55 @@ public:
 	 */
     void load_program(std::filesystem::path filename);
 
+	/**
+	 * Loads a program that is already in memory.
+	 *
+	 * @param program			 The bytes of the program.
+	 * @throw std::invalid_argument if the program is bigger than the
+	 *							 allocated space in memory.
+	 * @throw std::runtime_error if the program is empty.
+	 */
+    void load_program(std::span<const Byte> program);
+
+	/**
+	 * Copies the user memory into a machine state.
+	 *
+	 * @param state	The state to be filled in.
+	 */
+    void save_state(MachineState& state) const;
+
+	/**
+	 * Restores the user memory from a machine state.
+	 *
+	 * @param state	The state to be restored.
+	 */
+    void load_state(const MachineState& state);
+
+    /**
+     * @return The user memory (0x200..0xfff).
+     */
+    std::span<const Byte, USERCODE_SIZE> data() const { return user(); }
+
+    /**
+     * Returns and clears the set of pages written to since the last call.
+     *
+     * @return	A bitmask where bit n is set if the n-th MEMORY_PAGE_SIZE page
+     *			of the user memory has been written to.
+     */
+    uint64_t take_dirty() { return std::exchange(m_dirty, 0); }
+
 private:
-    Bus();
-    ~Bus();
+    void mark_dirty(Addr addr) { m_dirty |= uint64_t{1} << ((addr - USERCODE_BEG) / MEMORY_PAGE_SIZE); }
+
+    std::span<Byte, USERCODE_SIZE> user() { return std::span(m_memory).subspan<USERCODE_BEG, USERCODE_SIZE>(); }
+    std::span<const Byte, USERCODE_SIZE> user() const {
+        return std::span(m_memory).subspan<USERCODE_BEG, USERCODE_SIZE>();
+    }
 
-    char* const m_data{nullptr};
+    // The fonts, what the interpreter would occupy and the user memory, so
+    // that any range of memory is one contiguous block
+    std::array<Byte, MEMORY_SIZE> m_memory{};
+    uint64_t m_dirty{~uint64_t{0}};
 };
 
 #endif
@@ -0,0 +1,111 @@
+#pragma once
+
+#ifndef MOVIE_H
+#define MOVIE_H
+
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <vector>
+
+/**
+ * The header of a movie file.
+ *
+ * A movie file starts with the magic "SCHIPMOV" followed by this header, all
+ * little endian. Then comes one record per keypad change: a varint holding
+ * (frames since the previous record << 1) followed by the 16-bit key mask.
+ * The last record has the low bit of its varint set and is followed by the
+ * 64-bit hash of the final machine state instead of a key mask.
+ */
+struct MovieHeader {
+    uint16_t version{1};
+    uint16_t instructions_per_frame{};
+    uint32_t seed{};
+    uint64_t rom_hash{};
+};
+
+/**
+ * Writes the keypad changes of a running machine to a movie file.
+ */
+class MovieWriter {
+public:
+    /**
+     * @param filename			 The movie file to be created.
+     * @param header			 The header to write.
+     * @throw std::runtime_error if the file cannot be created.
+     */
+    MovieWriter(std::filesystem::path filename, const MovieHeader& header);
+
+    /**
+     * Records the keypad state of a frame. Nothing is written unless the state
+     * has changed since the previous call.
+     *
+     * @param frame	The frame the keys apply to.
+     * @param keys	A bitmask of the pressed keys.
+     */
+    void record(uint64_t frame, uint16_t keys);
+
+    /**
+     * Ends the movie.
+     *
+     * @param frames	 The total number of frames that were run.
+     * @param state_hash The hash of the final machine state.
+     */
+    void finish(uint64_t frames, uint64_t state_hash);
+
+private:
+    void write_varint(uint64_t value);
+
+    std::ofstream m_file;
+    uint64_t m_frame{0};
+    uint16_t m_keys{0};
+    bool m_finished{false};
+};
+
+/**
+ * Reads a movie file and feeds the keypad states back frame by frame.
+ */
+class MovieReader {
+public:
+    /**
+     * @param filename			 The movie file to be read.
+     * @throw std::runtime_error if the file cannot be read or is not a movie.
+     */
+    explicit MovieReader(std::filesystem::path filename);
+
+    const MovieHeader& header() const { return m_header; }
+
+    /**
+     * @param frame	The frame to look up. Must not be lower than in the previous call.
+     * @return		A bitmask of the keys pressed during that frame.
+     */
+    uint16_t keys_at(uint64_t frame);
+
+    /**
+     * @return The number of frames in the movie.
+     */
+    uint64_t frames() const { return m_frames; }
+
+    /**
+     * @return false if the recording was cut short and has no final state.
+     */
+    bool finished() const { return m_finished; }
+
+    uint64_t state_hash() const { return m_state_hash; }
+
+private:
+    struct Event {
+        uint64_t frame;
+        uint16_t keys;
+    };
+
+    MovieHeader m_header;
+    std::vector<Event> m_events;
+    size_t m_next{0};
+    uint16_t m_keys{0};
+    uint64_t m_frames{0};
+    uint64_t m_state_hash{0};
+    bool m_finished{false};
+};
+
+#endif
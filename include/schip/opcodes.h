@@ -0,0 +1,89 @@
+#pragma once
+
+#ifndef OPCODES_H
+#define OPCODES_H
+
+#include <cstdint>
+#include <array>
+#include <string>
+#include <string_view>
+
+/**
+ * The instruction handlers of the chip, one per kind of opcode.
+ */
+enum Op : uint8_t {
+    OP_SCRD = 0,
+    OP_CLR,
+    OP_RET,
+    OP_SCRR,
+    OP_SCRL,
+    OP_EXIT,
+    OP_DEX,
+    OP_EEX,
+    OP_JMP,
+    OP_CALL,
+    OP_SEQ_IMM,
+    OP_SNE_IMM,
+    OP_SEQ,
+    OP_LD,
+    OP_ADD_IMM,
+    OP_MOV,
+    OP_OR,
+    OP_AND,
+    OP_XOR,
+    OP_ADD,
+    OP_SUB,
+    OP_SHR,
+    OP_SBR,
+    OP_SHL,
+    OP_SNE,
+    OP_LDI,
+    OP_JMPR,
+    OP_RAND,
+    OP_DRAW,
+    OP_SKP,
+    OP_SKNP,
+    OP_GET_DELAY,
+    OP_GET_KEY,
+    OP_SET_DELAY,
+    OP_SET_STIMER,
+    OP_ADDI,
+    OP_LD_SPRITE,
+    OP_LD_ESPRITE,
+    OP_SET_BCD,
+    OP_REG_DUMP,
+    OP_REG_STORE,
+    OP_REG_DUMP_RPL,
+    OP_REG_STORE_RPL,
+    OP_COUNT
+};
+
+// The names of the handlers, without the op_ prefix
+constexpr std::array<std::string_view, OP_COUNT> OP_NAMES = {
+    "scrd", "clr", "ret", "scrr", "scrl", "exit", "dex", "eex",
+    "jmp", "call", "seq_imm", "sne_imm", "seq", "ld", "add_imm",
+    "mov", "or", "and", "xor", "add", "sub", "shr", "sbr", "shl",
+    "sne", "ldi", "jmpr", "rand", "draw", "skp", "sknp",
+    "get_delay", "get_key", "set_delay", "set_stimer", "addi",
+    "ld_sprite", "ld_esprite", "set_bcd",
+    "reg_dump", "reg_store", "reg_dump_rpl", "reg_store_rpl",
+};
+
+/**
+ * Finds the handler that executes an opcode, the same way the chip decodes it.
+ *
+ * @param opcode	The opcode.
+ * @return			The handler, or OP_COUNT if the opcode is invalid.
+ */
+Op classify(uint16_t opcode);
+
+/**
+ * Turns an opcode into assembly, e.g. 0xd01f into "drw v0, v1, 15".
+ *
+ * @param opcode	The opcode.
+ * @return			The instruction, or "db" and the two bytes if the opcode
+ *					is invalid.
+ */
+std::string disassemble(uint16_t opcode);
+
+#endif
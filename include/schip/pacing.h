@@ -0,0 +1,110 @@
+#pragma once
+
+#ifndef PACING_H
+#define PACING_H
+
+#include <cstdint>
+#include <cstddef>
+#include <chrono>
+#include <optional>
+#include <ostream>
+#include <vector>
+
+/**
+ * A histogram of durations with a resolution of one microsecond, from which
+ * percentiles can be read.
+ */
+class LatencyHistogram {
+public:
+    // Durations from this on share the last bucket
+    static constexpr std::chrono::microseconds limit{50'000};
+
+    LatencyHistogram() : m_buckets(limit.count() + 1) {}
+
+    /**
+     * @param duration	The duration to add. Negative ones count as zero.
+     */
+    void record(std::chrono::nanoseconds duration);
+
+    /**
+     * @param p	The percentile, between 0 and 100.
+     * @return	The smallest duration that p percent of the durations are at
+     *			most, rounded up to the microsecond.
+     */
+    std::chrono::microseconds percentile(double p) const;
+
+    /**
+     * @param low	The start of the range.
+     * @param high	The end of the range, exclusive.
+     * @return		The number of durations in the range.
+     */
+    uint64_t count_between(std::chrono::microseconds low, std::chrono::microseconds high) const;
+
+    uint64_t count() const { return m_count; }
+    std::chrono::nanoseconds max() const { return m_max; }
+    std::chrono::nanoseconds mean() const;
+
+private:
+    std::vector<uint32_t> m_buckets;
+    uint64_t m_count{0};
+    std::chrono::nanoseconds m_sum{0};
+    std::chrono::nanoseconds m_max{0};
+};
+
+/**
+ * Measures how evenly the run loop hits its frame deadlines.
+ *
+ * Every frame the run loop reports when it woke up and when it meant to. The
+ * deviation of the time between two wake-ups from the ideal frame time and
+ * how late each wake-up was are collected into histograms.
+ */
+class FramePacing {
+public:
+    /**
+     * @param frame_time	The ideal time between two frames.
+     */
+    explicit FramePacing(std::chrono::nanoseconds frame_time) : m_frame_time(frame_time) {}
+
+    /**
+     * Records a wake-up of the run loop.
+     *
+     * @param woke		When the loop woke up.
+     * @param deadline	When it meant to wake up.
+     */
+    void record(std::chrono::steady_clock::time_point woke, std::chrono::steady_clock::time_point deadline);
+
+    /**
+     * Writes the percentiles and a coarse histogram of both measurements.
+     *
+     * @param out	The stream to write to.
+     */
+    void report(std::ostream& out) const;
+
+    const LatencyHistogram& deviation() const { return m_deviation; }
+    const LatencyHistogram& lateness() const { return m_lateness; }
+
+private:
+    std::chrono::nanoseconds m_frame_time;
+    std::optional<std::chrono::steady_clock::time_point> m_last;
+
+    LatencyHistogram m_deviation;
+    LatencyHistogram m_lateness;
+};
+
+/**
+ * Pins the calling thread to one CPU core.
+ *
+ * @param core	The index of the core.
+ * @return		false if the platform does not support it or it failed.
+ */
+bool pin_current_thread(unsigned core);
+
+/**
+ * Asks the scheduler to prefer the calling thread: first with the SCHED_FIFO
+ * real-time policy and, if that is not permitted, with a raised priority.
+ *
+ * @return	A description of what was granted, or nothing if neither was.
+ */
+std::optional<const char*> raise_current_thread_priority();
+
+#endif
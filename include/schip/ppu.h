@@ -0,0 +1,102 @@
+#pragma once
+
+#ifndef PPU_H
+#define PPU_H
+
+#include <cstdint>
+#include <array>
+#include <atomic>
+#include <utility>
+
+#include <schip/memory.h>
+
+struct MachineState;
+class FramePublisher;
+
+class PPU final {
+public:
+    static constexpr int screen_width = 128;
+    static constexpr int screen_height = 64;
+
+    static PPU& get_instance();
+
+    explicit PPU(Bus& bus) : m_bus(bus) {}
+    PPU(const PPU&) = delete;
+    PPU& operator=(const PPU&) = delete;
+
+    void enable_extended();
+
+    bool is_extended() const { return m_is_extended; }
+
+    void disable_extended();
+
+    void clear_screen();
+
+    void scroll_down(unsigned lines);
+
+    void scroll_left();
+
+    void scroll_right();
+
+    /**
+     * Publishes the current framebuffer as the frame that is shown.
+     */
+    void present();
+
+    /**
+     * Also publishes every presented frame into shared memory.
+     *
+     * @param publisher	The publisher, or nullptr to stop publishing.
+     */
+    void set_publisher(FramePublisher* publisher) { m_publisher = publisher; }
+
+    /**
+     * Copies the most recently presented frame. This is thread safe.
+     *
+     * @param pixels	Receives the frame, one byte per pixel.
+     * @return			true if the frame is in extended mode.
+     */
+    bool copy_presented(std::array<char, screen_width * screen_height>& pixels);
+
+    bool draw_sprite_at(Addr loc, unsigned lines, unsigned x, unsigned y);
+
+    void make_test_pattern(); // Debugging
+
+    void save_state(MachineState& state);
+
+    void load_state(const MachineState& state);
+
+    /**
+     * @return The framebuffer, one byte per pixel. Only safe to read from the
+     *		   thread that runs the chip.
+     */
+    const std::array<char, screen_width * screen_height>& pixels() const { return m_pixels; }
+
+    /**
+     * Returns and clears the set of rows changed since the last call.
+     *
+     * @return A bitmask where bit n is set if row n has changed.
+     */
+    uint64_t take_dirty_rows() { return std::exchange(m_dirty_rows, 0); }
+
+private:
+    void mark_dirty(unsigned first, unsigned count) {
+        m_dirty_rows |= (count >= 64 ? ~uint64_t{0} : ((uint64_t{1} << count) - 1)) << first;
+    }
+
+    void lock();
+
+    void release();
+
+    std::array<char, screen_width * screen_height> m_pixels{};
+    std::array<char, screen_width * screen_height> m_front{};
+    bool m_front_extended{false};
+    std::atomic<bool> m_busy{false};
+    bool m_is_extended{false};
+    uint64_t m_dirty_rows{~uint64_t{0}};
+    FramePublisher* m_publisher{nullptr};
+
+    Bus& m_bus;
+};
+
+#endif
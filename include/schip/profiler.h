@@ -0,0 +1,79 @@
+#pragma once
+
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <cstdint>
+#include <cstddef>
+#include <array>
+#include <filesystem>
+#include <map>
+#include <vector>
+
+#include <schip/memory.h>
+
+/**
+ * A sampling profiler for the guest program.
+ *
+ * Every interval instructions the address of the instruction about to run is
+ * counted, together with the call stack that led to it. The call stack is read
+ * from the return addresses that the chip pushes onto the guest stack, and
+ * every frame is named after the subroutine that was called.
+ */
+class Profiler {
+public:
+    /**
+     * @param interval	The number of instructions between two samples. A prime
+     *					keeps the samples from lining up with loops.
+     */
+    explicit Profiler(unsigned interval = 61);
+
+    /**
+     * Called by the chip before every instruction.
+     *
+     * @param pc	The address of the instruction.
+     * @param bus	The memory the stack is in.
+     * @param sp	The stack pointer.
+     */
+    void tick(Addr pc, const Bus& bus, Addr sp) {
+        if (--m_countdown == 0)
+            sample(pc, bus, sp);
+    }
+
+    /**
+     * @return The number of samples taken.
+     */
+    uint64_t samples() const { return m_samples; }
+
+    /**
+     * Writes the call stacks in the folded format that flame graph tools read,
+     * one "main;sub_2a4;sub_31c <samples>" line per distinct stack.
+     *
+     * @param filename			 The file to be written.
+     * @throw std::runtime_error if the file cannot be written.
+     */
+    void write_folded(const std::filesystem::path& filename) const;
+
+    /**
+     * Writes a readable report: the hottest loops, a heatmap of the address
+     * space and every sampled address with its instruction.
+     *
+     * @param filename			 The file to be written.
+     * @param bus				 The memory to disassemble the instructions from.
+     * @throw std::runtime_error if the file cannot be written.
+     */
+    void write_report(const std::filesystem::path& filename, const Bus& bus) const;
+
+private:
+    void sample(Addr pc, const Bus& bus, Addr sp);
+
+    unsigned m_interval;
+    unsigned m_countdown;
+    uint64_t m_samples{0};
+
+    std::array<uint64_t, 0x1000> m_hits{};
+    std::map<std::vector<Addr>, uint64_t> m_stacks;
+    std::vector<Addr> m_stack;
+};
+
+#endif
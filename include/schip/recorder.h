@@ -0,0 +1,183 @@
+#pragma once
+
+#ifndef RECORDER_H
+#define RECORDER_H
+
+#include <cstdint>
+#include <array>
+#include <atomic>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include <schip/ppu.h>
+#include <schip/scaler.h>
+#include <schip/spsc.h>
+
+using FramePixels = std::array<char, PPU::screen_width * PPU::screen_height>;
+
+struct RecordedFrame {
+    uint64_t frame{0};
+    bool extended{false};
+    FramePixels pixels{};
+};
+
+enum RecordingFormat {
+    // XOR against the previous frame, packed to bits and run-length encoded
+    RECORDING_DELTA = 0,
+
+    // Every frame at 128x64 as one byte per pixel, 0 or 255
+    RECORDING_RAW,
+
+    // Every frame scaled up by a FrameScaler, as four bytes of RGBA per pixel
+    RECORDING_RGBA
+};
+
+/**
+ * Scales a low resolution frame up to the size of a high resolution one.
+ *
+ * In low resolution the PPU only uses the top left 64x32 pixels of its
+ * framebuffer. This doubles them, so that every frame has the same size.
+ *
+ * @param frame		The frame, as the PPU keeps it.
+ * @param extended	true if the frame is in high resolution.
+ * @param out		Receives the 128x64 frame.
+ */
+void expand_frame(const FramePixels& frame, bool extended, FramePixels& out);
+
+/**
+ * Streams presented frames to a file from a thread of its own.
+ *
+ * The chip hands frames over through a wait-free ring. If the ring is full
+ * because the encoder has fallen behind, the frame is dropped and counted
+ * rather than making the chip wait.
+ *
+ * A delta recording starts with the magic "SCHIPREC", a 32-bit version, the
+ * 16-bit width and height and the 32-bit keyframe interval. Then follows one
+ * record per frame: the 64-bit frame number, an 8-bit flags field where bit 0
+ * means high resolution and bit 1 a keyframe, a 16-bit payload size and the
+ * payload, all little endian. The payload is the frame packed to one bit per
+ * pixel, most significant bit first, XORed with the previous frame, or with
+ * nothing for a keyframe, and compressed with PackBits. A frame that did not
+ * change has an empty payload.
+ *
+ * Raw and RGBA recordings have no header at all, so that they can be written
+ * into a pipe to an external encoder.
+ */
+class FrameRecorder {
+public:
+    static constexpr size_t queue_size = 64;
+    static constexpr uint32_t keyframe_interval = 600;
+
+    /**
+     * Opens the file and starts the encoder thread.
+     *
+     * @param filename			 The file or pipe to write to.
+     * @param format			 How to encode the frames.
+     * @param scale				 How to scale frames up for RECORDING_RGBA.
+     * @throw std::runtime_error if the file cannot be created.
+     * @throw std::invalid_argument if the scale options are not valid.
+     */
+    FrameRecorder(const std::filesystem::path& filename, RecordingFormat format, const ScaleOptions& scale = {});
+
+    /**
+     * Calls finish().
+     */
+    ~FrameRecorder();
+
+    FrameRecorder(const FrameRecorder&) = delete;
+    FrameRecorder& operator=(const FrameRecorder&) = delete;
+
+    /**
+     * Queues a frame for encoding. This never blocks. Only one thread may
+     * push frames.
+     *
+     * @param frame		The number of the frame.
+     * @param pixels	The framebuffer.
+     * @param extended	true if the frame is in high resolution.
+     * @return			false if the queue was full and the frame was dropped.
+     */
+    bool push(uint64_t frame, const FramePixels& pixels, bool extended);
+
+    /**
+     * Queues a frame for encoding, waiting for room if the queue is full. This
+     * is for running without a display, where no frame may be lost.
+     *
+     * @param frame		The number of the frame.
+     * @param pixels	The framebuffer.
+     * @param extended	true if the frame is in high resolution.
+     */
+    void push_wait(uint64_t frame, const FramePixels& pixels, bool extended);
+
+    /**
+     * Encodes the frames that are still queued, stops the encoder thread and
+     * flushes the file. No frames may be pushed after this.
+     */
+    void finish();
+
+    /**
+     * @return The number of frames that have been written.
+     */
+    uint64_t written() const { return m_written.load(std::memory_order_relaxed); }
+
+    /**
+     * @return The number of frames that were dropped because the queue was full.
+     */
+    uint64_t dropped() const { return m_dropped.load(std::memory_order_relaxed); }
+
+private:
+    void encode();
+
+    void write(const RecordedFrame& frame);
+
+    std::ofstream m_file;
+    RecordingFormat m_format;
+
+    std::unique_ptr<SpscRing<RecordedFrame, queue_size>> m_queue;
+    std::unique_ptr<RecordedFrame> m_current;
+
+    // The previous frame packed to bits, and the scratch space to encode into
+    std::vector<uint8_t> m_previous;
+    std::vector<uint8_t> m_packed;
+    std::vector<uint8_t> m_payload;
+    std::unique_ptr<FramePixels> m_expanded;
+    std::unique_ptr<FrameScaler> m_scaler;
+
+    std::atomic<bool> m_done{false};
+    std::atomic<uint64_t> m_written{0};
+    std::atomic<uint64_t> m_dropped{0};
+
+    std::thread m_thread;
+};
+
+/**
+ * Reads the frames of a delta recording back one at a time.
+ */
+class RecordingReader {
+public:
+    /**
+     * @param filename			 The recording to be read.
+     * @throw std::runtime_error if the file cannot be read or is not a delta
+     *							 recording.
+     */
+    explicit RecordingReader(const std::filesystem::path& filename);
+
+    /**
+     * Decodes the next frame.
+     *
+     * @param frame				 Receives the frame.
+     * @return					 false at the end of the recording.
+     * @throw std::runtime_error if the recording is damaged.
+     */
+    bool next(RecordedFrame& frame);
+
+private:
+    std::ifstream m_file;
+    std::vector<uint8_t> m_previous;
+    std::vector<uint8_t> m_delta;
+    std::vector<uint8_t> m_payload;
+};
+
+#endif
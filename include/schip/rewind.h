@@ -0,0 +1,78 @@
+#pragma once
+
+#ifndef REWIND_H
+#define REWIND_H
+
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <vector>
+
+#include <schip/state.h>
+
+/**
+ * A ring of per-frame machine states that can be stepped back through.
+ *
+ * Every frame is stored as an XOR delta against the frame before it. Every
+ * keyframe_interval frames a full copy is stored as well, so that a frame far
+ * away from the newest one can be rebuilt without walking the whole ring.
+ * When the ring is full the oldest frame is dropped.
+ */
+class Rewind {
+public:
+    /**
+     * @param capacity			 The number of frames to keep.
+     * @param keyframe_interval	 The number of frames between two full copies.
+     */
+    explicit Rewind(size_t capacity, size_t keyframe_interval = 600);
+
+    /**
+     * Records the state of the newest frame.
+     *
+     * @param state	The state to be recorded.
+     */
+    void record(const MachineState& state);
+
+    /**
+     * Steps back in time.
+     *
+     * The frames newer than the restored one are dropped from the ring.
+     *
+     * @param frames	The number of frames to go back. If this is larger than the
+     *					number of recorded frames, the oldest one is restored.
+     * @param state		Receives the restored state.
+     * @return			false if nothing has been recorded.
+     */
+    bool step_back(size_t frames, MachineState& state);
+
+    /**
+     * Drops every recorded frame.
+     */
+    void clear();
+
+    size_t size() const { return m_entries.size(); }
+
+    /**
+     * @return The number of bytes used by the recorded frames.
+     */
+    size_t memory_usage() const { return m_bytes; }
+
+private:
+    struct Entry {
+        std::vector<Byte> delta; // Against the previous entry
+        std::unique_ptr<MachineState> key; // Only set for keyframes
+    };
+
+    size_t entry_size(const Entry& entry) const;
+
+    std::deque<Entry> m_entries;
+    std::vector<Byte> m_scratch;
+    MachineState m_head{};
+
+    size_t m_capacity;
+    size_t m_keyframe_interval;
+    size_t m_since_key{0};
+    size_t m_bytes{0};
+};
+
+#endif
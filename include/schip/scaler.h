@@ -0,0 +1,113 @@
+#pragma once
+
+#ifndef SCALER_H
+#define SCALER_H
+
+#include <cstdint>
+#include <cstddef>
+#include <array>
+#include <span>
+#include <vector>
+
+#include <schip/ppu.h>
+
+enum ScaleFilter {
+    // Every screen pixel becomes a square of scale x scale image pixels
+    SCALE_NEAREST = 0,
+
+    // Scale2x (also known as EPX) first, which rounds off the steps of
+    // diagonal lines, then nearest for the rest of the scale
+    SCALE_2X
+};
+
+enum ScaleKernel {
+    // The widest kernel the CPU supports
+    SCALE_KERNEL_AUTO = 0,
+    SCALE_KERNEL_SCALAR,
+    SCALE_KERNEL_SSE2,
+    SCALE_KERNEL_AVX2
+};
+
+struct ScaleOptions {
+    ScaleFilter filter{SCALE_NEAREST};
+
+    // How many image pixels wide a pixel of a high resolution frame is
+    unsigned scale{1};
+
+    // Colours as RGBA bytes in memory, which is 0xAABBGGRR on a little endian host
+    uint32_t foreground{0xffffffff};
+    uint32_t background{0xff000000};
+
+    ScaleKernel kernel{SCALE_KERNEL_AUTO};
+};
+
+/**
+ * Expands frames into scaled up RGBA images on the CPU, for the texture of
+ * the window and for raw video.
+ *
+ * A frame is first brought to 128x64 like expand_frame() does, so that both
+ * resolutions come out at the same size. Scale2x then doubles it, and every
+ * pixel is finally coloured and repeated in both directions. Each row of the
+ * image is built once and copied for the rows below it, so most of the time
+ * goes into writing the image out.
+ *
+ * There are SSE2 and AVX2 kernels next to the plain C++ one on x86, which are
+ * chosen at run time and produce the same images.
+ */
+class FrameScaler {
+public:
+    static constexpr unsigned max_scale = 32;
+
+    /**
+     * @param options				 How to scale frames.
+     * @throw std::invalid_argument if the scale is 0 or above max_scale, or
+     *								 odd with SCALE_2X, or the kernel is not
+     *								 supported by this CPU.
+     */
+    explicit FrameScaler(const ScaleOptions& options);
+
+    /**
+     * Scales a frame up.
+     *
+     * @param frame		The frame, as the PPU keeps it.
+     * @param extended	true if the frame is in high resolution.
+     * @return			width() x height() pixels, row after row, which stay
+     *					valid until the next call.
+     */
+    std::span<const uint32_t> scale(const std::array<char, PPU::screen_width * PPU::screen_height>& frame,
+                                    bool extended);
+
+    unsigned width() const { return PPU::screen_width * m_options.scale; }
+    unsigned height() const { return PPU::screen_height * m_options.scale; }
+
+    /**
+     * @return The kernel that is used, never SCALE_KERNEL_AUTO.
+     */
+    ScaleKernel kernel() const { return m_options.kernel; }
+
+    /**
+     * @return The widest kernel this CPU supports.
+     */
+    static ScaleKernel best_kernel();
+
+    /**
+     * @return true if this CPU can run a kernel.
+     */
+    static bool supports(ScaleKernel kernel);
+
+    static const char* kernel_name(ScaleKernel kernel);
+
+private:
+    ScaleOptions m_options;
+
+    // The frame at 128x64 with a border of copied edge pixels, one byte per
+    // pixel that is 0 or 0xff
+    std::vector<uint8_t> m_source;
+
+    // The frame after Scale2x
+    std::vector<uint8_t> m_smoothed;
+
+    std::vector<uint32_t> m_image;
+};
+
+#endif
@@ -0,0 +1,176 @@
+#ifndef SCHIP_C_H
+#define SCHIP_C_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * The C interface of libschip, for driving machines from other languages.
+ *
+ * Every function takes the machine it works on, and machines share nothing,
+ * so each thread can run its own machines without locking. Functions that can
+ * fail return a status; the reason for the last failure is kept in the
+ * machine and can be read with schip_error().
+ */
+
+#if defined(_WIN32)
+#define SCHIP_API __declspec(dllexport)
+#elif defined(__GNUC__)
+#define SCHIP_API __attribute__((visibility("default")))
+#else
+#define SCHIP_API
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Bumped whenever a function or a type in this header changes incompatibly */
+#define SCHIP_ABI_VERSION 1
+
+#define SCHIP_SCREEN_WIDTH 128
+#define SCHIP_SCREEN_HEIGHT 64
+
+typedef struct schip_machine schip_machine;
+
+typedef enum schip_status {
+    SCHIP_OK = 0,
+
+    /* The program has exited by itself and runs no more frames */
+    SCHIP_EXITED = 1,
+
+    /* The program executed an invalid instruction or overflowed the stack */
+    SCHIP_FAULT = -1,
+
+    /* An argument was out of range, such as a ROM that is too big */
+    SCHIP_INVALID = -2
+} schip_status;
+
+typedef enum schip_engine {
+    SCHIP_ENGINE_SWITCH = 0,
+    SCHIP_ENGINE_TABLE = 1
+} schip_engine;
+
+/**
+ * @return SCHIP_ABI_VERSION of the library, to be compared with the header
+ *		   the caller was built against.
+ */
+SCHIP_API int schip_abi_version(void);
+
+/**
+ * Creates a machine with an empty memory and a blank screen.
+ *
+ * @param seed	Seeds the random number generator, so that runs are
+ *				reproducible.
+ * @return		The machine, or NULL if there is not enough memory.
+ */
+SCHIP_API schip_machine* schip_create(uint32_t seed);
+
+/**
+ * Destroys a machine. Pointers returned by schip_framebuffer() become invalid.
+ *
+ * @param machine	The machine, or NULL.
+ */
+SCHIP_API void schip_destroy(schip_machine* machine);
+
+/**
+ * Resets the machine and loads a program at 0x200. The random number
+ * generator is seeded again with the seed the machine was created with.
+ *
+ * @param machine	The machine.
+ * @param rom		The bytes of the program, which are copied.
+ * @param size		The size of the program.
+ * @return			SCHIP_OK, or SCHIP_INVALID if the program is empty or
+ *					does not fit into memory.
+ */
+SCHIP_API schip_status schip_load_rom(schip_machine* machine, const uint8_t* rom, size_t size);
+
+/**
+ * Sets the keys held down from the next frame on.
+ *
+ * @param machine	The machine.
+ * @param keys		A bitmask where bit n is set if key n is held down.
+ */
+SCHIP_API void schip_set_keys(schip_machine* machine, uint16_t keys);
+
+/**
+ * Chooses how opcodes are dispatched. Both engines behave the same.
+ *
+ * @param machine	The machine.
+ * @param engine	The engine.
+ * @return			SCHIP_OK, or SCHIP_INVALID if there is no such engine.
+ */
+SCHIP_API schip_status schip_set_engine(schip_machine* machine, schip_engine engine);
+
+/**
+ * Runs frames with the keys that are held down.
+ *
+ * Frames in between calls are never copied or presented anywhere, so
+ * skipping frames is a matter of running more than one per call and looking
+ * at the framebuffer afterwards.
+ *
+ * @param machine	The machine.
+ * @param frames	The number of frames to run.
+ * @return			SCHIP_OK, SCHIP_EXITED if the program exited, or
+ *					SCHIP_FAULT if it faulted, which stops it early.
+ */
+SCHIP_API schip_status schip_step(schip_machine* machine, uint32_t frames);
+
+/**
+ * @return The number of frames run since the last schip_load_rom().
+ */
+SCHIP_API uint64_t schip_frame(const schip_machine* machine);
+
+/**
+ * Returns the framebuffer without copying it. It is updated in place by
+ * schip_step() and stays valid until the machine is destroyed.
+ *
+ * @param machine	The machine.
+ * @return			SCHIP_SCREEN_WIDTH * SCHIP_SCREEN_HEIGHT bytes, one per
+ *					pixel, each 0 or 1, row by row. In low resolution only the
+ *					top left 64x32 pixels are used.
+ */
+SCHIP_API const uint8_t* schip_framebuffer(const schip_machine* machine);
+
+/**
+ * @return 1 if the screen is in high resolution, 0 otherwise.
+ */
+SCHIP_API int schip_is_extended(const schip_machine* machine);
+
+/**
+ * @return The number of bytes a saved state takes.
+ */
+SCHIP_API size_t schip_state_size(void);
+
+/**
+ * Copies the registers, the memory and the framebuffer into a buffer.
+ *
+ * @param machine	The machine.
+ * @param buffer	Receives the state.
+ * @param size		The size of the buffer.
+ * @return			SCHIP_OK, or SCHIP_INVALID if the buffer is smaller than
+ *					schip_state_size().
+ */
+SCHIP_API schip_status schip_save_state(const schip_machine* machine, void* buffer, size_t size);
+
+/**
+ * Restores a state saved with schip_save_state(), possibly by another machine.
+ *
+ * @param machine	The machine.
+ * @param buffer	The state.
+ * @param size		The size of the state.
+ * @return			SCHIP_OK, or SCHIP_INVALID if the size is not
+ *					schip_state_size().
+ */
+SCHIP_API schip_status schip_load_state(schip_machine* machine, const void* buffer, size_t size);
+
+/**
+ * @return Why the last call that failed did so, or an empty string.
+ */
+SCHIP_API const char* schip_error(const schip_machine* machine);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
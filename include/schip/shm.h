@@ -0,0 +1,163 @@
+#pragma once
+
+#ifndef SHM_H
+#define SHM_H
+
+#include <cstdint>
+#include <cstddef>
+#include <array>
+#include <atomic>
+#include <string>
+
+#include <schip/ppu.h>
+
+static_assert(std::atomic<uint32_t>::is_always_lock_free && std::atomic<uint64_t>::is_always_lock_free,
+              "Shared memory needs lock-free atomics");
+
+/**
+ * One frame in shared memory, guarded by a sequence lock.
+ *
+ * The sequence is odd while the publisher writes the slot. A reader takes the
+ * sequence before it looks at the slot and checks it again afterwards; if it
+ * changed, the slot was reused in the meantime and what was read is not valid.
+ */
+struct SharedFrameSlot {
+    std::atomic<uint32_t> sequence;
+    uint32_t extended;
+
+    // The number of the frame, counting every published frame from 1
+    uint64_t frame;
+
+    // Bit n is set if row n differs from the previously published frame
+    uint64_t dirty_rows;
+
+    // One byte per pixel, 0 or 1. In low resolution only the top left 64x32 are used.
+    std::array<char, PPU::screen_width * PPU::screen_height> pixels;
+};
+
+/**
+ * The start of the shared memory object, followed by the slots.
+ *
+ * latest is the number of the newest complete frame, which is in slot
+ * (latest - 1) % slots, or 0 if nothing has been published yet.
+ */
+struct SharedFrameHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t slots;
+    uint16_t width;
+    uint16_t height;
+    uint32_t slot_size;
+    alignas(64) std::atomic<uint64_t> latest;
+};
+
+/**
+ * Publishes presented frames into a POSIX shared memory object, for other
+ * processes on the same machine to read.
+ *
+ * Frames go into a ring of slots that readers map and read in place. The
+ * publisher never waits for readers, so a reader that holds on to a slot for
+ * longer than it takes to publish slots - 1 more frames finds that its
+ * sequence has changed and has to start over.
+ *
+ * Only available on POSIX systems.
+ */
+class FramePublisher {
+public:
+    static constexpr uint32_t default_slots = 8;
+
+    /**
+     * Creates the shared memory object, replacing one of the same name.
+     *
+     * @param name				 The name of the object, such as /schip.
+     * @param slots				 The number of frames in the ring.
+     * @throw std::runtime_error if the object cannot be created or mapped.
+     */
+    explicit FramePublisher(std::string name, uint32_t slots = default_slots);
+
+    /**
+     * Unmaps and removes the shared memory object. Readers that still have it
+     * mapped keep their mapping.
+     */
+    ~FramePublisher();
+
+    FramePublisher(const FramePublisher&) = delete;
+    FramePublisher& operator=(const FramePublisher&) = delete;
+
+    /**
+     * Writes a frame into the next slot. Only one thread may publish.
+     *
+     * @param pixels	The framebuffer.
+     * @param extended	true if the frame is in high resolution.
+     */
+    void publish(const std::array<char, PPU::screen_width * PPU::screen_height>& pixels, bool extended);
+
+    /**
+     * @return The number of frames published so far.
+     */
+    uint64_t published() const { return m_published; }
+
+private:
+    SharedFrameSlot& slot(uint64_t n) const;
+
+    std::string m_name;
+    void* m_mapping{nullptr};
+    size_t m_size{0};
+    SharedFrameHeader* m_header{nullptr};
+    uint64_t m_published{0};
+};
+
+/**
+ * A frame being read in place from shared memory.
+ */
+struct SharedFrameView {
+    const SharedFrameSlot* slot{nullptr};
+    uint32_t sequence{0};
+};
+
+/**
+ * Maps the shared memory object of a FramePublisher in another process.
+ */
+class FrameSubscriber {
+public:
+    /**
+     * @param name				 The name the publisher was created with.
+     * @throw std::runtime_error if there is no such object or it is not one
+     *							 written by FramePublisher.
+     */
+    explicit FrameSubscriber(const std::string& name);
+
+    ~FrameSubscriber();
+
+    FrameSubscriber(const FrameSubscriber&) = delete;
+    FrameSubscriber& operator=(const FrameSubscriber&) = delete;
+
+    /**
+     * @return The number of the newest complete frame, or 0 if there is none.
+     */
+    uint64_t latest() const;
+
+    /**
+     * Starts reading the newest frame in place.
+     *
+     * @param view	Receives the slot and its sequence.
+     * @return		false if there is no frame yet or the slot is being written.
+     */
+    bool acquire(SharedFrameView& view) const;
+
+    /**
+     * Checks that a frame was not overwritten while it was being read. Call
+     * this after reading and throw away what was read if it fails.
+     *
+     * @param view	The view from acquire().
+     * @return		true if what was read is a consistent frame.
+     */
+    bool validate(const SharedFrameView& view) const;
+
+private:
+    const void* m_mapping{nullptr};
+    size_t m_size{0};
+    const SharedFrameHeader* m_header{nullptr};
+};
+
+#endif
@@ -0,0 +1,133 @@
+#pragma once
+
+#ifndef SPSC_H
+#define SPSC_H
+
+#include <cstddef>
+#include <array>
+#include <atomic>
+#include <bit>
+
+/**
+ * A fixed size, wait-free queue between exactly one producer thread and one
+ * consumer thread.
+ *
+ * Each side only ever writes its own index, and reads the other one with
+ * acquire ordering, so neither push nor pop takes a lock or makes a system
+ * call. The indices are kept on separate cache lines so that the two threads
+ * do not slow each other down.
+ */
+template <typename T, size_t Capacity>
+class SpscRing {
+    static_assert(std::has_single_bit(Capacity), "The capacity must be a power of two");
+
+public:
+    static constexpr size_t capacity = Capacity;
+
+    /**
+     * Adds an element. Only the producer thread may call this.
+     *
+     * @param value	The element to be copied into the ring.
+     * @return		false if the ring is full, in which case nothing is added.
+     */
+    bool try_push(const T& value) {
+        size_t head = m_head.load(std::memory_order_relaxed);
+        if (head - m_tail.load(std::memory_order_acquire) == Capacity)
+            return false;
+
+        m_slots[head & (Capacity - 1)] = value;
+        m_head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * Fills the next free slot in place, which saves a copy for big elements.
+     * Only the producer thread may call this.
+     *
+     * @param fill	Called with the slot to fill, unless the ring is full.
+     * @return		false if the ring is full.
+     */
+    template <typename F>
+    bool try_push_with(F&& fill) {
+        size_t head = m_head.load(std::memory_order_relaxed);
+        if (head - m_tail.load(std::memory_order_acquire) == Capacity)
+            return false;
+
+        fill(m_slots[head & (Capacity - 1)]);
+        m_head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * Removes the oldest element. Only the consumer thread may call this.
+     *
+     * @param value	Receives the element.
+     * @return		false if the ring is empty.
+     */
+    bool try_pop(T& value) {
+        size_t tail = m_tail.load(std::memory_order_relaxed);
+        if (tail == m_head.load(std::memory_order_acquire))
+            return false;
+
+        value = m_slots[tail & (Capacity - 1)];
+        m_tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * Adds as many elements as there is room for. Only the producer thread may
+     * call this.
+     *
+     * @param values	The elements to be copied into the ring.
+     * @param count		The number of elements.
+     * @return			The number of elements that were added.
+     */
+    size_t push(const T* values, size_t count) {
+        size_t head = m_head.load(std::memory_order_relaxed);
+        size_t room = Capacity - (head - m_tail.load(std::memory_order_acquire));
+        if (count > room)
+            count = room;
+
+        for (size_t n = 0; n < count; n++)
+            m_slots[(head + n) & (Capacity - 1)] = values[n];
+
+        m_head.store(head + count, std::memory_order_release);
+        return count;
+    }
+
+    /**
+     * Removes up to count of the oldest elements. Only the consumer thread may
+     * call this.
+     *
+     * @param values	Receives the elements.
+     * @param count		The most elements to remove.
+     * @return			The number of elements that were removed.
+     */
+    size_t pop(T* values, size_t count) {
+        size_t tail = m_tail.load(std::memory_order_relaxed);
+        size_t available = m_head.load(std::memory_order_acquire) - tail;
+        if (count > available)
+            count = available;
+
+        for (size_t n = 0; n < count; n++)
+            values[n] = m_slots[(tail + n) & (Capacity - 1)];
+
+        m_tail.store(tail + count, std::memory_order_release);
+        return count;
+    }
+
+    /**
+     * @return The number of elements in the ring. Only exact when called from
+     *		   one of the two threads while the other is idle.
+     */
+    size_t size() const {
+        return m_head.load(std::memory_order_acquire) - m_tail.load(std::memory_order_acquire);
+    }
+
+private:
+    alignas(64) std::atomic<size_t> m_head{0};
+    alignas(64) std::atomic<size_t> m_tail{0};
+    alignas(64) std::array<T, Capacity> m_slots{};
+};
+
+#endif
@@ -0,0 +1,99 @@
+#pragma once
+
+#ifndef STATE_H
+#define STATE_H
+
+#include <cstdint>
+#include <cstddef>
+#include <array>
+#include <vector>
+#include <type_traits>
+
+#include <schip/memory.h>
+
+/**
+ * The registers of the chip and the mode of the PPU.
+ */
+struct RegisterState {
+    // State of the random number generator
+    uint32_t rng;
+
+    // Chip registers
+    std::array<uint8_t, 16> v;
+    uint16_t i;
+    uint16_t sp;
+    uint16_t pc;
+    uint16_t opcode;
+    uint8_t dtimer;
+    uint8_t stimer;
+    uint8_t chipstate;
+    uint8_t key_state;
+    std::array<uint8_t, 8> rpl;
+
+    // PPU mode
+    uint8_t extended;
+    std::array<uint8_t, 3> reserved;
+};
+
+/**
+ * A flat copy of everything that makes up a running machine.
+ *
+ * The fields are laid out so that the structure has no padding. Two states
+ * can therefore be compared, hashed and diffed as raw bytes.
+ */
+struct MachineState {
+    RegisterState regs;
+
+    // User memory (0x200..0xfff)
+    std::array<Byte, USERCODE_SIZE> memory;
+
+    // Framebuffer, one byte per pixel
+    std::array<char, 128 * 64> pixels;
+};
+
+static_assert(std::has_unique_object_representations_v<MachineState>,
+              "MachineState must not contain padding");
+
+/**
+ * Hashes a sequence of bytes with 64-bit FNV-1a.
+ *
+ * @param data	The bytes to be hashed.
+ * @param size	The number of bytes.
+ * @param hash	The hash to continue from.
+ * @return		The new hash.
+ */
+uint64_t hash_bytes(const void* data, size_t size, uint64_t hash = 0xcbf29ce484222325);
+
+/**
+ * Hashes a whole machine state.
+ *
+ * @param state	The state to be hashed.
+ * @return		A 64-bit hash of the state.
+ */
+inline uint64_t hash_state(const MachineState& state) { return hash_bytes(&state, sizeof(state)); }
+
+/**
+ * Encodes the difference between two states.
+ *
+ * The registers, every 64-byte memory page and every framebuffer row are
+ * compared as blocks. Blocks that changed are XORed and the non-zero runs are
+ * written as [offset:16][length:8][bytes...] records.
+ *
+ * @param from	The older state.
+ * @param to	The newer state.
+ * @param out	Receives the encoded delta. It is cleared first.
+ */
+void encode_delta(const MachineState& from, const MachineState& to, std::vector<Byte>& out);
+
+/**
+ * Applies a delta made by encode_delta().
+ *
+ * Since the delta is an XOR, applying it to either of the two states yields the
+ * other one.
+ *
+ * @param state	The state to be modified.
+ * @param delta	The encoded delta.
+ */
+void apply_delta(MachineState& state, const std::vector<Byte>& delta);
+
+#endif
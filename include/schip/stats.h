@@ -0,0 +1,82 @@
+#pragma once
+
+#ifndef STATS_H
+#define STATS_H
+
+#include <cstdint>
+#include <cstddef>
+#include <array>
+#include <chrono>
+#include <ostream>
+
+#include <schip/opcodes.h>
+
+/**
+ * Execution counts per instruction handler and the host time that the
+ * expensive handlers take.
+ *
+ * The chip only fills these in when it is built with SCHIP_STATS. Every
+ * handler is counted, and every sample_interval-th run of an expensive one is
+ * timed into a histogram with power of two buckets, where bucket n holds the
+ * runs that took [2^(n-1), 2^n) nanoseconds.
+ */
+struct OpStats {
+    static constexpr size_t buckets = 32;
+    static constexpr uint64_t sample_interval = 64;
+
+    /**
+     * @param op	The handler.
+     * @return		true if the handler is worth timing.
+     */
+    static constexpr bool is_timed(Op op) {
+        switch (op) {
+            case OP_SCRD:
+            case OP_CLR:
+            case OP_SCRR:
+            case OP_SCRL:
+            case OP_RAND:
+            case OP_DRAW:
+            case OP_SET_BCD:
+            case OP_REG_DUMP:
+            case OP_REG_STORE:
+            case OP_REG_DUMP_RPL:
+            case OP_REG_STORE_RPL:
+                return true;
+            default:
+                return false;
+        }
+    }
+
+    /**
+     * Adds a timed run of a handler to its histogram.
+     *
+     * @param op	The handler.
+     * @param time	How long it took.
+     */
+    void record(Op op, std::chrono::nanoseconds time);
+
+    /**
+     * Writes the counts and the histograms of the handlers that have run.
+     *
+     * @param out	The stream to write the JSON object to.
+     */
+    void write_json(std::ostream& out) const;
+
+    std::array<uint64_t, OP_COUNT> counts{};
+    std::array<std::array<uint64_t, buckets>, OP_COUNT> histograms{};
+
+    /**
+     * Makes SIGUSR1 ask for a snapshot of the stats. Does nothing on platforms
+     * without it.
+     */
+    static void install_signal_handler();
+
+    /**
+     * Returns and clears whether a snapshot has been asked for.
+     *
+     * @return true if SIGUSR1 has been received since the last call.
+     */
+    static bool take_request();
+};
+
+#endif
@@ -0,0 +1,132 @@
+#pragma once
+
+#ifndef TIMELINE_H
+#define TIMELINE_H
+
+#include <cstdint>
+#include <cstddef>
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/**
+ * Records what the host threads are doing, for viewing in a trace viewer
+ * such as chrome://tracing or Perfetto.
+ *
+ * Every thread appends to a buffer of its own, so recording takes no lock.
+ * Only the first event of a thread takes one, to register the buffer. When a
+ * buffer is full further events of that thread are dropped. Nothing is
+ * recorded until enable() is called, and a disabled timeline costs one
+ * relaxed load per scope.
+ *
+ * Event names must be string literals, or otherwise outlive the timeline.
+ */
+class Timeline {
+public:
+    static Timeline& get_instance();
+
+    // The number of events each thread can record
+    static constexpr size_t capacity = 1 << 18;
+
+    Timeline(const Timeline&) = delete;
+    Timeline& operator=(const Timeline&) = delete;
+
+    /**
+     * Starts recording.
+     */
+    void enable() { m_enabled.store(true, std::memory_order_relaxed); }
+
+    /**
+     * @return true if events are being recorded.
+     */
+    bool enabled() const { return m_enabled.load(std::memory_order_relaxed); }
+
+    /**
+     * Names the calling thread in the trace. Does nothing unless recording.
+     *
+     * @param name	The name of the thread.
+     */
+    void name_thread(const char* name);
+
+    /**
+     * Records something that happens at one point in time.
+     *
+     * @param name		What happened.
+     * @param arg_name	The name of a value to attach, or nullptr.
+     * @param arg		The value.
+     */
+    void instant(const char* name, const char* arg_name = nullptr, int64_t arg = 0);
+
+    /**
+     * Writes every recorded event as Chrome trace-event JSON.
+     *
+     * Must not be called while other threads are still recording.
+     *
+     * @param filename			 The file to be written.
+     * @throw std::runtime_error if the file cannot be written.
+     */
+    void write(const std::filesystem::path& filename) const;
+
+    /**
+     * Records the time from its construction to its destruction as one event
+     * on the calling thread.
+     */
+    class Scope {
+    public:
+        explicit Scope(const char* name)
+            : m_name(Timeline::get_instance().enabled() ? name : nullptr),
+              m_begin(m_name ? clock::now() : clock::time_point{})
+        {}
+
+        ~Scope() {
+            if (m_name)
+                Timeline::get_instance().complete(m_name, m_begin, clock::now());
+        }
+
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+    private:
+        const char* m_name;
+        std::chrono::steady_clock::time_point m_begin;
+    };
+
+private:
+    using clock = std::chrono::steady_clock;
+
+    struct Event {
+        const char* name;
+        const char* arg_name;
+        int64_t arg;
+        uint64_t begin; // ns since the timeline was created
+        uint64_t duration; // ns, or UINT64_MAX for an instant
+    };
+
+    struct Buffer {
+        std::unique_ptr<Event[]> events{new Event[capacity]};
+        std::atomic<size_t> size{0};
+        size_t dropped{0};
+        uint32_t tid{0};
+        std::string name;
+    };
+
+    Timeline() = default;
+
+    void complete(const char* name, clock::time_point begin, clock::time_point end);
+
+    void append(const Event& event);
+
+    Buffer& buffer();
+
+    clock::time_point m_epoch{clock::now()};
+    std::atomic<bool> m_enabled{false};
+
+    mutable std::mutex m_mutex;
+    std::vector<std::unique_ptr<Buffer>> m_buffers;
+};
+
+#endif
@@ -0,0 +1,115 @@
+#pragma once
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <cstdint>
+#include <cstddef>
+#include <array>
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <schip/memory.h>
+
+/**
+ * One executed instruction and what it left behind: Vx, VF and I after it
+ * ran. Together with the opcode that tells what was written, e.g. the memory
+ * at I for Fx55 or the collision flag for Dxyn.
+ */
+struct TraceRecord {
+    uint16_t pc;
+    uint16_t opcode;
+    uint16_t i;
+    uint8_t vx;
+    uint8_t vf;
+};
+
+static_assert(sizeof(TraceRecord) == 8, "Trace records must stay compact");
+
+/**
+ * A fixed size ring of the most recently executed instructions.
+ *
+ * Recording an instruction is a single 8 byte store into the ring, so the chip
+ * keeps it on all the time. The ring can be written to a trace file when the chip
+ * faults or when asked to, and decoded later with schip_trace.
+ *
+ * A trace file starts with the magic "SCHIPTRC", a 16-bit version, a 16-bit
+ * record size, a 64-bit count of all recorded instructions, a 32-bit count of
+ * the records in the file and a 16-bit length followed by the error message,
+ * which is empty if the chip did not fault. Then follow the records from the
+ * oldest to the newest, all little endian. If the chip faulted, the newest
+ * record is the instruction that faulted and its registers are not valid.
+ */
+class TraceRing {
+public:
+    static constexpr size_t capacity = 1 << 13;
+
+    /**
+     * Records an instruction.
+     *
+     * @param record	The instruction and the registers after it.
+     */
+    void record(const TraceRecord& record) {
+        m_records[m_count++ & (capacity - 1)] = record;
+    }
+
+    /**
+     * Forgets every recorded instruction.
+     */
+    void clear() { m_count = 0; }
+
+    /**
+     * @return The number of instructions recorded since the last clear().
+     */
+    uint64_t count() const { return m_count; }
+
+    /**
+     * @return The records in the ring, from the oldest to the newest.
+     */
+    std::vector<TraceRecord> records() const;
+
+    /**
+     * Writes the ring to a trace file.
+     *
+     * @param filename			 The file to be written.
+     * @param error				 Why the chip stopped, or empty if it did not fault.
+     * @throw std::runtime_error if the file cannot be written.
+     */
+    void write(const std::filesystem::path& filename, std::string_view error) const;
+
+    /**
+     * Makes SIGUSR2 ask for the ring to be written. Does nothing on platforms
+     * without it.
+     */
+    static void install_signal_handler();
+
+    /**
+     * Returns and clears whether the ring has been asked to be written.
+     *
+     * @return true if SIGUSR2 has been received since the last call.
+     */
+    static bool take_request();
+
+private:
+    std::array<TraceRecord, capacity> m_records{};
+    uint64_t m_count{0};
+};
+
+struct TraceFile {
+    uint64_t count{0};
+    std::string error;
+    std::vector<TraceRecord> records;
+};
+
+/**
+ * Reads a file written by TraceRing::write().
+ *
+ * @param filename			 The file to be read.
+ * @return					 The records and the error message.
+ * @throw std::runtime_error if the file cannot be read or is not a trace.
+ */
+TraceFile read_trace(const std::filesystem::path& filename);
+
+#endif
@@ -0,0 +1,51 @@
+#pragma once
+
+#ifndef WORKLOAD_H
+#define WORKLOAD_H
+
+#include <cstdint>
+#include <chrono>
+#include <string_view>
+#include <vector>
+
+#include <schip/memory.h>
+#include <schip/chip.h>
+
+/**
+ * A small synthetic program that stresses one part of the interpreter.
+ *
+ * Every workload loops forever, never waits for a key and never faults, so it
+ * can be run for any number of instructions.
+ */
+struct Workload {
+    std::string_view name;
+    std::string_view description;
+    std::vector<Byte> program;
+};
+
+struct WorkloadResult {
+    FrameProfile profile;
+
+    // The wall clock time of the whole run
+    std::chrono::nanoseconds elapsed{0};
+};
+
+/**
+ * @return The workloads built into the emulator.
+ */
+const std::vector<Workload>& builtin_workloads();
+
+/**
+ * Runs a workload on a fresh machine, unthrottled, through the same frame
+ * loop as the window: run a frame, then present it.
+ *
+ * @param workload		The workload to run.
+ * @param instructions	The number of instructions to run at least. Whole
+ *						frames are run, so this is rounded up.
+ * @param engine		How opcodes are dispatched.
+ * @return				How long each phase took.
+ * @throw see Chip::run().
+ */
+WorkloadResult run_workload(const Workload& workload, uint64_t instructions, ChipEngine engine = ENGINE_SWITCH);
+
+#endif
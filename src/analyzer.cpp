@@ -0,0 +1,432 @@
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+#include <string_view>
+#include <thread>
+
+#include <schip/analyzer.h>
+#include <schip/hash.h>
+#include <schip/library.h>
+#include <schip/opcodes.h>
+
+namespace {
+
+constexpr std::string_view MAP_MAGIC{"SCHIPMAP"};
+constexpr uint32_t MAP_VERSION = 1;
+
+struct MapHeader {
+    char magic[8];
+    uint32_t version;
+    uint16_t size;
+    uint16_t flags;
+    uint64_t hash;
+    uint32_t write_count;
+    uint32_t reserved;
+};
+
+static_assert(sizeof(MapHeader) == 32 && std::has_unique_object_representations_v<MapHeader>,
+              "MapHeader is stored as is and must not contain padding");
+
+// A value that is not known
+constexpr int UNKNOWN = -1;
+
+// What is known about the registers on the way to an instruction
+struct Values {
+    std::array<int, 16> v;
+    int i{UNKNOWN};
+
+    // Whether 00FF switched to high resolution on the way, where Dxy0 draws
+    // a 16x16 sprite rather than nothing
+    bool extended{false};
+
+    Values() { v.fill(UNKNOWN); }
+};
+
+// A store through I, which is only known to hit code once all code is found
+struct Write {
+    Addr pc;
+    int first;
+    int length;
+};
+
+class Analysis {
+public:
+    explicit Analysis(std::span<const Byte> rom) : m_rom(rom) {
+        m_map.bytes.resize(rom.size());
+    }
+
+    RomMap run() {
+        follow(USERCODE_BEG, Values{});
+
+        while (!m_pending.empty()) {
+            auto [pc, values] = m_pending.back();
+            m_pending.pop_back();
+            walk(pc, values);
+        }
+
+        for (const Write& write : m_writes) {
+            if (write.first == UNKNOWN) {
+                m_map.flags |= MAP_UNKNOWN_WRITES;
+                m_map.code_writes.push_back(write.pc);
+                continue;
+            }
+
+            bool hits_code = false;
+            for (int addr = write.first; addr < write.first + write.length; addr++)
+                hits_code |= in_rom(addr) && (byte(addr) & MAP_CODE);
+
+            if (hits_code) {
+                m_map.flags |= MAP_WRITES_CODE;
+                m_map.code_writes.push_back(write.pc);
+            }
+        }
+
+        std::sort(m_map.code_writes.begin(), m_map.code_writes.end());
+        m_map.code_writes.erase(std::unique(m_map.code_writes.begin(), m_map.code_writes.end()),
+                                m_map.code_writes.end());
+        return std::move(m_map);
+    }
+
+private:
+    bool in_rom(int addr) const {
+        return addr >= USERCODE_BEG && addr < static_cast<int>(USERCODE_BEG + m_rom.size());
+    }
+
+    uint8_t& byte(int addr) { return m_map.bytes[addr - USERCODE_BEG]; }
+
+    // Whether a whole instruction is in the ROM
+    bool has_instruction(int pc) const { return in_rom(pc) && in_rom(pc + 1); }
+
+    uint16_t opcode(int pc) const {
+        return static_cast<uint16_t>(m_rom[pc - USERCODE_BEG] << 8 | m_rom[pc + 1 - USERCODE_BEG]);
+    }
+
+    void mark(int first, int length, uint8_t flag) {
+        for (int addr = first; addr < first + length; addr++) {
+            if (in_rom(addr))
+                byte(addr) |= flag;
+        }
+    }
+
+    // Queues the start of a block
+    void follow(int pc, const Values& values) {
+        if (!has_instruction(pc))
+            return;
+
+        byte(pc) |= MAP_BLOCK;
+        m_pending.emplace_back(pc, values);
+    }
+
+    void walk(int pc, Values values) {
+        while (has_instruction(pc) && !m_visited[pc]) {
+            m_visited[pc] = true;
+            mark(pc, 2, MAP_CODE);
+
+            uint16_t op = opcode(pc);
+            unsigned x = (op >> 8) & 0xf, y = (op >> 4) & 0xf, n = op & 0xf, kk = op & 0xff, nnn = op & 0xfff;
+            int& vx = values.v[x];
+
+            switch (classify(op)) {
+            case OP_COUNT:
+                m_map.flags |= MAP_INVALID_CODE;
+                return;
+
+            case OP_EXIT:
+            case OP_RET:
+                return;
+
+            case OP_JMP:
+                follow(nnn, values);
+                return;
+
+            case OP_CALL:
+                follow(nnn, values);
+
+                // The subroutine may change any register
+                forget(values);
+                break;
+
+            case OP_SEQ_IMM:
+            case OP_SNE_IMM:
+            case OP_SEQ:
+            case OP_SNE:
+            case OP_SKP:
+            case OP_SKNP:
+                follow(pc + 4, values);
+                break;
+
+            case OP_JMPR:
+                jump_table(nnn, values);
+                return;
+
+            case OP_EEX:
+                values.extended = true;
+                break;
+
+            case OP_DEX:
+                values.extended = false;
+                break;
+
+            case OP_LD:
+                vx = kk;
+                break;
+
+            case OP_ADD_IMM:
+                if (vx != UNKNOWN)
+                    vx = (vx + kk) & 0xff;
+                break;
+
+            case OP_MOV:
+                vx = values.v[y];
+                break;
+
+            case OP_OR:
+            case OP_AND:
+            case OP_XOR:
+            case OP_ADD:
+            case OP_SUB:
+            case OP_SHR:
+            case OP_SBR:
+            case OP_SHL:
+                vx = UNKNOWN;
+                values.v[0xf] = UNKNOWN;
+                break;
+
+            case OP_RAND:
+            case OP_GET_DELAY:
+            case OP_GET_KEY:
+                vx = UNKNOWN;
+                break;
+
+            case OP_LDI:
+                values.i = nnn;
+                break;
+
+            case OP_ADDI:
+                values.i = values.i != UNKNOWN && vx != UNKNOWN ? values.i + vx : UNKNOWN;
+                break;
+
+            case OP_LD_SPRITE:
+                values.i = vx != UNKNOWN ? vx * 5 : UNKNOWN;
+                break;
+
+            case OP_LD_ESPRITE:
+                values.i = vx != UNKNOWN ? vx * 10 + 0x50 : UNKNOWN;
+                break;
+
+            case OP_DRAW:
+                if (values.i != UNKNOWN && (n || values.extended))
+                    mark(values.i, n ? n : 32, MAP_SPRITE);
+                values.v[0xf] = UNKNOWN;
+                break;
+
+            case OP_SET_BCD:
+                store(pc, values.i, 3);
+                break;
+
+            case OP_REG_DUMP:
+                store(pc, values.i, x + 1);
+                break;
+
+            case OP_REG_STORE:
+                if (values.i != UNKNOWN)
+                    mark(values.i, x + 1, MAP_READ);
+                std::fill(values.v.begin(), values.v.begin() + x + 1, UNKNOWN);
+                break;
+
+            case OP_REG_STORE_RPL:
+                std::fill(values.v.begin(), values.v.begin() + std::min(x + 1, 16u), UNKNOWN);
+                break;
+
+            default:
+                break;
+            }
+
+            pc += 2;
+        }
+    }
+
+    // Bnnn jumps to nnn plus the register in the top nibble of nnn, like the chip does it
+    void jump_table(unsigned nnn, const Values& values) {
+        int offset = values.v[nnn >> 8];
+        if (offset != UNKNOWN) {
+            follow(nnn + offset, values);
+            return;
+        }
+
+        // Without the offset, look for a table of jumps at nnn, which is what
+        // Bnnn is nearly always used for
+        Values unknown = values;
+        forget(unknown);
+        int entries = 0;
+
+        for (int entry = nnn; entry < static_cast<int>(nnn) + 0x100 && has_instruction(entry); entry += 2) {
+            Op op = classify(opcode(entry));
+            if (op != OP_JMP && op != OP_CALL && op != OP_RET)
+                break;
+
+            follow(entry, unknown);
+            entries++;
+        }
+
+        if (entries == 0)
+            m_map.flags |= MAP_UNRESOLVED_JUMPS;
+    }
+
+    // Forgets the registers and I, but not the resolution
+    static void forget(Values& values) {
+        values.v.fill(UNKNOWN);
+        values.i = UNKNOWN;
+    }
+
+    void store(Addr pc, int i, int length) {
+        m_writes.push_back({pc, i, length});
+        if (i != UNKNOWN)
+            mark(i, length, MAP_WRITTEN);
+    }
+
+    std::span<const Byte> m_rom;
+    RomMap m_map;
+    // Instructions are walked once, with the values of the first path to them
+    std::array<bool, MEMORY_SIZE> m_visited{};
+    std::vector<std::pair<int, Values>> m_pending;
+    std::vector<Write> m_writes;
+};
+
+template <typename T>
+void write_raw(std::ofstream& file, const T& value) {
+    file.write(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+}
+
+RomMap analyze_rom(std::span<const Byte> rom) {
+    if (rom.size() > USERCODE_SIZE)
+        throw std::invalid_argument("The ROM does not fit into memory");
+
+    RomMap map = Analysis{rom}.run();
+    map.hash = hash_block(rom.data(), rom.size());
+    return map;
+}
+
+void write_rom_map(const std::filesystem::path& filename, const RomMap& map) {
+    MapHeader header{};
+    std::memcpy(header.magic, MAP_MAGIC.data(), sizeof(header.magic));
+    header.version = MAP_VERSION;
+    header.size = static_cast<uint16_t>(map.bytes.size());
+    header.flags = map.flags;
+    header.hash = map.hash;
+    header.write_count = static_cast<uint32_t>(map.code_writes.size());
+
+    std::ofstream file{filename, std::ios_base::out | std::ios::binary | std::ios::trunc};
+    if (!file)
+        throw std::runtime_error("Cannot create " + filename.string());
+
+    write_raw(file, header);
+    for (Addr pc : map.code_writes)
+        write_raw(file, static_cast<uint16_t>(pc));
+    file.write(reinterpret_cast<const char*>(map.bytes.data()), map.bytes.size());
+
+    if (!file)
+        throw std::runtime_error("Cannot write " + filename.string());
+}
+
+RomMap read_rom_map(const std::filesystem::path& filename) {
+    std::vector<Byte> data = read_rom_file(filename);
+
+    MapHeader header;
+    if (data.size() < sizeof(header))
+        throw std::runtime_error(filename.string() + " is not a ROM map");
+    std::memcpy(&header, data.data(), sizeof(header));
+
+    if (MAP_MAGIC != std::string_view(header.magic, sizeof(header.magic)) || header.version != MAP_VERSION)
+        throw std::runtime_error(filename.string() + " is not a ROM map");
+
+    size_t writes = size_t{header.write_count} * sizeof(uint16_t);
+    if (header.size > USERCODE_SIZE || data.size() != sizeof(header) + writes + header.size)
+        throw std::runtime_error("The ROM map " + filename.string() + " is damaged");
+
+    RomMap map;
+    map.hash = header.hash;
+    map.flags = header.flags;
+    map.code_writes.resize(header.write_count);
+
+    const Byte* pos = data.data() + sizeof(header);
+    for (Addr& pc : map.code_writes) {
+        uint16_t value;
+        std::memcpy(&value, pos, sizeof(value));
+        pc = value;
+        pos += sizeof(value);
+    }
+
+    map.bytes.assign(pos, pos + header.size);
+    return map;
+}
+
+AnalyzeStats analyze_roms(const std::vector<std::filesystem::path>& inputs, const std::filesystem::path& outdir,
+                          const AnalyzeOptions& options) {
+    AnalyzeStats stats;
+    std::vector<std::vector<Byte>> roms;
+    std::map<uint64_t, size_t> seen;
+
+    for (const auto& path : find_rom_files(inputs)) {
+        stats.files++;
+
+        std::vector<Byte> data = read_rom_file(path);
+        if (data.empty() || data.size() > USERCODE_SIZE) {
+            stats.skipped++;
+            continue;
+        }
+
+        if (!seen.emplace(hash_block(data.data(), data.size()), roms.size()).second) {
+            stats.duplicates++;
+            continue;
+        }
+
+        roms.push_back(std::move(data));
+    }
+
+    stats.roms = roms.size();
+    std::filesystem::create_directories(outdir);
+
+    std::atomic<size_t> next{0};
+    std::atomic<size_t> self_modifying{0};
+    std::exception_ptr error;
+    std::mutex error_mutex;
+    std::vector<std::thread> workers;
+
+    for (unsigned t = 0; t < std::max(1u, options.threads); t++) {
+        workers.emplace_back([&]() {
+            for (size_t n = next.fetch_add(1); n < roms.size(); n = next.fetch_add(1)) {
+                try {
+                    RomMap map = analyze_rom(roms[n]);
+                    if (map.self_modifying())
+                        self_modifying.fetch_add(1, std::memory_order_relaxed);
+
+                    char name[32];
+                    std::snprintf(name, sizeof(name), "%016llx.map", static_cast<unsigned long long>(map.hash));
+                    write_rom_map(outdir / name, map);
+                } catch (...) {
+                    std::lock_guard lock{error_mutex};
+                    if (!error)
+                        error = std::current_exception();
+                }
+            }
+        });
+    }
+
+    for (auto& worker : workers)
+        worker.join();
+
+    if (error)
+        std::rethrow_exception(error);
+
+    stats.self_modifying = self_modifying;
+    return stats;
+}
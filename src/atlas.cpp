@@ -0,0 +1,61 @@
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+#include <schip/atlas.h>
+
+TileAtlas::TileAtlas(size_t tiles) {
+    if (tiles == 0)
+        throw std::invalid_argument("An atlas needs at least one tile");
+
+    // Tiles are twice as wide as they are high
+    m_columns = std::max(1, static_cast<int>(std::ceil(std::sqrt(tiles / 2.0))));
+    m_rows = static_cast<int>((tiles + m_columns - 1) / m_columns);
+
+    m_texels.assign(static_cast<size_t>(width()) * height(), border);
+    m_frames.resize(tiles);
+    m_extended.assign(tiles, false);
+    m_dirty.assign(tiles, true);
+
+    for (size_t tile = 0; tile < tiles; tile++) {
+        for (int y = 0; y < PPU::screen_height; y++) {
+            uint8_t* row = &m_texels[static_cast<size_t>(tile_y(tile) + y) * width() + tile_x(tile)];
+            std::fill_n(row, PPU::screen_width, 0);
+        }
+    }
+}
+
+bool TileAtlas::update(size_t tile, const FramePixels& frame, bool extended) {
+    if (m_extended[tile] == extended && frame == m_frames[tile])
+        return false;
+
+    m_frames[tile] = frame;
+    m_extended[tile] = extended;
+    m_dirty[tile] = true;
+
+    FramePixels expanded;
+    expand_frame(frame, extended, expanded);
+
+    for (int y = 0; y < PPU::screen_height; y++) {
+        const char* src = &expanded[y * PPU::screen_width];
+        uint8_t* dst = &m_texels[static_cast<size_t>(tile_y(tile) + y) * width() + tile_x(tile)];
+
+        for (int x = 0; x < PPU::screen_width; x++)
+            dst[x] = src[x] ? 0xff : 0x00;
+    }
+
+    return true;
+}
+
+const std::vector<size_t>& TileAtlas::take_dirty() {
+    m_taken.clear();
+
+    for (size_t tile = 0; tile < m_dirty.size(); tile++) {
+        if (m_dirty[tile]) {
+            m_taken.push_back(tile);
+            m_dirty[tile] = false;
+        }
+    }
+
+    return m_taken;
+}
@@ -0,0 +1,196 @@
+#include <algorithm>
+#include <bit>
+#include <chrono>
+#include <stdexcept>
+
+#include <schip/audio.h>
+#include <schip/timeline.h>
+
+namespace {
+
+constexpr uint16_t WAV_CHANNELS = 1;
+constexpr uint16_t WAV_BITS = 16;
+constexpr uint32_t WAV_HEADER_SIZE = 44;
+
+// How long the sink sleeps between two rounds
+constexpr auto IDLE_WAIT = std::chrono::milliseconds(2);
+constexpr auto PERIOD = std::chrono::milliseconds(5);
+
+constexpr size_t CHUNK_SIZE = 2048;
+
+template <typename T>
+void write_le(std::ofstream& file, T value) {
+    for (size_t i = 0; i < sizeof(T); i++)
+        file.put(static_cast<char>((value >> (i * 8)) & 0xff));
+}
+
+void write_wav_header(std::ofstream& file, uint32_t data_size) {
+    file.write("RIFF", 4);
+    write_le<uint32_t>(file, WAV_HEADER_SIZE - 8 + data_size);
+    file.write("WAVEfmt ", 8);
+    write_le<uint32_t>(file, 16);
+    write_le<uint16_t>(file, 1); // PCM
+    write_le<uint16_t>(file, WAV_CHANNELS);
+    write_le<uint32_t>(file, Buzzer::sample_rate);
+    write_le<uint32_t>(file, Buzzer::sample_rate * WAV_CHANNELS * WAV_BITS / 8);
+    write_le<uint16_t>(file, WAV_CHANNELS * WAV_BITS / 8);
+    write_le<uint16_t>(file, WAV_BITS);
+    file.write("data", 4);
+    write_le<uint32_t>(file, data_size);
+}
+
+}
+
+void Buzzer::render(bool on, AudioSample* out) {
+    for (unsigned n = 0; n < samples_per_frame; n++) {
+        if (on && m_gain < fade)
+            m_gain++;
+        else if (!on && m_gain > 0)
+            m_gain--;
+
+        // The wave is high for the first half of every period
+        int level = m_phase < sample_rate / 2 ? amplitude : -amplitude;
+        out[n] = static_cast<AudioSample>(level * static_cast<int>(m_gain) / static_cast<int>(fade));
+
+        m_phase += frequency;
+        if (m_phase >= sample_rate)
+            m_phase -= sample_rate;
+    }
+}
+
+AudioOutput::AudioOutput(AudioSinkType sink, const std::filesystem::path& filename, bool realtime)
+    : m_sink(sink),
+      m_realtime(realtime),
+      m_queue(std::make_unique<SpscRing<AudioSample, queue_size>>()),
+      m_chunk(CHUNK_SIZE)
+{
+    if (m_sink == AUDIO_WAV) {
+        m_file.open(filename, std::ios_base::out | std::ios::binary | std::ios::trunc);
+        if (!m_file)
+            throw std::runtime_error("Cannot create the WAV file " + filename.string());
+
+        // The sizes are filled in by finish()
+        write_wav_header(m_file, 0);
+    }
+
+    m_thread = std::thread(&AudioOutput::drain, this);
+}
+
+AudioOutput::~AudioOutput() {
+    finish();
+}
+
+void AudioOutput::finish() {
+    if (!m_thread.joinable())
+        return;
+
+    m_done.store(true, std::memory_order_release);
+    m_thread.join();
+
+    if (m_sink == AUDIO_WAV) {
+        uint64_t size = written() * sizeof(AudioSample);
+        m_file.seekp(0);
+        write_wav_header(m_file, static_cast<uint32_t>(std::min<uint64_t>(size, UINT32_MAX - WAV_HEADER_SIZE)));
+        m_file.flush();
+    }
+}
+
+bool AudioOutput::push(bool on) {
+    m_buzzer.render(on, m_frame.data());
+
+    size_t queued = m_queue->push(m_frame.data(), m_frame.size());
+    if (queued == m_frame.size())
+        return true;
+
+    m_overruns.fetch_add(m_frame.size() - queued, std::memory_order_relaxed);
+    return false;
+}
+
+void AudioOutput::push_wait(bool on) {
+    m_buzzer.render(on, m_frame.data());
+
+    for (size_t queued = 0; queued < m_frame.size();) {
+        queued += m_queue->push(m_frame.data() + queued, m_frame.size() - queued);
+        if (queued < m_frame.size())
+            std::this_thread::sleep_for(IDLE_WAIT / 4);
+    }
+}
+
+void AudioOutput::drain() {
+    using clock = std::chrono::steady_clock;
+
+    Timeline::get_instance().name_thread("audio");
+
+    // The clock of the imaginary sound card starts once enough samples are queued
+    clock::time_point start;
+    bool started = false;
+    bool priming = true;
+    uint64_t played = 0;
+
+    for (;;) {
+        // Read the flag first, so that nothing pushed before it was set is lost
+        bool done = m_done.load(std::memory_order_acquire);
+
+        if (!m_realtime || done) {
+            if (size_t count = m_queue->pop(m_chunk.data(), m_chunk.size()); count > 0) {
+                write(m_chunk.data(), count);
+                continue;
+            }
+
+            if (done)
+                break;
+
+            std::this_thread::sleep_for(IDLE_WAIT);
+            continue;
+        }
+
+        // After running dry, wait for a few frames to be queued again before
+        // playing them, rather than stuttering through them one at a time
+        if (priming && m_queue->size() >= prebuffer) {
+            priming = false;
+
+            if (!started) {
+                started = true;
+                start = clock::now();
+            }
+        }
+
+        if (started) {
+            std::chrono::duration<double> elapsed = clock::now() - start;
+            uint64_t due = static_cast<uint64_t>(elapsed.count() * Buzzer::sample_rate) - played;
+
+            while (due > 0) {
+                size_t wanted = std::min<uint64_t>(due, m_chunk.size());
+                size_t count = priming ? 0 : m_queue->pop(m_chunk.data(), wanted);
+
+                if (count < wanted) {
+                    std::fill(m_chunk.begin() + count, m_chunk.begin() + wanted, 0);
+                    m_underruns.fetch_add(wanted - count, std::memory_order_relaxed);
+                    priming = true;
+                }
+
+                write(m_chunk.data(), wanted);
+                played += wanted;
+                due -= wanted;
+            }
+        }
+
+        std::this_thread::sleep_for(PERIOD);
+    }
+
+    if (m_sink == AUDIO_WAV)
+        m_file.flush();
+}
+
+void AudioOutput::write(const AudioSample* samples, size_t count) {
+    if (m_sink == AUDIO_WAV) {
+        if constexpr (std::endian::native == std::endian::little) {
+            m_file.write(reinterpret_cast<const char*>(samples), count * sizeof(AudioSample));
+        } else {
+            for (size_t n = 0; n < count; n++)
+                write_le(m_file, static_cast<uint16_t>(samples[n]));
+        }
+    }
+
+    m_written.fetch_add(count, std::memory_order_relaxed);
+}
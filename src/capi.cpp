@@ -0,0 +1,145 @@
+#include <cstring>
+#include <exception>
+#include <memory>
+#include <span>
+#include <string>
+
+#include <schip/machine.h>
+#include <schip/schip.h>
+
+struct schip_machine {
+    Machine machine;
+
+    // States are copied through here, since the caller's buffer may not be aligned
+    mutable MachineState state{};
+    mutable std::string error;
+    uint32_t seed{0};
+    uint16_t keys{0};
+};
+
+static_assert(PPU::screen_width == SCHIP_SCREEN_WIDTH && PPU::screen_height == SCHIP_SCREEN_HEIGHT);
+
+namespace {
+
+schip_status fail(const schip_machine* machine, schip_status status, const char* error) {
+    machine->error = error;
+    return status;
+}
+
+}
+
+int schip_abi_version(void) {
+    return SCHIP_ABI_VERSION;
+}
+
+schip_machine* schip_create(uint32_t seed) {
+    try {
+        auto machine = std::make_unique<schip_machine>();
+        machine->seed = seed;
+        machine->machine.chip.seed(seed);
+        return machine.release();
+    } catch (std::exception&) {
+        return nullptr;
+    }
+}
+
+void schip_destroy(schip_machine* machine) {
+    delete machine;
+}
+
+schip_status schip_load_rom(schip_machine* machine, const uint8_t* rom, size_t size) {
+    if (!rom)
+        return fail(machine, SCHIP_INVALID, "There is no program");
+
+    try {
+        machine->machine.bus.load_program(std::span<const Byte>{rom, size});
+    } catch (std::exception& err) {
+        return fail(machine, SCHIP_INVALID, err.what());
+    }
+
+    Chip& chip = machine->machine.chip;
+    PPU& ppu = machine->machine.ppu;
+
+    chip.reset();
+    chip.seed(machine->seed);
+    ppu.disable_extended();
+    ppu.clear_screen();
+    machine->keys = 0;
+
+    return SCHIP_OK;
+}
+
+void schip_set_keys(schip_machine* machine, uint16_t keys) {
+    machine->keys = keys;
+}
+
+schip_status schip_set_engine(schip_machine* machine, schip_engine engine) {
+    switch (engine) {
+    case SCHIP_ENGINE_SWITCH:
+        machine->machine.chip.set_engine(ENGINE_SWITCH);
+        return SCHIP_OK;
+    case SCHIP_ENGINE_TABLE:
+        machine->machine.chip.set_engine(ENGINE_TABLE);
+        return SCHIP_OK;
+    }
+
+    return fail(machine, SCHIP_INVALID, "There is no such engine");
+}
+
+schip_status schip_step(schip_machine* machine, uint32_t frames) {
+    Chip& chip = machine->machine.chip;
+
+    // Exceptions must not cross into C, and a try block costs nothing until something is thrown
+    try {
+        for (uint32_t n = 0; n < frames; n++) {
+            if (chip.has_exited())
+                return SCHIP_EXITED;
+
+            chip.run_frame(machine->keys);
+        }
+    } catch (std::exception& err) {
+        return fail(machine, SCHIP_FAULT, err.what());
+    }
+
+    return chip.has_exited() ? SCHIP_EXITED : SCHIP_OK;
+}
+
+uint64_t schip_frame(const schip_machine* machine) {
+    return machine->machine.chip.frame();
+}
+
+const uint8_t* schip_framebuffer(const schip_machine* machine) {
+    return reinterpret_cast<const uint8_t*>(machine->machine.ppu.pixels().data());
+}
+
+int schip_is_extended(const schip_machine* machine) {
+    return machine->machine.ppu.is_extended() ? 1 : 0;
+}
+
+size_t schip_state_size(void) {
+    return sizeof(MachineState);
+}
+
+schip_status schip_save_state(const schip_machine* machine, void* buffer, size_t size) {
+    if (!buffer || size < sizeof(MachineState))
+        return fail(machine, SCHIP_INVALID, "The buffer is too small for a state");
+
+    machine->machine.chip.save_state(machine->state);
+    std::memcpy(buffer, &machine->state, sizeof(MachineState));
+
+    return SCHIP_OK;
+}
+
+schip_status schip_load_state(schip_machine* machine, const void* buffer, size_t size) {
+    if (!buffer || size != sizeof(MachineState))
+        return fail(machine, SCHIP_INVALID, "The state has the wrong size");
+
+    std::memcpy(&machine->state, buffer, sizeof(MachineState));
+    machine->machine.chip.load_state(machine->state);
+
+    return SCHIP_OK;
+}
+
+const char* schip_error(const schip_machine* machine) {
+    return machine->error.c_str();
+}
@@ -3,51 +3,366 @@
 #include <stdexcept>
 #include <thread>
 #include <iostream>
+#include <memory>
+#include <utility>
 
 #include <schip/chip.h>
+#include <schip/audio.h>
+#include <schip/debugger.h>
 #include <schip/keypad.h>
-#include <schip/display.h>
+#include <schip/ppu.h>
+#include <schip/rewind.h>
+#include <schip/movie.h>
+#include <schip/profiler.h>
+#include <schip/timeline.h>
+#include <schip/pacing.h>
+#include <schip/recorder.h>
+
+namespace {
+
+// Every possible opcode mapped to its handler, or to OP_COUNT if it is invalid
+struct OpcodeTable {
+    std::array<Op, 0x10000> ops;
+
+    OpcodeTable() {
+        for (uint32_t opcode = 0; opcode < ops.size(); opcode++)
+            ops[opcode] = classify(static_cast<uint16_t>(opcode));
+    }
+};
+
+const OpcodeTable OPCODE_TABLE;
+
+}
+
+Chip& Chip::get_instance() {
+    static Chip instance(Bus::get_instance(), PPU::get_instance());
+    return instance;
+}
 
 void Chip::reset() {
     m_v.fill(0);
     m_i = 0;
-    m_sp = 0xea0;
+    m_sp = stack_base;
     m_pc = 0x200;
     m_dtimer = 0;
     m_stimer = 0;
+    m_buzzing = false;
+    m_keys = 0;
+    m_frame = 0;
+    m_chipstate = CHIP_READY;
+    m_key_state = GK_NOTHING;
+    m_trace_ring->clear();
+
+    seed(std::random_device{}());
+}
+
+void Chip::seed(uint32_t seed) {
+    // The state of std::minstd_rand must be in [1, modulus)
+    m_rng = seed % std::minstd_rand::modulus;
+    if (m_rng == 0)
+        m_rng = 1;
 }
 
 void Chip::run() {
-    m_chipstate = CHIP_RUNNING;
+    // A steady clock, so that the deadlines don't move when the wall clock does
+    using clock = std::chrono::steady_clock;
+
     std::cout << "The SChip interpreter has started" << std::endl;
+    Timeline::get_instance().name_thread("cpu");
+
+    m_ppu.disable_extended();
 
-    m_lasttick = std::chrono::high_resolution_clock::now();
-    PPU::get_instance().disable_extended();
+    auto state = std::make_unique<MachineState>();
+    auto ahead = std::make_unique<MachineState>();
+    auto deadline = clock::now();
 
     try {
-        while (!m_stopflag.load()) {
-            auto start = std::chrono::high_resolution_clock::now();
+        while (!m_stopflag.load() && !has_exited()) {
+            Timeline::Scope frame{"frame"};
+
+            if (m_rewind) {
+                if (unsigned frames = m_rewind_request.exchange(0); frames > 0) {
+                    Timeline::Scope scope{"rewind"};
+                    if (m_rewind->step_back(frames, *state))
+                        load_state(*state);
+                } else {
+                    Timeline::Scope scope{"record rewind"};
+                    save_state(*state);
+                    m_rewind->record(*state);
+                }
+            }
+
+            uint16_t keys = KeyPad::get_instance().get_mask();
+            if (m_movie)
+                m_movie->record(m_frame, keys);
 
-            if (m_chipstate != CHIP_HALTED)
-                fetch();
-            decode();
-            update_timers();
+            {
+                Timeline::Scope scope{"execute"};
+                run_frame(keys);
+            }
 
-            auto duration = std::chrono::duration_cast<std::chrono::microseconds>(
-                std::chrono::high_resolution_clock::now() - start
-            );
+            if (m_audio)
+                m_audio->push(m_buzzing);
 
-            // 200 us for each instruction was arbitrarily chosen. Idk how fast it should be..
-            std::this_thread::sleep_for(std::chrono::microseconds(200) - duration);
+#if(SCHIP_STATS)
+            if (OpStats::take_request())
+                m_stats.write_json(std::cerr);
+#endif
+
+            if (TraceRing::take_request())
+                write_trace({});
+
+            if (m_run_ahead) {
+                Timeline::Scope scope{"run ahead"};
+                run_ahead(keys, *ahead);
+            } else {
+                present();
+            }
+
+            // Sleep until the next frame is due. If we have fallen more than a
+            // frame behind, don't try to catch up.
+            deadline += frame_time;
+            if (auto now = clock::now(); now > deadline + frame_time)
+                deadline = now;
+
+            {
+                Timeline::Scope scope{"sleep"};
+                std::this_thread::sleep_until(deadline);
+            }
+
+            if (m_pacing)
+                m_pacing->record(clock::now(), deadline);
+
+            if (Timeline& timeline = Timeline::get_instance(); timeline.enabled()) {
+                auto late = std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - deadline);
+                timeline.instant("wake", "late_ns", late.count());
+            }
         }
     } catch(std::exception& err) {
         std::cerr << "Chip error: " << err.what() << std::endl;
+        write_trace(err.what());
+    }
+
+    if (m_movie) {
+        save_state(*state);
+        m_movie->finish(m_frame, hash_state(*state));
     }
 
     m_chipstate = CHIP_STOPPED;
     std::cout << "The SChip interpreter has stopped" << std::endl;
 }
 
+void Chip::run_frame(uint16_t keys) {
+    begin_frame(keys);
+
+    if (m_profile) [[unlikely]] {
+        using clock = std::chrono::steady_clock;
+        auto start = clock::now();
+
+        unsigned n = m_debugger ? run_instructions<true>() : run_instructions<false>();
+
+        auto executed = clock::now();
+        end_frame();
+
+        m_profile->frames++;
+        m_profile->instructions += n;
+        m_profile->exec += executed - start;
+        m_profile->timers += clock::now() - executed;
+        return;
+    }
+
+    if (m_debugger) [[unlikely]]
+        run_instructions<true>();
+    else
+        run_instructions<false>();
+
+    end_frame();
+}
+
+void Chip::begin_frame(uint16_t keys) {
+    if (m_chipstate == CHIP_READY)
+        m_chipstate = CHIP_RUNNING;
+
+    m_keys = keys;
+}
+
+void Chip::end_frame() {
+    update_timers();
+    m_frame++;
+}
+
+template <bool debugged>
+unsigned Chip::run_instructions() {
+    unsigned n = 0;
+
+    try {
+        for (; n < instructions_per_frame && !has_exited(); n++) {
+            if constexpr (debugged) {
+                // An instruction that waits for a key runs again without being fetched
+                bool fetching = m_chipstate != CHIP_HALTED;
+                m_debugger->before_step(fetching ? m_pc : m_pc - 2, fetching);
+            }
+
+            step();
+        }
+    } catch (std::exception& err) {
+        // The instruction that faulted is the one worth seeing in the trace
+        if (m_trace)
+            m_trace->record({static_cast<Addr>((m_pc - 2) & 0xfff), m_opc.packed, m_i, m_v[m_opc.x], m_v[0xf]});
+
+        if constexpr (debugged)
+            m_debugger->fault(m_pc - 2, err.what());
+        throw;
+    }
+
+    return n;
+}
+
+void Chip::present() {
+    Timeline::Scope scope{"present"};
+
+    if (m_profile) [[unlikely]] {
+        using clock = std::chrono::steady_clock;
+        auto start = clock::now();
+        m_ppu.present();
+        m_profile->present += clock::now() - start;
+    } else {
+        m_ppu.present();
+    }
+
+    if (m_recorder)
+        m_recorder->push(m_frame, m_ppu.pixels(), m_ppu.is_extended());
+}
+
+void Chip::run_ahead(uint16_t keys, MachineState& state) {
+    uint64_t frame = m_frame;
+    Addr prev_loc = m_prev_loc;
+
+    // Nothing that counts or measures what runs may see the speculative frames
+    Profiler* profiler = std::exchange(m_profiler, nullptr);
+    Debugger* debugger = std::exchange(m_debugger, nullptr);
+    TraceRing* trace = std::exchange(m_trace, nullptr);
+    uint8_t* coverage = std::exchange(m_coverage, nullptr);
+    FrameProfile* profile = std::exchange(m_profile, nullptr);
+#if(SCHIP_STATS)
+    OpStats stats = m_stats;
+#endif
+    save_state(state);
+
+    // Run speculatively with the current input and show where the machine
+    // will be in a few frames. Errors will surface again when the real
+    // frames are run.
+    try {
+        for (unsigned n = 0; n < m_run_ahead && !has_exited(); n++)
+            run_frame(keys);
+    } catch (std::exception&) {}
+
+    m_profiler = profiler;
+    m_debugger = debugger;
+    m_trace = trace;
+    m_coverage = coverage;
+    m_prev_loc = prev_loc;
+    m_profile = profile;
+#if(SCHIP_STATS)
+    m_stats = stats;
+#endif
+
+    // The speculative picture stands in for the frame that really ran, and
+    // is recorded under its number
+    m_frame = frame;
+    present();
+
+    load_state(state);
+}
+
+void Chip::write_trace(std::string_view error) const {
+    if (m_trace_file.empty())
+        return;
+
+    try {
+        m_trace_ring->write(m_trace_file, error);
+        std::cerr << "Wrote the last " << std::min<uint64_t>(m_trace_ring->count(), TraceRing::capacity)
+                  << " instructions to " << m_trace_file.string() << std::endl;
+    } catch (std::exception& err) {
+        std::cerr << "Error: " << err.what() << std::endl;
+    }
+}
+
+void Chip::step() {
+    // An instruction that waits for a key is only traced the first time
+    TraceRing* trace = nullptr;
+
+    if (m_chipstate != CHIP_HALTED) {
+        fetch();
+        trace = m_trace;
+    }
+
+    if (m_coverage) [[unlikely]]
+        record_edge();
+
+    if (m_profiler) [[unlikely]]
+        m_profiler->tick((m_pc - 2) & 0xfff, m_bus, m_sp);
+
+    Addr pc = (m_pc - 2) & 0xfff;
+    execute_opcode();
+
+    if (trace)
+        trace->record({pc, m_opc.packed, m_i, m_v[m_opc.x], m_v[0xf]});
+}
+
+void Chip::execute(uint16_t opcode) {
+    m_opc.packed = opcode;
+    execute_opcode();
+}
+
+void Chip::record_edge() {
+    // Both addresses are 12 bits, so the pair is hashed down to the bitmap size
+    Addr loc = (m_pc - 2) & 0xfff;
+    uint32_t edge = (static_cast<uint32_t>(m_prev_loc) << 12 | loc) * 0x9e3779b1u;
+
+    ++m_coverage[edge >> 16];
+    m_prev_loc = loc;
+}
+
+void Chip::save_state(MachineState& state) const {
+    save_registers(state.regs);
+    m_bus.save_state(state);
+    m_ppu.save_state(state);
+}
+
+void Chip::save_registers(RegisterState& regs) const {
+    regs.rng = m_rng;
+    regs.v = m_v;
+    regs.i = m_i;
+    regs.sp = m_sp;
+    regs.pc = m_pc;
+    regs.opcode = m_opc.packed;
+    regs.dtimer = m_dtimer;
+    regs.stimer = m_stimer;
+    regs.chipstate = m_chipstate;
+    regs.key_state = m_key_state;
+    regs.rpl = m_rpl;
+    regs.extended = m_ppu.is_extended();
+    regs.reserved = {};
+}
+
+void Chip::load_state(const MachineState& state) {
+    m_rng = state.regs.rng;
+    m_v = state.regs.v;
+    m_i = state.regs.i;
+    m_sp = state.regs.sp;
+    m_pc = state.regs.pc;
+    m_opc.packed = state.regs.opcode;
+    m_dtimer = state.regs.dtimer;
+    m_stimer = state.regs.stimer;
+    m_chipstate = static_cast<ChipState>(state.regs.chipstate);
+    m_key_state = static_cast<GKState>(state.regs.key_state);
+    m_rpl = state.regs.rpl;
+
+    m_bus.load_state(state);
+    m_ppu.load_state(state);
+}
+
 void Chip::not_implemented() const {
 #if(DEBUG)
     printf("Opcode 0x%04x is not implemented\n", m_opc.packed);
@@ -60,113 +375,131 @@ void Chip::fetch() {
     m_opc.kk = m_bus.read(m_pc++);
 }
 
+template <Op op, void (Chip::*handler)()>
+void Chip::dispatch() {
+#if(SCHIP_STATS)
+    uint64_t count = ++m_stats.counts[op];
+
+    if constexpr (OpStats::is_timed(op)) {
+        if (count % OpStats::sample_interval == 0) {
+            auto start = std::chrono::steady_clock::now();
+            (this->*handler)();
+            m_stats.record(op, std::chrono::steady_clock::now() - start);
+            return;
+        }
+    }
+#endif
+
+    (this->*handler)();
+}
+
 void Chip::decode() {
     switch (m_opc.o) {
 		case 0x0:
             if ((m_opc.packed & 0xfff0) == 0x00c0)
-                return op_scrd();
+                return dispatch<OP_SCRD, &Chip::op_scrd>();
 
             switch (m_opc.packed) {
 				case 0x00e0:
-                    return op_clr();
+                    return dispatch<OP_CLR, &Chip::op_clr>();
 				case 0x00ee:
-                    return op_ret();
+                    return dispatch<OP_RET, &Chip::op_ret>();
 				case 0x00fb:
-                    return op_scrr();
+                    return dispatch<OP_SCRR, &Chip::op_scrr>();
 				case 0x00fc:
-                    return op_scrl();
+                    return dispatch<OP_SCRL, &Chip::op_scrl>();
 				case 0x00fd:
-                    return op_exit();
+                    return dispatch<OP_EXIT, &Chip::op_exit>();
 				case 0x00fe:
-                    return op_dex();
+                    return dispatch<OP_DEX, &Chip::op_dex>();
 				case 0x00ff:
-                    return op_eex();
+                    return dispatch<OP_EEX, &Chip::op_eex>();
             }
 
             break;
 		case 0x1:
-            return op_jmp();
+            return dispatch<OP_JMP, &Chip::op_jmp>();
 		case 0x2:
-            return op_call();
+            return dispatch<OP_CALL, &Chip::op_call>();
 		case 0x3:
-            return op_seq_imm();
+            return dispatch<OP_SEQ_IMM, &Chip::op_seq_imm>();
 		case 0x4:
-            return op_sne_imm();
+            return dispatch<OP_SNE_IMM, &Chip::op_sne_imm>();
 		case 0x5:
             if (m_opc.n == 0) {
-                return op_seq();
+                return dispatch<OP_SEQ, &Chip::op_seq>();
 			}
 			break;
 		case 0x6:
-            return op_ld();
+            return dispatch<OP_LD, &Chip::op_ld>();
 		case 0x7:
-            return op_add_imm();
+            return dispatch<OP_ADD_IMM, &Chip::op_add_imm>();
 		case 0x8:
             switch (m_opc.n) {
 				case 0x0:
-                    return op_mov();
+                    return dispatch<OP_MOV, &Chip::op_mov>();
 				case 0x1:
-                    return op_or();
+                    return dispatch<OP_OR, &Chip::op_or>();
 				case 0x2:
-                    return op_and();
+                    return dispatch<OP_AND, &Chip::op_and>();
 				case 0x3:
-                    return op_xor();
+                    return dispatch<OP_XOR, &Chip::op_xor>();
 				case 0x4:
-                    return op_add();
+                    return dispatch<OP_ADD, &Chip::op_add>();
 				case 0x5:
-                    return op_sub();
+                    return dispatch<OP_SUB, &Chip::op_sub>();
 				case 0x6:
-                    return op_shr();
+                    return dispatch<OP_SHR, &Chip::op_shr>();
 				case 0x7:
-                    return op_sbr();
+                    return dispatch<OP_SBR, &Chip::op_sbr>();
 				case 0xe:
-                    return op_shl();
+                    return dispatch<OP_SHL, &Chip::op_shl>();
 			}
 			break;
 		case 0x9:
-            return op_sne();
+            return dispatch<OP_SNE, &Chip::op_sne>();
 		case 0xa:
-            return op_ldi();
+            return dispatch<OP_LDI, &Chip::op_ldi>();
 		case 0xb:
-            return op_jmpr();
+            return dispatch<OP_JMPR, &Chip::op_jmpr>();
 		case 0xc:
-            return op_rand();
+            return dispatch<OP_RAND, &Chip::op_rand>();
 		case 0xd:
-            return op_draw();
+            return dispatch<OP_DRAW, &Chip::op_draw>();
 		case 0xe:
             switch (m_opc.kk) {
 				case 0x9e:
-                    return op_skp();
+                    return dispatch<OP_SKP, &Chip::op_skp>();
 				case 0xa1:
-                    return op_sknp();
+                    return dispatch<OP_SKNP, &Chip::op_sknp>();
 			}
 			break;
 		case 0xf:
             switch (m_opc.kk) {
 				case 0x07:
-                    return op_get_delay();
+                    return dispatch<OP_GET_DELAY, &Chip::op_get_delay>();
 				case 0x0a:
-                    return op_get_key();
+                    return dispatch<OP_GET_KEY, &Chip::op_get_key>();
 				case 0x15:
-                    return op_set_delay();
+                    return dispatch<OP_SET_DELAY, &Chip::op_set_delay>();
 				case 0x18:
-                    return op_set_stimer();
+                    return dispatch<OP_SET_STIMER, &Chip::op_set_stimer>();
 				case 0x1e:
-                    return op_addi();
+                    return dispatch<OP_ADDI, &Chip::op_addi>();
 				case 0x29:
-                    return op_ld_sprite();
+                    return dispatch<OP_LD_SPRITE, &Chip::op_ld_sprite>();
 				case 0x30:
-                    return op_ld_esprite();
+                    return dispatch<OP_LD_ESPRITE, &Chip::op_ld_esprite>();
 				case 0x33:
-                    return op_set_bcd();
+                    return dispatch<OP_SET_BCD, &Chip::op_set_bcd>();
 				case 0x55:
-                    return op_reg_dump();
+                    return dispatch<OP_REG_DUMP, &Chip::op_reg_dump>();
 				case 0x65:
-                    return op_reg_store();
+                    return dispatch<OP_REG_STORE, &Chip::op_reg_store>();
 				case 0x75:
-                    return op_reg_dump_rpl();
+                    return dispatch<OP_REG_DUMP_RPL, &Chip::op_reg_dump_rpl>();
 				case 0x85:
-                    return op_reg_store_rpl();
+                    return dispatch<OP_REG_STORE_RPL, &Chip::op_reg_store_rpl>();
 			}
 			break;
 	}
@@ -174,18 +507,66 @@ void Chip::decode() {
     not_implemented();
 }
 
-void Chip::update_timers() {
-    auto duration = std::chrono::duration_cast<std::chrono::microseconds>(
-        std::chrono::high_resolution_clock::now() - m_lasttick
-    );
-
-    // The timers are decremented at a rate of 60Hz if possible.
-    if (duration >= std::chrono::microseconds(1'000'000 / 60)) {
-        if (m_dtimer > 0) --m_dtimer;
-        if (m_stimer > 0) --m_stimer;
+void Chip::decode_table() {
+    using Handler = void (Chip::*)();
+
+    // In the order of Op, with the invalid opcodes last
+    static constexpr std::array<Handler, OP_COUNT + 1> handlers = {
+        &Chip::dispatch<OP_SCRD, &Chip::op_scrd>,
+        &Chip::dispatch<OP_CLR, &Chip::op_clr>,
+        &Chip::dispatch<OP_RET, &Chip::op_ret>,
+        &Chip::dispatch<OP_SCRR, &Chip::op_scrr>,
+        &Chip::dispatch<OP_SCRL, &Chip::op_scrl>,
+        &Chip::dispatch<OP_EXIT, &Chip::op_exit>,
+        &Chip::dispatch<OP_DEX, &Chip::op_dex>,
+        &Chip::dispatch<OP_EEX, &Chip::op_eex>,
+        &Chip::dispatch<OP_JMP, &Chip::op_jmp>,
+        &Chip::dispatch<OP_CALL, &Chip::op_call>,
+        &Chip::dispatch<OP_SEQ_IMM, &Chip::op_seq_imm>,
+        &Chip::dispatch<OP_SNE_IMM, &Chip::op_sne_imm>,
+        &Chip::dispatch<OP_SEQ, &Chip::op_seq>,
+        &Chip::dispatch<OP_LD, &Chip::op_ld>,
+        &Chip::dispatch<OP_ADD_IMM, &Chip::op_add_imm>,
+        &Chip::dispatch<OP_MOV, &Chip::op_mov>,
+        &Chip::dispatch<OP_OR, &Chip::op_or>,
+        &Chip::dispatch<OP_AND, &Chip::op_and>,
+        &Chip::dispatch<OP_XOR, &Chip::op_xor>,
+        &Chip::dispatch<OP_ADD, &Chip::op_add>,
+        &Chip::dispatch<OP_SUB, &Chip::op_sub>,
+        &Chip::dispatch<OP_SHR, &Chip::op_shr>,
+        &Chip::dispatch<OP_SBR, &Chip::op_sbr>,
+        &Chip::dispatch<OP_SHL, &Chip::op_shl>,
+        &Chip::dispatch<OP_SNE, &Chip::op_sne>,
+        &Chip::dispatch<OP_LDI, &Chip::op_ldi>,
+        &Chip::dispatch<OP_JMPR, &Chip::op_jmpr>,
+        &Chip::dispatch<OP_RAND, &Chip::op_rand>,
+        &Chip::dispatch<OP_DRAW, &Chip::op_draw>,
+        &Chip::dispatch<OP_SKP, &Chip::op_skp>,
+        &Chip::dispatch<OP_SKNP, &Chip::op_sknp>,
+        &Chip::dispatch<OP_GET_DELAY, &Chip::op_get_delay>,
+        &Chip::dispatch<OP_GET_KEY, &Chip::op_get_key>,
+        &Chip::dispatch<OP_SET_DELAY, &Chip::op_set_delay>,
+        &Chip::dispatch<OP_SET_STIMER, &Chip::op_set_stimer>,
+        &Chip::dispatch<OP_ADDI, &Chip::op_addi>,
+        &Chip::dispatch<OP_LD_SPRITE, &Chip::op_ld_sprite>,
+        &Chip::dispatch<OP_LD_ESPRITE, &Chip::op_ld_esprite>,
+        &Chip::dispatch<OP_SET_BCD, &Chip::op_set_bcd>,
+        &Chip::dispatch<OP_REG_DUMP, &Chip::op_reg_dump>,
+        &Chip::dispatch<OP_REG_STORE, &Chip::op_reg_store>,
+        &Chip::dispatch<OP_REG_DUMP_RPL, &Chip::op_reg_dump_rpl>,
+        &Chip::dispatch<OP_REG_STORE_RPL, &Chip::op_reg_store_rpl>,
+        &Chip::op_invalid,
+    };
+
+    (this->*handlers[OPCODE_TABLE.ops[m_opc.packed]])();
+}
 
-        m_lasttick = std::chrono::high_resolution_clock::now();
-	}
+void Chip::update_timers() {
+    // The timers are decremented once per frame, i.e. at a rate of 60Hz.
+    // The buzzer sounds for as many frames as the sound timer was set to.
+    m_buzzing = m_stimer > 0;
+    if (m_dtimer > 0) --m_dtimer;
+    if (m_stimer > 0) --m_stimer;
 }
 
 void Chip::push(Addr address) {
@@ -197,7 +578,7 @@ void Chip::push(Addr address) {
 }
 
 Addr Chip::pop() {
-    if (m_sp < 0x0ea2)
+    if (m_sp < stack_base + 2)
 		throw std::underflow_error("The stack pointer has underflowed!");
 
     Addr popped = m_bus.read(--m_sp);
@@ -209,13 +590,13 @@ void Chip::pop(Reg& reg) { reg = pop(); }
 void Chip::op_scrd() {
 	// 0x00Cn
 	// Scrolls the display n pixels down
-    PPU::get_instance().scroll_down(m_v[m_opc.x]);
+    m_ppu.scroll_down(m_opc.n);
 }
 
 void Chip::op_clr() {
 	// 0x00E0
 	// Clears the display.
-    PPU::get_instance().clear_screen();
+    m_ppu.clear_screen();
 }
 
 void Chip::op_ret() {
@@ -227,44 +608,44 @@ void Chip::op_ret() {
 void Chip::op_scrr() {
 	// 0x00FB
 	// Scrolls screen 4 pixels right
-    PPU::get_instance().scroll_right();
+    m_ppu.scroll_right();
 }
 
 void Chip::op_scrl() {
 	// 0x00FC
 	// Scrolls screen 4 pixels left
-    PPU::get_instance().scroll_left();
+    m_ppu.scroll_left();
 }
 
 void Chip::op_exit() {
 	// 0x00FD
 	// Exits the interpreter
-    stop();
+    exit();
 }
 
 void Chip::op_dex() {
 	// 0x00FE
 	// Disables extended screen mode
-    PPU::get_instance().disable_extended();
+    m_ppu.disable_extended();
 }
 
 void Chip::op_eex() {
 	// 0x00FF
 	// Enables extended screen mode
-    PPU::get_instance().enable_extended();
+    m_ppu.enable_extended();
 }
 
 void Chip::op_jmp() {
 	// 0x1nnn
 	// Jumps to address nnn.
-    if (m_opc.nnn == m_pc - 2) stop(); // Infinite loop
+    if (m_opc.nnn == m_pc - 2) exit(); // Infinite loop
     m_pc = m_opc.nnn;
 }
 
 void Chip::op_call() {
 	// 0x2nnn
 	// Calls subroutine at address nnn.
-    if (m_opc.nnn == m_pc - 2) stop(); // Infinite loop
+    if (m_opc.nnn == m_pc - 2) exit(); // Infinite loop
     push(m_pc);
     m_pc = m_opc.nnn;
 }
@@ -388,37 +769,37 @@ void Chip::op_jmpr() {
     /* Quirks: CHIP48 and SCHIP interprets this instruction as 0xBxnn and
     jumps to the address xnn + Vx */
     Addr loc = m_v[m_opc.x] + m_opc.nnn;
-    if (loc == m_pc - 2) stop(); // Infinite loop
+    if (loc == m_pc - 2) exit(); // Infinite loop
     m_pc = loc;
 }
 
 void Chip::op_rand() {
 	// 0xCxnn
 	// Sets Vx to rand() & nn.
-	std::random_device dev;
-	std::mt19937 rng(dev());
-    std::uniform_int_distribution<std::mt19937::result_type> dist(0, 0xff);
+    // The generator state is kept in m_rng so that it can be saved and replayed.
+    std::minstd_rand rng(m_rng);
+    m_rng = rng();
 
-    m_v[m_opc.x] = dist(rng) & m_opc.kk;
+    m_v[m_opc.x] = (m_rng >> 8) & m_opc.kk;
 }
 
 void Chip::op_draw() {
 	// 0xDxyn
 	// Draws a sprite from memory address I to the screen.
     // Each bit are interpreted as a pixel. If a pixel is flipped from 1 to 0, VF is set.
-    m_v[0xf] = PPU::get_instance().draw_sprite_at(m_i, m_opc.n, m_v[m_opc.x], m_v[m_opc.y]) ? 1 : 0;
+    m_v[0xf] = m_ppu.draw_sprite_at(m_i, m_opc.n, m_v[m_opc.x], m_v[m_opc.y]) ? 1 : 0;
 }
 
 void Chip::op_skp() {
 	// 0xEx9E
     // Skips the next instruction if the key in Vx is pressed.
-    if (KeyPad::get_instance().is_pressed(m_v[m_opc.x])) m_pc += 2;
+    if (key_down(m_v[m_opc.x])) m_pc += 2;
 }
 
 void Chip::op_sknp() {
 	// 0xExA1
     // Skips the next instruction if the key in Vx is not pressed.
-    if (!KeyPad::get_instance().is_pressed(m_v[m_opc.x])) m_pc += 2;
+    if (!key_down(m_v[m_opc.x])) m_pc += 2;
 }
 
 void Chip::op_get_delay() {
@@ -430,7 +811,7 @@ void Chip::op_get_delay() {
 void Chip::op_get_key() {
 	// 0xFx0A
     // Await a keypress and store it into Vx. Blocking operation.
-    int k = KeyPad::get_instance().get_key();
+    int k = KeyPad::first_key(m_keys);
 
     switch (m_key_state) {
     case GK_NOTHING:
@@ -487,25 +868,25 @@ void Chip::op_set_bcd() {
 	// 0xFx33
 	// Stores the BCD representation of Vx into memory starting at
 	// address I.
-    m_bus.write(m_i, m_v[m_opc.x] / 100);
-    m_bus.write(m_i + 1, (m_v[m_opc.x] % 100) / 10);
-    m_bus.write(m_i + 2, m_v[m_opc.x] % 10);
+    GPReg value = m_v[m_opc.x];
+    std::array<Byte, 3> digits{static_cast<Byte>(value / 100), static_cast<Byte>(value / 10 % 10),
+                               static_cast<Byte>(value % 10)};
+    m_bus.write_span(m_i, digits);
 }
 
 void Chip::op_reg_dump() {
 	// 0xFx55
 	// Stores V0..Vx into memory starting at address I.
     // FIXME: quirks
-    for (int i = 0; i <= m_opc.x; i++)
-        m_bus.write(m_i + i, m_v[i]);
+    m_bus.write_span(m_i, std::span(m_v).first(m_opc.x + 1));
 }
 
 void Chip::op_reg_store() {
 	// 0xFx65
 	// Fills V0..Vx from memory starting at address I.
 	// TODO: quirks
-    for (int i = 0; i <= m_opc.x; i++)
-        m_v[i] = m_bus.read(m_i + i);
+    auto bytes = m_bus.read_span(m_i, m_opc.x + 1);
+    std::copy(bytes.begin(), bytes.end(), m_v.begin());
 }
 
 void Chip::op_reg_dump_rpl() {
@@ -527,3 +908,8 @@ void Chip::op_reg_store_rpl() {
     for (int i = 0; i <= m_opc.x; i++)
         m_v[i] = m_rpl[i];
 }
+
+void Chip::op_invalid() {
+    // Any opcode without a handler
+    not_implemented();
+}
@@ -0,0 +1,658 @@
+#include <algorithm>
+#include <cerrno>
+#include <condition_variable>
+#include <cstring>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#define SCHIP_HAS_SOCKETS 1
+#else
+#define SCHIP_HAS_SOCKETS 0
+#endif
+
+#include <schip/control.h>
+#include <schip/hash.h>
+#include <schip/machine.h>
+
+namespace {
+
+// Instance numbers are 16 bits, and 0 is never a machine
+constexpr size_t MAX_INSTANCES = 0x10000;
+
+// A connection is not read from while this much input waits for its batch to
+// finish, and no new batch is started while this much output is unsent
+constexpr size_t MAX_PENDING_INPUT = 1 << 20;
+constexpr size_t MAX_PENDING_OUTPUT = 1 << 20;
+
+constexpr size_t READ_CHUNK = 64 * 1024;
+
+#if SCHIP_HAS_SOCKETS && defined(MSG_NOSIGNAL)
+constexpr int SEND_FLAGS = MSG_NOSIGNAL;
+#else
+constexpr int SEND_FLAGS = 0;
+#endif
+
+template <typename T>
+T read_value(const uint8_t* data) {
+    T value;
+    std::memcpy(&value, data, sizeof(T));
+    return value;
+}
+
+template <typename T>
+void append(std::vector<uint8_t>& out, const T& value) {
+    auto bytes = reinterpret_cast<const uint8_t*>(&value);
+    out.insert(out.end(), bytes, bytes + sizeof(T));
+}
+
+// Finds the requests at the start of the input that have arrived completely,
+// and returns false if one is too large to find the request after it
+bool find_requests(const std::vector<uint8_t>& in, size_t& end, size_t& count) {
+    end = 0;
+    count = 0;
+
+    while (in.size() - end >= sizeof(ControlHeader)) {
+        auto header = read_value<ControlHeader>(&in[end]);
+        if (header.size > ControlServer::max_body)
+            return false;
+
+        if (in.size() - end - sizeof(ControlHeader) < header.size)
+            break;
+
+        end += sizeof(ControlHeader) + header.size;
+        count++;
+    }
+
+    return true;
+}
+
+#if SCHIP_HAS_SOCKETS
+
+void set_nonblocking(int fd) {
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+}
+
+void wake(int fd) {
+    char byte = 0;
+    [[maybe_unused]] auto written = write(fd, &byte, 1);
+}
+
+sockaddr_un socket_address(const std::filesystem::path& path) {
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+
+    std::string name = path.string();
+    if (name.empty() || name.size() >= sizeof(address.sun_path))
+        throw std::runtime_error("The socket path " + name + " is empty or too long");
+
+    std::memcpy(address.sun_path, name.c_str(), name.size() + 1);
+    return address;
+}
+
+#endif
+
+}
+
+struct ControlServer::Instance {
+    Machine machine;
+    uint16_t keys{0};
+
+    Instance() { machine.chip.seed(0); }
+};
+
+struct ControlServer::Reply {
+    ControlHeader header{};
+    std::vector<uint8_t> body;
+};
+
+struct ControlServer::Batch {
+    // The requests as they arrived, which the jobs point into
+    std::vector<uint8_t> requests;
+    std::vector<Reply> replies;
+
+    // The jobs that have not run yet
+    std::atomic<size_t> remaining{0};
+};
+
+struct ControlServer::Job {
+    std::shared_ptr<Batch> batch;
+    size_t reply;
+    const uint8_t* body;
+    uint32_t size;
+};
+
+struct ControlServer::Worker {
+    std::mutex mutex;
+    std::condition_variable ready;
+    std::vector<Job> jobs;
+    bool closed{false};
+    std::thread thread;
+};
+
+struct ControlServer::Connection {
+    int fd{-1};
+    std::vector<uint8_t> in;
+    std::vector<uint8_t> out;
+    size_t sent{0};
+
+    // The batch the workers are running, until its replies are written
+    std::shared_ptr<Batch> batch;
+
+    // The client has shut down its side and sends no more requests, but the
+    // ones it sent are still answered
+    bool eof{false};
+
+    bool closed{false};
+};
+
+ControlServer::ControlServer(std::filesystem::path socket, unsigned threads)
+    : m_path(std::move(socket))
+{
+#if SCHIP_HAS_SOCKETS
+    sockaddr_un address = socket_address(m_path);
+
+    m_listener = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (m_listener < 0)
+        throw std::runtime_error("Cannot create a socket");
+
+    // Start over, so that the socket of a server that was killed does not get in the way
+    unlink(m_path.c_str());
+
+    if (bind(m_listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0
+        || listen(m_listener, SOMAXCONN) != 0 || pipe(m_wake) != 0) {
+        close(m_listener);
+        unlink(m_path.c_str());
+        throw std::runtime_error("Cannot listen on " + m_path.string());
+    }
+
+    set_nonblocking(m_listener);
+    set_nonblocking(m_wake[0]);
+    set_nonblocking(m_wake[1]);
+
+    m_instances.resize(MAX_INSTANCES);
+    m_taken.resize(MAX_INSTANCES);
+
+    for (unsigned t = 0; t < std::max(1u, threads); t++) {
+        auto& worker = m_workers.emplace_back(std::make_unique<Worker>());
+        worker->thread = std::thread(&ControlServer::work, this, std::ref(*worker));
+    }
+#else
+    throw std::runtime_error("Control sockets are not supported on this platform");
+#endif
+}
+
+ControlServer::~ControlServer() {
+#if SCHIP_HAS_SOCKETS
+    for (auto& worker : m_workers) {
+        {
+            std::lock_guard lock{worker->mutex};
+            worker->closed = true;
+        }
+        worker->ready.notify_one();
+        worker->thread.join();
+    }
+
+    for (auto& connection : m_connections)
+        close(connection->fd);
+
+    close(m_listener);
+    close(m_wake[0]);
+    close(m_wake[1]);
+    unlink(m_path.c_str());
+#endif
+}
+
+void ControlServer::stop() {
+#if SCHIP_HAS_SOCKETS
+    m_stopping.store(true);
+    wake(m_wake[1]);
+#endif
+}
+
+void ControlServer::run() {
+#if SCHIP_HAS_SOCKETS
+    std::vector<pollfd> fds;
+
+    while (!m_stopping.load()) {
+        fds.clear();
+        fds.push_back({m_listener, POLLIN, 0});
+        fds.push_back({m_wake[0], POLLIN, 0});
+
+        // A closed connection is left out, so that its hangup does not wake
+        // poll() again and again while its batch finishes
+        for (auto& connection : m_connections) {
+            short events = 0;
+            if (!connection->eof && connection->in.size() < MAX_PENDING_INPUT)
+                events |= POLLIN;
+            if (connection->sent < connection->out.size())
+                events |= POLLOUT;
+            fds.push_back({connection->closed ? -1 : connection->fd, events, 0});
+        }
+
+        if (poll(fds.data(), fds.size(), -1) < 0) {
+            if (errno == EINTR)
+                continue;
+            throw std::runtime_error("Cannot wait for the control socket");
+        }
+
+        if (fds[1].revents & POLLIN) {
+            char bytes[64];
+            while (read(m_wake[0], bytes, sizeof(bytes)) > 0) {}
+        }
+
+        // Connections accepted now are only looked at in the next round
+        size_t polled = m_connections.size();
+        if (fds[0].revents & POLLIN)
+            accept_connections();
+
+        for (size_t n = 0; n < polled; n++) {
+            Connection& connection = *m_connections[n];
+
+            short revents = fds[n + 2].revents;
+
+            if (!connection.eof && (revents & (POLLIN | POLLHUP | POLLERR)) && !read_requests(connection))
+                connection.closed = true;
+            else if (connection.eof && (revents & (POLLHUP | POLLERR)))
+                connection.closed = true; // Nobody is left to read the replies
+
+            if (connection.batch && connection.batch->remaining.load(std::memory_order_acquire) == 0)
+                finish_batch(connection);
+
+            if (!connection.batch && !connection.closed)
+                start_batch(connection);
+
+            if (!connection.closed && !write_replies(connection))
+                connection.closed = true;
+
+            // After the client has sent everything, the connection is done once
+            // the last request it sent has been answered
+            size_t end, count;
+            if (connection.eof && !connection.batch && connection.sent == connection.out.size()
+                && (!find_requests(connection.in, end, count) || count == 0))
+                connection.closed = true;
+        }
+
+        // A closed connection goes once the workers are done with its batch
+        std::erase_if(m_connections, [](const std::unique_ptr<Connection>& connection) {
+            if (!connection->closed || connection->batch)
+                return false;
+
+            close(connection->fd);
+            return true;
+        });
+    }
+#endif
+}
+
+uint16_t ControlServer::take_instance() {
+    for (size_t tries = 0; tries < MAX_INSTANCES; tries++) {
+        uint16_t instance = m_next_instance++;
+        if (instance != 0 && !m_taken[instance]) {
+            m_taken[instance] = true;
+            return instance;
+        }
+    }
+
+    return 0;
+}
+
+void ControlServer::accept_connections() {
+#if SCHIP_HAS_SOCKETS
+    for (;;) {
+        int fd = accept(m_listener, nullptr, nullptr);
+        if (fd < 0)
+            return;
+
+        set_nonblocking(fd);
+        auto& connection = m_connections.emplace_back(std::make_unique<Connection>());
+        connection->fd = fd;
+    }
+#endif
+}
+
+bool ControlServer::read_requests(Connection& connection) {
+#if SCHIP_HAS_SOCKETS
+    while (connection.in.size() < MAX_PENDING_INPUT) {
+        size_t size = connection.in.size();
+        connection.in.resize(size + READ_CHUNK);
+
+        ssize_t received = recv(connection.fd, connection.in.data() + size, READ_CHUNK, 0);
+        connection.in.resize(size + std::max<ssize_t>(received, 0));
+
+        if (received > 0)
+            continue;
+        if (received < 0 && errno == EINTR)
+            continue;
+
+        if (received == 0) {
+            connection.eof = true;
+            return true;
+        }
+
+        return errno == EAGAIN || errno == EWOULDBLOCK;
+    }
+#endif
+    return true;
+}
+
+void ControlServer::start_batch(Connection& connection) {
+    // Leave the requests where they are while the client does not read its responses
+    if (connection.out.size() - connection.sent > MAX_PENDING_OUTPUT)
+        return;
+
+    size_t end, count;
+    if (!find_requests(connection.in, end, count)) {
+        connection.closed = true;
+        return;
+    }
+
+    if (count == 0)
+        return;
+
+    auto batch = std::make_shared<Batch>();
+    batch->requests.assign(connection.in.begin(), connection.in.begin() + end);
+    batch->replies.resize(count);
+    connection.in.erase(connection.in.begin(), connection.in.begin() + end);
+
+    std::vector<std::vector<Job>> jobs(m_workers.size());
+    size_t queued = 0;
+
+    for (size_t n = 0, pos = 0; n < count; n++) {
+        auto header = read_value<ControlHeader>(&batch->requests[pos]);
+        const uint8_t* body = &batch->requests[pos + sizeof(ControlHeader)];
+        pos += sizeof(ControlHeader) + header.size;
+
+        Reply& reply = batch->replies[n];
+        reply.header = {0, header.tag, header.instance, header.command, CONTROL_OK};
+
+        // Instance numbers are handed out and taken back here, in the order of
+        // the requests, so that the workers never have to agree on them
+        if (header.command == CONTROL_CREATE) {
+            reply.header.instance = take_instance();
+            if (reply.header.instance == 0) {
+                reply.header.status = CONTROL_FULL;
+                continue;
+            }
+        } else if (header.command < CONTROL_CREATE || header.command > CONTROL_FRAME_HASH) {
+            reply.header.status = CONTROL_UNKNOWN_COMMAND;
+            continue;
+        } else if (header.instance == 0 || !m_taken[header.instance]) {
+            reply.header.status = CONTROL_NO_INSTANCE;
+            continue;
+        } else if (header.command == CONTROL_DESTROY) {
+            m_taken[header.instance] = false;
+        }
+
+        jobs[reply.header.instance % m_workers.size()].push_back({batch, n, body, header.size});
+        queued++;
+    }
+
+    batch->remaining.store(queued, std::memory_order_relaxed);
+    connection.batch = batch;
+    m_batches++;
+
+    for (size_t w = 0; w < m_workers.size(); w++) {
+        if (jobs[w].empty())
+            continue;
+
+        Worker& worker = *m_workers[w];
+        {
+            std::lock_guard lock{worker.mutex};
+            worker.jobs.insert(worker.jobs.end(), std::make_move_iterator(jobs[w].begin()),
+                               std::make_move_iterator(jobs[w].end()));
+        }
+        worker.ready.notify_one();
+    }
+
+    if (queued == 0)
+        finish_batch(connection);
+}
+
+void ControlServer::finish_batch(Connection& connection) {
+    if (connection.sent == connection.out.size()) {
+        connection.out.clear();
+        connection.sent = 0;
+    }
+
+    for (Reply& reply : connection.batch->replies) {
+        reply.header.size = static_cast<uint32_t>(reply.body.size());
+        append(connection.out, reply.header);
+        connection.out.insert(connection.out.end(), reply.body.begin(), reply.body.end());
+    }
+
+    m_requests += connection.batch->replies.size();
+    connection.batch.reset();
+}
+
+bool ControlServer::write_replies(Connection& connection) {
+#if SCHIP_HAS_SOCKETS
+    while (connection.sent < connection.out.size()) {
+        ssize_t sent = send(connection.fd, connection.out.data() + connection.sent,
+                            connection.out.size() - connection.sent, SEND_FLAGS);
+
+        if (sent > 0) {
+            connection.sent += sent;
+        } else if (sent < 0 && errno == EINTR) {
+            continue;
+        } else {
+            return sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK);
+        }
+    }
+
+    connection.out.clear();
+    connection.sent = 0;
+#endif
+    return true;
+}
+
+void ControlServer::work(Worker& worker) {
+    std::vector<Job> jobs;
+
+    for (;;) {
+        {
+            std::unique_lock lock{worker.mutex};
+            worker.ready.wait(lock, [&]() { return worker.closed || !worker.jobs.empty(); });
+
+            if (worker.jobs.empty())
+                return;
+
+            jobs.swap(worker.jobs);
+        }
+
+        for (const Job& job : jobs) {
+            execute(job);
+
+            if (job.batch->remaining.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+#if SCHIP_HAS_SOCKETS
+                wake(m_wake[1]);
+#endif
+            }
+        }
+
+        jobs.clear();
+    }
+}
+
+void ControlServer::execute(const Job& job) {
+    Reply& reply = job.batch->replies[job.reply];
+    std::unique_ptr<Instance>& instance = m_instances[reply.header.instance];
+
+    auto expect_size = [&](uint32_t size) {
+        if (job.size == size)
+            return true;
+
+        reply.header.status = CONTROL_BAD_REQUEST;
+        return false;
+    };
+
+    switch (reply.header.command) {
+    case CONTROL_CREATE:
+        instance = std::make_unique<Instance>();
+        return;
+
+    case CONTROL_DESTROY:
+        instance.reset();
+        return;
+
+    case CONTROL_LOAD:
+        if (job.size == 0 || job.size > USERCODE_SIZE) {
+            reply.header.status = CONTROL_BAD_REQUEST;
+            return;
+        }
+
+        instance = std::make_unique<Instance>();
+        instance->machine.bus.load_program(std::span<const Byte>(job.body, job.size));
+        return;
+
+    case CONTROL_SET_KEYS:
+        if (expect_size(sizeof(uint16_t)))
+            instance->keys = read_value<uint16_t>(job.body);
+        return;
+
+    case CONTROL_STEP:
+        if (!expect_size(sizeof(uint32_t)))
+            return;
+
+        try {
+            Chip& chip = instance->machine.chip;
+            for (uint32_t frames = read_value<uint32_t>(job.body); frames > 0 && !chip.has_exited(); frames--)
+                chip.run_frame(instance->keys);
+        } catch (std::exception& err) {
+            std::string_view error{err.what()};
+            reply.header.status = CONTROL_FAULT;
+            reply.body.assign(error.begin(), error.end());
+            return;
+        }
+
+        append(reply.body, instance->machine.chip.frame());
+        return;
+
+    case CONTROL_REGISTERS: {
+        if (!expect_size(0))
+            return;
+
+        RegisterState regs;
+        instance->machine.chip.save_registers(regs);
+        append(reply.body, regs);
+        return;
+    }
+
+    case CONTROL_READ_MEMORY: {
+        if (!expect_size(2 * sizeof(uint16_t)))
+            return;
+
+        Addr address = read_value<uint16_t>(job.body);
+        size_t length = read_value<uint16_t>(job.body + sizeof(uint16_t));
+
+        try {
+            std::span<const Byte> bytes = instance->machine.bus.read_span(address, length);
+            reply.body.assign(bytes.begin(), bytes.end());
+        } catch (std::out_of_range&) {
+            reply.header.status = CONTROL_BAD_REQUEST;
+        }
+        return;
+    }
+
+    case CONTROL_FRAME_HASH: {
+        if (!expect_size(0))
+            return;
+
+        const PPU& ppu = instance->machine.ppu;
+        append(reply.body, hash_block(ppu.pixels().data(), ppu.pixels().size()));
+        append(reply.body, static_cast<uint8_t>(ppu.is_extended()));
+        return;
+    }
+    }
+}
+
+ControlClient::ControlClient(const std::filesystem::path& socket) {
+#if SCHIP_HAS_SOCKETS
+    sockaddr_un address = socket_address(socket);
+
+    m_socket = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (m_socket < 0)
+        throw std::runtime_error("Cannot create a socket");
+
+    if (connect(m_socket, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+        close(m_socket);
+        throw std::runtime_error("Cannot connect to " + socket.string());
+    }
+#else
+    throw std::runtime_error("Control sockets are not supported on this platform");
+#endif
+}
+
+ControlClient::~ControlClient() {
+#if SCHIP_HAS_SOCKETS
+    close(m_socket);
+#endif
+}
+
+uint32_t ControlClient::queue(uint16_t instance, ControlCommand command, std::span<const uint8_t> body) {
+    uint32_t tag = m_next_tag++;
+    append(m_out, ControlHeader{static_cast<uint32_t>(body.size()), tag, instance, command, 0});
+    m_out.insert(m_out.end(), body.begin(), body.end());
+    return tag;
+}
+
+void ControlClient::flush() {
+#if SCHIP_HAS_SOCKETS
+    for (size_t pos = 0; pos < m_out.size();) {
+        ssize_t sent = send(m_socket, m_out.data() + pos, m_out.size() - pos, SEND_FLAGS);
+
+        if (sent > 0)
+            pos += sent;
+        else if (sent < 0 && errno == EINTR)
+            continue;
+        else
+            throw std::runtime_error("The control connection was lost");
+    }
+#endif
+    m_out.clear();
+}
+
+void ControlClient::finish() {
+    flush();
+
+#if SCHIP_HAS_SOCKETS
+    if (shutdown(m_socket, SHUT_WR) != 0)
+        throw std::runtime_error("The control connection was lost");
+#endif
+}
+
+void ControlClient::receive(ControlResponse& response) {
+#if SCHIP_HAS_SOCKETS
+    auto read_exact = [&](void* data, size_t size) {
+        for (size_t pos = 0; pos < size;) {
+            ssize_t received = recv(m_socket, static_cast<char*>(data) + pos, size - pos, 0);
+
+            if (received > 0)
+                pos += received;
+            else if (received < 0 && errno == EINTR)
+                continue;
+            else
+                throw std::runtime_error("The control connection was lost");
+        }
+    };
+
+    read_exact(&response.header, sizeof(response.header));
+    response.body.resize(response.header.size);
+    read_exact(response.body.data(), response.body.size());
+#endif
+}
+
+ControlResponse ControlClient::call(uint16_t instance, ControlCommand command, std::span<const uint8_t> body) {
+    queue(instance, command, body);
+    flush();
+
+    ControlResponse response;
+    receive(response);
+    return response;
+}
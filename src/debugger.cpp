@@ -0,0 +1,547 @@
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+
+#include <schip/debugger.h>
+#include <schip/chip.h>
+#include <schip/opcodes.h>
+
+namespace {
+
+constexpr std::string_view HELP =
+    "break <addr> [if <cond>]  Stop before the instruction at an address, e.g. break 2a4 if v3 == 5\n"
+    "break if <cond>           Stop before any instruction once a condition holds\n"
+    "watch <addr>[-<last>|+<n>] Stop before an instruction writes to memory, rwatch for reads, awatch for both\n"
+    "delete [<id>]             Delete a breakpoint or watchpoint, or all of them\n"
+    "info                      List the breakpoints and watchpoints\n"
+    "continue, c               Go on running\n"
+    "step, s [<n>]             Run one or n instructions\n"
+    "pause                     Stop before the next instruction\n"
+    "regs, r                   Show the registers and the stack\n"
+    "x <addr> [<n>]            Show n bytes of memory\n"
+    "dis [<addr>] [<n>]        Disassemble n instructions\n"
+    "trace [<n>]               Show the last n instructions that ran\n"
+    "detach                    Delete everything and go on running without stopping again\n"
+    "quit, q                   Stop the chip\n"
+    "Addresses are hexadecimal. Conditions compare v0-vf, i, sp, dt or st with ==, !=, <, <=, > or >=.\n";
+
+std::vector<std::string_view> split(std::string_view line) {
+    std::vector<std::string_view> words;
+
+    for (size_t pos = 0; pos < line.size();) {
+        size_t start = line.find_first_not_of(" \t\r", pos);
+        if (start == std::string_view::npos)
+            break;
+
+        size_t end = std::min(line.find_first_of(" \t\r", start), line.size());
+        words.push_back(line.substr(start, end - start));
+        pos = end;
+    }
+
+    return words;
+}
+
+unsigned long parse_number(std::string_view text, int base, unsigned long limit) {
+    if (base == 16 && (text.starts_with("0x") || text.starts_with("0X")))
+        text.remove_prefix(2);
+    else if (base == 0 && (text.starts_with("0x") || text.starts_with("0X")))
+        text.remove_prefix(2), base = 16;
+    else if (base == 0)
+        base = 10;
+
+    unsigned long value = 0;
+    auto [end, error] = std::from_chars(text.data(), text.data() + text.size(), value, base);
+    if (text.empty() || error != std::errc{} || end != text.data() + text.size() || value > limit)
+        throw std::invalid_argument("Not a valid number: " + std::string(text));
+
+    return value;
+}
+
+Addr parse_address(std::string_view text) {
+    return static_cast<Addr>(parse_number(text, 16, 0xfff));
+}
+
+DebugCondition parse_condition(const std::vector<std::string_view>& words, size_t first) {
+    if (words.size() != first + 3)
+        throw std::invalid_argument("A condition is <register> <comparison> <value>");
+
+    DebugCondition condition;
+    std::string_view reg = words[first];
+
+    if (reg.size() == 2 && (reg[0] == 'v' || reg[0] == 'V'))
+        condition.reg = static_cast<DebugCondition::Register>(parse_number(reg.substr(1), 16, 0xf));
+    else if (reg == "i")
+        condition.reg = DebugCondition::REG_I;
+    else if (reg == "sp")
+        condition.reg = DebugCondition::REG_SP;
+    else if (reg == "dt")
+        condition.reg = DebugCondition::REG_DT;
+    else if (reg == "st")
+        condition.reg = DebugCondition::REG_ST;
+    else
+        throw std::invalid_argument("Unknown register " + std::string(reg));
+
+    constexpr std::array<std::string_view, 6> COMPARISONS = {"==", "!=", "<", "<=", ">", ">="};
+    auto it = std::find(COMPARISONS.begin(), COMPARISONS.end(), words[first + 1]);
+    if (it == COMPARISONS.end())
+        throw std::invalid_argument("Unknown comparison " + std::string(words[first + 1]));
+
+    condition.compare = static_cast<DebugCondition::Compare>(it - COMPARISONS.begin());
+    condition.value = static_cast<uint16_t>(parse_number(words[first + 2], 0, 0xffff));
+    return condition;
+}
+
+std::string describe(const DebugCondition& condition) {
+    constexpr std::array<std::string_view, 6> COMPARISONS = {"==", "!=", "<", "<=", ">", ">="};
+    constexpr std::array<std::string_view, 4> NAMES = {"i", "sp", "dt", "st"};
+
+    std::ostringstream text;
+    if (condition.reg < DebugCondition::REG_I)
+        text << 'v' << std::hex << static_cast<unsigned>(condition.reg);
+    else
+        text << NAMES[condition.reg - DebugCondition::REG_I];
+
+    text << ' ' << COMPARISONS[condition.compare] << " 0x" << std::hex << condition.value;
+    return text.str();
+}
+
+// Formats a number as zero padded hexadecimal
+std::string hex(unsigned value, int width) {
+    std::ostringstream text;
+    text << std::hex << std::setw(width) << std::setfill('0') << value;
+    return text.str();
+}
+
+}
+
+bool DebugCondition::holds(const RegisterState& regs) const {
+    uint16_t actual;
+    switch (reg) {
+        case REG_I:  actual = regs.i; break;
+        case REG_SP: actual = regs.sp; break;
+        case REG_DT: actual = regs.dtimer; break;
+        case REG_ST: actual = regs.stimer; break;
+        default:     actual = regs.v[reg & 0xf]; break;
+    }
+
+    switch (compare) {
+        case CMP_EQ: return actual == value;
+        case CMP_NE: return actual != value;
+        case CMP_LT: return actual < value;
+        case CMP_LE: return actual <= value;
+        case CMP_GT: return actual > value;
+        case CMP_GE: return actual >= value;
+    }
+
+    return false;
+}
+
+Debugger::Debugger(Chip& chip, const Bus& bus, std::ostream& out) : m_chip(chip), m_bus(bus), m_out(out) {}
+
+Debugger::~Debugger() {
+    shutdown();
+}
+
+void Debugger::start_console(std::istream& in) {
+    // Reading blocks until a line is typed, so the thread is not joined but
+    // only holds on to the queue
+    std::thread([queue = m_queue, &in]() {
+        for (std::string line; std::getline(in, line);) {
+            if (line == "pause") {
+                queue->interrupt.store(true);
+                continue;
+            }
+
+            std::lock_guard lock{queue->mutex};
+            queue->commands.push_back(std::move(line));
+            queue->ready.notify_one();
+        }
+
+        std::lock_guard lock{queue->mutex};
+        queue->commands.push_back("detach");
+        queue->closed = true;
+        queue->ready.notify_one();
+    }).detach();
+}
+
+void Debugger::post(std::string command) {
+    std::lock_guard lock{m_queue->mutex};
+    m_queue->commands.push_back(std::move(command));
+    m_queue->ready.notify_one();
+}
+
+void Debugger::shutdown() {
+    std::lock_guard lock{m_queue->mutex};
+    m_shutdown.store(true);
+    m_queue->ready.notify_all();
+}
+
+void Debugger::check(Addr pc, bool fetching) {
+    if (m_shutdown.load())
+        return;
+
+    pc &= 0xfff;
+    std::string reason;
+
+    if (m_queue->interrupt.exchange(false)) {
+        reason = "Paused";
+    } else if (m_steps > 0 && --m_steps == 0) {
+        reason = "Stepped";
+    } else if (fetching) {
+        // The registers are only needed for conditions and watchpoints
+        RegisterState regs;
+        bool saved = false;
+        auto registers = [&]() -> const RegisterState& {
+            if (!saved)
+                m_chip.save_registers(regs);
+            saved = true;
+            return regs;
+        };
+
+        for (const Breakpoint& breakpoint : m_breakpoint_list) {
+            if ((breakpoint.address && *breakpoint.address != pc)
+                || (breakpoint.condition && !breakpoint.condition->holds(registers())))
+                continue;
+
+            reason = "Breakpoint " + std::to_string(breakpoint.id) + " at 0x" + hex(pc, 3);
+            break;
+        }
+
+        if (reason.empty() && !m_watchpoint_list.empty())
+            touches_watch(pc, registers(), reason);
+    }
+
+    if (!reason.empty())
+        stop(reason, pc);
+}
+
+bool Debugger::touches_watch(Addr pc, const RegisterState& regs, std::string& what) const {
+    auto opcode = static_cast<uint16_t>(m_bus.read(pc) << 8 | m_bus.read((pc + 1) & 0xfff));
+    unsigned x = (opcode >> 8) & 0xf;
+
+    // The same accesses as the handlers make, as long as they do not fault
+    Addr first = regs.i;
+    unsigned count = 0;
+    uint8_t access = WATCH_READ;
+
+    switch (classify(opcode)) {
+        case OP_CALL:
+            first = regs.sp;
+            count = regs.sp <= 0xffe ? 2 : 0;
+            access = WATCH_WRITE;
+            break;
+        case OP_RET:
+            first = regs.sp - 2;
+            count = regs.sp >= Chip::stack_base + 2 ? 2 : 0;
+            break;
+        case OP_DRAW:
+            count = opcode & 0xf;
+            if (count == 0 && regs.extended)
+                count = 32;
+            break;
+        case OP_SET_BCD:
+            count = 3;
+            access = WATCH_WRITE;
+            break;
+        case OP_REG_DUMP:
+            count = x + 1;
+            access = WATCH_WRITE;
+            break;
+        case OP_REG_STORE:
+            count = x + 1;
+            break;
+        default:
+            return false;
+    }
+
+    const auto& watched = access == WATCH_WRITE ? m_watch_write : m_watch_read;
+
+    for (unsigned n = 0; n < count; n++) {
+        Addr address = first + n;
+        if (address >= USERCODE_END || !watched.test(address))
+            continue;
+
+        auto it = std::find_if(m_watchpoint_list.begin(), m_watchpoint_list.end(), [&](const Watchpoint& watch) {
+            return (watch.access & access) && watch.first <= address && address <= watch.last;
+        });
+
+        what = "Watchpoint " + std::to_string(it->id) + ": the instruction at 0x" + hex(pc, 3)
+            + (access == WATCH_WRITE ? " writes 0x" : " reads 0x") + hex(first, 3);
+        if (count > 1)
+            what += "..0x" + hex(first + count - 1, 3);
+        return true;
+    }
+
+    return false;
+}
+
+void Debugger::fault(Addr pc, std::string_view error) {
+    if (!m_shutdown.load())
+        stop("Fault: " + std::string(error), pc & 0xfff);
+}
+
+void Debugger::stop(std::string_view reason, Addr pc) {
+    m_steps = 0;
+
+    m_out << reason << std::endl;
+    print_disassembly(pc, 1);
+
+    std::unique_lock lock{m_queue->mutex};
+    m_stopped.store(true);
+
+    while (!m_shutdown.load()) {
+        m_queue->ready.wait(lock, [this]() {
+            return !m_queue->commands.empty() || m_queue->closed || m_shutdown.load();
+        });
+
+        // Nothing will come from a closed console any more
+        if (m_queue->commands.empty())
+            break;
+
+        std::string command = std::move(m_queue->commands.front());
+        m_queue->commands.pop_front();
+
+        lock.unlock();
+        bool resume = execute(command);
+        lock.lock();
+
+        if (resume)
+            break;
+    }
+
+    m_stopped.store(false);
+}
+
+bool Debugger::execute(std::string_view line) {
+    std::vector<std::string_view> words = split(line);
+    if (words.empty())
+        return false;
+
+    std::string_view command = words[0];
+    bool resume = false;
+
+    try {
+        if (command == "break" || command == "b") {
+            if (words.size() < 2)
+                throw std::invalid_argument("break needs an address or a condition");
+
+            Breakpoint breakpoint{};
+            breakpoint.id = m_next_id;
+            size_t next = 1;
+            if (words[1] != "if")
+                breakpoint.address = parse_address(words[next++]);
+
+            if (next < words.size()) {
+                if (words[next] != "if")
+                    throw std::invalid_argument("Expected if and a condition after the address");
+                breakpoint.condition = parse_condition(words, next + 1);
+            }
+
+            m_next_id++;
+            m_breakpoint_list.push_back(breakpoint);
+            m_out << "Breakpoint " << breakpoint.id;
+            if (breakpoint.address)
+                m_out << " at 0x" << hex(*breakpoint.address, 3);
+            if (breakpoint.condition)
+                m_out << " if " << describe(*breakpoint.condition);
+            m_out << std::endl;
+        } else if (command == "watch" || command == "rwatch" || command == "awatch") {
+            if (words.size() != 2)
+                throw std::invalid_argument(std::string(command) + " needs an address or a range");
+
+            std::string_view range = words[1];
+            size_t split_at = range.find_first_of("-+");
+            Addr first = parse_address(range.substr(0, split_at));
+            Addr last = first;
+
+            if (split_at != std::string_view::npos) {
+                if (range[split_at] == '-')
+                    last = parse_address(range.substr(split_at + 1));
+                else
+                    last = first + parse_number(range.substr(split_at + 1), 0, 0x1000) - 1;
+            }
+
+            if (first < USERCODE_BEG || last < first || last >= USERCODE_END)
+                throw std::invalid_argument("Only the range 0x200..0xfff can be watched");
+
+            uint8_t access = command == "watch" ? WATCH_WRITE : command == "rwatch" ? WATCH_READ
+                                                                                    : WATCH_READ | WATCH_WRITE;
+            m_watchpoint_list.push_back({m_next_id++, first, last, access});
+            m_out << "Watchpoint " << m_watchpoint_list.back().id << " on 0x" << hex(first, 3) << "..0x"
+                  << hex(last, 3) << std::endl;
+        } else if (command == "delete" || command == "d") {
+            if (words.size() == 1) {
+                m_breakpoint_list.clear();
+                m_watchpoint_list.clear();
+            } else {
+                unsigned id = parse_number(words[1], 10, UINT32_MAX);
+                size_t before = m_breakpoint_list.size() + m_watchpoint_list.size();
+                std::erase_if(m_breakpoint_list, [id](const Breakpoint& point) { return point.id == id; });
+                std::erase_if(m_watchpoint_list, [id](const Watchpoint& point) { return point.id == id; });
+
+                if (before == m_breakpoint_list.size() + m_watchpoint_list.size())
+                    throw std::invalid_argument("There is no breakpoint or watchpoint " + std::to_string(id));
+            }
+        } else if (command == "info") {
+            print_points();
+        } else if (command == "continue" || command == "c") {
+            resume = true;
+        } else if (command == "step" || command == "s") {
+            m_steps = words.size() > 1 ? parse_number(words[1], 0, UINT32_MAX) : 1;
+            resume = m_steps > 0;
+        } else if (command == "pause") {
+            // The chip is already stopped
+        } else if (command == "regs" || command == "r") {
+            print_registers();
+        } else if (command == "x") {
+            if (words.size() < 2)
+                throw std::invalid_argument("x needs an address");
+            print_memory(parse_address(words[1]), words.size() > 2 ? parse_number(words[2], 0, 0x1000) : 16);
+        } else if (command == "dis") {
+            RegisterState regs;
+            m_chip.save_registers(regs);
+            Addr address = words.size() > 1 ? parse_address(words[1]) : regs.pc & 0xfff;
+            print_disassembly(address, words.size() > 2 ? parse_number(words[2], 0, 0x800) : 8);
+        } else if (command == "trace") {
+            print_trace(words.size() > 1 ? parse_number(words[1], 0, TraceRing::capacity) : 16);
+        } else if (command == "detach") {
+            detach();
+            resume = true;
+        } else if (command == "quit" || command == "q") {
+            m_quit = true;
+            m_chip.stop();
+            detach();
+            resume = true;
+        } else if (command == "help" || command == "h") {
+            m_out << HELP;
+        } else {
+            throw std::invalid_argument("Unknown command " + std::string(command) + ", try help");
+        }
+    } catch (std::exception& err) {
+        m_out << "Error: " << err.what() << std::endl;
+    }
+
+    update();
+    return resume;
+}
+
+void Debugger::detach() {
+    m_breakpoint_list.clear();
+    m_watchpoint_list.clear();
+    m_steps = 0;
+}
+
+void Debugger::update() {
+    m_breakpoints.reset();
+    m_watch_read.reset();
+    m_watch_write.reset();
+    bool anywhere = false;
+
+    for (const Breakpoint& breakpoint : m_breakpoint_list) {
+        if (breakpoint.address)
+            m_breakpoints.set(*breakpoint.address);
+        else
+            anywhere = true;
+    }
+
+    for (const Watchpoint& watch : m_watchpoint_list) {
+        for (unsigned address = watch.first; address <= watch.last; address++) {
+            if (watch.access & WATCH_READ)
+                m_watch_read.set(address);
+            if (watch.access & WATCH_WRITE)
+                m_watch_write.set(address);
+        }
+    }
+
+    m_check_all = m_steps > 0 || anywhere || !m_watchpoint_list.empty();
+}
+
+void Debugger::print_registers() {
+    RegisterState regs;
+    m_chip.save_registers(regs);
+
+    for (unsigned row = 0; row < 2; row++) {
+        m_out << "v" << hex(row * 8, 1) << "-v" << hex(row * 8 + 7, 1) << " ";
+        for (unsigned n = row * 8; n < row * 8 + 8; n++)
+            m_out << " " << hex(regs.v[n], 2);
+        m_out << "\n";
+    }
+
+    m_out << "pc 0x" << hex(regs.pc, 3) << "  i 0x" << hex(regs.i, 3) << "  sp 0x" << hex(regs.sp, 3)
+          << "  dt " << unsigned{regs.dtimer} << "  st " << unsigned{regs.stimer} << "  frame " << m_chip.frame()
+          << (regs.extended ? "  hires" : "") << (regs.chipstate == CHIP_HALTED ? "  waiting for a key" : "")
+          << "\n";
+
+    // The return addresses, innermost first
+    m_out << "stack";
+    for (Addr sp = regs.sp; sp >= Chip::stack_base + 2 && sp <= USERCODE_END; sp -= 2)
+        m_out << " 0x" << hex((m_bus.read(sp - 2) << 8 | m_bus.read(sp - 1)) & 0xfff, 3);
+    m_out << std::endl;
+}
+
+void Debugger::print_memory(Addr address, size_t length) {
+    for (size_t n = 0; n < length && address + n < USERCODE_END; n++) {
+        if (n % 16 == 0)
+            m_out << (n ? "\n" : "") << "0x" << hex(address + n, 3) << " ";
+        m_out << " " << hex(m_bus.read(address + n), 2);
+    }
+
+    m_out << std::endl;
+}
+
+void Debugger::print_disassembly(Addr address, size_t count) {
+    RegisterState regs;
+    m_chip.save_registers(regs);
+
+    for (size_t n = 0; n < count && address + 1 < USERCODE_END; n++, address += 2) {
+        auto opcode = static_cast<uint16_t>(m_bus.read(address) << 8 | m_bus.read(address + 1));
+        bool here = address == (regs.pc & 0xfff);
+        bool stop = m_breakpoints.test(address);
+
+        m_out << (here ? "=> " : "   ") << (stop ? "* " : "  ") << "0x" << hex(address, 3) << "  "
+              << hex(opcode, 4) << "  " << disassemble(opcode) << "\n";
+    }
+
+    m_out << std::flush;
+}
+
+void Debugger::print_trace(size_t count) {
+    std::vector<TraceRecord> records = m_chip.trace().records();
+    size_t first = records.size() > count ? records.size() - count : 0;
+
+    for (size_t n = first; n < records.size(); n++) {
+        const TraceRecord& record = records[n];
+        m_out << "  0x" << hex(record.pc, 3) << "  " << hex(record.opcode, 4) << "  " << std::left
+              << std::setw(20) << disassemble(record.opcode) << std::right << "; i=0x" << hex(record.i, 3)
+              << " vf=" << hex(record.vf, 2) << "\n";
+    }
+
+    m_out << std::flush;
+}
+
+void Debugger::print_points() {
+    if (m_breakpoint_list.empty() && m_watchpoint_list.empty())
+        m_out << "No breakpoints or watchpoints\n";
+
+    for (const Breakpoint& breakpoint : m_breakpoint_list) {
+        m_out << std::setw(3) << breakpoint.id << "  break";
+        if (breakpoint.address)
+            m_out << " 0x" << hex(*breakpoint.address, 3);
+        if (breakpoint.condition)
+            m_out << " if " << describe(*breakpoint.condition);
+        m_out << "\n";
+    }
+
+    for (const Watchpoint& watch : m_watchpoint_list) {
+        std::string_view kind = watch.access == WATCH_WRITE ? "watch" : watch.access == WATCH_READ ? "rwatch" : "awatch";
+        m_out << std::setw(3) << watch.id << "  " << kind << " 0x" << hex(watch.first, 3) << "..0x"
+              << hex(watch.last, 3) << "\n";
+    }
+
+    m_out << std::flush;
+}
@@ -1,249 +1,346 @@
+#include <array>
 #include <algorithm>
-#include <thread>
-#include <cassert>
+#include <bit>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <utility>
 
 #include <schip/display.h>
 
-PPU& PPU::get_instance() {
-    static PPU instance;
-    return instance;
+// glutSetOption() is a freeglut extension
+#if defined(FREEGLUT)
+#include <GL/freeglut_ext.h>
+#endif
+#include <schip/atlas.h>
+#include <schip/chip.h>
+#include <schip/timeline.h>
+
+namespace {
+
+struct TiledView {
+    std::vector<Display::TileSource> sources;
+    TileAtlas atlas;
+    GLuint texture{0};
+
+    // The texture is rounded up to powers of two for old drivers
+    int texture_width{0};
+    int texture_height{0};
+};
+
+struct ScaledView {
+    ScaleFilter filter{SCALE_NEAREST};
+    std::unique_ptr<FrameScaler> scaler;
+    GLuint texture{0};
+    int texture_width{0};
+    int texture_height{0};
+    int max_texture_size{0};
+
+    int window_width{PPU::screen_width * Display::zoom};
+    int window_height{PPU::screen_height * Display::zoom};
+
+    // The frame in the texture, to skip scaling when it did not change
+    FramePixels shown{};
+    bool extended{false};
+    bool stale{true};
+};
+
+std::unique_ptr<TiledView> tiled;
+std::unique_ptr<ScaledView> scaled;
+
+// What to do once the window is closed, until it has been done
+std::function<void()> close_handler;
+
+void close_window() {
+    if (auto handler = std::exchange(close_handler, nullptr))
+        handler();
 }
 
-void PPU::lock() {
-    while (m_busy.load())
-        std::this_thread::yield();
-    m_busy.store(true);
-}
-
-void PPU::release() {
-    m_busy.store(false);
-}
-
-void PPU::enable_extended() {
-    lock();
-    m_is_extended = true;
-    release();
-}
+// Makes a scaler for the size of the window, and a texture it fits into
+void resize_scaler(ScaledView& view) {
+    int fits = std::min(view.window_width / PPU::screen_width, view.window_height / PPU::screen_height);
+    unsigned scale = std::clamp(fits, 1, static_cast<int>(FrameScaler::max_scale));
 
-void PPU::disable_extended() {
-    lock();
-    m_is_extended = false;
-    release();
-}
+    // Keep the texture within what the driver can take
+    while (scale > 1 && std::bit_ceil(PPU::screen_width * scale) > static_cast<unsigned>(view.max_texture_size))
+        scale--;
 
-void PPU::clear_screen() {
-    lock();
-    m_pixels.fill(0);
-    release();
-}
+    // Scale2x needs an even scale, and is no use below 2 anyway
+    if (view.filter == SCALE_2X)
+        scale = std::max(2u, scale & ~1u);
 
-void PPU::scroll_down(unsigned lines) {
-    if (lines < 1 || lines > screen_height)
+    if (view.scaler && view.scaler->width() == PPU::screen_width * scale)
         return;
 
-    if (lines == screen_height)
-        return clear_screen();
+    ScaleOptions options;
+    options.filter = view.filter;
+    options.scale = scale;
+    view.scaler = std::make_unique<FrameScaler>(options);
 
-    lock();
-    std::shift_right(m_pixels.begin(), m_pixels.end(), lines * screen_width);
-    std::fill_n(m_pixels.begin(), lines * screen_width, 0);
-    release();
-}
+    // The texture is rounded up to powers of two for old drivers
+    view.texture_width = static_cast<int>(std::bit_ceil(view.scaler->width()));
+    view.texture_height = static_cast<int>(std::bit_ceil(view.scaler->height()));
 
-void PPU::scroll_left() {
-    lock();
-    for (auto i = m_pixels.begin(); i < m_pixels.end(); std::advance(i, screen_width)) {
-        std::shift_left(i, i + screen_width, 4);
-        std::fill_n(i + screen_width - 4, 4, 0);
-    }
-    release();
+    glBindTexture(GL_TEXTURE_2D, view.texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, view.texture_width, view.texture_height, 0,
+                 GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    view.stale = true;
 }
 
-void PPU::scroll_right() {
-    lock();
-    for (auto i = m_pixels.begin(); i < m_pixels.end(); std::advance(i, screen_width)) {
-        std::shift_right(i, i + screen_width, 4);
-        std::fill_n(i, 4, 0);
-    }
-    release();
 }
 
-void PPU::render() {
-    if (m_busy.load()) return; // If the PPU is busy, just return. Avoids flickering.
-
-    lock();
+void Display::init(ScaleFilter filter) {
+    glutInitDisplayMode(GLUT_DOUBLE | GLUT_RGB);
+    glutInitWindowSize(
+        PPU::screen_width * zoom,
+        PPU::screen_height * zoom
+	);
+    glutCreateWindow("S-Chip Emulator");
+    Timeline::get_instance().name_thread("display");
 
-    glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
-    glClear(GL_COLOR_BUFFER_BIT);
+#if defined(FREEGLUT)
+    // Return from the main loop when the window is closed, so that the
+    // interpreter can be stopped cleanly.
+    glutSetOption(GLUT_ACTION_ON_WINDOW_CLOSE, GLUT_ACTION_GLUTMAINLOOP_RETURNS);
+#endif
+	glColor3f(1.0f, 1.0f, 1.0f);
 
-    int i, x, y, z = zoom;
-    if (!m_is_extended)
-        z *= 2; // Double zoom
+    scaled = std::make_unique<ScaledView>();
+    scaled->filter = filter;
+    glGetIntegerv(GL_MAX_TEXTURE_SIZE, &scaled->max_texture_size);
 
-    for (i = 0; i < m_pixels.size(); i++) {
-        if (!m_is_extended) {
-            if (i / screen_width >= screen_height / 2) break;
-            if (i % screen_width >= screen_width / 2) {
-                i += screen_width / 2 - 1;
-                continue;
-            }
-        }
+    glGenTextures(1, &scaled->texture);
+    glBindTexture(GL_TEXTURE_2D, scaled->texture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    resize_scaler(*scaled);
 
-        if (m_pixels.at(i)) {
-            x = (i % screen_width) * z;
-            y = (i / screen_width) * z;
-
-            glRecti(x, y, x + z, y + z);
-        }
-    }
+	glutDisplayFunc(Display::repaint);
+	glutReshapeFunc(Display::reshape);
+    glutIdleFunc(Display::repaint);
 
-    release();
+    glutKeyboardFunc(Display::keydown);
+    glutKeyboardUpFunc(Display::keyup);
 
-    glutSwapBuffers();
+//    PPU::get_instance().make_test_pattern();
 }
 
-bool PPU::draw_sprite_at(Addr loc, unsigned lines, unsigned x, unsigned y) {
-    unsigned width{8};
-    unsigned adj{0};
+void Display::init_tiled(std::vector<TileSource> sources) {
+    TileAtlas layout{sources.size()};
+    tiled = std::make_unique<TiledView>(TiledView{std::move(sources), std::move(layout)});
+    TileAtlas& atlas = tiled->atlas;
 
-    if (lines == 0 && m_is_extended) {
-        width = 16;
-        lines = 16;
-    }
+    double scale = std::min<double>(zoom, static_cast<double>(max_tiled_width) / atlas.width());
 
-    if (lines < 1 || lines > 16)
-        return false; // Out of range
+    glutInitDisplayMode(GLUT_DOUBLE | GLUT_RGB);
+    glutInitWindowSize(
+        std::max(1, static_cast<int>(atlas.width() * scale)),
+        std::max(1, static_cast<int>(atlas.height() * scale))
+    );
+    glutCreateWindow(("S-Chip Emulator (" + std::to_string(atlas.tiles()) + " screens)").c_str());
+    Timeline::get_instance().name_thread("display");
+
+#if defined(FREEGLUT)
+    glutSetOption(GLUT_ACTION_ON_WINDOW_CLOSE, GLUT_ACTION_GLUTMAINLOOP_RETURNS);
+#endif
+
+    GLint max_size = 0;
+    glGetIntegerv(GL_MAX_TEXTURE_SIZE, &max_size);
+
+    tiled->texture_width = static_cast<int>(std::bit_ceil(static_cast<unsigned>(atlas.width())));
+    tiled->texture_height = static_cast<int>(std::bit_ceil(static_cast<unsigned>(atlas.height())));
+    if (tiled->texture_width > max_size || tiled->texture_height > max_size)
+        throw std::runtime_error("Too many screens for one texture");
+
+    glGenTextures(1, &tiled->texture);
+    glBindTexture(GL_TEXTURE_2D, tiled->texture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP);
+
+    // Rows of the atlas are not padded, and tiles are uploaded straight out of it
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, atlas.width());
+
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_LUMINANCE, tiled->texture_width, tiled->texture_height, 0,
+                 GL_LUMINANCE, GL_UNSIGNED_BYTE, nullptr);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, atlas.width(), atlas.height(),
+                    GL_LUMINANCE, GL_UNSIGNED_BYTE, atlas.texels());
+    atlas.take_dirty();
+
+    glColor3f(1.0f, 1.0f, 1.0f);
+
+    glutDisplayFunc(Display::repaint);
+    glutReshapeFunc(Display::reshape_tiled);
+    glutIdleFunc(Display::repaint);
 
-    if (m_is_extended) {
-        x %= screen_width;
-        y %= screen_height;
-    } else {
-        x %= screen_width / 2;
-        y %= screen_height / 2;
-    }
+    glutKeyboardFunc(Display::keydown);
+    glutKeyboardUpFunc(Display::keyup);
+}
 
-    if (unsigned n{screen_width - x}; n < width)
-        adj = width - n; // Remove overflow
+void Display::render_tiled() {
+    Timeline::Scope scope{"render tiles"};
+    TileAtlas& atlas = tiled->atlas;
 
-    if (unsigned n{screen_height - y}; n < lines)
-        lines = n; // Remove overflow
+    {
+        Timeline::Scope poll{"poll tiles"};
+        FramePixels frame;
+        bool extended;
 
-    Bus& bus = Bus::get_instance();
-    lock();
+        for (size_t tile = 0; tile < tiled->sources.size(); tile++) {
+            if (tiled->sources[tile](frame, extended))
+                atlas.update(tile, frame, extended);
+        }
+    }
 
-    uint8_t pix;
-    uint16_t row;
-    unsigned i, j, c;
-    bool collision{false};
+    const std::vector<size_t>& dirty = atlas.take_dirty();
+    if (!dirty.empty()) {
+        Timeline::Scope upload{"upload tiles"};
 
-    for (i = 0; i < lines; i++) {
-        if (width == 16) {
-            row = bus.read(loc + (i * 2));
-            row <<= 8;
-            row |= bus.read(loc + (i * 2) + 1);
+        // One big upload beats many small ones once most tiles have changed
+        if (dirty.size() * 2 > atlas.tiles()) {
+            glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, atlas.width(), atlas.height(),
+                            GL_LUMINANCE, GL_UNSIGNED_BYTE, atlas.texels());
         } else {
-            row = bus.read(loc + i);
+            for (size_t tile : dirty) {
+                int x = atlas.tile_x(tile), y = atlas.tile_y(tile);
+                glTexSubImage2D(GL_TEXTURE_2D, 0, x, y, PPU::screen_width, PPU::screen_height,
+                                GL_LUMINANCE, GL_UNSIGNED_BYTE, atlas.texels() + y * atlas.width() + x);
+            }
         }
+    }
 
-        c = ((y + i) * screen_width + x);
-        assert(c < m_pixels.size());
-
-        for (j = 0; j < width - adj; j++) {
-            pix = (row >> (width - 1 - j)) & 1;
-            if (pix && m_pixels.at(c + j))
-                collision = true;
+    float u = static_cast<float>(atlas.width()) / tiled->texture_width;
+    float v = static_cast<float>(atlas.height()) / tiled->texture_height;
 
-            m_pixels.at(c + j) ^= pix;
-        }
-    }
+    glEnable(GL_TEXTURE_2D);
+    glBegin(GL_QUADS);
+    glTexCoord2f(0.0f, 0.0f); glVertex2i(0, 0);
+    glTexCoord2f(u, 0.0f); glVertex2i(atlas.width(), 0);
+    glTexCoord2f(u, v); glVertex2i(atlas.width(), atlas.height());
+    glTexCoord2f(0.0f, v); glVertex2i(0, atlas.height());
+    glEnd();
+    glDisable(GL_TEXTURE_2D);
 
-    release();
-    return collision;
+    Timeline::Scope swap{"swap buffers"};
+    glutSwapBuffers();
 }
 
-void PPU::make_test_pattern() {
-    Bus& bus = Bus::get_instance();
-    int i = 0x200;
-    for (Byte b : {0b01111111, 0b11111110,
-                   0b11000000, 0b00000011,
-                   0b10100000, 0b00000101,
-                   0b10010000, 0b00001001,
-                   0b10001000, 0b00010001,
-                   0b10000100, 0b00100001,
-                   0b10000010, 0b01000001,
-                   0b10000000, 0b10000001,
-                   0b10000001, 0b00000001,
-                   0b10000010, 0b01000001,
-                   0b10000100, 0b00100001,
-                   0b10001000, 0b00010001,
-                   0b10010000, 0b00001001,
-                   0b10100000, 0b00000101,
-                   0b11000000, 0b00000011,
-                   0b01111111, 0b11111110}) {
-        bus.write(i++, b);
-    }
+void Display::render() {
+    Timeline::Scope scope{"render"};
 
-    i = 0x300;
-    for (Byte b : {0b11111111,
-                   0b10000001,
-                   0b10000001,
-                   0b10000001,
-                   0b10000001,
-                   0b10000001,
-                   0b10000001,
-                   0b10000001,
-                   0b11111111}) {
-        bus.write(i++, b);
+    // Take a copy of the presented frame, so that the CPU thread isn't held up
+    // while we draw.
+    static std::array<char, PPU::screen_width * PPU::screen_height> pixels;
+    bool extended;
+    {
+        Timeline::Scope copy{"copy frame"};
+        extended = PPU::get_instance().copy_presented(pixels);
     }
 
-//    enable_extended();
-
-//    draw_sprite_at(0x200, 0, 120, 60);
+    ScaledView& view = *scaled;
+    if (view.stale || extended != view.extended || pixels != view.shown) {
+        std::span<const uint32_t> image;
+        {
+            Timeline::Scope scale{"scale frame"};
+            image = view.scaler->scale(pixels, extended);
+        }
 
-    draw_sprite_at(0x300, 8, 60, 28);
+        Timeline::Scope upload{"upload frame"};
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, view.scaler->width(), view.scaler->height(),
+                        GL_RGBA, GL_UNSIGNED_BYTE, image.data());
 
-//    lock();
-//    m_is_extended = true;
-//    for (int i = 0; i < m_pixels.size(); i++)
-//        m_pixels.at(i) = (i / screen_width == 63) ? 1 : 0;
-//    release();
-}
+        view.shown = pixels;
+        view.extended = extended;
+        view.stale = false;
+    }
 
-void Display::init() {
-    glutInitDisplayMode(GLUT_DOUBLE | GLUT_RGB);
-    glutInitWindowSize(
-        PPU::screen_width * PPU::zoom,
-        PPU::screen_height * PPU::zoom
-	);
-    glutCreateWindow("S-Chip Emulator");
-	glColor3f(1.0f, 1.0f, 1.0f);
+    float u = static_cast<float>(view.scaler->width()) / view.texture_width;
+    float v = static_cast<float>(view.scaler->height()) / view.texture_height;
 
-	glutDisplayFunc(Display::repaint);
-	glutReshapeFunc(Display::reshape);
-    glutIdleFunc(Display::repaint);
+    glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+    glClear(GL_COLOR_BUFFER_BIT);
 
-    glutKeyboardFunc(Display::keydown);
-    glutKeyboardUpFunc(Display::keyup);
+    glEnable(GL_TEXTURE_2D);
+    glBegin(GL_QUADS);
+    glTexCoord2f(0.0f, 0.0f); glVertex2i(0, 0);
+    glTexCoord2f(u, 0.0f); glVertex2i(PPU::screen_width, 0);
+    glTexCoord2f(u, v); glVertex2i(PPU::screen_width, PPU::screen_height);
+    glTexCoord2f(0.0f, v); glVertex2i(0, PPU::screen_height);
+    glEnd();
+    glDisable(GL_TEXTURE_2D);
 
-//    PPU::get_instance().make_test_pattern();
+    Timeline::Scope swap{"swap buffers"};
+    glutSwapBuffers();
 }
 
 void Display::reshape(int w, int h) {
+    // The screen is stretched over the whole window, from a texture scaled
+    // up as far as it fits
+    scaled->window_width = std::max(1, w);
+    scaled->window_height = std::max(1, h);
+    resize_scaler(*scaled);
+
+    glViewport(0, 0, w, h);
 	glMatrixMode(GL_PROJECTION);
 	glLoadIdentity();
 	glOrtho(
-        0.0f, PPU::screen_width * PPU::zoom,
-        PPU::screen_height * PPU::zoom, 0.0f,
+        0.0f, PPU::screen_width,
+        PPU::screen_height, 0.0f,
 		0.0f, 1.0f
 	);
 }
 
+void Display::reshape_tiled(int w, int h) {
+    // The grid is stretched over the whole window
+    glViewport(0, 0, w, h);
+    glMatrixMode(GL_PROJECTION);
+    glLoadIdentity();
+    glOrtho(0.0f, tiled->atlas.width(), tiled->atlas.height(), 0.0f, 0.0f, 1.0f);
+}
+
 void Display::repaint() {
-    PPU::get_instance().render();
+    if (tiled)
+        return render_tiled();
+
+    render();
 }
 
-void Display::keydown(unsigned char key, int x, int y) { KeyPad::get_instance().press_key(key); }
+void Display::keydown(unsigned char key, int x, int y) {
+    Timeline::get_instance().instant("key down", "key", key);
+
+    // Backspace steps one second back in time if rewinding is enabled
+    if (key == '\b')
+        return Chip::get_instance().rewind(Chip::frame_rate);
 
-void Display::keyup(unsigned char key, int x, int y) { KeyPad::get_instance().release_key(key); }
+    KeyPad::get_instance().press_key(key);
+}
+
+void Display::keyup(unsigned char key, int x, int y) {
+    Timeline::get_instance().instant("key up", "key", key);
+    KeyPad::get_instance().release_key(key);
+}
 
-void Display::run() { glutMainLoop(); }
+void Display::run(std::function<void()> on_close) {
+    close_handler = std::move(on_close);
+
+#if !defined(FREEGLUT)
+    // The main loop never returns, and closing the window calls exit()
+    std::atexit([]() {
+        try {
+            close_window();
+        } catch (std::exception& err) {
+            std::cerr << "Error: " << err.what() << std::endl;
+        }
+    });
+#endif
+
+    glutMainLoop();
+    close_window();
+}
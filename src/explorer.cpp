@@ -0,0 +1,204 @@
+#include <algorithm>
+#include <bit>
+#include <fstream>
+#include <stdexcept>
+
+#include <schip/explorer.h>
+#include <schip/machine.h>
+#include <schip/hash.h>
+
+namespace {
+
+constexpr uint32_t INDEX_VERSION = 1;
+
+// Give up on a slot after this many probes and call the set full
+constexpr size_t MAX_PROBES = 64;
+
+template <typename T>
+void write_le(std::ofstream& file, T value) {
+    for (size_t i = 0; i < sizeof(T); i++)
+        file.put(static_cast<char>((value >> (i * 8)) & 0xff));
+}
+
+}
+
+VisitedSet::VisitedSet(size_t capacity)
+    : m_slots(new std::atomic<uint64_t>[std::bit_ceil(std::max<size_t>(capacity * 2, 64))]),
+      m_mask(std::bit_ceil(std::max<size_t>(capacity * 2, 64)) - 1)
+{
+    for (size_t i = 0; i <= m_mask; i++)
+        m_slots[i].store(0, std::memory_order_relaxed);
+}
+
+bool VisitedSet::insert(uint64_t hash) {
+    // Zero marks an empty slot
+    if (hash == 0)
+        hash = 1;
+
+    for (size_t probe = 0, i = hash & m_mask; probe < MAX_PROBES; probe++, i = (i + 1) & m_mask) {
+        uint64_t current = m_slots[i].load(std::memory_order_relaxed);
+
+        if (current == 0 && m_slots[i].compare_exchange_strong(current, hash, std::memory_order_relaxed))
+            return true;
+
+        // Either the slot was taken already or we lost the race for it
+        if (current == hash)
+            return false;
+    }
+
+    m_full.store(true, std::memory_order_relaxed);
+    return false;
+}
+
+Explorer::Explorer(const MachineState& root, const ExploreOptions& options)
+    : m_root(std::make_unique<MachineState>(root)),
+      m_options(options),
+      m_visited(options.max_states),
+      m_entries(options.max_states)
+{
+    m_options.threads = std::max(1u, m_options.threads);
+    m_options.hold_frames = std::max(1u, m_options.hold_frames);
+}
+
+ExploreStats Explorer::run() {
+    ExploreStats stats;
+
+    if (m_options.max_states == 0)
+        return stats;
+
+    auto machine = std::make_unique<Machine>();
+    machine->chip.load_state(*m_root);
+
+    StateHasher hasher;
+    hasher.rehash(*machine);
+    m_visited.insert(hasher.value());
+
+    m_entries[0] = {hasher.value(), hasher.screen(), 0, 0, 0};
+    m_count.store(1);
+
+    std::vector<Node> frontier{{0, {}}};
+    std::vector<Node> next;
+
+    for (unsigned depth = 1; depth <= m_options.max_depth && !frontier.empty(); depth++) {
+        expand(frontier, next, depth);
+
+        if (!next.empty())
+            stats.depth = depth;
+
+        frontier.swap(next);
+        next.clear();
+
+        if (m_count.load() >= m_options.max_states || m_visited.full())
+            break;
+    }
+
+    stats.states = std::min(m_count.load(), m_options.max_states);
+    stats.exits = m_exits.load();
+    stats.faults = m_faults.load();
+
+    std::vector<uint64_t> screens;
+    screens.reserve(stats.states);
+    for (size_t i = 0; i < stats.states; i++)
+        screens.push_back(m_entries[i].screen);
+
+    std::sort(screens.begin(), screens.end());
+    stats.screens = std::unique(screens.begin(), screens.end()) - screens.begin();
+
+    return stats;
+}
+
+void Explorer::expand(const std::vector<Node>& frontier, std::vector<Node>& next, unsigned depth) {
+    std::atomic<size_t> index{0};
+    std::vector<std::vector<Node>> found(m_options.threads);
+    std::vector<std::thread> workers;
+
+    auto worker = [&](std::vector<Node>& out) {
+        auto machine = std::make_unique<Machine>();
+        auto parent = std::make_unique<MachineState>();
+        auto child = std::make_unique<MachineState>();
+        StateHasher base, hasher;
+
+        for (size_t n; (n = index.fetch_add(1)) < frontier.size();) {
+            const Node& node = frontier[n];
+
+            *parent = *m_root;
+            apply_delta(*parent, node.delta);
+
+            machine->chip.load_state(*parent);
+            base.rehash(*machine);
+
+            for (unsigned key = 0; key <= 16; key++) {
+                uint16_t keys = key ? 1 << (key - 1) : 0;
+
+                hasher = base;
+                machine->chip.load_state(*parent);
+                machine->bus.take_dirty();
+                machine->ppu.take_dirty_rows();
+
+                try {
+                    for (unsigned f = 0; f < m_options.hold_frames && !machine->chip.has_exited(); f++)
+                        machine->chip.run_frame(keys);
+                } catch (std::exception&) {
+                    m_faults.fetch_add(1, std::memory_order_relaxed);
+                    continue;
+                }
+
+                hasher.update(*machine);
+                if (!m_visited.insert(hasher.value()))
+                    continue;
+
+                size_t id = m_count.fetch_add(1);
+                if (id >= m_options.max_states)
+                    return;
+
+                m_entries[id] = {hasher.value(), hasher.screen(), node.id,
+                                 static_cast<uint16_t>(depth), keys};
+
+                if (machine->chip.has_exited()) {
+                    m_exits.fetch_add(1, std::memory_order_relaxed);
+                    continue;
+                }
+
+                machine->chip.save_state(*child);
+                Node& expanded = out.emplace_back();
+                expanded.id = id;
+                encode_delta(*m_root, *child, expanded.delta);
+            }
+        }
+    };
+
+    for (unsigned t = 0; t < m_options.threads; t++)
+        workers.emplace_back(worker, std::ref(found[t]));
+
+    for (auto& t : workers)
+        t.join();
+
+    for (auto& nodes : found)
+        std::move(nodes.begin(), nodes.end(), std::back_inserter(next));
+}
+
+void Explorer::write_index(std::filesystem::path filename) const {
+    std::ofstream file{filename, std::ios_base::out | std::ios::binary | std::ios::trunc};
+
+    if (!file)
+        throw std::runtime_error("Cannot create the index file");
+
+    size_t count = std::min(m_count.load(), m_options.max_states);
+
+    file.write("SCHIPIDX", 8);
+    write_le(file, INDEX_VERSION);
+    write_le(file, static_cast<uint32_t>(count));
+    write_le(file, hash_bytes(m_root->memory.data(), m_root->memory.size()));
+
+    for (size_t i = 0; i < count; i++) {
+        const Entry& entry = m_entries[i];
+        write_le(file, entry.hash);
+        write_le(file, entry.screen);
+        write_le(file, entry.parent);
+        write_le(file, entry.depth);
+        write_le(file, entry.keys);
+    }
+
+    if (!file)
+        throw std::runtime_error("Cannot write the index file");
+}
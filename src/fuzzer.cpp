@@ -0,0 +1,253 @@
+#include <chrono>
+#include <cstring>
+#include <random>
+#include <iomanip>
+#include <sstream>
+
+#include <schip/fuzzer.h>
+#include <schip/machine.h>
+#include <schip/movie.h>
+
+namespace {
+
+// AFL style hit count buckets: 1, 2, 3, 4-7, 8-15, 16-31, 32-127, 128+
+constexpr std::array<uint8_t, 256> make_buckets() {
+    std::array<uint8_t, 256> buckets{};
+
+    for (unsigned n = 1; n < 256; n++) {
+        if (n <= 3)
+            buckets[n] = 1 << (n - 1);
+        else if (n <= 7)
+            buckets[n] = 1 << 3;
+        else if (n <= 15)
+            buckets[n] = 1 << 4;
+        else if (n <= 31)
+            buckets[n] = 1 << 5;
+        else if (n <= 127)
+            buckets[n] = 1 << 6;
+        else
+            buckets[n] = 1 << 7;
+    }
+
+    return buckets;
+}
+
+constexpr auto BUCKETS = make_buckets();
+
+// The number of mutations stacked on top of each other per execution
+constexpr unsigned MAX_STACK = 4;
+
+}
+
+Fuzzer::Fuzzer(const MachineState& boot, std::filesystem::path outdir, const FuzzOptions& options)
+    : m_boot(std::make_unique<MachineState>(boot)),
+      m_outdir(std::move(outdir)),
+      m_options(options),
+      m_virgin(new std::atomic<uint8_t>[Chip::coverage_size])
+{
+    m_options.threads = std::max(1u, m_options.threads);
+    m_options.frames = std::max(1u, m_options.frames);
+
+    for (size_t i = 0; i < Chip::coverage_size; i++)
+        m_virgin[i].store(0xff, std::memory_order_relaxed);
+
+    std::filesystem::create_directories(m_outdir / "queue");
+    std::filesystem::create_directories(m_outdir / "crashes");
+
+    // Start out with doing nothing at all
+    m_corpus.emplace_back();
+}
+
+FuzzStats Fuzzer::run() {
+    using clock = std::chrono::steady_clock;
+
+    auto start = clock::now();
+    std::vector<std::thread> workers;
+
+    for (unsigned t = 0; t < m_options.threads; t++)
+        workers.emplace_back(&Fuzzer::work, this, t);
+
+    while (!m_done.load()) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+
+        std::chrono::duration<double> elapsed = clock::now() - start;
+        if (m_options.max_seconds > 0 && elapsed.count() >= m_options.max_seconds)
+            m_done.store(true);
+    }
+
+    for (auto& t : workers)
+        t.join();
+
+    FuzzStats stats;
+    stats.seconds = std::chrono::duration<double>(clock::now() - start).count();
+    stats.execs = m_execs.load();
+    stats.frames = m_frames.load();
+    stats.corpus = m_corpus.size();
+    stats.crashes = m_crashes.size();
+
+    for (size_t i = 0; i < Chip::coverage_size; i++) {
+        if (m_virgin[i].load(std::memory_order_relaxed) != 0xff)
+            stats.edges++;
+    }
+
+    return stats;
+}
+
+void Fuzzer::work(unsigned thread) {
+    std::mt19937 rng(m_options.seed * 7919 + thread);
+    auto machine = std::make_unique<Machine>();
+    auto trace = std::make_unique<uint8_t[]>(Chip::coverage_size);
+    auto state = std::make_unique<MachineState>();
+
+    auto pick = [&rng](size_t n) { return std::uniform_int_distribution<size_t>(0, n - 1)(rng); };
+
+    while (!m_done.load(std::memory_order_relaxed)) {
+        Input input, other;
+        {
+            std::lock_guard lock(m_mutex);
+            input = m_corpus[pick(m_corpus.size())];
+            other = m_corpus[pick(m_corpus.size())];
+        }
+
+        for (unsigned n = 1 + pick(MAX_STACK); n > 0; n--) {
+            uint32_t frame = pick(m_options.frames);
+            uint16_t key = 1 << pick(16);
+
+            switch (pick(input.empty() ? 2 : 6)) {
+            case 0: // Press a key
+                input.push_back({frame, key});
+                break;
+            case 1: // Splice with another input
+                std::erase_if(input, [frame](auto& e) { return e.frame >= frame; });
+                for (auto& e : other) {
+                    if (e.frame >= frame)
+                        input.push_back(e);
+                }
+                break;
+            case 2: // Release everything
+                input.push_back({frame, 0});
+                break;
+            case 3: // Toggle a key in an existing change
+                input[pick(input.size())].keys ^= key;
+                break;
+            case 4: // Move a change
+                input[pick(input.size())].frame = frame;
+                break;
+            case 5: // Drop a change
+                input.erase(input.begin() + pick(input.size()));
+                break;
+            }
+        }
+
+        // Keep the changes in order, with at most one change per frame
+        std::stable_sort(input.begin(), input.end(), [](auto& a, auto& b) { return a.frame < b.frame; });
+        for (size_t i = 1; i < input.size();) {
+            if (input[i - 1].frame == input[i].frame)
+                input.erase(input.begin() + i - 1);
+            else
+                i++;
+        }
+
+        Result result = execute(*machine, input, trace.get());
+
+        m_frames.fetch_add(result.frames, std::memory_order_relaxed);
+        uint64_t execs = m_execs.fetch_add(1, std::memory_order_relaxed) + 1;
+        if (m_options.max_execs && execs >= m_options.max_execs)
+            m_done.store(true);
+
+        bool interesting = has_new_bits(trace.get());
+        if (!interesting && result.error.empty())
+            continue;
+
+        machine->chip.save_state(*state);
+        result.state_hash = hash_state(*state);
+
+        std::lock_guard lock(m_mutex);
+
+        if (!result.error.empty() && m_crashes.emplace(result.error, result.pc).second) {
+            std::ostringstream name;
+            name << "crash_" << std::setw(4) << std::setfill('0') << m_crashes.size()
+                 << "_pc" << std::hex << std::setw(3) << result.pc << ".mov";
+            std::filesystem::path filename = m_outdir / "crashes" / name.str();
+            save(filename, input, result);
+            machine->chip.trace().write(filename.replace_extension(".trace"), result.error);
+        }
+
+        if (interesting) {
+            m_corpus.push_back(input);
+
+            std::ostringstream name;
+            name << "id_" << std::setw(6) << std::setfill('0') << m_corpus.size() - 1 << ".mov";
+            save(m_outdir / "queue" / name.str(), input, result);
+        }
+    }
+}
+
+Fuzzer::Result Fuzzer::execute(Machine& machine, const Input& input, uint8_t* trace) const {
+    Result result;
+    Chip& chip = machine.chip;
+
+    std::memset(trace, 0, Chip::coverage_size);
+    chip.load_state(*m_boot);
+    chip.trace().clear();
+    chip.set_coverage(trace);
+
+    uint16_t keys = 0;
+    auto next = input.begin();
+
+    try {
+        for (uint32_t frame = 0; frame < m_options.frames && !chip.has_exited(); frame++) {
+            for (; next != input.end() && next->frame <= frame; ++next)
+                keys = next->keys;
+
+            // A frame that faults still counts, so that replaying reaches the fault
+            result.frames++;
+            chip.run_frame(keys);
+        }
+    } catch (std::exception& err) {
+        RegisterState regs;
+        chip.save_registers(regs);
+
+        result.error = err.what();
+        result.pc = (regs.pc - 2) & 0xfff;
+    }
+
+    chip.set_coverage(nullptr);
+    return result;
+}
+
+bool Fuzzer::has_new_bits(const uint8_t* trace) {
+    bool found = false;
+
+    for (size_t i = 0; i < Chip::coverage_size; i += sizeof(uint64_t)) {
+        uint64_t word;
+        std::memcpy(&word, trace + i, sizeof(word));
+        if (!word)
+            continue;
+
+        for (size_t j = i; j < i + sizeof(uint64_t); j++) {
+            uint8_t bucket = BUCKETS[trace[j]];
+
+            if (bucket && (m_virgin[j].load(std::memory_order_relaxed) & bucket)) {
+                m_virgin[j].fetch_and(~bucket, std::memory_order_relaxed);
+                found = true;
+            }
+        }
+    }
+
+    return found;
+}
+
+void Fuzzer::save(const std::filesystem::path& filename, const Input& input, const Result& result) const {
+    MovieHeader header;
+    header.instructions_per_frame = Chip::instructions_per_frame;
+    header.seed = m_options.seed;
+    header.rom_hash = hash_bytes(m_boot->memory.data(), m_boot->memory.size());
+
+    MovieWriter movie{filename, header};
+    for (auto& e : input) {
+        if (e.frame < result.frames)
+            movie.record(e.frame, e.keys);
+    }
+    movie.finish(result.frames, result.state_hash);
+}
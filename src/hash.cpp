@@ -0,0 +1,88 @@
+#include <cstring>
+
+#include <schip/hash.h>
+#include <schip/machine.h>
+#include <schip/state.h>
+
+namespace {
+
+constexpr uint64_t mix(uint64_t h) {
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccd;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53;
+    h ^= h >> 33;
+    return h;
+}
+
+// Ties a block hash to the position of the block, so that swapping two blocks
+// changes the combined hash.
+constexpr uint64_t place(uint64_t hash, uint64_t block) {
+    return mix(hash + block * 0x9e3779b97f4a7c15);
+}
+
+constexpr uint64_t MEMORY_SALT = 0x100;
+constexpr uint64_t SCREEN_SALT = 0x200;
+
+}
+
+uint64_t hash_block(const void* data, size_t size) {
+    auto bytes = static_cast<const Byte*>(data);
+    uint64_t h = mix(size);
+    size_t i = 0;
+
+    for (; i + 8 <= size; i += 8) {
+        uint64_t word;
+        std::memcpy(&word, bytes + i, sizeof(word));
+        h = (h ^ word) * 0x9e3779b97f4a7c15;
+        h ^= h >> 29;
+    }
+
+    for (; i < size; i++)
+        h = (h ^ bytes[i]) * 0x100000001b3;
+
+    return mix(h);
+}
+
+void StateHasher::rehash(Machine& machine) {
+    m_pages.fill(0);
+    m_rows.fill(0);
+    m_memory = 0;
+    m_screen = 0;
+
+    machine.bus.take_dirty();
+    machine.ppu.take_dirty_rows();
+
+    // XOR-ing a block in for the first time starts from a zero contribution
+    update_blocks(machine, ~uint64_t{0}, ~uint64_t{0});
+}
+
+void StateHasher::update(Machine& machine) {
+    update_blocks(machine, machine.bus.take_dirty(), machine.ppu.take_dirty_rows());
+}
+
+void StateHasher::update_blocks(Machine& machine, uint64_t pages, uint64_t rows) {
+    RegisterState regs;
+    machine.chip.save_registers(regs);
+    m_regs = place(hash_block(&regs, sizeof(regs)), 0);
+
+    const auto& memory = machine.bus.data();
+    for (size_t page = 0; page < MEMORY_PAGES; page++) {
+        if (!((pages >> page) & 1))
+            continue;
+
+        uint64_t h = place(hash_block(&memory[page * MEMORY_PAGE_SIZE], MEMORY_PAGE_SIZE), MEMORY_SALT + page);
+        m_memory ^= m_pages[page] ^ h;
+        m_pages[page] = h;
+    }
+
+    const auto& pixels = machine.ppu.pixels();
+    for (size_t row = 0; row < ROWS; row++) {
+        if (!((rows >> row) & 1))
+            continue;
+
+        uint64_t h = place(hash_block(&pixels[row * PPU::screen_width], PPU::screen_width), SCREEN_SALT + row);
+        m_screen ^= m_rows[row] ^ h;
+        m_rows[row] = h;
+    }
+}
@@ -0,0 +1,382 @@
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <charconv>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <stdexcept>
+#include <tuple>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define SCHIP_HAS_MMAP 1
+#else
+#define SCHIP_HAS_MMAP 0
+#endif
+
+#include <schip/library.h>
+#include <schip/hash.h>
+#include <schip/machine.h>
+
+namespace {
+
+constexpr std::string_view LIBRARY_MAGIC{"SCHIPLIB"};
+constexpr uint32_t LIBRARY_VERSION = 1;
+
+bool has_name(const uint8_t* data, size_t size, uint32_t name) {
+    return name < size && std::memchr(data + name, '\0', size - name);
+}
+
+struct LibraryHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t count;
+    uint64_t index;
+    uint32_t name_count;
+    uint32_t reserved;
+    uint64_t name_index;
+};
+
+static_assert(sizeof(LibraryHeader) == 40);
+
+struct FoundRom {
+    // Every file the ROM was found in, the first one by path first
+    std::vector<std::filesystem::path> paths;
+    std::vector<Byte> data;
+    uint64_t hash{0};
+    RomProfile profile;
+};
+
+template <typename T>
+void write_raw(std::ofstream& file, const T& value) {
+    file.write(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+}
+
+std::vector<Byte> read_rom_file(const std::filesystem::path& path) {
+    std::ifstream file{path, std::ios_base::in | std::ios::binary};
+    if (!file)
+        throw std::runtime_error("Cannot open " + path.string());
+
+    std::vector<Byte> data(std::filesystem::file_size(path));
+    file.read(reinterpret_cast<char*>(data.data()), data.size());
+    if (!file)
+        throw std::runtime_error("Cannot read " + path.string());
+
+    return data;
+}
+
+std::vector<std::filesystem::path> find_rom_files(const std::vector<std::filesystem::path>& inputs) {
+    std::vector<std::filesystem::path> files;
+
+    for (const auto& input : inputs) {
+        if (!std::filesystem::is_directory(input)) {
+            files.push_back(input);
+            continue;
+        }
+
+        for (const auto& entry : std::filesystem::recursive_directory_iterator(input)) {
+            if (entry.is_regular_file())
+                files.push_back(entry.path());
+        }
+    }
+
+    std::sort(files.begin(), files.end());
+    return files;
+}
+
+RomProfile profile_rom(std::span<const Byte> rom, uint32_t frames) {
+    auto machine = std::make_unique<Machine>();
+    Chip& chip = machine->chip;
+
+    machine->bus.load_program(rom);
+    chip.seed(0);
+
+    RomProfile profile;
+
+    try {
+        for (uint32_t frame = 0; frame < frames && !chip.has_exited(); frame++) {
+            chip.run_frame(0);
+
+            if (machine->ppu.is_extended())
+                profile.flags |= ROM_HIRES;
+        }
+    } catch (std::exception&) {
+        profile.flags |= ROM_FAULTS;
+    }
+
+    if (chip.has_exited())
+        profile.flags |= ROM_EXITS;
+
+    const auto& pixels = machine->ppu.pixels();
+    profile.golden = hash_block(pixels.data(), pixels.size());
+    return profile;
+}
+
+LibraryBuildStats build_library(const std::vector<std::filesystem::path>& inputs,
+                                const std::filesystem::path& archive, const LibraryBuildOptions& options) {
+    if constexpr (std::endian::native != std::endian::little)
+        throw std::runtime_error("Library archives can only be built on little endian hosts");
+
+    LibraryBuildStats stats;
+    std::vector<FoundRom> roms;
+    std::map<uint64_t, size_t> seen;
+
+    for (const auto& path : find_rom_files(inputs)) {
+        stats.files++;
+
+        std::vector<Byte> data = read_rom_file(path);
+        if (data.empty() || data.size() > USERCODE_SIZE) {
+            stats.skipped++;
+            continue;
+        }
+
+        uint64_t hash = hash_block(data.data(), data.size());
+        if (auto [it, added] = seen.emplace(hash, roms.size()); !added) {
+            roms[it->second].paths.push_back(path);
+            stats.duplicates++;
+            continue;
+        }
+
+        roms.push_back({{path}, std::move(data), hash, {}});
+    }
+
+    stats.roms = roms.size();
+
+    // Profiling runs every ROM for a few seconds of emulated time, which is
+    // what takes long for a big collection
+    std::atomic<size_t> next{0};
+    std::vector<std::thread> workers;
+
+    for (unsigned t = 0; t < std::max(1u, options.threads); t++) {
+        workers.emplace_back([&roms, &next, &options]() {
+            for (size_t n = next.fetch_add(1); n < roms.size(); n = next.fetch_add(1))
+                roms[n].profile = profile_rom(roms[n].data, options.frames);
+        });
+    }
+
+    for (auto& worker : workers)
+        worker.join();
+
+    std::sort(roms.begin(), roms.end(), [](const FoundRom& a, const FoundRom& b) { return a.hash < b.hash; });
+
+    // The header, then the index, then the name index, then the names, then the ROMs
+    size_t name_count = 0;
+    for (const FoundRom& rom : roms)
+        name_count += rom.paths.size();
+
+    std::vector<RomEntry> entries(roms.size());
+    std::vector<RomName> name_index;
+    std::vector<std::string> name_strings;
+    std::vector<char> names;
+    uint64_t offset = sizeof(LibraryHeader) + sizeof(RomEntry) * entries.size() + sizeof(RomName) * name_count;
+
+    for (size_t n = 0; n < roms.size(); n++) {
+        for (size_t alias = 0; alias < roms[n].paths.size(); alias++) {
+            std::string name = roms[n].paths[alias].filename().string();
+            auto name_offset = static_cast<uint32_t>(offset + names.size());
+
+            if (alias == 0)
+                entries[n].name = name_offset;
+
+            name_index.push_back({name_offset, static_cast<uint32_t>(n)});
+            name_strings.push_back(name);
+            names.insert(names.end(), name.begin(), name.end());
+            names.push_back('\0');
+        }
+    }
+
+    // Sort the name index by name, through the strings it points to
+    std::vector<size_t> order(name_index.size());
+    for (size_t n = 0; n < order.size(); n++)
+        order[n] = n;
+    std::sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+        return std::tie(name_strings[a], name_index[a].rom) < std::tie(name_strings[b], name_index[b].rom);
+    });
+
+    std::vector<RomName> sorted_names;
+    for (size_t n : order)
+        sorted_names.push_back(name_index[n]);
+
+    offset += names.size();
+
+    for (size_t n = 0; n < roms.size(); n++) {
+        if (offset + roms[n].data.size() > UINT32_MAX)
+            throw std::runtime_error("Too many ROMs for one library archive");
+
+        RomEntry& entry = entries[n];
+        entry.hash = roms[n].hash;
+        entry.golden = roms[n].profile.golden;
+        entry.offset = static_cast<uint32_t>(offset);
+        entry.size = static_cast<uint16_t>(roms[n].data.size());
+        entry.flags = roms[n].profile.flags;
+        entry.instructions_per_frame = Chip::instructions_per_frame;
+        entry.golden_frames = options.frames;
+
+        offset += roms[n].data.size();
+    }
+
+    std::ofstream file{archive, std::ios_base::out | std::ios::binary | std::ios::trunc};
+    if (!file)
+        throw std::runtime_error("Cannot create the library " + archive.string());
+
+    LibraryHeader header{};
+    std::memcpy(header.magic, LIBRARY_MAGIC.data(), LIBRARY_MAGIC.size());
+    header.version = LIBRARY_VERSION;
+    header.count = static_cast<uint32_t>(entries.size());
+    header.index = sizeof(LibraryHeader);
+    header.name_count = static_cast<uint32_t>(sorted_names.size());
+    header.name_index = header.index + sizeof(RomEntry) * entries.size();
+
+    write_raw(file, header);
+    file.write(reinterpret_cast<const char*>(entries.data()), sizeof(RomEntry) * entries.size());
+    file.write(reinterpret_cast<const char*>(sorted_names.data()), sizeof(RomName) * sorted_names.size());
+    file.write(names.data(), names.size());
+    for (const FoundRom& rom : roms)
+        file.write(reinterpret_cast<const char*>(rom.data.data()), rom.data.size());
+
+    if (!file.flush())
+        throw std::runtime_error("Cannot write the library " + archive.string());
+
+    return stats;
+}
+
+RomLibrary::RomLibrary(const std::filesystem::path& archive) {
+    if constexpr (std::endian::native != std::endian::little)
+        throw std::runtime_error("Library archives can only be read on little endian hosts");
+
+#if SCHIP_HAS_MMAP
+    int fd = open(archive.c_str(), O_RDONLY);
+    if (fd < 0)
+        throw std::runtime_error("Cannot open the library " + archive.string());
+
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size == 0) {
+        close(fd);
+        throw std::runtime_error("The library " + archive.string() + " is empty");
+    }
+
+    m_size = info.st_size;
+    void* mapping = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if (mapping == MAP_FAILED)
+        throw std::runtime_error("Cannot map the library " + archive.string());
+
+    m_data = static_cast<const uint8_t*>(mapping);
+    m_mapped = true;
+#else
+    std::vector<Byte> data = read_rom_file(archive);
+    m_copy.assign(data.begin(), data.end());
+    m_data = m_copy.data();
+    m_size = m_copy.size();
+#endif
+
+    // Check everything the lookups rely on once, so that they need no checks
+    auto damaged = [this, &archive]() {
+        release();
+        return std::runtime_error("The library " + archive.string() + " is damaged");
+    };
+
+    LibraryHeader header;
+    if (m_size < sizeof(header))
+        throw damaged();
+
+    std::memcpy(&header, m_data, sizeof(header));
+    if (LIBRARY_MAGIC != std::string_view(header.magic, sizeof(header.magic)) || header.version != LIBRARY_VERSION)
+        throw damaged();
+
+    if (header.index % alignof(RomEntry) != 0 || header.index > m_size
+        || (m_size - header.index) / sizeof(RomEntry) < header.count)
+        throw damaged();
+
+    m_entries = {reinterpret_cast<const RomEntry*>(m_data + header.index), header.count};
+
+    for (size_t n = 0; n < m_entries.size(); n++) {
+        const RomEntry& entry = m_entries[n];
+
+        if (static_cast<uint64_t>(entry.offset) + entry.size > m_size || entry.size == 0 || entry.size > USERCODE_SIZE
+            || !has_name(m_data, m_size, entry.name) || (n > 0 && m_entries[n - 1].hash >= entry.hash))
+            throw damaged();
+    }
+
+    if (header.name_index % alignof(RomName) != 0 || header.name_index > m_size
+        || (m_size - header.name_index) / sizeof(RomName) < header.name_count)
+        throw damaged();
+
+    m_names = {reinterpret_cast<const RomName*>(m_data + header.name_index), header.name_count};
+
+    for (size_t n = 0; n < m_names.size(); n++) {
+        if (!has_name(m_data, m_size, m_names[n].name) || m_names[n].rom >= m_entries.size()
+            || (n > 0 && name(m_names[n - 1]) > name(m_names[n])))
+            throw damaged();
+    }
+}
+
+RomLibrary::~RomLibrary() {
+    release();
+}
+
+void RomLibrary::release() {
+#if SCHIP_HAS_MMAP
+    if (m_mapped)
+        munmap(const_cast<uint8_t*>(m_data), m_size);
+#endif
+    m_mapped = false;
+}
+
+const RomEntry* RomLibrary::find(uint64_t hash) const {
+    auto it = std::lower_bound(m_entries.begin(), m_entries.end(), hash,
+                               [](const RomEntry& entry, uint64_t hash) { return entry.hash < hash; });
+
+    return it != m_entries.end() && it->hash == hash ? &*it : nullptr;
+}
+
+const RomEntry* RomLibrary::find(std::string_view key) const {
+    // The same name may belong to several ROMs found in different directories
+    auto first = std::lower_bound(m_names.begin(), m_names.end(), key,
+                                  [this](const RomName& entry, std::string_view key) { return name(entry) < key; });
+    auto last = std::upper_bound(first, m_names.end(), key,
+                                 [this](std::string_view key, const RomName& entry) { return key < name(entry); });
+
+    if (first != last) {
+        bool single = std::all_of(first, last, [&](const RomName& other) { return other.rom == first->rom; });
+        return single ? &m_entries[first->rom] : nullptr;
+    }
+
+    // A hash prefix of n digits covers every hash from prefix << (64 - 4n) on
+    uint64_t prefix = 0;
+    if (key.empty() || key.size() > 16
+        || std::from_chars(key.data(), key.data() + key.size(), prefix, 16).ptr != key.data() + key.size())
+        return nullptr;
+
+    unsigned shift = 64 - 4 * static_cast<unsigned>(key.size());
+    uint64_t low = prefix << shift;
+
+    auto it = std::lower_bound(m_entries.begin(), m_entries.end(), low,
+                               [](const RomEntry& entry, uint64_t hash) { return entry.hash < hash; });
+
+    auto matches = [&](auto it) { return it != m_entries.end() && (it->hash >> shift) == prefix; };
+    if (!matches(it) || matches(std::next(it)))
+        return nullptr;
+
+    return &*it;
+}
+
+std::span<const Byte> RomLibrary::rom(const RomEntry& entry) const {
+    return {m_data + entry.offset, entry.size};
+}
+
+std::string_view RomLibrary::name(const RomEntry& entry) const {
+    return reinterpret_cast<const char*>(m_data + entry.name);
+}
+
+std::string_view RomLibrary::name(const RomName& name) const {
+    return reinterpret_cast<const char*>(m_data + name.name);
+}
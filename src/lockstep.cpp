@@ -0,0 +1,232 @@
+#include <cstring>
+#include <iomanip>
+#include <sstream>
+
+#include <schip/lockstep.h>
+#include <schip/machine.h>
+#include <schip/opcodes.h>
+
+namespace {
+
+// How many differing bytes and pixels a report lists before it gives up
+constexpr unsigned MAX_LISTED = 16;
+
+// How many instructions before the divergence a report shows
+constexpr size_t CONTEXT = 8;
+
+std::string hex(unsigned value, int width) {
+    std::ostringstream out;
+    out << "0x" << std::hex << std::setw(width) << std::setfill('0') << value;
+    return out.str();
+}
+
+void compare_registers(const RegisterState& a, const RegisterState& b, std::ostream& out) {
+    auto field = [&out](const char* name, unsigned x, unsigned y, int width) {
+        if (x != y)
+            out << "  " << std::left << std::setw(10) << name << std::right << hex(x, width) << " != " << hex(y, width) << "\n";
+    };
+
+    for (size_t n = 0; n < a.v.size(); n++) {
+        std::string name = "v" + std::string(1, "0123456789abcdef"[n]);
+        field(name.c_str(), a.v[n], b.v[n], 2);
+    }
+
+    field("i", a.i, b.i, 3);
+    field("sp", a.sp, b.sp, 3);
+    field("pc", a.pc, b.pc, 3);
+    field("opcode", a.opcode, b.opcode, 4);
+    field("dt", a.dtimer, b.dtimer, 2);
+    field("st", a.stimer, b.stimer, 2);
+    field("state", a.chipstate, b.chipstate, 1);
+    field("key state", a.key_state, b.key_state, 1);
+    field("rng", a.rng, b.rng, 8);
+    field("extended", a.extended, b.extended, 1);
+
+    for (size_t n = 0; n < a.rpl.size(); n++) {
+        std::string name = "rpl" + std::to_string(n);
+        field(name.c_str(), a.rpl[n], b.rpl[n], 2);
+    }
+}
+
+}
+
+Lockstep::Lockstep(const MachineState& boot, ChipEngine reference, ChipEngine candidate, const LockstepOptions& options)
+    : m_reference(std::make_unique<Machine>()),
+      m_candidate(std::make_unique<Machine>()),
+      m_options(options)
+{
+    m_reference->chip.load_state(boot);
+    m_candidate->chip.load_state(boot);
+
+    m_reference->chip.trace().clear();
+    m_reference->chip.set_engine(reference);
+    m_candidate->chip.set_engine(candidate);
+}
+
+Lockstep::~Lockstep() = default;
+
+std::optional<Divergence> Lockstep::run(const std::function<uint16_t(uint64_t)>& keys) {
+    Chip& a = m_reference->chip;
+    Chip& b = m_candidate->chip;
+
+    auto diverged = [this](std::string report) {
+        return Divergence{m_frames, m_instructions, std::move(report)};
+    };
+
+    // Runs the same step on both machines and checks that they fault alike
+    auto both = [this](auto&& step) -> std::optional<std::string> {
+        std::string errors[2];
+        Chip* chips[2] = {&m_reference->chip, &m_candidate->chip};
+
+        for (int n = 0; n < 2; n++) {
+            try {
+                step(*chips[n]);
+            } catch (std::exception& err) {
+                errors[n] = err.what();
+            }
+        }
+
+        if (errors[0] != errors[1]) {
+            return "The engines faulted differently:\n  reference: " + (errors[0].empty() ? "no fault" : errors[0])
+                 + "\n  candidate: " + (errors[1].empty() ? "no fault" : errors[1]) + "\n";
+        }
+
+        m_error = errors[0];
+        return std::nullopt;
+    };
+
+    // Start from a clean slate, so that only what is touched from here on is compared
+    m_reference->bus.take_dirty();
+    m_candidate->bus.take_dirty();
+    m_reference->ppu.take_dirty_rows();
+    m_candidate->ppu.take_dirty_rows();
+
+    for (; m_frames < m_options.frames && !a.has_exited() && m_error.empty(); m_frames++) {
+        uint16_t held = keys(m_frames);
+
+        if (!m_options.every_instruction) {
+            if (auto report = both([held](Chip& chip) { chip.run_frame(held); }))
+                return diverged(*report);
+
+            m_instructions = a.trace().count();
+            if (auto report = compare())
+                return diverged(*report);
+            continue;
+        }
+
+        a.begin_frame(held);
+        b.begin_frame(held);
+
+        for (unsigned n = 0; n < Chip::instructions_per_frame && !a.has_exited() && m_error.empty(); n++) {
+            auto report = both([](Chip& chip) { chip.step(); });
+            m_instructions++;
+
+            if (!report)
+                report = compare();
+            if (report)
+                return diverged(*report);
+        }
+
+        // A frame that faults still counts, as it does when fuzzing
+        if (!m_error.empty())
+            continue;
+
+        a.end_frame();
+        b.end_frame();
+
+        if (auto report = compare())
+            return diverged(*report);
+    }
+
+    return std::nullopt;
+}
+
+std::optional<std::string> Lockstep::compare() {
+    RegisterState a, b;
+    m_reference->chip.save_registers(a);
+    m_candidate->chip.save_registers(b);
+
+    uint64_t pages = m_reference->bus.take_dirty() | m_candidate->bus.take_dirty();
+    uint64_t rows = m_reference->ppu.take_dirty_rows() | m_candidate->ppu.take_dirty_rows();
+
+    std::ostringstream out;
+
+    if (std::memcmp(&a, &b, sizeof(a)) != 0) {
+        out << "Registers (reference != candidate):\n";
+        compare_registers(a, b, out);
+    }
+
+    const auto& ma = m_reference->bus.data();
+    const auto& mb = m_candidate->bus.data();
+    unsigned listed = 0;
+
+    for (size_t page = 0; pages; page++, pages >>= 1) {
+        if (!(pages & 1))
+            continue;
+
+        size_t begin = page * MEMORY_PAGE_SIZE;
+        if (std::memcmp(&ma[begin], &mb[begin], MEMORY_PAGE_SIZE) == 0)
+            continue;
+
+        for (size_t n = begin; n < begin + MEMORY_PAGE_SIZE; n++) {
+            if (ma[n] == mb[n])
+                continue;
+
+            if (listed++ == 0)
+                out << "Memory (reference != candidate):\n";
+            if (listed <= MAX_LISTED)
+                out << "  [" << hex(USERCODE_BEG + n, 3) << "] " << hex(ma[n], 2) << " != " << hex(mb[n], 2) << "\n";
+        }
+    }
+
+    if (listed > MAX_LISTED)
+        out << "  and " << listed - MAX_LISTED << " more bytes\n";
+
+    const auto& pa = m_reference->ppu.pixels();
+    const auto& pb = m_candidate->ppu.pixels();
+    listed = 0;
+
+    for (unsigned row = 0; rows; row++, rows >>= 1) {
+        if (!(rows & 1))
+            continue;
+
+        size_t begin = row * PPU::screen_width;
+        if (std::memcmp(&pa[begin], &pb[begin], PPU::screen_width) == 0)
+            continue;
+
+        if (listed++ == 0)
+            out << "Framebuffer rows (reference, then candidate):\n";
+        if (listed <= MAX_LISTED) {
+            auto draw = [&out](const char* pixels) {
+                out << "    ";
+                for (int x = 0; x < PPU::screen_width; x++)
+                    out << (pixels[x] ? '#' : '.');
+                out << "\n";
+            };
+
+            out << "  row " << row << ":\n";
+            draw(&pa[begin]);
+            draw(&pb[begin]);
+        }
+    }
+
+    if (out.tellp() == 0)
+        return std::nullopt;
+
+    // What led up to it, according to the reference
+    std::ostringstream report;
+    report << "The engines diverged in frame " << m_frames << " after " << m_instructions << " instructions\n";
+
+    auto records = m_reference->chip.trace().records();
+    size_t first = records.size() > CONTEXT ? records.size() - CONTEXT : 0;
+
+    report << "Last instructions of the reference:\n";
+    for (size_t n = first; n < records.size(); n++) {
+        report << "  " << hex(records[n].pc, 3) << "  " << std::hex << std::setw(4) << std::setfill('0')
+               << records[n].opcode << std::dec << std::setfill(' ') << "  " << disassemble(records[n].opcode)
+               << (n + 1 == records.size() && m_options.every_instruction ? "  <- diverged here" : "") << "\n";
+    }
+
+    report << out.str();
+    return report.str();
+}
@@ -1,33 +1,879 @@
 #include <iostream>
 #include <thread>
 #include <filesystem>
+#include <string_view>
+#include <memory>
+#include <random>
+#include <chrono>
+#include <algorithm>
+#include <iomanip>
+#include <fstream>
+#include <optional>
+#include <csignal>
 
 #include <schip/config.h>
+#include <schip/machine.h>
 #include <schip/memory.h>
 #include <schip/chip.h>
 #include <schip/display.h>
+#include <schip/rewind.h>
+#include <schip/movie.h>
+#include <schip/state.h>
+#include <schip/explorer.h>
+#include <schip/fuzzer.h>
+#include <schip/library.h>
+#include <schip/lockstep.h>
+#include <schip/workload.h>
+#include <schip/profiler.h>
+#include <schip/timeline.h>
+#include <schip/pacing.h>
+#include <schip/recorder.h>
+#include <schip/audio.h>
+#include <schip/debugger.h>
+#include <schip/shm.h>
+#include <schip/control.h>
+
+struct Options {
+    std::filesystem::path rom;
+    std::filesystem::path library;
+    std::filesystem::path record;
+    std::filesystem::path replay;
+    unsigned rewind_seconds{0};
+    unsigned run_ahead{0};
+    double speed{0};
+
+    unsigned threads{std::max(1u, std::thread::hardware_concurrency())};
+
+    std::filesystem::path explore;
+    ExploreOptions explore_options;
+
+    std::filesystem::path fuzz;
+    FuzzOptions fuzz_options;
+
+    std::optional<uint64_t> lockstep;
+    bool lockstep_per_frame{false};
+
+    std::filesystem::path stats;
+    std::filesystem::path timeline;
+
+    std::filesystem::path video;
+    bool raw_video{false};
+    unsigned video_scale{0};
+
+    ScaleFilter filter{SCALE_NEAREST};
+
+    std::string publish;
+
+    std::filesystem::path wav;
+    bool null_audio{false};
+
+    unsigned tiles{0};
+    std::vector<std::string> watch;
+
+    bool debug{false};
+
+    std::filesystem::path control;
+
+    bool pacing{false};
+    bool realtime{false};
+    std::optional<unsigned> cpu_core;
+    std::optional<unsigned> display_core;
+    std::filesystem::path trace{"chip8.trace"};
+
+    std::filesystem::path profile;
+    unsigned profile_interval{61};
+
+    ChipEngine engine{ENGINE_SWITCH};
+
+    bool bench{false};
+    uint64_t bench_instructions{20'000'000};
+};
+
+static void print_help(const char* program) {
+    std::cerr << PROJECT_NAME << " v" << PROJECT_VER << std::endl;
+    std::cerr << " -----" << std::endl;
+    std::cerr << "This is a SCHIP/CHIP8 emulator. " << std::endl << std::endl;
+    std::cerr << "Usage: " << program << " [options] <path to rom>" << std::endl;
+    std::cerr << "       " << program << " [--tiles <n> <path to rom>] [--watch <name>]..." << std::endl;
+    std::cerr << "       " << program << " --bench [--instructions <n>] [--engine <name>]" << std::endl;
+    std::cerr << "       " << program << " --control <socket> [--threads <n>]" << std::endl << std::endl;
+    std::cerr << "Options:" << std::endl;
+    std::cerr << "  --library <archive> Load the ROM from a library by its name or hash, see schip_library" << std::endl;
+    std::cerr << "  --rewind <seconds>  Keep a history that backspace steps back through" << std::endl;
+    std::cerr << "  --run-ahead <n>     Present frames n frames ahead to hide input latency" << std::endl;
+    std::cerr << "  --record <movie>    Record every keypad change into a movie file" << std::endl;
+    std::cerr << "  --replay <movie>    Replay a movie without a display and compare the final state" << std::endl;
+    std::cerr << "  --speed <factor>    Replay speed relative to real time (default: 0, unthrottled)" << std::endl;
+    std::cerr << "  --explore <index>   Search the states reachable with the keypad and index them" << std::endl;
+    std::cerr << "  --depth <steps>     How many steps to search (default: 60)" << std::endl;
+    std::cerr << "  --hold <frames>     How many frames each key is held down for (default: 1)" << std::endl;
+    std::cerr << "  --max-states <n>    How many states to find before giving up (default: 1048576)" << std::endl;
+    std::cerr << "  --fuzz <dir>        Fuzz the keypad input and save new coverage and crashes as movies" << std::endl;
+    std::cerr << "  --frames <n>        How many frames each fuzzed input runs for (default: 600)" << std::endl;
+    std::cerr << "  --seconds <s>       How long to fuzz for, 0 for no limit (default: 60)" << std::endl;
+    std::cerr << "  --execs <n>         How many inputs to run before stopping (default: no limit)" << std::endl;
+    std::cerr << "  --lockstep <frames> Run the table engine against the reference and report where they diverge" << std::endl;
+    std::cerr << "  --per-frame         Compare the engines after every frame instead of every instruction" << std::endl;
+    std::cerr << "  --threads <n>       How many threads to search, fuzz or serve machines with (default: all cores)" << std::endl;
+    std::cerr << "  --profile <prefix>  Sample the guest program counter and write <prefix>.txt and <prefix>.folded" << std::endl;
+    std::cerr << "  --profile-interval <n> How many instructions there are between two samples (default: 61)" << std::endl;
+    std::cerr << "  --trace <file>      Where to write the last instructions on a fault or SIGUSR2 (default: chip8.trace)" << std::endl;
+    std::cerr << "  --debug             Stop at the first instruction and read debugger commands from stdin" << std::endl;
+    std::cerr << "  --control <socket>  Serve headless machines on a Unix domain socket, see schip_control" << std::endl;
+    std::cerr << "  --pacing            Measure how evenly frames are paced and print percentiles on exit" << std::endl;
+    std::cerr << "  --cpu-core <n>      Pin the interpreter thread to a CPU core" << std::endl;
+    std::cerr << "  --display-core <n>  Pin the display thread to a CPU core" << std::endl;
+    std::cerr << "  --realtime          Run the interpreter and display with SCHED_FIFO or a raised priority if permitted," << std::endl;
+    std::cerr << "                      needs --cpu-core and --display-core on different cores" << std::endl;
+    std::cerr << "  --video <file>      Record the presented frames into a compact recording, see schip_frames" << std::endl;
+    std::cerr << "  --raw-video         Write --video as raw 128x64 8-bit frames instead, e.g. into a pipe" << std::endl;
+    std::cerr << "  --video-scale <n>   Write --video as raw RGBA frames scaled up n times with --filter instead" << std::endl;
+    std::cerr << "  --filter <name>     How frames are scaled up for the window: nearest or scale2x (default: nearest)" << std::endl;
+    std::cerr << "  --wav <file>        Play the buzzer into a WAV file" << std::endl;
+    std::cerr << "  --null-audio        Play the buzzer into nothing, to check the audio path for underruns" << std::endl;
+    std::cerr << "  --publish <name>    Publish the presented frames into a shared memory object, see schip_watch" << std::endl;
+    std::cerr << "  --tiles <n>         Run n machines of the ROM side by side and show them in one window" << std::endl;
+    std::cerr << "  --watch <name>      Show the frames published under a name in the same window, may be repeated" << std::endl;
+    std::cerr << "  --timeline <file>   Record what the host threads do and write it as Chrome trace-event JSON" << std::endl;
+    std::cerr << "  --stats <file>      Write per-instruction counts and timings on exit (needs SCHIP_STATS)" << std::endl;
+    std::cerr << "  --engine <name>     How opcodes are dispatched: switch or table (default: switch)" << std::endl;
+    std::cerr << "  --bench             Run the built-in workloads unthrottled and report their speed" << std::endl;
+    std::cerr << "  --instructions <n>  How many instructions each workload runs for (default: 20000000)" << std::endl;
+}
+
+static Options parse_options(int argc, char** argv) {
+    Options options;
+
+    for (int i = 1; i < argc; i++) {
+        std::string_view arg{argv[i]};
+        bool has_value = i + 1 < argc;
+
+        if (arg == "--library" && has_value) {
+            options.library = argv[++i];
+        } else if (arg == "--rewind" && has_value) {
+            options.rewind_seconds = std::stoul(argv[++i]);
+        } else if (arg == "--run-ahead" && has_value) {
+            options.run_ahead = std::stoul(argv[++i]);
+        } else if (arg == "--record" && has_value) {
+            options.record = argv[++i];
+        } else if (arg == "--replay" && has_value) {
+            options.replay = argv[++i];
+        } else if (arg == "--speed" && has_value) {
+            options.speed = std::stod(argv[++i]);
+        } else if (arg == "--explore" && has_value) {
+            options.explore = argv[++i];
+        } else if (arg == "--depth" && has_value) {
+            options.explore_options.max_depth = std::stoul(argv[++i]);
+        } else if (arg == "--hold" && has_value) {
+            options.explore_options.hold_frames = std::stoul(argv[++i]);
+        } else if (arg == "--max-states" && has_value) {
+            options.explore_options.max_states = std::stoull(argv[++i]);
+        } else if (arg == "--fuzz" && has_value) {
+            options.fuzz = argv[++i];
+        } else if (arg == "--frames" && has_value) {
+            options.fuzz_options.frames = std::stoul(argv[++i]);
+        } else if (arg == "--seconds" && has_value) {
+            options.fuzz_options.max_seconds = std::stod(argv[++i]);
+        } else if (arg == "--execs" && has_value) {
+            options.fuzz_options.max_execs = std::stoull(argv[++i]);
+        } else if (arg == "--threads" && has_value) {
+            options.threads = std::stoul(argv[++i]);
+        } else if (arg == "--profile" && has_value) {
+            options.profile = argv[++i];
+        } else if (arg == "--profile-interval" && has_value) {
+            options.profile_interval = std::stoul(argv[++i]);
+        } else if (arg == "--trace" && has_value) {
+            options.trace = argv[++i];
+        } else if (arg == "--debug") {
+            options.debug = true;
+        } else if (arg == "--control" && has_value) {
+            options.control = argv[++i];
+        } else if (arg == "--pacing") {
+            options.pacing = true;
+        } else if (arg == "--realtime") {
+            options.realtime = true;
+        } else if (arg == "--cpu-core" && has_value) {
+            options.cpu_core = std::stoul(argv[++i]);
+        } else if (arg == "--display-core" && has_value) {
+            options.display_core = std::stoul(argv[++i]);
+        } else if (arg == "--video" && has_value) {
+            options.video = argv[++i];
+        } else if (arg == "--raw-video") {
+            options.raw_video = true;
+        } else if (arg == "--video-scale" && has_value) {
+            options.video_scale = std::stoul(argv[++i]);
+        } else if (arg == "--filter" && has_value) {
+            std::string_view name{argv[++i]};
+            if (name == "nearest")
+                options.filter = SCALE_NEAREST;
+            else if (name == "scale2x")
+                options.filter = SCALE_2X;
+            else
+                throw std::invalid_argument("Unknown filter " + std::string(name));
+        } else if (arg == "--wav" && has_value) {
+            options.wav = argv[++i];
+        } else if (arg == "--null-audio") {
+            options.null_audio = true;
+        } else if (arg == "--publish" && has_value) {
+            options.publish = argv[++i];
+        } else if (arg == "--tiles" && has_value) {
+            options.tiles = std::stoul(argv[++i]);
+        } else if (arg == "--watch" && has_value) {
+            options.watch.push_back(argv[++i]);
+        } else if (arg == "--timeline" && has_value) {
+            options.timeline = argv[++i];
+        } else if (arg == "--lockstep" && has_value) {
+            options.lockstep = std::stoull(argv[++i]);
+        } else if (arg == "--per-frame") {
+            options.lockstep_per_frame = true;
+        } else if (arg == "--stats" && has_value) {
+            options.stats = argv[++i];
+        } else if (arg == "--engine" && has_value) {
+            std::string_view name{argv[++i]};
+            if (name == "switch")
+                options.engine = ENGINE_SWITCH;
+            else if (name == "table")
+                options.engine = ENGINE_TABLE;
+            else
+                throw std::invalid_argument("Unknown engine " + std::string(name));
+        } else if (arg == "--bench") {
+            options.bench = true;
+        } else if (arg == "--instructions" && has_value) {
+            options.bench_instructions = std::stoull(argv[++i]);
+        } else if (arg.starts_with("--")) {
+            throw std::invalid_argument("Unknown option " + std::string(arg));
+        } else {
+            options.rom = arg;
+        }
+    }
+
+    if (options.rom.empty() && !options.bench && options.control.empty() && (options.tiles || options.watch.empty()))
+        throw std::invalid_argument("No ROM was given");
+
+    if (!options.record.empty() && (options.rewind_seconds || !options.replay.empty()))
+        throw std::invalid_argument("--record cannot be combined with --rewind or --replay");
+
+    // The framebuffer lock is waited for by yielding, which a SCHED_FIFO
+    // thread never gives up its core for
+    if (options.realtime && (!options.cpu_core || !options.display_core || *options.cpu_core == *options.display_core))
+        throw std::invalid_argument("--realtime needs --cpu-core and --display-core on different cores");
+
+    return options;
+}
+
+static uint64_t rom_hash() {
+    auto state = std::make_unique<MachineState>();
+    Bus::get_instance().save_state(*state);
+    return hash_bytes(state->memory.data(), state->memory.size());
+}
+
+// Applies the core and scheduling options to the calling thread
+static void tune_thread(const char* name, std::optional<unsigned> core, bool realtime) {
+    if (core) {
+        if (pin_current_thread(*core))
+            std::cout << "Pinned the " << name << " thread to core " << *core << std::endl;
+        else
+            std::cerr << "Warning: cannot pin the " << name << " thread to core " << *core << std::endl;
+    }
+
+    if (realtime) {
+        if (auto granted = raise_current_thread_priority())
+            std::cout << "The " << name << " thread runs with " << *granted << std::endl;
+        else
+            std::cerr << "Warning: not permitted to raise the priority of the " << name << " thread" << std::endl;
+    }
+}
+
+static void write_timeline(const Options& options) {
+    if (options.timeline.empty())
+        return;
+
+    Timeline::get_instance().write(options.timeline);
+    std::cout << "Wrote the timeline to " << options.timeline.string() << std::endl;
+}
+
+static void write_stats(const Options& options) {
+    // There are no stats in a build without SCHIP_STATS
+    const OpStats* stats = Chip::get_instance().stats();
+    if (options.stats.empty() || !stats)
+        return;
+
+    std::ofstream file{options.stats};
+    if (!file)
+        throw std::runtime_error("Cannot create the stats file");
+
+    stats->write_json(file);
+}
+
+static std::unique_ptr<Profiler> attach_profiler(const Options& options) {
+    if (options.profile.empty())
+        return nullptr;
+
+    auto profiler = std::make_unique<Profiler>(options.profile_interval);
+    Chip::get_instance().set_profiler(profiler.get());
+    return profiler;
+}
+
+static void write_profile(const Options& options, Profiler* profiler) {
+    if (!profiler)
+        return;
+
+    Chip::get_instance().set_profiler(nullptr);
+
+    std::filesystem::path report = options.profile;
+    std::filesystem::path folded = options.profile;
+    report += ".txt";
+    folded += ".folded";
+
+    profiler->write_report(report, Bus::get_instance());
+    profiler->write_folded(folded);
+
+    std::cout << "Wrote " << profiler->samples() << " samples to " << report.string()
+              << " and " << folded.string() << std::endl;
+}
+
+static std::unique_ptr<FrameRecorder> start_recorder(const Options& options) {
+    if (options.video.empty())
+        return nullptr;
+
+    if (options.video_scale) {
+        ScaleOptions scale;
+        scale.filter = options.filter;
+        scale.scale = options.video_scale;
+
+        auto recorder = std::make_unique<FrameRecorder>(options.video, RECORDING_RGBA, scale);
+        std::cout << "Writing " << PPU::screen_width * scale.scale << "x" << PPU::screen_height * scale.scale
+                  << " RGBA frames to " << options.video.string() << std::endl;
+        return recorder;
+    }
+
+    return std::make_unique<FrameRecorder>(options.video, options.raw_video ? RECORDING_RAW : RECORDING_DELTA);
+}
+
+static void finish_recorder(const Options& options, FrameRecorder* recorder) {
+    if (!recorder)
+        return;
+
+    Chip::get_instance().set_recorder(nullptr);
+    recorder->finish();
+
+    std::cout << "Recorded " << recorder->written() << " frames to " << options.video.string();
+    if (uint64_t dropped = recorder->dropped())
+        std::cout << ", dropped " << dropped << " because the encoder fell behind";
+    std::cout << std::endl;
+}
+
+static std::unique_ptr<AudioOutput> start_audio(const Options& options, bool realtime) {
+    if (!options.wav.empty())
+        return std::make_unique<AudioOutput>(AUDIO_WAV, options.wav, realtime);
+
+    if (options.null_audio)
+        return std::make_unique<AudioOutput>(AUDIO_NULL, std::filesystem::path{}, realtime);
+
+    return nullptr;
+}
+
+static void finish_audio(const Options& options, AudioOutput* audio) {
+    if (!audio)
+        return;
+
+    Chip::get_instance().set_audio(nullptr);
+    audio->finish();
+
+    std::cout << "Played " << audio->written() << " samples";
+    if (!options.wav.empty())
+        std::cout << " into " << options.wav.string();
+    if (uint64_t underruns = audio->underruns())
+        std::cout << ", " << underruns << " of them silence because the queue ran dry";
+    if (uint64_t overruns = audio->overruns())
+        std::cout << ", dropped " << overruns << " because the queue was full";
+    std::cout << std::endl;
+}
+
+static std::unique_ptr<Debugger> start_debugger(const Options& options) {
+    if (!options.debug)
+        return nullptr;
+
+    Chip& chip = Chip::get_instance();
+    auto debugger = std::make_unique<Debugger>(chip, Bus::get_instance(), std::cout);
+    chip.set_debugger(debugger.get());
+
+    debugger->interrupt();
+    debugger->start_console(std::cin);
+    std::cout << "The debugger reads commands from stdin, try help. pause stops a running chip." << std::endl;
+    return debugger;
+}
+
+static int replay(const Options& options) {
+    using clock = std::chrono::steady_clock;
+    constexpr auto frame_time = std::chrono::duration<double>(1.0 / Chip::frame_rate);
+
+    MovieReader movie{options.replay};
+    Chip& chip = Chip::get_instance();
+
+    if (movie.header().rom_hash != rom_hash())
+        throw std::runtime_error("The movie was recorded with a different ROM");
+
+    if (movie.header().instructions_per_frame != Chip::instructions_per_frame)
+        throw std::runtime_error("The movie was recorded with a different speed");
+
+    chip.seed(movie.header().seed);
+    chip.set_trace_file(options.trace);
+    auto profiler = attach_profiler(options);
+    auto recorder = start_recorder(options);
+    auto audio = start_audio(options, false);
+    auto debugger = start_debugger(options);
+    PPU& ppu = PPU::get_instance();
+
+    std::unique_ptr<FramePublisher> publisher;
+    if (!options.publish.empty())
+        publisher = std::make_unique<FramePublisher>(options.publish);
+
+    auto start = clock::now();
+    uint64_t frame = 0;
+
+    try {
+        for (; frame < movie.frames() && !chip.has_exited() && !(debugger && debugger->has_quit()); frame++) {
+            {
+                Timeline::Scope scope{"execute"};
+                chip.run_frame(movie.keys_at(frame));
+            }
+
+            // Numbered like presented frames, which are numbered after the frame has run
+            if (recorder)
+                recorder->push_wait(frame + 1, ppu.pixels(), ppu.is_extended());
+
+            if (publisher)
+                publisher->publish(ppu.pixels(), ppu.is_extended());
+
+            if (audio)
+                audio->push_wait(chip.is_buzzing());
+
+            if (options.speed > 0) {
+                std::this_thread::sleep_until(start + std::chrono::duration_cast<clock::duration>(
+                    frame_time * (frame + 1) / options.speed
+                ));
+            }
+        }
+    } catch (std::exception& err) {
+        std::cerr << "Chip error: " << err.what() << std::endl;
+        chip.write_trace(err.what());
+    }
+
+    std::chrono::duration<double> elapsed = clock::now() - start;
+    chip.set_debugger(nullptr);
+    finish_recorder(options, recorder.get());
+    finish_audio(options, audio.get());
+    write_stats(options);
+    write_profile(options, profiler.get());
+    write_timeline(options);
+
+    auto state = std::make_unique<MachineState>();
+    chip.save_state(*state);
+    uint64_t hash = hash_state(*state);
+
+    std::cout << "Replayed " << frame << " frames in " << elapsed.count() * 1000 << " ms ("
+              << frame / elapsed.count() << " frames/s)" << std::endl;
+    std::cout << "Final state hash: 0x" << std::hex << hash << std::dec << std::endl;
+
+    if (!movie.finished()) {
+        std::cout << "The movie has no final state to compare with" << std::endl;
+        return EXIT_SUCCESS;
+    }
+
+    if (hash != movie.state_hash()) {
+        std::cout << "The final state DIFFERS from the recording (0x" << std::hex
+                  << movie.state_hash() << std::dec << ")" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    std::cout << "The final state matches the recording" << std::endl;
+    return EXIT_SUCCESS;
+}
+
+static int lockstep(const Options& options) {
+    using clock = std::chrono::steady_clock;
+
+    Chip& chip = Chip::get_instance();
+    std::optional<MovieReader> movie;
+
+    // Play the keys of a movie if there is one, otherwise press nothing
+    if (!options.replay.empty()) {
+        movie.emplace(options.replay);
+
+        if (movie->header().rom_hash != rom_hash())
+            throw std::runtime_error("The movie was recorded with a different ROM");
+
+        chip.seed(movie->header().seed);
+    } else {
+        chip.seed(0);
+    }
+
+    auto boot = std::make_unique<MachineState>();
+    chip.save_state(*boot);
+
+    LockstepOptions lockstep_options;
+    lockstep_options.frames = *options.lockstep;
+    lockstep_options.every_instruction = !options.lockstep_per_frame;
+
+    Lockstep checker{*boot, ENGINE_SWITCH, ENGINE_TABLE, lockstep_options};
+
+    auto start = clock::now();
+    auto divergence = checker.run([&movie](uint64_t frame) -> uint16_t {
+        return movie ? movie->keys_at(frame) : 0;
+    });
+    std::chrono::duration<double> elapsed = clock::now() - start;
+
+    std::cout << "Ran " << checker.frames() << " frames (" << checker.instructions() << " instructions) in lockstep in "
+              << elapsed.count() * 1000 << " ms" << std::endl;
+
+    if (divergence) {
+        std::cout << divergence->report;
+        return EXIT_FAILURE;
+    }
+
+    if (!checker.error().empty())
+        std::cout << "Both engines stopped with: " << checker.error() << std::endl;
+
+    std::cout << "The engines agree" << std::endl;
+    return EXIT_SUCCESS;
+}
+
+static int explore(const Options& options) {
+    using clock = std::chrono::steady_clock;
+
+    // Explore from a fixed seed so that the index can be reproduced
+    Chip& chip = Chip::get_instance();
+    chip.seed(0);
+
+    auto root = std::make_unique<MachineState>();
+    chip.save_state(*root);
+
+    auto start = clock::now();
+
+    ExploreOptions explore_options = options.explore_options;
+    explore_options.threads = options.threads;
+
+    Explorer explorer{*root, explore_options};
+    ExploreStats stats = explorer.run();
+    explorer.write_index(options.explore);
+
+    std::chrono::duration<double> elapsed = clock::now() - start;
+
+    std::cout << "Found " << stats.states << " states (" << stats.screens << " distinct screens) in "
+              << stats.depth << " steps" << std::endl;
+    std::cout << stats.exits << " states exited and " << stats.faults << " inputs faulted" << std::endl;
+    std::cout << "Searched for " << elapsed.count() * 1000 << " ms ("
+              << stats.states / elapsed.count() << " states/s)" << std::endl;
+
+    return EXIT_SUCCESS;
+}
+
+static int fuzz(const Options& options) {
+    FuzzOptions fuzz_options = options.fuzz_options;
+    fuzz_options.threads = options.threads;
+
+    Chip& chip = Chip::get_instance();
+    chip.seed(fuzz_options.seed);
+
+    auto boot = std::make_unique<MachineState>();
+    chip.save_state(*boot);
+
+    Fuzzer fuzzer{*boot, options.fuzz, fuzz_options};
+    FuzzStats stats = fuzzer.run();
+
+    std::cout << "Ran " << stats.execs << " inputs (" << stats.frames << " frames) in "
+              << stats.seconds << " s, " << stats.frames / stats.seconds * 60 << " frames/min" << std::endl;
+    std::cout << "Covered " << stats.edges << " edges with " << stats.corpus << " inputs, found "
+              << stats.crashes << " crashes" << std::endl;
+
+    return EXIT_SUCCESS;
+}
+
+static ControlServer* control_server = nullptr;
+
+static void on_control_signal(int) {
+    control_server->stop();
+}
+
+// Serves machines on --control until interrupted
+static int control(const Options& options) {
+    ControlServer server{options.control, options.threads};
+
+    control_server = &server;
+    std::signal(SIGINT, on_control_signal);
+    std::signal(SIGTERM, on_control_signal);
+
+    std::cout << "Serving machines on " << options.control.string() << " with " << options.threads
+              << " threads" << std::endl;
+
+    auto start = std::chrono::steady_clock::now();
+    server.run();
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    std::signal(SIGINT, SIG_DFL);
+    std::signal(SIGTERM, SIG_DFL);
+    control_server = nullptr;
+
+    std::cout << "Answered " << server.requests() << " requests in " << server.batches() << " batches over "
+              << elapsed.count() << " s" << std::endl;
+    return EXIT_SUCCESS;
+}
+
+static int bench(const Options& options) {
+    std::cout << std::left << std::setw(8) << "workload" << std::right
+              << std::setw(10) << "MIPS" << std::setw(12) << "frames/s"
+              << std::setw(9) << "exec" << std::setw(9) << "timers" << std::setw(9) << "present" << std::endl;
+
+    for (const Workload& workload : builtin_workloads()) {
+        WorkloadResult result = run_workload(workload, options.bench_instructions, options.engine);
+        const FrameProfile& profile = result.profile;
+
+        double seconds = std::chrono::duration<double>(result.elapsed).count();
+        double phases = static_cast<double>((profile.exec + profile.timers + profile.present).count());
+        auto percent = [phases](std::chrono::nanoseconds time) {
+            return phases > 0 ? time.count() * 100 / phases : 0.0;
+        };
+
+        std::cout << std::left << std::setw(8) << workload.name << std::right << std::fixed
+                  << std::setprecision(1) << std::setw(10) << profile.instructions / seconds / 1e6
+                  << std::setprecision(0) << std::setw(12) << profile.frames / seconds
+                  << std::setprecision(1) << std::setw(8) << percent(profile.exec) << "%"
+                  << std::setw(8) << percent(profile.timers) << "%"
+                  << std::setw(8) << percent(profile.present) << "%" << std::endl;
+    }
+
+    return EXIT_SUCCESS;
+}
+
+// Runs --tiles machines and shows them, with every --watch publisher, in one window
+static int tiled(const Options& options) {
+    using clock = std::chrono::steady_clock;
+
+    std::vector<std::unique_ptr<Machine>> machines;
+    for (unsigned n = 0; n < options.tiles; n++) {
+        auto machine = std::make_unique<Machine>();
+        machine->bus.load_program(Bus::get_instance().data());
+        machine->chip.seed(n + 1);
+        machine->chip.set_engine(options.engine);
+        machines.push_back(std::move(machine));
+    }
+
+    std::vector<std::unique_ptr<FrameSubscriber>> subscribers;
+    for (const std::string& name : options.watch)
+        subscribers.push_back(std::make_unique<FrameSubscriber>(name));
+
+    std::vector<Display::TileSource> sources;
+
+    for (auto& machine : machines) {
+        sources.push_back([&ppu = machine->ppu](FramePixels& frame, bool& extended) {
+            extended = ppu.copy_presented(frame);
+            return true;
+        });
+    }
+
+    for (auto& subscriber : subscribers) {
+        // A frame that was overwritten while it was copied is picked up on the next repaint
+        sources.push_back([&subscriber = *subscriber, shown = uint64_t{0}](FramePixels& frame, bool& extended) mutable {
+            SharedFrameView view;
+            if (subscriber.latest() == shown || !subscriber.acquire(view))
+                return false;
+
+            uint64_t number = view.slot->frame;
+            extended = view.slot->extended;
+            frame = view.slot->pixels;
+
+            if (!subscriber.validate(view))
+                return false;
+
+            shown = number;
+            return true;
+        });
+    }
+
+    // Every worker runs its share of the machines one frame each, then sleeps
+    // until the next frame. The workers are stopped and joined when they go
+    // out of scope.
+    std::vector<std::jthread> workers;
+    unsigned threads = std::min<unsigned>(options.threads, machines.size());
+
+    for (unsigned t = 0; t < threads; t++) {
+        workers.emplace_back([&machines, t, threads](std::stop_token stop) {
+            std::vector<bool> stopped(machines.size(), false);
+            auto deadline = clock::now();
+
+            while (!stop.stop_requested()) {
+                uint16_t keys = KeyPad::get_instance().get_mask();
+
+                for (size_t n = t; n < machines.size(); n += threads) {
+                    Chip& chip = machines[n]->chip;
+                    if (stopped[n])
+                        continue;
+
+                    try {
+                        chip.run_frame(keys);
+                        chip.present();
+                    } catch (std::exception& err) {
+                        std::cerr << "Machine " << n << " stopped: " << err.what() << std::endl;
+                        stopped[n] = true;
+                    }
+
+                    stopped[n] = stopped[n] || chip.has_exited();
+                }
+
+                deadline += Chip::frame_time;
+                if (auto now = clock::now(); now > deadline + Chip::frame_time)
+                    deadline = now;
+
+                std::this_thread::sleep_until(deadline);
+            }
+        });
+    }
+
+    std::cout << "Showing " << machines.size() << " machines on " << threads << " threads and "
+              << subscribers.size() << " published screens" << std::endl;
+
+    Display::init_tiled(std::move(sources));
+    Display::run([&]() {
+        workers.clear();
+        write_timeline(options);
+    });
+
+    return EXIT_SUCCESS;
+}
 
 int main(int argc, char** argv) {
-	if (argc < 2) {
-        // Print help text.
-		std::cerr << PROJECT_NAME << " v" << PROJECT_VER << std::endl;
-		std::cerr << " -----" << std::endl;
-		std::cerr << "This is a SCHIP/CHIP8 emulator. " << std::endl << std::endl;
-		std::cerr << "Usage: " << argv[0] << " <path to rom>" << std::endl;
+    Options options;
+
+    try {
+        options = parse_options(argc, argv);
+    } catch (std::exception& err) {
+        std::cerr << "Error: " << err.what() << std::endl << std::endl;
+        print_help(argv[0]);
         return EXIT_FAILURE;
-	}
+    }
 
 	try {
+        if (!options.stats.empty() && !Chip::get_instance().stats())
+            throw std::invalid_argument("--stats needs a build with SCHIP_STATS enabled");
+
+        if (Chip::get_instance().stats())
+            OpStats::install_signal_handler();
+
+        TraceRing::install_signal_handler();
+
+        if (!options.timeline.empty())
+            Timeline::get_instance().enable();
+
+        Chip::get_instance().set_engine(options.engine);
+
+        if (options.bench)
+            return bench(options);
+
+        if (!options.control.empty())
+            return control(options);
+
+        if (!options.library.empty()) {
+            RomLibrary library{options.library};
+            const RomEntry* entry = library.find(options.rom.string());
+            if (!entry)
+                throw std::invalid_argument("There is no single ROM called " + options.rom.string() + " in the library");
+
+            Bus::get_instance().load_program(library.rom(*entry));
+        } else if (!options.rom.empty()) {
+            Bus::get_instance().load_program(
+                std::filesystem::absolute(options.rom)
+            );
+        }
+
+        if (options.lockstep)
+            return lockstep(options);
+
+        if (!options.replay.empty())
+            return replay(options);
+
+        if (!options.explore.empty())
+            return explore(options);
+
+        if (!options.fuzz.empty())
+            return fuzz(options);
+
 		glutInit(&argc, argv);
 
-        Bus::get_instance().load_program(
-            std::filesystem::absolute(argv[1])
-        );
+        if (options.tiles || !options.watch.empty())
+            return tiled(options);
+
+        Chip& chip = Chip::get_instance();
+
+        chip.set_run_ahead(options.run_ahead);
+        chip.set_trace_file(options.trace);
+
+        std::unique_ptr<Rewind> rewind;
+        if (options.rewind_seconds) {
+            rewind = std::make_unique<Rewind>(options.rewind_seconds * Chip::frame_rate);
+            chip.set_rewind(rewind.get());
+        }
+
+        std::unique_ptr<MovieWriter> movie;
+        if (!options.record.empty()) {
+            MovieHeader header;
+            header.instructions_per_frame = Chip::instructions_per_frame;
+            header.seed = std::random_device{}();
+            header.rom_hash = rom_hash();
+
+            chip.seed(header.seed);
+            movie = std::make_unique<MovieWriter>(options.record, header);
+            chip.set_movie(movie.get());
+        }
+
+        auto profiler = attach_profiler(options);
+
+        auto recorder = start_recorder(options);
+        chip.set_recorder(recorder.get());
+
+        auto audio = start_audio(options, true);
+        chip.set_audio(audio.get());
+
+        std::unique_ptr<FramePublisher> publisher;
+        if (!options.publish.empty()) {
+            publisher = std::make_unique<FramePublisher>(options.publish);
+            PPU::get_instance().set_publisher(publisher.get());
+        }
+
+        std::unique_ptr<FramePacing> pacing;
+        if (options.pacing) {
+            pacing = std::make_unique<FramePacing>(Chip::frame_time);
+            chip.set_pacing(pacing.get());
+        }
+
+        auto debugger = start_debugger(options);
+
+        std::thread chipthread([&chip, &options]() {
+            tune_thread("interpreter", options.cpu_core, options.realtime);
+            chip.run();
+        });
+
+        tune_thread("display", options.display_core, options.realtime);
+
+        Display::init(options.filter);
+		Display::run([&]() {
+            chip.stop();
+            if (debugger)
+                debugger->shutdown();
+            chipthread.join();
+            chip.set_debugger(nullptr);
+
+            if (pacing)
+                pacing->report(std::cout);
 
-        std::thread chipthread([]() { Chip::get_instance().run(); });
+            finish_recorder(options, recorder.get());
+            finish_audio(options, audio.get());
+            PPU::get_instance().set_publisher(nullptr);
 
-        Display::init();
-		Display::run();
+            write_stats(options);
+            write_profile(options, profiler.get());
+            write_timeline(options);
+        });
 
 	} catch (std::exception& err) {
 		std::cerr << "Error: " << err.what() << std::endl;
@@ -1,12 +1,10 @@
 #include <cassert>
 #include <array>
+#include <algorithm>
 #include <fstream>
 
 #include <schip/memory.h>
-
-constexpr Addr USERCODE_BEG = 0x200;
-constexpr Addr USERCODE_END = 0x1000;
-constexpr size_t USERCODE_SIZE = USERCODE_END - USERCODE_BEG;
+#include <schip/state.h>
 
 // 4*5 pixel hex font patterns
 constexpr std::array<Byte, 0x50> HEX_FONT = {
@@ -42,11 +40,14 @@ constexpr std::array<Byte, 0x64> BIG_FONT = {
     0x3c, 0x7e, 0xc3, 0xc3, 0x7f, 0x3f, 0x03, 0x03, 0x3e, 0x7c  // 9
 };
 
-Bus::Bus()
-    : m_data(reinterpret_cast<char*>(calloc(USERCODE_SIZE, sizeof(Byte))))
-{}
+Bus::Bus() {
+    std::copy(HEX_FONT.begin(), HEX_FONT.end(), m_memory.begin());
+    std::copy(BIG_FONT.begin(), BIG_FONT.end(), m_memory.begin() + HEX_FONT.size());
 
-Bus::~Bus() { if (m_data) delete m_data; }
+    // This space contains the code for the chip8 interpreter irl.
+    // Fill it with "garbage". 0xcc is easy to spot.
+    std::fill(m_memory.begin() + HEX_FONT.size() + BIG_FONT.size(), m_memory.begin() + USERCODE_BEG, 0xcc);
+}
 
 Byte Bus::read(Addr addr) const {
     if (addr >= USERCODE_END) {
@@ -55,20 +56,13 @@ Byte Bus::read(Addr addr) const {
 #endif
         throw std::out_of_range("Bus read: Address is out of range");
     }
-    
-    if (addr < HEX_FONT.size()) {
-        return HEX_FONT[addr];
-    } else if (addr < HEX_FONT.size() + BIG_FONT.size()) {
-        return BIG_FONT[addr - HEX_FONT.size()];
-    } else if (addr < USERCODE_BEG) {
+
 #if(DEBUG)
+    if (addr >= HEX_FONT.size() + BIG_FONT.size() && addr < USERCODE_BEG)
         printf("Warning: Reading garbage from address [0x%04x]\n", addr);
 #endif
-        // This space contains the code for the chip8 interpreter irl.
-        return 0xcc; // Return "garbage". 0xcc is easy to spot.
-    }
 
-    return m_data[addr - USERCODE_BEG];
+    return m_memory[addr];
 }
 
 void Bus::write(Addr addr, Byte byte) {
@@ -79,7 +73,36 @@ void Bus::write(Addr addr, Byte byte) {
         throw std::out_of_range("Bus write: Address is out of range");
     }
 
-    m_data[addr - USERCODE_BEG] = byte;
+    m_memory[addr] = byte;
+    mark_dirty(addr);
+}
+
+void Bus::write_span(Addr addr, std::span<const Byte> bytes) {
+    if (bytes.empty())
+        return;
+
+    if (addr < USERCODE_BEG || addr + bytes.size() > USERCODE_END) {
+#if(DEBUG)
+        printf("Tried to write %zu bytes to address [0x%04x]\n", bytes.size(), addr);
+#endif
+        throw std::out_of_range("Bus write: Address is out of range");
+    }
+
+    std::copy(bytes.begin(), bytes.end(), m_memory.begin() + addr);
+
+    // Every page from the first to the last byte
+    size_t first = (addr - USERCODE_BEG) / MEMORY_PAGE_SIZE;
+    size_t last = (addr + bytes.size() - 1 - USERCODE_BEG) / MEMORY_PAGE_SIZE;
+    m_dirty |= (~uint64_t{0} >> (63 - last)) & (~uint64_t{0} << first);
+}
+
+void Bus::save_state(MachineState& state) const {
+    std::copy(user().begin(), user().end(), state.memory.begin());
+}
+
+void Bus::load_state(const MachineState& state) {
+    std::copy(state.memory.begin(), state.memory.end(), user().begin());
+    m_dirty = ~uint64_t{0};
 }
 
 void Bus::load_program(std::filesystem::path filename) {
@@ -108,7 +131,10 @@ void Bus::load_program(std::filesystem::path filename) {
     if (filesize > USERCODE_SIZE)
         throw std::invalid_argument("The file is too big to be a chip8/schip program");
 
-    file.read(m_data, USERCODE_SIZE);
+    std::fill(user().begin(), user().end(), 0);
+    m_dirty = ~uint64_t{0};
+
+    file.read(reinterpret_cast<char*>(user().data()), USERCODE_SIZE);
     size_t read = file.gcount();
 
 #if(DEBUG)
@@ -122,3 +148,16 @@ void Bus::load_program(std::filesystem::path filename) {
 
     file.close();
 }
+
+void Bus::load_program(std::span<const Byte> program) {
+    if (program.empty())
+        throw std::runtime_error("The program is empty");
+
+    if (program.size() > USERCODE_SIZE)
+        throw std::invalid_argument("The program is too big to be a chip8/schip program");
+
+    std::fill(user().begin(), user().end(), 0);
+    m_dirty = ~uint64_t{0};
+
+    std::copy(program.begin(), program.end(), user().begin());
+}
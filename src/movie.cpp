@@ -0,0 +1,133 @@
+#include <stdexcept>
+#include <iterator>
+#include <string_view>
+#include <algorithm>
+
+#include <schip/movie.h>
+
+namespace {
+
+constexpr std::string_view MOVIE_MAGIC{"SCHIPMOV"};
+
+template <typename T>
+void write_le(std::ofstream& file, T value) {
+    for (size_t i = 0; i < sizeof(T); i++)
+        file.put(static_cast<char>((value >> (i * 8)) & 0xff));
+}
+
+template <typename T>
+T read_le(const std::vector<char>& data, size_t& pos) {
+    if (pos + sizeof(T) > data.size())
+        throw std::runtime_error("The movie file is truncated");
+
+    T value{0};
+    for (size_t i = 0; i < sizeof(T); i++)
+        value |= static_cast<T>(static_cast<uint8_t>(data[pos++])) << (i * 8);
+    return value;
+}
+
+uint64_t read_varint(const std::vector<char>& data, size_t& pos) {
+    uint64_t value{0};
+
+    for (unsigned shift = 0; shift < 64; shift += 7) {
+        if (pos >= data.size())
+            throw std::runtime_error("The movie file is truncated");
+
+        uint8_t byte = data[pos++];
+        value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+        if (!(byte & 0x80))
+            return value;
+    }
+
+    throw std::runtime_error("The movie file is corrupt");
+}
+
+}
+
+MovieWriter::MovieWriter(std::filesystem::path filename, const MovieHeader& header)
+    : m_file(filename, std::ios_base::out | std::ios::binary | std::ios::trunc)
+{
+    if (!m_file)
+        throw std::runtime_error("Cannot create the movie file");
+
+    m_file.write(MOVIE_MAGIC.data(), MOVIE_MAGIC.size());
+    write_le(m_file, header.version);
+    write_le(m_file, header.instructions_per_frame);
+    write_le(m_file, header.seed);
+    write_le(m_file, header.rom_hash);
+}
+
+void MovieWriter::write_varint(uint64_t value) {
+    do {
+        uint8_t byte = value & 0x7f;
+        value >>= 7;
+        m_file.put(static_cast<char>(value ? byte | 0x80 : byte));
+    } while (value);
+}
+
+void MovieWriter::record(uint64_t frame, uint16_t keys) {
+    if (m_finished || keys == m_keys)
+        return;
+
+    write_varint((frame - m_frame) << 1);
+    write_le(m_file, keys);
+
+    m_frame = frame;
+    m_keys = keys;
+}
+
+void MovieWriter::finish(uint64_t frames, uint64_t state_hash) {
+    if (m_finished)
+        return;
+
+    write_varint(((frames - m_frame) << 1) | 1);
+    write_le(m_file, state_hash);
+    m_file.flush();
+
+    m_finished = true;
+}
+
+MovieReader::MovieReader(std::filesystem::path filename) {
+    std::ifstream file{filename, std::ios_base::in | std::ios::binary};
+
+    if (!file.is_open())
+        throw std::runtime_error("Movie file not found");
+
+    std::vector<char> data{std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>()};
+
+    if (std::string_view(data.data(), std::min(data.size(), MOVIE_MAGIC.size())) != MOVIE_MAGIC)
+        throw std::runtime_error("The file is not a movie");
+
+    size_t pos = MOVIE_MAGIC.size();
+    m_header.version = read_le<uint16_t>(data, pos);
+    m_header.instructions_per_frame = read_le<uint16_t>(data, pos);
+    m_header.seed = read_le<uint32_t>(data, pos);
+    m_header.rom_hash = read_le<uint64_t>(data, pos);
+
+    if (m_header.version != MovieHeader{}.version)
+        throw std::runtime_error("Unsupported movie version");
+
+    uint64_t frame = 0;
+    while (pos < data.size()) {
+        uint64_t tag = read_varint(data, pos);
+        frame += tag >> 1;
+
+        if (tag & 1) {
+            m_state_hash = read_le<uint64_t>(data, pos);
+            m_finished = true;
+            break;
+        }
+
+        m_events.push_back({frame, read_le<uint16_t>(data, pos)});
+    }
+
+    // An unfinished movie ends with its last key change
+    m_frames = frame;
+}
+
+uint16_t MovieReader::keys_at(uint64_t frame) {
+    while (m_next < m_events.size() && m_events[m_next].frame <= frame)
+        m_keys = m_events[m_next++].keys;
+
+    return m_keys;
+}
@@ -0,0 +1,140 @@
+#include <cstdio>
+
+#include <schip/opcodes.h>
+
+Op classify(uint16_t opcode) {
+    unsigned n = opcode & 0xf;
+    unsigned kk = opcode & 0xff;
+
+    switch (opcode >> 12) {
+        case 0x0:
+            if ((opcode & 0xfff0) == 0x00c0)
+                return OP_SCRD;
+
+            switch (opcode) {
+                case 0x00e0: return OP_CLR;
+                case 0x00ee: return OP_RET;
+                case 0x00fb: return OP_SCRR;
+                case 0x00fc: return OP_SCRL;
+                case 0x00fd: return OP_EXIT;
+                case 0x00fe: return OP_DEX;
+                case 0x00ff: return OP_EEX;
+            }
+            break;
+        case 0x1: return OP_JMP;
+        case 0x2: return OP_CALL;
+        case 0x3: return OP_SEQ_IMM;
+        case 0x4: return OP_SNE_IMM;
+        case 0x5:
+            if (n == 0)
+                return OP_SEQ;
+            break;
+        case 0x6: return OP_LD;
+        case 0x7: return OP_ADD_IMM;
+        case 0x8:
+            switch (n) {
+                case 0x0: return OP_MOV;
+                case 0x1: return OP_OR;
+                case 0x2: return OP_AND;
+                case 0x3: return OP_XOR;
+                case 0x4: return OP_ADD;
+                case 0x5: return OP_SUB;
+                case 0x6: return OP_SHR;
+                case 0x7: return OP_SBR;
+                case 0xe: return OP_SHL;
+            }
+            break;
+        case 0x9: return OP_SNE;
+        case 0xa: return OP_LDI;
+        case 0xb: return OP_JMPR;
+        case 0xc: return OP_RAND;
+        case 0xd: return OP_DRAW;
+        case 0xe:
+            switch (kk) {
+                case 0x9e: return OP_SKP;
+                case 0xa1: return OP_SKNP;
+            }
+            break;
+        case 0xf:
+            switch (kk) {
+                case 0x07: return OP_GET_DELAY;
+                case 0x0a: return OP_GET_KEY;
+                case 0x15: return OP_SET_DELAY;
+                case 0x18: return OP_SET_STIMER;
+                case 0x1e: return OP_ADDI;
+                case 0x29: return OP_LD_SPRITE;
+                case 0x30: return OP_LD_ESPRITE;
+                case 0x33: return OP_SET_BCD;
+                case 0x55: return OP_REG_DUMP;
+                case 0x65: return OP_REG_STORE;
+                case 0x75: return OP_REG_DUMP_RPL;
+                case 0x85: return OP_REG_STORE_RPL;
+            }
+            break;
+    }
+
+    return OP_COUNT;
+}
+
+std::string disassemble(uint16_t opcode) {
+    unsigned x = (opcode >> 8) & 0xf;
+    unsigned y = (opcode >> 4) & 0xf;
+    unsigned n = opcode & 0xf;
+    unsigned kk = opcode & 0xff;
+    unsigned nnn = opcode & 0xfff;
+
+    char buffer[32];
+    auto format = [&buffer](const char* fmt, auto... args) {
+        std::snprintf(buffer, sizeof(buffer), fmt, args...);
+        return std::string(buffer);
+    };
+
+    switch (classify(opcode)) {
+        case OP_SCRD:          return format("scd %u", n);
+        case OP_CLR:           return "cls";
+        case OP_RET:           return "ret";
+        case OP_SCRR:          return "scr";
+        case OP_SCRL:          return "scl";
+        case OP_EXIT:          return "exit";
+        case OP_DEX:           return "low";
+        case OP_EEX:           return "high";
+        case OP_JMP:           return format("jp 0x%03x", nnn);
+        case OP_CALL:          return format("call 0x%03x", nnn);
+        case OP_SEQ_IMM:       return format("se v%x, 0x%02x", x, kk);
+        case OP_SNE_IMM:       return format("sne v%x, 0x%02x", x, kk);
+        case OP_SEQ:           return format("se v%x, v%x", x, y);
+        case OP_LD:            return format("ld v%x, 0x%02x", x, kk);
+        case OP_ADD_IMM:       return format("add v%x, 0x%02x", x, kk);
+        case OP_MOV:           return format("ld v%x, v%x", x, y);
+        case OP_OR:            return format("or v%x, v%x", x, y);
+        case OP_AND:           return format("and v%x, v%x", x, y);
+        case OP_XOR:           return format("xor v%x, v%x", x, y);
+        case OP_ADD:           return format("add v%x, v%x", x, y);
+        case OP_SUB:           return format("sub v%x, v%x", x, y);
+        case OP_SHR:           return format("shr v%x, v%x", x, y);
+        case OP_SBR:           return format("subn v%x, v%x", x, y);
+        case OP_SHL:           return format("shl v%x, v%x", x, y);
+        case OP_SNE:           return format("sne v%x, v%x", x, y);
+        case OP_LDI:           return format("ld i, 0x%03x", nnn);
+        case OP_JMPR:          return format("jp v%x, 0x%03x", x, nnn);
+        case OP_RAND:          return format("rnd v%x, 0x%02x", x, kk);
+        case OP_DRAW:          return format("drw v%x, v%x, %u", x, y, n);
+        case OP_SKP:           return format("skp v%x", x);
+        case OP_SKNP:          return format("sknp v%x", x);
+        case OP_GET_DELAY:     return format("ld v%x, dt", x);
+        case OP_GET_KEY:       return format("ld v%x, k", x);
+        case OP_SET_DELAY:     return format("ld dt, v%x", x);
+        case OP_SET_STIMER:    return format("ld st, v%x", x);
+        case OP_ADDI:          return format("add i, v%x", x);
+        case OP_LD_SPRITE:     return format("ld f, v%x", x);
+        case OP_LD_ESPRITE:    return format("ld hf, v%x", x);
+        case OP_SET_BCD:       return format("ld b, v%x", x);
+        case OP_REG_DUMP:      return format("ld [i], v%x", x);
+        case OP_REG_STORE:     return format("ld v%x, [i]", x);
+        case OP_REG_DUMP_RPL:  return format("ld r, v%x", x);
+        case OP_REG_STORE_RPL: return format("ld v%x, r", x);
+        case OP_COUNT:         break;
+    }
+
+    return format("db 0x%02x, 0x%02x", opcode >> 8, kk);
+}
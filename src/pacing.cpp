@@ -0,0 +1,153 @@
+#include <algorithm>
+#include <iomanip>
+#include <sstream>
+#include <string>
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include <schip/pacing.h>
+
+namespace {
+
+// The real-time priority to ask for. Anything above zero beats the ordinary
+// threads, and staying low leaves room for the kernel's own.
+constexpr int FIFO_PRIORITY = 10;
+
+// The nice value to fall back to
+constexpr int RAISED_NICE = -10;
+
+constexpr double PERCENTILES[] = {50, 90, 99, 99.9};
+
+constexpr size_t BAR_WIDTH = 40;
+
+}
+
+void LatencyHistogram::record(std::chrono::nanoseconds duration) {
+    duration = std::max(duration, std::chrono::nanoseconds{0});
+
+    auto us = std::chrono::duration_cast<std::chrono::microseconds>(duration);
+    m_buckets[std::min(us, limit).count()]++;
+
+    m_count++;
+    m_sum += duration;
+    m_max = std::max(m_max, duration);
+}
+
+std::chrono::microseconds LatencyHistogram::percentile(double p) const {
+    if (!m_count)
+        return {};
+
+    uint64_t rank = static_cast<uint64_t>(p / 100 * m_count + 0.5);
+    rank = std::clamp<uint64_t>(rank, 1, m_count);
+
+    uint64_t seen = 0;
+    for (size_t us = 0; us < m_buckets.size(); us++) {
+        seen += m_buckets[us];
+        if (seen >= rank)
+            return std::min(std::chrono::microseconds(us + 1), std::chrono::ceil<std::chrono::microseconds>(m_max));
+    }
+
+    return limit;
+}
+
+uint64_t LatencyHistogram::count_between(std::chrono::microseconds low, std::chrono::microseconds high) const {
+    uint64_t n = 0;
+    for (auto us = std::max<int64_t>(low.count(), 0); us < high.count() && us < static_cast<int64_t>(m_buckets.size()); us++)
+        n += m_buckets[us];
+    return n;
+}
+
+std::chrono::nanoseconds LatencyHistogram::mean() const {
+    return m_count ? m_sum / static_cast<int64_t>(m_count) : std::chrono::nanoseconds{};
+}
+
+void FramePacing::record(std::chrono::steady_clock::time_point woke, std::chrono::steady_clock::time_point deadline) {
+    if (m_last) {
+        auto period = woke - *m_last;
+        auto deviation = period > m_frame_time ? period - m_frame_time : m_frame_time - period;
+        m_deviation.record(deviation);
+    }
+
+    m_last = woke;
+    m_lateness.record(woke - deadline);
+}
+
+void FramePacing::report(std::ostream& out) const {
+    using std::chrono::microseconds;
+    using std::chrono::duration_cast;
+
+    out << "Frame pacing over " << m_lateness.count() << " frames (ideal frame time "
+        << std::fixed << std::setprecision(3) << m_frame_time.count() / 1e6 << " ms)" << std::endl;
+    out << "              deviation   late wake-up" << std::endl;
+
+    auto row = [&out](const char* name, microseconds a, microseconds b) {
+        out << "  " << std::left << std::setw(8) << name << std::right
+            << std::setw(10) << a.count() << " us" << std::setw(12) << b.count() << " us" << std::endl;
+    };
+
+    for (double p : PERCENTILES) {
+        std::ostringstream name;
+        name << "p" << p;
+        row(name.str().c_str(), m_deviation.percentile(p), m_lateness.percentile(p));
+    }
+
+    row("max", duration_cast<microseconds>(m_deviation.max()), duration_cast<microseconds>(m_lateness.max()));
+    row("mean", duration_cast<microseconds>(m_deviation.mean()), duration_cast<microseconds>(m_lateness.mean()));
+
+    if (!m_deviation.count())
+        return;
+
+    // Power of two ranges of the deviation, drawn as bars
+    out << "Deviation from the ideal frame time:" << std::endl;
+
+    uint64_t most = 1;
+    std::vector<std::pair<uint64_t, uint64_t>> ranges;
+    for (uint64_t low = 0, high = 1; low <= static_cast<uint64_t>(LatencyHistogram::limit.count()); low = high, high *= 2) {
+        uint64_t n = m_deviation.count_between(microseconds(low), microseconds(high));
+        ranges.emplace_back(low, n);
+        most = std::max(most, n);
+    }
+
+    // Leave out the empty ranges at either end
+    auto first = std::find_if(ranges.begin(), ranges.end(), [](auto& r) { return r.second; });
+    auto last = std::find_if(ranges.rbegin(), ranges.rend(), [](auto& r) { return r.second; }).base();
+
+    for (auto it = first; it < last; ++it) {
+        out << "  >= " << std::setw(6) << it->first << " us " << std::setw(8) << it->second << " "
+            << std::string(it->second * BAR_WIDTH / most, '#') << std::endl;
+    }
+}
+
+bool pin_current_thread(unsigned core) {
+#if defined(__linux__)
+    if (core >= CPU_SETSIZE)
+        return false;
+
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(core, &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+    return false;
+#endif
+}
+
+std::optional<const char*> raise_current_thread_priority() {
+#if defined(__linux__)
+    sched_param param{};
+    param.sched_priority = std::clamp(FIFO_PRIORITY, sched_get_priority_min(SCHED_FIFO), sched_get_priority_max(SCHED_FIFO));
+    if (pthread_setschedparam(pthread_self(), SCHED_FIFO, &param) == 0)
+        return "SCHED_FIFO";
+
+    // On Linux the nice value belongs to the thread, not the process
+    if (setpriority(PRIO_PROCESS, static_cast<id_t>(syscall(SYS_gettid)), RAISED_NICE) == 0)
+        return "a raised priority";
+#endif
+    return std::nullopt;
+}
@@ -0,0 +1,227 @@
+#include <algorithm>
+#include <thread>
+#include <cassert>
+
+#include <schip/ppu.h>
+#include <schip/shm.h>
+#include <schip/state.h>
+#include <schip/timeline.h>
+
+static_assert(sizeof(MachineState::pixels) == PPU::screen_width * PPU::screen_height);
+
+PPU& PPU::get_instance() {
+    static PPU instance(Bus::get_instance());
+    return instance;
+}
+
+void PPU::lock() {
+    if (!m_busy.exchange(true, std::memory_order_acquire)) [[likely]]
+        return;
+
+    // Only waiting for the other thread is worth showing on the timeline
+    Timeline::Scope scope{"ppu lock wait"};
+    while (m_busy.exchange(true, std::memory_order_acquire))
+        std::this_thread::yield();
+}
+
+void PPU::release() {
+    m_busy.store(false, std::memory_order_release);
+}
+
+void PPU::enable_extended() {
+    lock();
+    m_is_extended = true;
+    release();
+}
+
+void PPU::disable_extended() {
+    lock();
+    m_is_extended = false;
+    release();
+}
+
+void PPU::clear_screen() {
+    lock();
+    m_pixels.fill(0);
+    mark_dirty(0, screen_height);
+    release();
+}
+
+void PPU::scroll_down(unsigned lines) {
+    if (lines < 1 || lines > screen_height)
+        return;
+
+    if (lines == screen_height)
+        return clear_screen();
+
+    lock();
+    std::shift_right(m_pixels.begin(), m_pixels.end(), lines * screen_width);
+    std::fill_n(m_pixels.begin(), lines * screen_width, 0);
+    mark_dirty(0, screen_height);
+    release();
+}
+
+void PPU::scroll_left() {
+    lock();
+    for (auto i = m_pixels.begin(); i < m_pixels.end(); std::advance(i, screen_width)) {
+        std::shift_left(i, i + screen_width, 4);
+        std::fill_n(i + screen_width - 4, 4, 0);
+    }
+    mark_dirty(0, screen_height);
+    release();
+}
+
+void PPU::scroll_right() {
+    lock();
+    for (auto i = m_pixels.begin(); i < m_pixels.end(); std::advance(i, screen_width)) {
+        std::shift_right(i, i + screen_width, 4);
+        std::fill_n(i, 4, 0);
+    }
+    mark_dirty(0, screen_height);
+    release();
+}
+
+void PPU::present() {
+    lock();
+    m_front = m_pixels;
+    m_front_extended = m_is_extended;
+    release();
+
+    // Only the thread that runs the chip changes the framebuffer, so this needs no lock
+    if (m_publisher)
+        m_publisher->publish(m_pixels, m_is_extended);
+}
+
+bool PPU::copy_presented(std::array<char, screen_width * screen_height>& pixels) {
+    lock();
+    pixels = m_front;
+    bool extended = m_front_extended;
+    release();
+
+    return extended;
+}
+
+bool PPU::draw_sprite_at(Addr loc, unsigned lines, unsigned x, unsigned y) {
+    unsigned width{8};
+    unsigned adj{0};
+
+    if (lines == 0 && m_is_extended) {
+        width = 16;
+        lines = 16;
+    }
+
+    if (lines < 1 || lines > 16)
+        return false; // Out of range
+
+    if (m_is_extended) {
+        x %= screen_width;
+        y %= screen_height;
+    } else {
+        x %= screen_width / 2;
+        y %= screen_height / 2;
+    }
+
+    if (unsigned n{screen_width - x}; n < width)
+        adj = width - n; // Remove overflow
+
+    if (unsigned n{screen_height - y}; n < lines)
+        lines = n; // Remove overflow
+
+    // Only the rows that are drawn are read, and they must all be in memory
+    std::span<const Byte> sprite = m_bus.read_span(loc, lines * (width / 8));
+
+    lock();
+
+    uint8_t pix;
+    uint16_t row;
+    unsigned i, j, c;
+    bool collision{false};
+
+    for (i = 0; i < lines; i++) {
+        if (width == 16) {
+            row = sprite[i * 2];
+            row <<= 8;
+            row |= sprite[i * 2 + 1];
+        } else {
+            row = sprite[i];
+        }
+
+        c = ((y + i) * screen_width + x);
+        assert(c < m_pixels.size());
+
+        for (j = 0; j < width - adj; j++) {
+            pix = (row >> (width - 1 - j)) & 1;
+            if (pix && m_pixels.at(c + j))
+                collision = true;
+
+            m_pixels.at(c + j) ^= pix;
+        }
+    }
+
+    mark_dirty(y, lines);
+    release();
+    return collision;
+}
+
+void PPU::save_state(MachineState& state) {
+    lock();
+    std::copy(m_pixels.begin(), m_pixels.end(), state.pixels.begin());
+    state.regs.extended = m_is_extended;
+    release();
+}
+
+void PPU::load_state(const MachineState& state) {
+    lock();
+    std::copy(state.pixels.begin(), state.pixels.end(), m_pixels.begin());
+    m_is_extended = state.regs.extended;
+    mark_dirty(0, screen_height);
+    release();
+}
+
+void PPU::make_test_pattern() {
+    Bus& bus = m_bus;
+    int i = 0x200;
+    for (Byte b : {0b01111111, 0b11111110,
+                   0b11000000, 0b00000011,
+                   0b10100000, 0b00000101,
+                   0b10010000, 0b00001001,
+                   0b10001000, 0b00010001,
+                   0b10000100, 0b00100001,
+                   0b10000010, 0b01000001,
+                   0b10000000, 0b10000001,
+                   0b10000001, 0b00000001,
+                   0b10000010, 0b01000001,
+                   0b10000100, 0b00100001,
+                   0b10001000, 0b00010001,
+                   0b10010000, 0b00001001,
+                   0b10100000, 0b00000101,
+                   0b11000000, 0b00000011,
+                   0b01111111, 0b11111110}) {
+        bus.write(i++, b);
+    }
+
+    i = 0x300;
+    for (Byte b : {0b11111111,
+                   0b10000001,
+                   0b10000001,
+                   0b10000001,
+                   0b10000001,
+                   0b10000001,
+                   0b10000001,
+                   0b10000001,
+                   0b11111111}) {
+        bus.write(i++, b);
+    }
+
+//    enable_extended();
+
+//    draw_sprite_at(0x200, 0, 120, 60);
+
+    draw_sprite_at(0x300, 8, 60, 28);
+
+//    lock();
+//    m_is_extended = true;
+//    for (int i = 0; i < m_pixels.size(); i++)
+//        m_pixels.at(i) = (i / screen_width == 63) ? 1 : 0;
+//    release();
+}
@@ -0,0 +1,151 @@
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+#include <string_view>
+
+#include <schip/profiler.h>
+#include <schip/opcodes.h>
+#include <schip/chip.h>
+
+namespace {
+
+// The bytes covered by one character of the heatmap, and the characters per row
+constexpr size_t HEATMAP_CELL = 2;
+constexpr size_t HEATMAP_ROW = 64;
+constexpr std::string_view HEATMAP_SHADES{" .:-=+*#%@"};
+
+constexpr size_t MAX_LOOPS = 20;
+
+uint16_t read_word(const Bus& bus, Addr addr) {
+    return static_cast<uint16_t>(bus.read(addr & 0xfff) << 8 | bus.read((addr + 1) & 0xfff));
+}
+
+}
+
+Profiler::Profiler(unsigned interval)
+    : m_interval(std::max(1u, interval)),
+      m_countdown(m_interval)
+{}
+
+void Profiler::sample(Addr pc, const Bus& bus, Addr sp) {
+    m_countdown = m_interval;
+    m_samples++;
+    m_hits[pc & 0xfff]++;
+
+    // Every return address points right after the call that pushed it, so
+    // the callee can be read back from the call instruction
+    m_stack.clear();
+    for (Addr addr = Chip::stack_base; addr + 1 < sp && addr + 1 < USERCODE_END; addr += 2) {
+        Addr ret = read_word(bus, addr);
+        uint16_t call = read_word(bus, ret - 2);
+        m_stack.push_back((call >> 12) == 0x2 ? call & 0xfff : (ret - 2) & 0xfff);
+    }
+
+    m_stacks[m_stack]++;
+}
+
+void Profiler::write_folded(const std::filesystem::path& filename) const {
+    std::ofstream file{filename};
+    if (!file)
+        throw std::runtime_error("Cannot create the folded stack file");
+
+    for (auto& [stack, count] : m_stacks) {
+        file << "main";
+        for (Addr callee : stack)
+            file << ";sub_" << std::hex << std::setw(3) << std::setfill('0') << callee << std::dec;
+        file << " " << count << "\n";
+    }
+
+    if (!file)
+        throw std::runtime_error("Cannot write the folded stack file");
+}
+
+void Profiler::write_report(const std::filesystem::path& filename, const Bus& bus) const {
+    std::ofstream file{filename};
+    if (!file)
+        throw std::runtime_error("Cannot create the profile report");
+
+    auto percent = [this](uint64_t count) {
+        return m_samples ? count * 100.0 / m_samples : 0.0;
+    };
+
+    auto hex = [](unsigned value, int width) {
+        std::ostringstream out;
+        out << std::hex << std::setw(width) << std::setfill('0') << value;
+        return out.str();
+    };
+
+    file << "Samples: " << m_samples << " (one every " << m_interval << " instructions)\n\n";
+    file << std::fixed << std::setprecision(1);
+
+    // A backward jump closes a loop that spans from its target up to itself
+    struct Loop {
+        Addr begin;
+        Addr end;
+        uint64_t samples;
+    };
+
+    std::vector<Loop> loops;
+    for (Addr addr = USERCODE_BEG; addr + 1 < USERCODE_END; addr++) {
+        uint16_t opcode = read_word(bus, addr);
+        Addr target = opcode & 0xfff;
+
+        if (!m_hits[addr] || (opcode >> 12) != 0x1 || target > addr)
+            continue;
+
+        uint64_t samples = 0;
+        for (Addr a = target; a <= addr + 1; a++)
+            samples += m_hits[a];
+        loops.push_back({target, addr, samples});
+    }
+
+    std::sort(loops.begin(), loops.end(), [](auto& a, auto& b) { return a.samples > b.samples; });
+    loops.resize(std::min(loops.size(), MAX_LOOPS));
+
+    file << "Hot loops\n";
+    file << "  range        samples  percent\n";
+    for (auto& loop : loops) {
+        file << "  0x" << hex(loop.begin, 3) << "-0x" << hex(loop.end, 3)
+             << std::setw(10) << loop.samples << std::setw(8) << percent(loop.samples) << "%\n";
+    }
+
+    // The hottest cell gets the darkest shade
+    std::array<uint64_t, 0x1000 / HEATMAP_CELL> cells{};
+    for (size_t addr = 0; addr < m_hits.size(); addr++)
+        cells[addr / HEATMAP_CELL] += m_hits[addr];
+    uint64_t hottest = std::max<uint64_t>(1, *std::max_element(cells.begin(), cells.end()));
+
+    file << "\nHeatmap (" << HEATMAP_CELL << " bytes per character)\n";
+    for (size_t row = 0; row < cells.size(); row += HEATMAP_ROW) {
+        if (std::all_of(cells.begin() + row, cells.begin() + row + HEATMAP_ROW, [](uint64_t c) { return c == 0; }))
+            continue;
+
+        file << "  0x" << hex(row * HEATMAP_CELL, 3) << " |";
+        for (size_t cell = row; cell < row + HEATMAP_ROW; cell++) {
+            size_t shade = cells[cell] ? 1 + cells[cell] * (HEATMAP_SHADES.size() - 2) / hottest : 0;
+            file << HEATMAP_SHADES[shade];
+        }
+        file << "|\n";
+    }
+
+    std::vector<Addr> addresses;
+    for (size_t addr = 0; addr < m_hits.size(); addr++) {
+        if (m_hits[addr])
+            addresses.push_back(static_cast<Addr>(addr));
+    }
+
+    std::stable_sort(addresses.begin(), addresses.end(), [this](Addr a, Addr b) { return m_hits[a] > m_hits[b]; });
+
+    file << "\nAddresses\n";
+    file << "  address  samples  percent  opcode  instruction\n";
+    for (Addr addr : addresses) {
+        uint16_t opcode = read_word(bus, addr);
+        file << "  0x" << hex(addr, 3) << std::setw(11) << m_hits[addr] << std::setw(8) << percent(m_hits[addr])
+             << "%    " << hex(opcode, 4) << "  " << disassemble(opcode) << "\n";
+    }
+
+    if (!file)
+        throw std::runtime_error("Cannot write the profile report");
+}
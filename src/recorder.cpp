@@ -0,0 +1,304 @@
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <stdexcept>
+#include <string_view>
+
+#include <schip/recorder.h>
+
+namespace {
+
+constexpr std::string_view RECORDING_MAGIC{"SCHIPREC"};
+constexpr uint32_t RECORDING_VERSION = 1;
+
+constexpr size_t PACKED_SIZE = PPU::screen_width * PPU::screen_height / 8;
+
+constexpr uint8_t FLAG_EXTENDED = 1 << 0;
+constexpr uint8_t FLAG_KEYFRAME = 1 << 1;
+
+// How long the encoder sleeps when there is nothing to encode
+constexpr auto IDLE_WAIT = std::chrono::milliseconds(2);
+
+template <typename T>
+void write_le(std::ofstream& file, T value) {
+    for (size_t i = 0; i < sizeof(T); i++)
+        file.put(static_cast<char>((value >> (i * 8)) & 0xff));
+}
+
+template <typename T>
+bool read_le(std::ifstream& file, T& value) {
+    value = 0;
+    for (size_t i = 0; i < sizeof(T); i++) {
+        int byte = file.get();
+        if (byte == std::char_traits<char>::eof())
+            return false;
+        value |= static_cast<T>(static_cast<uint8_t>(byte)) << (i * 8);
+    }
+    return true;
+}
+
+void pack(const FramePixels& pixels, uint8_t* packed) {
+    for (size_t n = 0; n < PACKED_SIZE; n++) {
+        uint8_t byte = 0;
+        for (size_t bit = 0; bit < 8; bit++)
+            byte = (byte << 1) | (pixels[n * 8 + bit] ? 1 : 0);
+        packed[n] = byte;
+    }
+}
+
+void unpack(const uint8_t* packed, FramePixels& pixels) {
+    for (size_t n = 0; n < PACKED_SIZE; n++) {
+        for (size_t bit = 0; bit < 8; bit++)
+            pixels[n * 8 + bit] = (packed[n] >> (7 - bit)) & 1;
+    }
+}
+
+// PackBits: a header byte h below 128 is followed by h + 1 literal bytes, one
+// above 128 by a byte that repeats 257 - h times
+void compress(const uint8_t* data, size_t size, std::vector<uint8_t>& out) {
+    out.clear();
+
+    for (size_t n = 0; n < size;) {
+        size_t run = 1;
+        while (n + run < size && run < 128 && data[n + run] == data[n])
+            run++;
+
+        if (run >= 2) {
+            out.push_back(static_cast<uint8_t>(257 - run));
+            out.push_back(data[n]);
+            n += run;
+            continue;
+        }
+
+        // Collect literals up to the next run of at least two
+        size_t count = 1;
+        while (n + count < size && count < 128
+               && !(n + count + 1 < size && data[n + count] == data[n + count + 1]))
+            count++;
+
+        out.push_back(static_cast<uint8_t>(count - 1));
+        out.insert(out.end(), data + n, data + n + count);
+        n += count;
+    }
+}
+
+void decompress(const std::vector<uint8_t>& data, uint8_t* out, size_t size) {
+    size_t pos = 0;
+
+    for (size_t n = 0; n < data.size();) {
+        uint8_t header = data[n++];
+
+        if (header < 128) {
+            size_t count = header + 1;
+            if (n + count > data.size() || pos + count > size)
+                throw std::runtime_error("The recording is damaged");
+
+            std::memcpy(out + pos, &data[n], count);
+            n += count;
+            pos += count;
+        } else if (header > 128) {
+            size_t count = 257 - header;
+            if (n >= data.size() || pos + count > size)
+                throw std::runtime_error("The recording is damaged");
+
+            std::memset(out + pos, data[n++], count);
+            pos += count;
+        }
+    }
+
+    if (pos != size)
+        throw std::runtime_error("The recording is damaged");
+}
+
+}
+
+void expand_frame(const FramePixels& frame, bool extended, FramePixels& out) {
+    if (extended) {
+        out = frame;
+        return;
+    }
+
+    for (int y = 0; y < PPU::screen_height; y++) {
+        for (int x = 0; x < PPU::screen_width; x++)
+            out[y * PPU::screen_width + x] = frame[(y / 2) * PPU::screen_width + x / 2];
+    }
+}
+
+FrameRecorder::FrameRecorder(const std::filesystem::path& filename, RecordingFormat format,
+                             const ScaleOptions& scale)
+    : m_file(filename, std::ios_base::out | std::ios::binary | std::ios::trunc),
+      m_format(format),
+      m_queue(std::make_unique<SpscRing<RecordedFrame, queue_size>>()),
+      m_current(std::make_unique<RecordedFrame>()),
+      m_previous(PACKED_SIZE),
+      m_packed(PACKED_SIZE),
+      m_expanded(std::make_unique<FramePixels>())
+{
+    if (!m_file)
+        throw std::runtime_error("Cannot create the recording " + filename.string());
+
+    if (m_format == RECORDING_RGBA)
+        m_scaler = std::make_unique<FrameScaler>(scale);
+
+    if (m_format == RECORDING_DELTA) {
+        m_file.write(RECORDING_MAGIC.data(), RECORDING_MAGIC.size());
+        write_le(m_file, RECORDING_VERSION);
+        write_le(m_file, static_cast<uint16_t>(PPU::screen_width));
+        write_le(m_file, static_cast<uint16_t>(PPU::screen_height));
+        write_le(m_file, keyframe_interval);
+    }
+
+    m_thread = std::thread(&FrameRecorder::encode, this);
+}
+
+FrameRecorder::~FrameRecorder() {
+    finish();
+}
+
+void FrameRecorder::finish() {
+    if (!m_thread.joinable())
+        return;
+
+    m_done.store(true, std::memory_order_release);
+    m_thread.join();
+}
+
+bool FrameRecorder::push(uint64_t frame, const FramePixels& pixels, bool extended) {
+    bool queued = m_queue->try_push_with([&](RecordedFrame& slot) {
+        slot.frame = frame;
+        slot.extended = extended;
+        slot.pixels = pixels;
+    });
+
+    if (!queued)
+        m_dropped.fetch_add(1, std::memory_order_relaxed);
+
+    return queued;
+}
+
+void FrameRecorder::push_wait(uint64_t frame, const FramePixels& pixels, bool extended) {
+    auto fill = [&](RecordedFrame& slot) {
+        slot.frame = frame;
+        slot.extended = extended;
+        slot.pixels = pixels;
+    };
+
+    while (!m_queue->try_push_with(fill))
+        std::this_thread::sleep_for(IDLE_WAIT / 4);
+}
+
+void FrameRecorder::encode() {
+    for (;;) {
+        // Read the flag first, so that nothing pushed before it was set is lost
+        bool done = m_done.load(std::memory_order_acquire);
+
+        if (!m_queue->try_pop(*m_current)) {
+            if (done)
+                break;
+
+            std::this_thread::sleep_for(IDLE_WAIT);
+            continue;
+        }
+
+        write(*m_current);
+        m_written.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    m_file.flush();
+}
+
+void FrameRecorder::write(const RecordedFrame& frame) {
+    if (m_format == RECORDING_RAW) {
+        expand_frame(frame.pixels, frame.extended, *m_expanded);
+
+        for (char& pixel : *m_expanded)
+            pixel = pixel ? '\xff' : '\0';
+
+        m_file.write(m_expanded->data(), m_expanded->size());
+        return;
+    }
+
+    if (m_format == RECORDING_RGBA) {
+        std::span<const uint32_t> image = m_scaler->scale(frame.pixels, frame.extended);
+        m_file.write(reinterpret_cast<const char*>(image.data()), image.size_bytes());
+        return;
+    }
+
+    bool keyframe = written() % keyframe_interval == 0;
+    uint8_t flags = (frame.extended ? FLAG_EXTENDED : 0) | (keyframe ? FLAG_KEYFRAME : 0);
+
+    pack(frame.pixels, m_packed.data());
+
+    if (keyframe)
+        std::fill(m_previous.begin(), m_previous.end(), 0);
+
+    for (size_t n = 0; n < PACKED_SIZE; n++)
+        m_previous[n] ^= m_packed[n];
+
+    // An unchanged frame is all zeroes now, and needs no payload at all
+    if (std::all_of(m_previous.begin(), m_previous.end(), [](uint8_t b) { return b == 0; }))
+        m_payload.clear();
+    else
+        compress(m_previous.data(), PACKED_SIZE, m_payload);
+
+    m_previous.swap(m_packed);
+
+    write_le(m_file, frame.frame);
+    write_le(m_file, flags);
+    write_le(m_file, static_cast<uint16_t>(m_payload.size()));
+    m_file.write(reinterpret_cast<const char*>(m_payload.data()), m_payload.size());
+}
+
+RecordingReader::RecordingReader(const std::filesystem::path& filename)
+    : m_file(filename, std::ios_base::in | std::ios::binary),
+      m_previous(PACKED_SIZE),
+      m_delta(PACKED_SIZE)
+{
+    if (!m_file)
+        throw std::runtime_error("Cannot open the recording " + filename.string());
+
+    char magic[RECORDING_MAGIC.size()];
+    uint32_t version, interval;
+    uint16_t width, height;
+
+    if (!m_file.read(magic, sizeof(magic)) || RECORDING_MAGIC != std::string_view(magic, sizeof(magic)))
+        throw std::runtime_error("Not a frame recording");
+
+    if (!read_le(m_file, version) || version != RECORDING_VERSION)
+        throw std::runtime_error("Unsupported recording version");
+
+    if (!read_le(m_file, width) || !read_le(m_file, height) || !read_le(m_file, interval)
+        || width != PPU::screen_width || height != PPU::screen_height)
+        throw std::runtime_error("Unsupported recording size");
+}
+
+bool RecordingReader::next(RecordedFrame& frame) {
+    uint64_t number;
+    uint8_t flags;
+    uint16_t size;
+
+    if (!read_le(m_file, number))
+        return false;
+
+    if (!read_le(m_file, flags) || !read_le(m_file, size))
+        throw std::runtime_error("The recording is truncated");
+
+    m_payload.resize(size);
+    if (!m_file.read(reinterpret_cast<char*>(m_payload.data()), size))
+        throw std::runtime_error("The recording is truncated");
+
+    if (flags & FLAG_KEYFRAME)
+        std::fill(m_previous.begin(), m_previous.end(), 0);
+
+    if (size > 0) {
+        decompress(m_payload, m_delta.data(), PACKED_SIZE);
+
+        for (size_t n = 0; n < PACKED_SIZE; n++)
+            m_previous[n] ^= m_delta[n];
+    }
+
+    frame.frame = number;
+    frame.extended = flags & FLAG_EXTENDED;
+    unpack(m_previous.data(), frame.pixels);
+    return true;
+}
@@ -0,0 +1,84 @@
+#include <algorithm>
+#include <stdexcept>
+
+#include <schip/rewind.h>
+
+Rewind::Rewind(size_t capacity, size_t keyframe_interval)
+    : m_capacity(capacity), m_keyframe_interval(std::max<size_t>(keyframe_interval, 1))
+{
+    if (!m_capacity)
+        throw std::invalid_argument("The rewind capacity must be at least one frame");
+}
+
+size_t Rewind::entry_size(const Entry& entry) const {
+    return sizeof(Entry) + entry.delta.capacity() + (entry.key ? sizeof(MachineState) : 0);
+}
+
+void Rewind::record(const MachineState& state) {
+    Entry& entry = m_entries.emplace_back();
+
+    if (m_entries.size() == 1 || ++m_since_key >= m_keyframe_interval) {
+        entry.key = std::make_unique<MachineState>(state);
+        m_since_key = 0;
+    }
+
+    if (m_entries.size() > 1) {
+        encode_delta(m_head, state, m_scratch);
+        entry.delta.assign(m_scratch.begin(), m_scratch.end());
+    }
+
+    m_head = state;
+    m_bytes += entry_size(entry);
+
+    if (m_entries.size() > m_capacity) {
+        m_bytes -= entry_size(m_entries.front());
+        m_entries.pop_front();
+    }
+}
+
+bool Rewind::step_back(size_t frames, MachineState& state) {
+    if (m_entries.empty())
+        return false;
+
+    size_t newest = m_entries.size() - 1;
+    size_t target = newest - std::min(frames, newest);
+
+    // Find the closest keyframe at or before the target
+    size_t key = target + 1;
+    for (size_t i = target + 1; i-- > 0;) {
+        if (m_entries[i].key) {
+            key = i;
+            break;
+        }
+    }
+
+    if (key <= target && target - key < newest - target) {
+        // Walk forward from the keyframe
+        state = *m_entries[key].key;
+        for (size_t i = key + 1; i <= target; i++)
+            apply_delta(state, m_entries[i].delta);
+    } else {
+        // Walk backward from the newest frame
+        state = m_head;
+        for (size_t i = newest; i > target; i--)
+            apply_delta(state, m_entries[i].delta);
+    }
+
+    while (m_entries.size() > target + 1) {
+        m_bytes -= entry_size(m_entries.back());
+        m_entries.pop_back();
+    }
+
+    m_since_key = 0;
+    for (size_t i = target; i > 0 && !m_entries[i].key; i--)
+        m_since_key++;
+
+    m_head = state;
+    return true;
+}
+
+void Rewind::clear() {
+    m_entries.clear();
+    m_since_key = 0;
+    m_bytes = 0;
+}
@@ -0,0 +1,349 @@
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+#include <schip/scaler.h>
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define SCHIP_SCALER_X86 1
+#include <immintrin.h>
+#else
+#define SCHIP_SCALER_X86 0
+#endif
+
+namespace {
+
+constexpr size_t SOURCE_WIDTH = PPU::screen_width;
+constexpr size_t SOURCE_HEIGHT = PPU::screen_height;
+
+// The border around the source is wide enough for the loads of the widest
+// kernel to stay aligned
+constexpr size_t SOURCE_BORDER = 32;
+constexpr size_t SOURCE_STRIDE = SOURCE_WIDTH + 2 * SOURCE_BORDER;
+
+// Colours one row of pixels that are 0 or 0xff and repeats each one k times
+using ColorizeRow = void (*)(const uint8_t* src, size_t width, unsigned k, uint32_t fg, uint32_t bg, uint32_t* out);
+
+// Scale2x of one row, given the rows above and below it. row[-1] and
+// row[width] must be readable. out0 and out1 receive the two rows of twice
+// the width that the row becomes.
+using Scale2xRow = void (*)(const uint8_t* up, const uint8_t* row, const uint8_t* down, size_t width,
+                            uint8_t* out0, uint8_t* out1);
+
+struct Kernels {
+    ColorizeRow colorize_row;
+    Scale2xRow scale2x_row;
+};
+
+// With pixels that are 0 or 0xff, XOR tells apart which ones differ, and the
+// conditions of Scale2x become bit operations that every kernel shares:
+//
+//   E0 = D == B && B != F && D != H ? D : E
+//   E1 = B == F && B != D && F != H ? F : E
+//   E2 = D == H && D != B && H != F ? D : E
+//   E3 = H == F && D != H && B != F ? F : E
+
+void colorize_row_scalar(const uint8_t* src, size_t width, unsigned k, uint32_t fg, uint32_t bg, uint32_t* out) {
+    uint32_t diff = fg ^ bg;
+
+    for (size_t x = 0; x < width; x++) {
+        uint32_t mask = src[x] ? 0xffffffff : 0;
+        out = std::fill_n(out, k, bg ^ (mask & diff));
+    }
+}
+
+void scale2x_row_scalar(const uint8_t* up, const uint8_t* row, const uint8_t* down, size_t width,
+                        uint8_t* out0, uint8_t* out1) {
+    for (size_t x = 0; x < width; x++) {
+        uint8_t b = up[x], d = row[x - 1], e = row[x], f = row[x + 1], h = down[x];
+        uint8_t db = d ^ b, bf = b ^ f, dh = d ^ h, hf = h ^ f;
+
+        uint8_t c0 = ~db & bf & dh;
+        uint8_t c1 = ~bf & db & hf;
+        uint8_t c2 = ~dh & db & hf;
+        uint8_t c3 = ~hf & dh & bf;
+
+        out0[2 * x] = (c0 & d) | (~c0 & e);
+        out0[2 * x + 1] = (c1 & f) | (~c1 & e);
+        out1[2 * x] = (c2 & d) | (~c2 & e);
+        out1[2 * x + 1] = (c3 & f) | (~c3 & e);
+    }
+}
+
+#if SCHIP_SCALER_X86
+
+__attribute__((target("sse2")))
+void colorize_row_sse2(const uint8_t* src, size_t width, unsigned k, uint32_t fg, uint32_t bg, uint32_t* out) {
+    const __m128i bgv = _mm_set1_epi32(static_cast<int>(bg));
+    const __m128i diff = _mm_set1_epi32(static_cast<int>(fg ^ bg));
+
+    for (size_t x = 0; x < width; x += 4) {
+        // Widen four bytes of 0 or 0xff into four masks of 32 bits
+        uint32_t bytes;
+        std::memcpy(&bytes, src + x, sizeof(bytes));
+        __m128i mask = _mm_cvtsi32_si128(static_cast<int>(bytes));
+        mask = _mm_unpacklo_epi8(mask, mask);
+        mask = _mm_unpacklo_epi16(mask, mask);
+        __m128i colors = _mm_xor_si128(bgv, _mm_and_si128(mask, diff));
+
+        if (k == 1) {
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out), colors);
+            out += 4;
+            continue;
+        }
+
+        if (k == 2) {
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out), _mm_unpacklo_epi32(colors, colors));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 4), _mm_unpackhi_epi32(colors, colors));
+            out += 8;
+            continue;
+        }
+
+        const __m128i splats[4] = {
+            _mm_shuffle_epi32(colors, 0x00),
+            _mm_shuffle_epi32(colors, 0x55),
+            _mm_shuffle_epi32(colors, 0xaa),
+            _mm_shuffle_epi32(colors, 0xff)
+        };
+
+        for (const __m128i& splat : splats) {
+            unsigned n = 0;
+            for (; n + 4 <= k; n += 4)
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(out + n), splat);
+            for (; n < k; n++)
+                out[n] = static_cast<uint32_t>(_mm_cvtsi128_si32(splat));
+            out += k;
+        }
+    }
+}
+
+__attribute__((target("sse2")))
+void scale2x_row_sse2(const uint8_t* up, const uint8_t* row, const uint8_t* down, size_t width,
+                      uint8_t* out0, uint8_t* out1) {
+    for (size_t x = 0; x < width; x += 16) {
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(up + x));
+        __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + x - 1));
+        __m128i e = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + x));
+        __m128i f = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + x + 1));
+        __m128i h = _mm_loadu_si128(reinterpret_cast<const __m128i*>(down + x));
+
+        __m128i db = _mm_xor_si128(d, b), bf = _mm_xor_si128(b, f);
+        __m128i dh = _mm_xor_si128(d, h), hf = _mm_xor_si128(h, f);
+
+        __m128i c0 = _mm_andnot_si128(db, _mm_and_si128(bf, dh));
+        __m128i c1 = _mm_andnot_si128(bf, _mm_and_si128(db, hf));
+        __m128i c2 = _mm_andnot_si128(dh, _mm_and_si128(db, hf));
+        __m128i c3 = _mm_andnot_si128(hf, _mm_and_si128(dh, bf));
+
+        __m128i e0 = _mm_or_si128(_mm_and_si128(c0, d), _mm_andnot_si128(c0, e));
+        __m128i e1 = _mm_or_si128(_mm_and_si128(c1, f), _mm_andnot_si128(c1, e));
+        __m128i e2 = _mm_or_si128(_mm_and_si128(c2, d), _mm_andnot_si128(c2, e));
+        __m128i e3 = _mm_or_si128(_mm_and_si128(c3, f), _mm_andnot_si128(c3, e));
+
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out0 + 2 * x), _mm_unpacklo_epi8(e0, e1));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out0 + 2 * x + 16), _mm_unpackhi_epi8(e0, e1));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out1 + 2 * x), _mm_unpacklo_epi8(e2, e3));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out1 + 2 * x + 16), _mm_unpackhi_epi8(e2, e3));
+    }
+}
+
+__attribute__((target("avx2")))
+void colorize_row_avx2(const uint8_t* src, size_t width, unsigned k, uint32_t fg, uint32_t bg, uint32_t* out) {
+    const __m256i bgv = _mm256_set1_epi32(static_cast<int>(bg));
+    const __m256i diff = _mm256_set1_epi32(static_cast<int>(fg ^ bg));
+
+    // Eight pixels become k vectors of eight, and lane i of vector j is a
+    // copy of pixel (8j + i) / k
+    __m256i lanes[FrameScaler::max_scale];
+    for (unsigned j = 0; j < k; j++) {
+        alignas(32) int32_t index[8];
+        for (unsigned i = 0; i < 8; i++)
+            index[i] = static_cast<int32_t>((8 * j + i) / k);
+        lanes[j] = _mm256_load_si256(reinterpret_cast<const __m256i*>(index));
+    }
+
+    for (size_t x = 0; x < width; x += 8) {
+        __m256i mask = _mm256_cvtepi8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(src + x)));
+        __m256i colors = _mm256_xor_si256(bgv, _mm256_and_si256(mask, diff));
+
+        for (unsigned j = 0; j < k; j++)
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + 8 * j), _mm256_permutevar8x32_epi32(colors, lanes[j]));
+        out += 8 * k;
+    }
+}
+
+__attribute__((target("avx2")))
+void scale2x_row_avx2(const uint8_t* up, const uint8_t* row, const uint8_t* down, size_t width,
+                      uint8_t* out0, uint8_t* out1) {
+    for (size_t x = 0; x < width; x += 32) {
+        __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(up + x));
+        __m256i d = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(row + x - 1));
+        __m256i e = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(row + x));
+        __m256i f = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(row + x + 1));
+        __m256i h = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(down + x));
+
+        __m256i db = _mm256_xor_si256(d, b), bf = _mm256_xor_si256(b, f);
+        __m256i dh = _mm256_xor_si256(d, h), hf = _mm256_xor_si256(h, f);
+
+        __m256i c0 = _mm256_andnot_si256(db, _mm256_and_si256(bf, dh));
+        __m256i c1 = _mm256_andnot_si256(bf, _mm256_and_si256(db, hf));
+        __m256i c2 = _mm256_andnot_si256(dh, _mm256_and_si256(db, hf));
+        __m256i c3 = _mm256_andnot_si256(hf, _mm256_and_si256(dh, bf));
+
+        __m256i e0 = _mm256_or_si256(_mm256_and_si256(c0, d), _mm256_andnot_si256(c0, e));
+        __m256i e1 = _mm256_or_si256(_mm256_and_si256(c1, f), _mm256_andnot_si256(c1, e));
+        __m256i e2 = _mm256_or_si256(_mm256_and_si256(c2, d), _mm256_andnot_si256(c2, e));
+        __m256i e3 = _mm256_or_si256(_mm256_and_si256(c3, f), _mm256_andnot_si256(c3, e));
+
+        // The unpacks work within each 128-bit half, which puts the halves of
+        // the output out of order
+        __m256i lo0 = _mm256_unpacklo_epi8(e0, e1), hi0 = _mm256_unpackhi_epi8(e0, e1);
+        __m256i lo1 = _mm256_unpacklo_epi8(e2, e3), hi1 = _mm256_unpackhi_epi8(e2, e3);
+
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out0 + 2 * x), _mm256_permute2x128_si256(lo0, hi0, 0x20));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out0 + 2 * x + 32), _mm256_permute2x128_si256(lo0, hi0, 0x31));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out1 + 2 * x), _mm256_permute2x128_si256(lo1, hi1, 0x20));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out1 + 2 * x + 32), _mm256_permute2x128_si256(lo1, hi1, 0x31));
+    }
+}
+
+#endif
+
+Kernels kernels(ScaleKernel kernel) {
+    switch (kernel) {
+#if SCHIP_SCALER_X86
+    case SCALE_KERNEL_SSE2:
+        return {colorize_row_sse2, scale2x_row_sse2};
+    case SCALE_KERNEL_AVX2:
+        return {colorize_row_avx2, scale2x_row_avx2};
+#endif
+    default:
+        return {colorize_row_scalar, scale2x_row_scalar};
+    }
+}
+
+// Colours a picture of width x height and repeats every pixel k times in both directions
+void colorize(const Kernels& kernels, const uint8_t* src, size_t stride, size_t width, size_t height, unsigned k,
+              uint32_t fg, uint32_t bg, uint32_t* out) {
+    size_t out_width = width * k;
+
+    for (size_t y = 0; y < height; y++) {
+        uint32_t* first = out + y * k * out_width;
+        kernels.colorize_row(src + y * stride, width, k, fg, bg, first);
+
+        for (unsigned n = 1; n < k; n++)
+            std::memcpy(first + n * out_width, first, out_width * sizeof(uint32_t));
+    }
+}
+
+}
+
+FrameScaler::FrameScaler(const ScaleOptions& options)
+    : m_options(options),
+      m_source(SOURCE_STRIDE * (SOURCE_HEIGHT + 2))
+{
+    if (m_options.scale == 0 || m_options.scale > max_scale)
+        throw std::invalid_argument("The scale must be between 1 and " + std::to_string(max_scale));
+
+    if (m_options.filter == SCALE_2X && m_options.scale % 2)
+        throw std::invalid_argument("Scale2x needs an even scale");
+
+    if (!supports(m_options.kernel))
+        throw std::invalid_argument(std::string("This CPU does not support ") + kernel_name(m_options.kernel));
+
+    if (m_options.kernel == SCALE_KERNEL_AUTO)
+        m_options.kernel = best_kernel();
+
+    if (m_options.filter == SCALE_2X)
+        m_smoothed.resize(4 * SOURCE_WIDTH * SOURCE_HEIGHT);
+
+    m_image.resize(static_cast<size_t>(width()) * height());
+}
+
+std::span<const uint32_t> FrameScaler::scale(const std::array<char, PPU::screen_width * PPU::screen_height>& frame,
+                                             bool extended) {
+    Kernels funcs = kernels(m_options.kernel);
+
+    // Expand the frame into the source, and copy its edges into the border
+    // so that the pixels past them read as repeats of the edge
+    for (size_t y = 0; y < SOURCE_HEIGHT; y++) {
+        uint8_t* row = &m_source[(y + 1) * SOURCE_STRIDE + SOURCE_BORDER];
+        const char* pixels = extended ? &frame[y * SOURCE_WIDTH] : &frame[(y / 2) * SOURCE_WIDTH];
+
+        if (extended) {
+            for (size_t x = 0; x < SOURCE_WIDTH; x++)
+                row[x] = pixels[x] ? 0xff : 0;
+        } else {
+            for (size_t x = 0; x < SOURCE_WIDTH; x++)
+                row[x] = pixels[x / 2] ? 0xff : 0;
+        }
+
+        row[-1] = row[0];
+        row[SOURCE_WIDTH] = row[SOURCE_WIDTH - 1];
+    }
+
+    std::memcpy(&m_source[0], &m_source[SOURCE_STRIDE], SOURCE_STRIDE);
+    std::memcpy(&m_source[(SOURCE_HEIGHT + 1) * SOURCE_STRIDE], &m_source[SOURCE_HEIGHT * SOURCE_STRIDE],
+                SOURCE_STRIDE);
+
+    const uint8_t* source = &m_source[SOURCE_STRIDE + SOURCE_BORDER];
+
+    if (m_options.filter == SCALE_2X) {
+        size_t out_width = 2 * SOURCE_WIDTH;
+
+        for (size_t y = 0; y < SOURCE_HEIGHT; y++) {
+            const uint8_t* row = source + y * SOURCE_STRIDE;
+            uint8_t* out = &m_smoothed[2 * y * out_width];
+            funcs.scale2x_row(row - SOURCE_STRIDE, row, row + SOURCE_STRIDE, SOURCE_WIDTH, out, out + out_width);
+        }
+
+        colorize(funcs, m_smoothed.data(), out_width, out_width, 2 * SOURCE_HEIGHT, m_options.scale / 2,
+                 m_options.foreground, m_options.background, m_image.data());
+    } else {
+        colorize(funcs, source, SOURCE_STRIDE, SOURCE_WIDTH, SOURCE_HEIGHT, m_options.scale,
+                 m_options.foreground, m_options.background, m_image.data());
+    }
+
+    return m_image;
+}
+
+ScaleKernel FrameScaler::best_kernel() {
+    if (supports(SCALE_KERNEL_AVX2))
+        return SCALE_KERNEL_AVX2;
+    if (supports(SCALE_KERNEL_SSE2))
+        return SCALE_KERNEL_SSE2;
+    return SCALE_KERNEL_SCALAR;
+}
+
+bool FrameScaler::supports(ScaleKernel kernel) {
+    switch (kernel) {
+    case SCALE_KERNEL_AUTO:
+    case SCALE_KERNEL_SCALAR:
+        return true;
+#if SCHIP_SCALER_X86
+    case SCALE_KERNEL_SSE2:
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("sse2");
+    case SCALE_KERNEL_AVX2:
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx2");
+#endif
+    default:
+        return false;
+    }
+}
+
+const char* FrameScaler::kernel_name(ScaleKernel kernel) {
+    switch (kernel) {
+    case SCALE_KERNEL_AUTO:
+        return "auto";
+    case SCALE_KERNEL_SCALAR:
+        return "scalar";
+    case SCALE_KERNEL_SSE2:
+        return "sse2";
+    case SCALE_KERNEL_AVX2:
+        return "avx2";
+    }
+    return "unknown";
+}
@@ -0,0 +1,173 @@
+#include <cstring>
+#include <new>
+#include <stdexcept>
+#include <string_view>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define SCHIP_HAS_SHM 1
+#else
+#define SCHIP_HAS_SHM 0
+#endif
+
+#include <schip/shm.h>
+
+namespace {
+
+constexpr std::string_view SHM_MAGIC{"SCHIPSHM"};
+constexpr uint32_t SHM_VERSION = 1;
+
+constexpr size_t SLOT_SIZE = (sizeof(SharedFrameSlot) + 63) / 64 * 64;
+constexpr size_t HEADER_SIZE = (sizeof(SharedFrameHeader) + 63) / 64 * 64;
+
+}
+
+FramePublisher::FramePublisher(std::string name, uint32_t slots)
+    : m_name(std::move(name))
+{
+#if SCHIP_HAS_SHM
+    if (slots < 2)
+        throw std::invalid_argument("Publishing frames needs at least two slots");
+
+    m_size = HEADER_SIZE + SLOT_SIZE * slots;
+
+    // Start over, so that readers of an old object do not mistake it for this one
+    shm_unlink(m_name.c_str());
+
+    int fd = shm_open(m_name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+    if (fd < 0)
+        throw std::runtime_error("Cannot create the shared memory object " + m_name);
+
+    if (ftruncate(fd, static_cast<off_t>(m_size)) != 0) {
+        close(fd);
+        shm_unlink(m_name.c_str());
+        throw std::runtime_error("Cannot size the shared memory object " + m_name);
+    }
+
+    m_mapping = mmap(nullptr, m_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if (m_mapping == MAP_FAILED) {
+        shm_unlink(m_name.c_str());
+        throw std::runtime_error("Cannot map the shared memory object " + m_name);
+    }
+
+    // A new object is zero filled, which is a valid state for every atomic in it
+    m_header = new (m_mapping) SharedFrameHeader{};
+    m_header->version = SHM_VERSION;
+    m_header->slots = slots;
+    m_header->width = PPU::screen_width;
+    m_header->height = PPU::screen_height;
+    m_header->slot_size = SLOT_SIZE;
+
+    for (uint32_t n = 0; n < slots; n++)
+        new (&slot(n)) SharedFrameSlot{};
+
+    // Readers check the magic last, so write it last
+    std::memcpy(m_header->magic, SHM_MAGIC.data(), SHM_MAGIC.size());
+    m_header->latest.store(0, std::memory_order_release);
+#else
+    (void)slots;
+    throw std::runtime_error("Shared memory is not supported on this platform");
+#endif
+}
+
+FramePublisher::~FramePublisher() {
+#if SCHIP_HAS_SHM
+    munmap(m_mapping, m_size);
+    shm_unlink(m_name.c_str());
+#endif
+}
+
+SharedFrameSlot& FramePublisher::slot(uint64_t n) const {
+    auto base = static_cast<char*>(m_mapping) + HEADER_SIZE;
+    return *reinterpret_cast<SharedFrameSlot*>(base + SLOT_SIZE * (n % m_header->slots));
+}
+
+void FramePublisher::publish(const std::array<char, PPU::screen_width * PPU::screen_height>& pixels, bool extended) {
+    // The slot the previous frame went into, to find the rows that changed
+    const SharedFrameSlot& previous = slot(m_published + m_header->slots - 1);
+    SharedFrameSlot& next = slot(m_published);
+
+    uint64_t dirty = 0;
+    for (int row = 0; row < PPU::screen_height; row++) {
+        size_t offset = row * PPU::screen_width;
+        if (m_published == 0 || std::memcmp(&previous.pixels[offset], &pixels[offset], PPU::screen_width) != 0)
+            dirty |= uint64_t{1} << row;
+    }
+
+    uint32_t sequence = next.sequence.load(std::memory_order_relaxed);
+    next.sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    next.frame = ++m_published;
+    next.extended = extended;
+    next.dirty_rows = dirty;
+    next.pixels = pixels;
+
+    next.sequence.store(sequence + 2, std::memory_order_release);
+    m_header->latest.store(m_published, std::memory_order_release);
+}
+
+FrameSubscriber::FrameSubscriber(const std::string& name) {
+#if SCHIP_HAS_SHM
+    int fd = shm_open(name.c_str(), O_RDONLY, 0);
+    if (fd < 0)
+        throw std::runtime_error("There is no shared memory object " + name);
+
+    struct stat info;
+    if (fstat(fd, &info) != 0 || static_cast<size_t>(info.st_size) < HEADER_SIZE) {
+        close(fd);
+        throw std::runtime_error("The shared memory object " + name + " is not a frame ring");
+    }
+
+    m_size = info.st_size;
+    m_mapping = mmap(nullptr, m_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if (m_mapping == MAP_FAILED)
+        throw std::runtime_error("Cannot map the shared memory object " + name);
+
+    m_header = static_cast<const SharedFrameHeader*>(m_mapping);
+
+    if (SHM_MAGIC != std::string_view(m_header->magic, sizeof(m_header->magic))
+        || m_header->version != SHM_VERSION || m_header->slot_size != SLOT_SIZE
+        || HEADER_SIZE + size_t{SLOT_SIZE} * m_header->slots > m_size) {
+        munmap(const_cast<void*>(m_mapping), m_size);
+        throw std::runtime_error("The shared memory object " + name + " is not a frame ring");
+    }
+#else
+    (void)name;
+    throw std::runtime_error("Shared memory is not supported on this platform");
+#endif
+}
+
+FrameSubscriber::~FrameSubscriber() {
+#if SCHIP_HAS_SHM
+    munmap(const_cast<void*>(m_mapping), m_size);
+#endif
+}
+
+uint64_t FrameSubscriber::latest() const {
+    return m_header->latest.load(std::memory_order_acquire);
+}
+
+bool FrameSubscriber::acquire(SharedFrameView& view) const {
+    uint64_t frame = latest();
+    if (frame == 0)
+        return false;
+
+    auto base = static_cast<const char*>(m_mapping) + HEADER_SIZE;
+    view.slot = reinterpret_cast<const SharedFrameSlot*>(base + SLOT_SIZE * ((frame - 1) % m_header->slots));
+    view.sequence = view.slot->sequence.load(std::memory_order_acquire);
+
+    return (view.sequence & 1) == 0;
+}
+
+bool FrameSubscriber::validate(const SharedFrameView& view) const {
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return view.slot->sequence.load(std::memory_order_relaxed) == view.sequence;
+}
@@ -0,0 +1,95 @@
+#include <cstring>
+#include <stdexcept>
+
+#include <schip/state.h>
+
+namespace {
+
+constexpr size_t PIXEL_ROW = 128;
+
+// A run of changed bytes is continued through this many unchanged bytes,
+// since starting a new record costs three bytes.
+constexpr size_t MAX_GAP = 3;
+
+void encode_block(const Byte* from, const Byte* to, size_t offset, size_t size, std::vector<Byte>& out) {
+    if (std::memcmp(from, to, size) == 0)
+        return;
+
+    size_t i = 0;
+    while (i < size) {
+        if (from[i] == to[i]) {
+            i++;
+            continue;
+        }
+
+        // Find the end of this run
+        size_t end = i + 1, gap = 0;
+        for (size_t j = end; j < size && j - i < 0xff && gap <= MAX_GAP; j++) {
+            if (from[j] != to[j]) {
+                end = j + 1;
+                gap = 0;
+            } else {
+                gap++;
+            }
+        }
+
+        size_t addr = offset + i;
+        out.push_back(addr & 0xff);
+        out.push_back(addr >> 8);
+        out.push_back(end - i);
+        for (; i < end; i++)
+            out.push_back(from[i] ^ to[i]);
+    }
+}
+
+}
+
+uint64_t hash_bytes(const void* data, size_t size, uint64_t hash) {
+    auto bytes = static_cast<const Byte*>(data);
+
+    for (size_t i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= 0x100000001b3;
+    }
+
+    return hash;
+}
+
+void encode_delta(const MachineState& from, const MachineState& to, std::vector<Byte>& out) {
+    auto a = reinterpret_cast<const Byte*>(&from);
+    auto b = reinterpret_cast<const Byte*>(&to);
+
+    out.clear();
+
+    // Registers
+    encode_block(a, b, 0, offsetof(MachineState, memory), out);
+
+    // Memory pages
+    for (size_t page = 0; page < USERCODE_SIZE; page += MEMORY_PAGE_SIZE) {
+        size_t offset = offsetof(MachineState, memory) + page;
+        encode_block(a + offset, b + offset, offset, MEMORY_PAGE_SIZE, out);
+    }
+
+    // Framebuffer rows
+    for (size_t row = 0; row < sizeof(MachineState::pixels); row += PIXEL_ROW) {
+        size_t offset = offsetof(MachineState, pixels) + row;
+        encode_block(a + offset, b + offset, offset, PIXEL_ROW, out);
+    }
+}
+
+void apply_delta(MachineState& state, const std::vector<Byte>& delta) {
+    auto data = reinterpret_cast<Byte*>(&state);
+
+    for (size_t i = 0; i + 3 <= delta.size();) {
+        size_t addr = delta[i] | (delta[i + 1] << 8);
+        size_t len = delta[i + 2];
+        i += 3;
+
+        if (addr + len > sizeof(MachineState) || i + len > delta.size())
+            throw std::invalid_argument("Corrupt state delta");
+
+        for (size_t j = 0; j < len; j++)
+            data[addr + j] ^= delta[i + j];
+        i += len;
+    }
+}
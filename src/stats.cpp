@@ -0,0 +1,68 @@
+#include <atomic>
+#include <bit>
+#include <csignal>
+
+#include <schip/stats.h>
+
+namespace {
+
+std::atomic<bool> requested{false};
+
+static_assert(std::atomic<bool>::is_always_lock_free, "The signal handler needs a lock free flag");
+
+extern "C" void on_stats_signal(int) {
+    requested.store(true, std::memory_order_relaxed);
+}
+
+}
+
+void OpStats::record(Op op, std::chrono::nanoseconds time) {
+    uint64_t ns = time.count() > 0 ? static_cast<uint64_t>(time.count()) : 0;
+    histograms[op][std::min<size_t>(std::bit_width(ns), buckets - 1)]++;
+}
+
+void OpStats::write_json(std::ostream& out) const {
+    uint64_t total = 0;
+    for (uint64_t count : counts)
+        total += count;
+
+    out << "{\"instructions\": " << total << ", \"sample_interval\": " << sample_interval << ", \"ops\": {";
+
+    bool first = true;
+    for (size_t op = 0; op < OP_COUNT; op++) {
+        if (!counts[op])
+            continue;
+
+        out << (first ? "" : ",") << "\n  \"" << OP_NAMES[op] << "\": {\"count\": " << counts[op];
+        first = false;
+
+        if (!is_timed(static_cast<Op>(op))) {
+            out << "}";
+            continue;
+        }
+
+        // Keyed by the upper bound of each bucket in nanoseconds
+        out << ", \"ns\": {";
+        bool first_bucket = true;
+        for (size_t b = 0; b < buckets; b++) {
+            if (!histograms[op][b])
+                continue;
+
+            out << (first_bucket ? "" : ", ") << "\"" << (uint64_t{1} << b) << "\": " << histograms[op][b];
+            first_bucket = false;
+        }
+        out << "}}";
+    }
+
+    out << "\n}}" << std::endl;
+}
+
+void OpStats::install_signal_handler() {
+#ifdef SIGUSR1
+    std::signal(SIGUSR1, on_stats_signal);
+#endif
+}
+
+bool OpStats::take_request() {
+    return requested.exchange(false, std::memory_order_relaxed);
+}
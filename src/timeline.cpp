@@ -0,0 +1,128 @@
+#include <fstream>
+#include <iomanip>
+#include <limits>
+#include <stdexcept>
+
+#include <schip/timeline.h>
+
+namespace {
+
+constexpr uint64_t INSTANT = std::numeric_limits<uint64_t>::max();
+
+}
+
+Timeline& Timeline::get_instance() {
+    static Timeline instance;
+    return instance;
+}
+
+Timeline::Buffer& Timeline::buffer() {
+    thread_local Buffer* current = nullptr;
+
+    if (!current) {
+        std::lock_guard lock(m_mutex);
+        auto& buffer = m_buffers.emplace_back(std::make_unique<Buffer>());
+        buffer->tid = static_cast<uint32_t>(m_buffers.size());
+        current = buffer.get();
+    }
+
+    return *current;
+}
+
+void Timeline::append(const Event& event) {
+    Buffer& current = buffer();
+    size_t size = current.size.load(std::memory_order_relaxed);
+
+    if (size >= capacity) {
+        current.dropped++;
+        return;
+    }
+
+    current.events[size] = event;
+    current.size.store(size + 1, std::memory_order_release);
+}
+
+void Timeline::name_thread(const char* name) {
+    // Naming a thread would give it a buffer
+    if (!enabled())
+        return;
+
+    Buffer& current = buffer();
+    std::lock_guard lock(m_mutex);
+    current.name = name;
+}
+
+void Timeline::complete(const char* name, clock::time_point begin, clock::time_point end) {
+    append({
+        name, nullptr, 0,
+        static_cast<uint64_t>(std::chrono::nanoseconds(begin - m_epoch).count()),
+        static_cast<uint64_t>(std::chrono::nanoseconds(end - begin).count())
+    });
+}
+
+void Timeline::instant(const char* name, const char* arg_name, int64_t arg) {
+    if (!enabled())
+        return;
+
+    append({
+        name, arg_name, arg,
+        static_cast<uint64_t>(std::chrono::nanoseconds(clock::now() - m_epoch).count()),
+        INSTANT
+    });
+}
+
+void Timeline::write(const std::filesystem::path& filename) const {
+    std::ofstream file{filename};
+    if (!file)
+        throw std::runtime_error("Cannot create the timeline file");
+
+    std::lock_guard lock(m_mutex);
+
+    // Trace viewers want microseconds
+    file << std::fixed << std::setprecision(3);
+    file << "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [\n";
+
+    bool first = true;
+    auto separate = [&file, &first]() {
+        file << (first ? "" : ",\n");
+        first = false;
+    };
+
+    for (auto& buffer : m_buffers) {
+        if (!buffer->name.empty()) {
+            separate();
+            file << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": " << buffer->tid
+                 << ", \"args\": {\"name\": \"" << buffer->name << "\"}}";
+        }
+
+        if (buffer->dropped) {
+            separate();
+            file << "{\"name\": \"dropped events\", \"ph\": \"i\", \"s\": \"t\", \"pid\": 1, \"tid\": " << buffer->tid
+                 << ", \"ts\": 0, \"args\": {\"count\": " << buffer->dropped << "}}";
+        }
+
+        size_t size = buffer->size.load(std::memory_order_acquire);
+        for (size_t n = 0; n < size; n++) {
+            const Event& event = buffer->events[n];
+
+            separate();
+            file << "{\"name\": \"" << event.name << "\", \"pid\": 1, \"tid\": " << buffer->tid
+                 << ", \"ts\": " << event.begin / 1000.0;
+
+            if (event.duration == INSTANT)
+                file << ", \"ph\": \"i\", \"s\": \"t\"";
+            else
+                file << ", \"ph\": \"X\", \"dur\": " << event.duration / 1000.0;
+
+            if (event.arg_name)
+                file << ", \"args\": {\"" << event.arg_name << "\": " << event.arg << "}";
+
+            file << "}";
+        }
+    }
+
+    file << "\n]}\n";
+
+    if (!file)
+        throw std::runtime_error("Cannot write the timeline file");
+}
@@ -0,0 +1,130 @@
+#include <algorithm>
+#include <atomic>
+#include <csignal>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+
+#include <schip/trace.h>
+
+namespace {
+
+constexpr std::string_view TRACE_MAGIC{"SCHIPTRC"};
+constexpr uint16_t TRACE_VERSION = 1;
+
+std::atomic<bool> requested{false};
+
+extern "C" void on_trace_signal(int) {
+    requested.store(true, std::memory_order_relaxed);
+}
+
+template <typename T>
+void write_le(std::ofstream& file, T value) {
+    for (size_t i = 0; i < sizeof(T); i++)
+        file.put(static_cast<char>((value >> (i * 8)) & 0xff));
+}
+
+template <typename T>
+T read_le(const std::vector<char>& data, size_t& pos) {
+    if (pos + sizeof(T) > data.size())
+        throw std::runtime_error("The trace file is truncated");
+
+    T value{0};
+    for (size_t i = 0; i < sizeof(T); i++)
+        value |= static_cast<T>(static_cast<uint8_t>(data[pos++])) << (i * 8);
+    return value;
+}
+
+}
+
+std::vector<TraceRecord> TraceRing::records() const {
+    size_t size = std::min<uint64_t>(m_count, capacity);
+    std::vector<TraceRecord> records;
+    records.reserve(size);
+
+    for (uint64_t n = m_count - size; n < m_count; n++)
+        records.push_back(m_records[n & (capacity - 1)]);
+
+    return records;
+}
+
+void TraceRing::write(const std::filesystem::path& filename, std::string_view error) const {
+    std::ofstream file{filename, std::ios_base::out | std::ios::binary | std::ios::trunc};
+
+    if (!file)
+        throw std::runtime_error("Cannot create the trace file");
+
+    std::vector<TraceRecord> all = records();
+    error = error.substr(0, UINT16_MAX);
+
+    file.write(TRACE_MAGIC.data(), TRACE_MAGIC.size());
+    write_le(file, TRACE_VERSION);
+    write_le(file, static_cast<uint16_t>(sizeof(TraceRecord)));
+    write_le(file, m_count);
+    write_le(file, static_cast<uint32_t>(all.size()));
+    write_le(file, static_cast<uint16_t>(error.size()));
+    file.write(error.data(), error.size());
+
+    for (const TraceRecord& record : all) {
+        write_le(file, record.pc);
+        write_le(file, record.opcode);
+        write_le(file, record.i);
+        write_le(file, record.vx);
+        write_le(file, record.vf);
+    }
+
+    if (!file)
+        throw std::runtime_error("Cannot write the trace file");
+}
+
+void TraceRing::install_signal_handler() {
+#ifdef SIGUSR2
+    std::signal(SIGUSR2, on_trace_signal);
+#endif
+}
+
+bool TraceRing::take_request() {
+    return requested.exchange(false, std::memory_order_relaxed);
+}
+
+TraceFile read_trace(const std::filesystem::path& filename) {
+    std::ifstream file{filename, std::ios_base::in | std::ios::binary};
+
+    if (!file)
+        throw std::runtime_error("Cannot open the trace file");
+
+    std::vector<char> data{std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>()};
+
+    if (data.size() < TRACE_MAGIC.size() || !std::equal(TRACE_MAGIC.begin(), TRACE_MAGIC.end(), data.begin()))
+        throw std::runtime_error("This is not a trace file");
+
+    size_t pos = TRACE_MAGIC.size();
+    if (read_le<uint16_t>(data, pos) != TRACE_VERSION)
+        throw std::runtime_error("The trace file has an unsupported version");
+
+    if (read_le<uint16_t>(data, pos) != sizeof(TraceRecord))
+        throw std::runtime_error("The trace file has an unsupported record size");
+
+    TraceFile trace;
+    trace.count = read_le<uint64_t>(data, pos);
+    uint32_t size = read_le<uint32_t>(data, pos);
+    uint16_t length = read_le<uint16_t>(data, pos);
+
+    if (pos + length > data.size())
+        throw std::runtime_error("The trace file is truncated");
+
+    trace.error.assign(data.data() + pos, length);
+    pos += length;
+
+    trace.records.reserve(size);
+    for (uint32_t n = 0; n < size; n++) {
+        TraceRecord& record = trace.records.emplace_back();
+        record.pc = read_le<uint16_t>(data, pos);
+        record.opcode = read_le<uint16_t>(data, pos);
+        record.i = read_le<uint16_t>(data, pos);
+        record.vx = read_le<uint8_t>(data, pos);
+        record.vf = read_le<uint8_t>(data, pos);
+    }
+
+    return trace;
+}
@@ -0,0 +1,97 @@
+#include <memory>
+
+#include <schip/workload.h>
+#include <schip/machine.h>
+
+const std::vector<Workload>& builtin_workloads() {
+    static const std::vector<Workload> workloads = {
+        {"alu", "arithmetic and logic on registers", {
+            0x60, 0x01, // 200: ld v0, 0x01
+            0x61, 0x03, // 202: ld v1, 0x03
+            0x80, 0x14, // 204: add v0, v1
+            0x81, 0x02, // 206: and v1, v0
+            0x81, 0x03, // 208: xor v1, v0
+            0x80, 0x16, // 20a: shr v0
+            0x80, 0x1e, // 20c: shl v0
+            0x80, 0x15, // 20e: sub v0, v1
+            0x81, 0x07, // 210: subn v1, v0
+            0x72, 0x05, // 212: add v2, 0x05
+            0x81, 0x21, // 214: or v1, v2
+            0x32, 0x00, // 216: se v2, 0x00
+            0x12, 0x04, // 218: jp 0x204
+            0x12, 0x00, // 21a: jp 0x200
+        }},
+        {"draw", "8x15 sprites all over the low resolution screen", {
+            0xa2, 0x0a, // 200: ld i, 0x20a
+            0xd0, 0x1f, // 202: drw v0, v1, 15
+            0x70, 0x09, // 204: add v0, 0x09
+            0x71, 0x05, // 206: add v1, 0x05
+            0x12, 0x02, // 208: jp 0x202
+            0xff, 0x81, 0xbd, 0xa5, 0xa5, 0xbd, 0x81, 0xff,
+            0x18, 0x3c, 0x7e, 0xff, 0x7e, 0x3c, 0x18,
+        }},
+        {"scroll", "scrolling a high resolution screen in every direction", {
+            0x00, 0xff, // 200: high
+            0xa2, 0x10, // 202: ld i, 0x210
+            0xd0, 0x10, // 204: drw v0, v1, 0
+            0x00, 0xc4, // 206: scd 4
+            0x00, 0xfb, // 208: scr
+            0x00, 0xfc, // 20a: scl
+            0x00, 0xfb, // 20c: scr
+            0x12, 0x04, // 20e: jp 0x204
+            0xff, 0xff, 0x80, 0x01, 0xbf, 0xfd, 0xa0, 0x05,
+            0xaf, 0xf5, 0xa8, 0x15, 0xab, 0xd5, 0xaa, 0x55,
+            0xaa, 0x55, 0xab, 0xd5, 0xa8, 0x15, 0xaf, 0xf5,
+            0xa0, 0x05, 0xbf, 0xfd, 0x80, 0x01, 0xff, 0xff,
+        }},
+        {"copy", "copying registers to and from memory with Fx55 and Fx65", {
+            0xa3, 0x00, // 200: ld i, 0x300
+            0xff, 0x65, // 202: ld vf, [i]
+            0x70, 0x01, // 204: add v0, 0x01
+            0xa4, 0x00, // 206: ld i, 0x400
+            0xff, 0x55, // 208: ld [i], vf
+            0xa3, 0x80, // 20a: ld i, 0x380
+            0xf7, 0x65, // 20c: ld v7, [i]
+            0xa3, 0xc0, // 20e: ld i, 0x3c0
+            0xf7, 0x55, // 210: ld [i], v7
+            0x12, 0x00, // 212: jp 0x200
+        }},
+        {"call", "nested subroutine calls and returns", {
+            0x22, 0x06, // 200: call 0x206
+            0x22, 0x06, // 202: call 0x206
+            0x12, 0x00, // 204: jp 0x200
+            0x22, 0x0a, // 206: call 0x20a
+            0x00, 0xee, // 208: ret
+            0x70, 0x01, // 20a: add v0, 0x01
+            0x00, 0xee, // 20c: ret
+        }},
+    };
+
+    return workloads;
+}
+
+WorkloadResult run_workload(const Workload& workload, uint64_t instructions, ChipEngine engine) {
+    using clock = std::chrono::steady_clock;
+
+    auto machine = std::make_unique<Machine>();
+    Chip& chip = machine->chip;
+
+    machine->bus.load_program(workload.program);
+    chip.seed(0);
+    chip.set_engine(engine);
+
+    WorkloadResult result;
+    chip.set_profile(&result.profile);
+
+    auto start = clock::now();
+
+    while (result.profile.instructions < instructions && !chip.has_exited()) {
+        chip.run_frame(0);
+        chip.present();
+    }
+
+    result.elapsed = clock::now() - start;
+    chip.set_profile(nullptr);
+
+    return result;
+}
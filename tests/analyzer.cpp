@@ -0,0 +1,263 @@
+#include <cstdlib>
+#include <filesystem>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <schip/analyzer.h>
+#include <schip/hash.h>
+#include <schip/library.h>
+
+#include "check.h"
+
+/**
+ * Analyzes the conformance ROMs, whose listings say which bytes are code and
+ * which are sprites, and small ROMs made for the cases the conformance ROMs
+ * do not have: a Bxnn where Vx and V0 differ, a Bxnn whose register is not
+ * known, stores into code and Dxy0 in low resolution. Then writes a map and reads it back.
+ */
+
+namespace {
+
+// Whether every byte from first on for length bytes has all of flags
+bool all(const RomMap& map, Addr first, size_t length, uint8_t flags) {
+    for (size_t addr = first; addr < first + length; addr++) {
+        if (addr < USERCODE_BEG || addr - USERCODE_BEG >= map.bytes.size()
+            || (map.bytes[addr - USERCODE_BEG] & flags) != flags)
+            return false;
+    }
+    return true;
+}
+
+// Whether no byte from first on for length bytes has any of flags
+bool none(const RomMap& map, Addr first, size_t length, uint8_t flags) {
+    for (size_t addr = first; addr < first + length; addr++) {
+        if (addr >= USERCODE_BEG && addr - USERCODE_BEG < map.bytes.size()
+            && (map.bytes[addr - USERCODE_BEG] & flags))
+            return false;
+    }
+    return true;
+}
+
+void check_conformance_roms(const std::filesystem::path& dir) {
+    for (const char* name : {"alu.ch8", "flow.ch8", "font.ch8", "hires.ch8", "sprites.ch8"}) {
+        std::vector<Byte> rom = read_rom_file(dir / name);
+        RomMap map = analyze_rom(rom);
+
+        CHECK(map.hash == hash_block(rom.data(), rom.size()));
+        CHECK(map.bytes.size() == rom.size());
+
+        // None of them change their code or jump where it cannot be told
+        if (map.flags != 0) {
+            std::cerr << name << " has flags " << map.flags << std::endl;
+            failures++;
+        }
+        CHECK(map.code_writes.empty());
+        CHECK(all(map, USERCODE_BEG, 1, MAP_CODE | MAP_BLOCK));
+    }
+
+    // The box, ball and dot that follow the code
+    RomMap sprites = analyze_rom(read_rom_file(dir / "sprites.ch8"));
+    CHECK(all(sprites, 0x200, 0x64, MAP_CODE));
+    CHECK(all(sprites, 0x264, 8 + 4 + 1, MAP_SPRITE));
+    CHECK(none(sprites, 0x264, 8 + 4 + 1, MAP_CODE));
+    CHECK(all(sprites, 0x281, 1, MAP_CODE | MAP_BLOCK));
+
+    // hex is never called, so it is not known to be code
+    CHECK(none(sprites, 0x271, 0x10, MAP_CODE));
+
+    // The 16x16 sprite drawn with Dxy0 after 00FF, and again with Dxy8
+    // after 00FE, which does not make the rest of it any less a sprite
+    RomMap hires = analyze_rom(read_rom_file(dir / "hires.ch8"));
+    CHECK(all(hires, 0x26e, 32, MAP_SPRITE));
+    CHECK(none(hires, 0x26e, 32, MAP_CODE));
+    CHECK(all(hires, 0x2bc, 1, MAP_CODE | MAP_BLOCK));
+
+    // jp v2, 0x298 with v2 = 4 takes the third entry of the table only
+    RomMap flow = analyze_rom(read_rom_file(dir / "flow.ch8"));
+    CHECK(all(flow, 0x24e, 2, MAP_CODE));
+    CHECK(all(flow, 0x29c, 1, MAP_CODE | MAP_BLOCK));
+    CHECK(all(flow, 0x2a2, 4, MAP_CODE));
+    CHECK(none(flow, 0x298, 4, MAP_CODE));
+    CHECK(none(flow, 0x29e, 4, MAP_CODE));
+
+    // The scratch bytes Fx33 and Fx55 store into, and the entry of the table
+    // at 0x378 that Fx65 loads after Fx1E added 2 to I
+    RomMap alu = analyze_rom(read_rom_file(dir / "alu.ch8"));
+    CHECK(all(alu, 0x3b4, 3, MAP_WRITTEN));
+    CHECK(none(alu, 0x3b4, 3, MAP_CODE));
+    CHECK(all(alu, 0x37a, 1, MAP_READ));
+    CHECK(none(alu, 0x378, 2, MAP_READ));
+}
+
+void check_jump_tables() {
+    // Bxnn adds Vx, here v2, and not V0 like on the original CHIP-8
+    RomMap known = analyze_rom(std::vector<Byte>{
+        0x60, 0x00, // 200: ld v0, 0x00
+        0x62, 0x02, // 202: ld v2, 0x02
+        0xb2, 0x08, // 204: jp v2, 0x208
+        0x00, 0xfd, // 206: exit
+        0x12, 0x08, // 208: jp 0x208, where V0 would lead
+        0x00, 0xfd, // 20a: exit
+    });
+
+    CHECK(known.flags == 0);
+    CHECK(all(known, 0x20a, 1, MAP_CODE | MAP_BLOCK));
+    CHECK(none(known, 0x206, 4, MAP_CODE));
+
+    // v2 is random, so the table is guessed from the jumps at 0x206
+    RomMap table = analyze_rom(std::vector<Byte>{
+        0xc2, 0x01, // 200: rnd v2, 0x01
+        0xb2, 0x06, // 202: jp v2, 0x206 (table)
+        0x00, 0xfd, // 204: exit
+        // table:
+        0x12, 0x0c, // 206: jp 0x20c (a)
+        0x12, 0x0e, // 208: jp 0x20e (b)
+        0xff, 0xff, // 20a: not a jump, which ends the table
+        // a:
+        0x00, 0xfd, // 20c: exit
+        // b:
+        0x00, 0xfd, // 20e: exit
+    });
+
+    CHECK(table.flags == 0);
+    CHECK(all(table, 0x206, 4, MAP_CODE));
+    CHECK(all(table, 0x20c, 4, MAP_CODE));
+    for (Addr entry : {0x206, 0x208, 0x20c, 0x20e})
+        CHECK(all(table, entry, 1, MAP_BLOCK));
+    CHECK(none(table, 0x204, 2, MAP_CODE));
+    CHECK(none(table, 0x20a, 2, MAP_CODE));
+
+    // And without any jump there, where it goes is not known
+    RomMap unresolved = analyze_rom(std::vector<Byte>{
+        0xc2, 0x01, // 200: rnd v2, 0x01
+        0xb2, 0x04, // 202: jp v2, 0x204
+        0x00, 0xfd, // 204: exit
+    });
+
+    CHECK(unresolved.flags == MAP_UNRESOLVED_JUMPS);
+    CHECK(none(unresolved, 0x204, 2, MAP_CODE));
+}
+
+void check_code_writes() {
+    // Stores V0 and V1 over the first instruction
+    RomMap writes = analyze_rom(std::vector<Byte>{
+        0xa2, 0x00, // 200: ld i, 0x200
+        0x60, 0x00, // 202: ld v0, 0x00
+        0xf1, 0x55, // 204: ld [i], v1
+        0x00, 0xfd, // 206: exit
+    });
+
+    CHECK(writes.flags == MAP_WRITES_CODE);
+    CHECK(writes.self_modifying());
+    CHECK(writes.code_writes == std::vector<Addr>{0x204});
+    CHECK(all(writes, 0x200, 2, MAP_CODE | MAP_WRITTEN));
+    CHECK(none(writes, 0x202, 6, MAP_WRITTEN));
+
+    // Through an I that depends on a random number
+    RomMap unknown = analyze_rom(std::vector<Byte>{
+        0xa2, 0x08, // 200: ld i, 0x208
+        0xc0, 0x07, // 202: rnd v0, 0x07
+        0xf0, 0x1e, // 204: add i, v0
+        0xf0, 0x55, // 206: ld [i], v0
+        0x00, 0xfd, // 208: exit
+    });
+
+    CHECK(unknown.flags == MAP_UNKNOWN_WRITES);
+    CHECK(unknown.code_writes == std::vector<Addr>{0x206});
+}
+
+void check_low_resolution() {
+    // Dxy0 draws nothing in low resolution, before 00FF and after 00FE
+    std::vector<Byte> rom{
+        0xa2, 0x0c, // 200: ld i, 0x20c
+        0xd0, 0x00, // 202: drw v0, v0, 0
+        0x00, 0xff, // 204: high
+        0x00, 0xfe, // 206: low
+        0xd0, 0x00, // 208: drw v0, v0, 0
+        0x00, 0xfd, // 20a: exit
+    };
+    rom.resize(rom.size() + 32, 0xaa);
+
+    RomMap low = analyze_rom(rom);
+    CHECK(none(low, 0x20c, 32, MAP_SPRITE));
+
+    // But a 16x16 sprite in high resolution, with 00FE turned into 00FF
+    rom[7] = 0xff;
+    RomMap high = analyze_rom(rom);
+    CHECK(all(high, 0x20c, 32, MAP_SPRITE));
+    CHECK(none(high, 0x20c, 32, MAP_CODE));
+}
+
+void check_map_file(const std::filesystem::path& dir) {
+    auto filename = unique_temp_path("schip_analyzer_test");
+
+    try {
+        // A map with code writes, so that every part of the file is there
+        RomMap map = analyze_rom(std::vector<Byte>{0xa2, 0x00, 0xf0, 0x55, 0x00, 0xfd});
+        CHECK(!map.code_writes.empty());
+
+        for (const RomMap& written : {map, analyze_rom(read_rom_file(dir / "alu.ch8"))}) {
+            write_rom_map(filename, written);
+            RomMap read = read_rom_map(filename);
+
+            CHECK(read.hash == written.hash);
+            CHECK(read.flags == written.flags);
+            CHECK(read.bytes == written.bytes);
+            CHECK(read.code_writes == written.code_writes);
+        }
+
+        // A map that is cut short is refused
+        std::filesystem::resize_file(filename, std::filesystem::file_size(filename) - 1);
+        bool refused = false;
+        try {
+            read_rom_map(filename);
+        } catch (std::runtime_error&) {
+            refused = true;
+        }
+        CHECK(refused);
+
+        // As is a file that is not a map at all
+        std::filesystem::resize_file(filename, 16);
+        refused = false;
+        try {
+            read_rom_map(filename);
+        } catch (std::runtime_error&) {
+            refused = true;
+        }
+        CHECK(refused);
+    } catch (std::exception& err) {
+        std::cerr << "Error: " << err.what() << std::endl;
+        failures++;
+    }
+
+    std::filesystem::remove(filename);
+}
+
+}
+
+int main(int argc, char** argv) {
+    if (argc != 2) {
+        std::cerr << "Usage: " << argv[0] << " <rom dir>" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    try {
+        check_conformance_roms(argv[1]);
+        check_jump_tables();
+        check_code_writes();
+        check_low_resolution();
+        check_map_file(argv[1]);
+    } catch (std::exception& err) {
+        std::cerr << "Error: " << err.what() << std::endl;
+        failures++;
+    }
+
+    if (failures) {
+        std::cerr << failures << " checks failed" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    std::cout << "The analyzer maps every ROM as expected" << std::endl;
+    return EXIT_SUCCESS;
+}
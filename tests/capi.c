@@ -0,0 +1,150 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <schip/schip.h>
+
+#include "check.h"
+
+/*
+ * Checks the C interface of libschip with a ROM: two machines with the same
+ * seed must see the same frames, a restored state must replay the same frames,
+ * and bad arguments must be refused. Written in C so that the header is
+ * compiled as C.
+ */
+
+#define FRAMES 300
+#define SPLIT 100
+
+static uint64_t hash_frame(const schip_machine* machine) {
+    const uint8_t* pixels = schip_framebuffer(machine);
+    uint64_t hash = 0xcbf29ce484222325ull;
+
+    for (size_t n = 0; n < SCHIP_SCREEN_WIDTH * SCHIP_SCREEN_HEIGHT; n++)
+        hash = (hash ^ pixels[n]) * 0x100000001b3ull;
+
+    return hash;
+}
+
+/* A different key every ten frames */
+static uint16_t keys_at(int frame) {
+    return (uint16_t)(1u << (frame / 10 % 16));
+}
+
+/* Runs frames one at a time from the given frame on, hashing each, and returns the status of the last */
+static schip_status run(schip_machine* machine, int start, uint64_t* hashes, int frames) {
+    schip_status status = SCHIP_OK;
+
+    for (int n = 0; n < frames; n++) {
+        if (status == SCHIP_OK) {
+            schip_set_keys(machine, keys_at(start + n));
+            status = schip_step(machine, 1);
+        }
+        hashes[n] = hash_frame(machine);
+    }
+
+    return status;
+}
+
+static uint8_t* read_file(const char* path, size_t* size) {
+    FILE* file = fopen(path, "rb");
+    uint8_t* data;
+
+    if (!file)
+        return NULL;
+
+    fseek(file, 0, SEEK_END);
+    *size = (size_t)ftell(file);
+    fseek(file, 0, SEEK_SET);
+
+    data = malloc(*size ? *size : 1);
+    if (data && fread(data, 1, *size, file) != *size) {
+        free(data);
+        data = NULL;
+    }
+
+    fclose(file);
+    return data;
+}
+
+int main(int argc, char** argv) {
+    static uint64_t first[FRAMES], second[FRAMES], replayed[FRAMES];
+    static uint8_t too_big[4096];
+    schip_machine *a, *b;
+    schip_status status;
+    uint8_t* rom;
+    size_t size;
+    void* state;
+
+    if (argc != 2) {
+        fprintf(stderr, "Usage: %s <rom>\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    rom = read_file(argv[1], &size);
+    if (!rom) {
+        fprintf(stderr, "Cannot read %s\n", argv[1]);
+        return EXIT_FAILURE;
+    }
+
+    CHECK(schip_abi_version() == SCHIP_ABI_VERSION);
+
+    a = schip_create(42);
+    b = schip_create(42);
+    CHECK(a && b);
+
+    /* Bad arguments are refused and explained */
+    CHECK(schip_load_rom(a, too_big, sizeof(too_big)) == SCHIP_INVALID);
+    CHECK(strlen(schip_error(a)) > 0);
+    CHECK(schip_load_rom(a, rom, 0) == SCHIP_INVALID);
+    CHECK(schip_set_engine(a, (schip_engine)7) == SCHIP_INVALID);
+
+    /* Two machines with the same seed see the same frames, whatever the engine */
+    CHECK(schip_load_rom(a, rom, size) == SCHIP_OK);
+    CHECK(schip_load_rom(b, rom, size) == SCHIP_OK);
+    CHECK(schip_set_engine(b, SCHIP_ENGINE_TABLE) == SCHIP_OK);
+
+    status = run(a, 0, first, FRAMES);
+    CHECK(status != SCHIP_FAULT);
+    CHECK(run(b, 0, second, FRAMES) == status);
+    CHECK(memcmp(first, second, sizeof(first)) == 0);
+
+    /* Loading the ROM again starts over from the same seed */
+    CHECK(schip_load_rom(a, rom, size) == SCHIP_OK);
+    CHECK(schip_frame(a) == 0);
+    run(a, 0, second, FRAMES);
+    CHECK(memcmp(first, second, sizeof(first)) == 0);
+
+    /* A state saved by one machine replays the same frames on another */
+    state = malloc(schip_state_size());
+    CHECK(state != NULL);
+    CHECK(schip_save_state(a, state, schip_state_size() - 1) == SCHIP_INVALID);
+
+    CHECK(schip_load_rom(a, rom, size) == SCHIP_OK);
+    run(a, 0, second, SPLIT);
+    CHECK(schip_save_state(a, state, schip_state_size()) == SCHIP_OK);
+
+    CHECK(schip_load_state(b, state, schip_state_size()) == SCHIP_OK);
+    CHECK(hash_frame(b) == first[SPLIT - 1]);
+    run(b, SPLIT, replayed, FRAMES - SPLIT);
+    CHECK(memcmp(replayed, first + SPLIT, sizeof(uint64_t) * (FRAMES - SPLIT)) == 0);
+
+    /* Running ten frames per call, skipping the ones in between, lands on the same frames */
+    CHECK(schip_load_rom(a, rom, size) == SCHIP_OK);
+    for (int n = 0; n < SPLIT && status == SCHIP_OK; n += 10) {
+        schip_set_keys(a, keys_at(n));
+        CHECK(schip_step(a, 10) == SCHIP_OK);
+        CHECK(schip_frame(a) == (uint64_t)n + 10);
+        CHECK(hash_frame(a) == first[n + 9]);
+    }
+
+    free(state);
+    schip_destroy(a);
+    schip_destroy(b);
+    free(rom);
+
+    if (failures)
+        fprintf(stderr, "%d checks failed\n", failures);
+
+    return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
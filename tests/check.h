@@ -0,0 +1,50 @@
+#pragma once
+
+#ifndef CHECK_H
+#define CHECK_H
+
+#include <stdio.h>
+
+/*
+ * What every test has: a count of the checks that failed, and CHECK, which
+ * says where a check failed and goes on so that one run shows every failure.
+ * Written to be included from C as well as C++.
+ */
+
+static int failures = 0;
+
+#define CHECK(cond) \
+    do { \
+        if (!(cond)) { \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+            failures++; \
+        } \
+    } while (0)
+
+#ifdef __cplusplus
+
+#include <filesystem>
+#include <random>
+#include <string>
+
+/**
+ * Makes up a path in the temporary directory that nothing else uses, so that
+ * tests running at the same time do not get in each other's way.
+ *
+ * @param name	What the path is for, which starts its file name.
+ * @return		The path, which does not exist yet.
+ */
+inline std::filesystem::path unique_temp_path(const std::string& name) {
+    std::random_device random;
+    std::filesystem::path path;
+
+    do {
+        path = std::filesystem::temp_directory_path() / (name + "." + std::to_string(random()));
+    } while (std::filesystem::exists(path));
+
+    return path;
+}
+
+#endif
+
+#endif
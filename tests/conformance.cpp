@@ -0,0 +1,301 @@
+#include <array>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <schip/hash.h>
+#include <schip/machine.h>
+
+/**
+ * Runs a ROM headless for a number of frames, hashes the framebuffer after
+ * every frame and compares the hashes with a golden file.
+ *
+ * A golden file has one hexadecimal hash per line, one line per frame, and
+ * lines starting with # are comments. If the program stopped before the last
+ * frame, the last line is "exit" or "fault: " and the error. --update writes
+ * the golden file instead of checking it, and shows the last frame so that it
+ * can be checked by eye.
+ *
+ * The test ROMs are written as annotated listings like the built-in
+ * workloads: the bytes of each instruction, then a // comment with its
+ * address and mnemonic. --listing checks that the ROM is the listing, and
+ * with --update assembles the listing into the ROM first, so that a ROM is
+ * changed by editing its listing.
+ */
+
+namespace {
+
+using Pixels = std::array<char, PPU::screen_width * PPU::screen_height>;
+
+struct Options {
+    std::filesystem::path rom;
+    std::filesystem::path golden;
+    std::filesystem::path listing;
+    unsigned frames{300};
+    ChipEngine engine{ENGINE_SWITCH};
+    bool update{false};
+};
+
+struct Run {
+    std::vector<uint64_t> hashes;
+    std::string end; // "exit", "fault: ..." or empty if every frame ran
+};
+
+void print_help(const char* program) {
+    std::cerr << "Usage: " << program << " [--update] [--frames <n>] [--engine <name>] [--listing <file>] <rom> <golden>" << std::endl << std::endl;
+    std::cerr << "  --update            Write the golden file instead of checking it, and the ROM from the listing" << std::endl;
+    std::cerr << "  --frames <n>        How many frames to record with --update (default: 300)" << std::endl;
+    std::cerr << "  --engine <name>     How opcodes are dispatched: switch or table (default: switch)" << std::endl;
+    std::cerr << "  --listing <file>    Check that the ROM is this listing" << std::endl;
+}
+
+Options parse_options(int argc, char** argv) {
+    Options options;
+    std::vector<std::string_view> paths;
+
+    for (int i = 1; i < argc; i++) {
+        std::string_view arg{argv[i]};
+        bool has_value = i + 1 < argc;
+
+        if (arg == "--update") {
+            options.update = true;
+        } else if (arg == "--listing" && has_value) {
+            options.listing = argv[++i];
+        } else if (arg == "--frames" && has_value) {
+            options.frames = std::stoul(argv[++i]);
+        } else if (arg == "--engine" && has_value) {
+            std::string_view name{argv[++i]};
+            if (name == "switch")
+                options.engine = ENGINE_SWITCH;
+            else if (name == "table")
+                options.engine = ENGINE_TABLE;
+            else
+                throw std::invalid_argument("Unknown engine " + std::string(name));
+        } else if (arg.starts_with("--")) {
+            throw std::invalid_argument("Unknown option " + std::string(arg));
+        } else {
+            paths.push_back(arg);
+        }
+    }
+
+    if (paths.size() != 2)
+        throw std::invalid_argument("A ROM and a golden file must be given");
+
+    options.rom = paths[0];
+    options.golden = paths[1];
+    return options;
+}
+
+// Every hexadecimal number in front of a // comment is a byte of the ROM
+std::vector<uint8_t> read_listing(const std::filesystem::path& filename) {
+    std::ifstream file{filename};
+    if (!file)
+        throw std::runtime_error("Cannot open the listing " + filename.string());
+
+    std::vector<uint8_t> rom;
+    for (std::string line; std::getline(file, line);) {
+        std::istringstream bytes{line.substr(0, line.find("//"))};
+
+        for (std::string byte; std::getline(bytes >> std::ws, byte, ',');) {
+            size_t end = byte.find_last_not_of(" \t");
+            byte.erase(end == std::string::npos ? 0 : end + 1);
+            if (byte.empty())
+                continue;
+
+            size_t used = 0;
+            unsigned long value = std::stoul(byte, &used, 16);
+            if (!byte.starts_with("0x") || used != byte.size() || value > 0xff)
+                throw std::runtime_error("Bad byte " + byte + " in the listing " + filename.string());
+            rom.push_back(static_cast<uint8_t>(value));
+        }
+    }
+
+    return rom;
+}
+
+std::vector<uint8_t> read_rom(const std::filesystem::path& filename) {
+    std::ifstream file{filename, std::ios_base::in | std::ios::binary};
+    if (!file)
+        throw std::runtime_error("Cannot open the ROM " + filename.string());
+    return {std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>()};
+}
+
+void write_rom(const std::filesystem::path& filename, const std::vector<uint8_t>& rom) {
+    std::ofstream file{filename, std::ios_base::out | std::ios::binary | std::ios_base::trunc};
+    file.write(reinterpret_cast<const char*>(rom.data()), rom.size());
+    if (!file)
+        throw std::runtime_error("Cannot write the ROM " + filename.string());
+}
+
+Run read_golden(const std::filesystem::path& filename) {
+    std::ifstream file{filename};
+    if (!file)
+        throw std::runtime_error("Cannot open the golden file " + filename.string());
+
+    Run run;
+    for (std::string line; std::getline(file, line);) {
+        if (line.empty() || line.front() == '#')
+            continue;
+
+        if (line == "exit" || line.starts_with("fault: ")) {
+            run.end = line;
+            break;
+        }
+
+        run.hashes.push_back(std::stoull(line, nullptr, 16));
+    }
+
+    return run;
+}
+
+void write_golden(const std::filesystem::path& filename, const std::filesystem::path& rom, const Run& run) {
+    std::ofstream file{filename, std::ios_base::out | std::ios_base::trunc};
+    if (!file)
+        throw std::runtime_error("Cannot create the golden file " + filename.string());
+
+    file << "# " << rom.filename().string() << ": framebuffer hash after each frame" << std::endl;
+    for (uint64_t hash : run.hashes)
+        file << std::hex << std::setw(16) << std::setfill('0') << hash << std::endl;
+
+    if (!run.end.empty())
+        file << run.end << std::endl;
+}
+
+/**
+ * Draws a frame as ASCII art. Pixels that are lit are #, and pixels that
+ * changed since the previous frame are + if they were switched on and - if
+ * they were switched off.
+ */
+void draw(const Pixels& pixels, const Pixels& previous, bool extended) {
+    int width = extended ? PPU::screen_width : PPU::screen_width / 2;
+    int height = extended ? PPU::screen_height : PPU::screen_height / 2;
+
+    std::string border = "+" + std::string(width, '-') + "+";
+    std::cout << border << std::endl;
+
+    for (int y = 0; y < height; y++) {
+        std::string line = "|";
+
+        for (int x = 0; x < width; x++) {
+            size_t n = y * PPU::screen_width + x;
+
+            if (pixels[n] && previous[n])
+                line += '#';
+            else if (pixels[n])
+                line += '+';
+            else if (previous[n])
+                line += '-';
+            else
+                line += ' ';
+        }
+
+        std::cout << line << "|" << std::endl;
+    }
+
+    std::cout << border << std::endl;
+}
+
+}
+
+int main(int argc, char** argv) {
+    Options options;
+
+    try {
+        options = parse_options(argc, argv);
+    } catch (std::exception& err) {
+        std::cerr << "Error: " << err.what() << std::endl << std::endl;
+        print_help(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    try {
+        if (!options.listing.empty()) {
+            std::vector<uint8_t> listing = read_listing(options.listing);
+
+            if (options.update) {
+                write_rom(options.rom, listing);
+            } else if (read_rom(options.rom) != listing) {
+                std::cout << options.rom.filename().string() << " is not " << options.listing.filename().string()
+                          << ", assemble it with --update" << std::endl;
+                return EXIT_FAILURE;
+            }
+        }
+
+        Run golden;
+        if (!options.update)
+            golden = read_golden(options.golden);
+
+        auto machine = std::make_unique<Machine>();
+        Chip& chip = machine->chip;
+
+        machine->bus.load_program(options.rom);
+        chip.seed(0);
+        chip.set_engine(options.engine);
+
+        uint64_t frames = options.update ? options.frames : golden.hashes.size();
+        auto previous = std::make_unique<Pixels>();
+        Run run;
+
+        for (uint64_t frame = 0; frame < frames; frame++) {
+            *previous = machine->ppu.pixels();
+
+            try {
+                chip.run_frame(0);
+            } catch (std::exception& err) {
+                run.end = std::string("fault: ") + err.what();
+            }
+
+            const Pixels& pixels = machine->ppu.pixels();
+            run.hashes.push_back(hash_block(pixels.data(), pixels.size()));
+
+            if (!options.update && run.hashes.back() != golden.hashes[frame]) {
+                std::cout << options.rom.filename().string() << ": frame " << frame << " differs, expected "
+                          << std::hex << golden.hashes[frame] << " but got " << run.hashes.back() << std::dec
+                          << std::endl;
+
+                draw(pixels, *previous, machine->ppu.is_extended());
+                return EXIT_FAILURE;
+            }
+
+            if (!run.end.empty())
+                break;
+
+            if (chip.has_exited()) {
+                run.end = "exit";
+                break;
+            }
+        }
+
+        if (options.update) {
+            write_golden(options.golden, options.rom, run);
+            draw(machine->ppu.pixels(), machine->ppu.pixels(), machine->ppu.is_extended());
+            std::cout << "Wrote " << run.hashes.size() << " frames to " << options.golden.string() << std::endl;
+            return EXIT_SUCCESS;
+        }
+
+        if (run.hashes.size() != golden.hashes.size() || run.end != golden.end) {
+            auto describe = [](const Run& r) {
+                return std::to_string(r.hashes.size()) + " frames" + (r.end.empty() ? "" : ", then " + r.end);
+            };
+
+            std::cout << options.rom.filename().string() << ": expected " << describe(golden)
+                      << " but ran " << describe(run) << std::endl;
+            return EXIT_FAILURE;
+        }
+
+        std::cout << options.rom.filename().string() << ": " << run.hashes.size() << " frames match" << std::endl;
+    } catch (std::exception& err) {
+        std::cerr << "Error: " << err.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,207 @@
+#include <array>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <schip/control.h>
+#include <schip/hash.h>
+#include <schip/machine.h>
+#include <schip/state.h>
+
+#include "check.h"
+
+/**
+ * Checks the control socket protocol against a server in the same process:
+ * a machine driven over the socket must end up like one run directly, bad
+ * requests must be refused, and a client that shuts down its side after
+ * sending its requests must still get every response.
+ */
+
+namespace {
+
+constexpr uint32_t FRAMES = 120;
+constexpr uint16_t KEYS = 1 << 5;
+
+template <typename T>
+std::vector<uint8_t> bytes_of(const T& value) {
+    auto data = reinterpret_cast<const uint8_t*>(&value);
+    return {data, data + sizeof(T)};
+}
+
+template <typename T>
+T value_of(const ControlResponse& response) {
+    T value{};
+    if (response.body.size() >= sizeof(T))
+        std::memcpy(&value, response.body.data(), sizeof(T));
+    return value;
+}
+
+std::vector<uint8_t> read_file(const std::filesystem::path& path) {
+    std::ifstream file{path, std::ios_base::in | std::ios::binary};
+    if (!file)
+        throw std::runtime_error("Cannot open " + path.string());
+    return {std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>()};
+}
+
+// What the machine driven over the socket is expected to look like
+struct Expected {
+    uint64_t frame;
+    uint64_t hash;
+    RegisterState regs;
+};
+
+Expected run_directly(const std::vector<uint8_t>& rom) {
+    auto machine = std::make_unique<Machine>();
+    machine->chip.seed(0);
+    machine->bus.load_program(rom);
+
+    for (uint32_t n = 0; n < FRAMES && !machine->chip.has_exited(); n++)
+        machine->chip.run_frame(KEYS);
+
+    Expected expected;
+    expected.frame = machine->chip.frame();
+    expected.hash = hash_block(machine->ppu.pixels().data(), machine->ppu.pixels().size());
+    machine->chip.save_registers(expected.regs);
+    return expected;
+}
+
+std::vector<ControlResponse> receive_all(ControlClient& client, size_t count) {
+    std::vector<ControlResponse> responses(count);
+    for (ControlResponse& response : responses)
+        client.receive(response);
+    return responses;
+}
+
+// Drives two machines with pipelined requests and checks every response
+void check_round_trip(const std::filesystem::path& socket, const std::vector<uint8_t>& rom, const Expected& expected) {
+    ControlClient client{socket};
+
+    client.queue(0, CONTROL_CREATE);
+    client.queue(0, CONTROL_CREATE);
+    client.flush();
+
+    auto created = receive_all(client, 2);
+    uint16_t machines[2] = {created[0].header.instance, created[1].header.instance};
+    CHECK(created[0].header.status == CONTROL_OK && created[1].header.status == CONTROL_OK);
+    CHECK(machines[0] != 0 && machines[1] != 0 && machines[0] != machines[1]);
+
+    std::vector<uint32_t> tags;
+    for (uint16_t machine : machines) {
+        tags.push_back(client.queue(machine, CONTROL_LOAD, rom));
+        client.queue(machine, CONTROL_SET_KEYS, bytes_of(KEYS));
+        client.queue(machine, CONTROL_STEP, bytes_of(FRAMES));
+        client.queue(machine, CONTROL_FRAME_HASH);
+        client.queue(machine, CONTROL_REGISTERS);
+        client.queue(machine, CONTROL_READ_MEMORY, bytes_of(std::array<uint16_t, 2>{USERCODE_BEG, 4}));
+    }
+    client.flush();
+
+    auto responses = receive_all(client, 12);
+    for (size_t m = 0; m < 2; m++) {
+        const ControlResponse* r = &responses[6 * m];
+
+        for (size_t n = 0; n < 6; n++) {
+            CHECK(r[n].header.status == CONTROL_OK);
+            CHECK(r[n].header.instance == machines[m]);
+            CHECK(r[n].header.tag == tags[m] + n);
+        }
+
+        CHECK(value_of<uint64_t>(r[2]) == expected.frame);
+        CHECK(r[3].body.size() == sizeof(uint64_t) + 1);
+        CHECK(value_of<uint64_t>(r[3]) == expected.hash);
+
+        RegisterState regs = value_of<RegisterState>(r[4]);
+        CHECK(r[4].body.size() == sizeof(RegisterState));
+        CHECK(std::memcmp(&regs, &expected.regs, sizeof(regs)) == 0);
+
+        CHECK(r[5].body == std::vector<uint8_t>(rom.begin(), rom.begin() + 4));
+    }
+
+    // Requests that are refused
+    CHECK(client.call(machines[0], CONTROL_STEP, bytes_of(uint8_t{1})).header.status == CONTROL_BAD_REQUEST);
+    CHECK(client.call(machines[0], CONTROL_READ_MEMORY, bytes_of(std::array<uint16_t, 2>{0xfff, 2})).header.status
+          == CONTROL_BAD_REQUEST);
+    CHECK(client.call(machines[0], static_cast<ControlCommand>(0x7f)).header.status == CONTROL_UNKNOWN_COMMAND);
+
+    for (uint16_t machine : machines)
+        CHECK(client.call(machine, CONTROL_DESTROY).header.status == CONTROL_OK);
+    CHECK(client.call(machines[0], CONTROL_FRAME_HASH).header.status == CONTROL_NO_INSTANCE);
+}
+
+// Sends a batch, shuts down the sending side while it runs and reads every response
+void check_half_close(const std::filesystem::path& socket, const std::vector<uint8_t>& rom, const Expected& expected) {
+    ControlClient client{socket};
+
+    uint16_t machine = client.call(0, CONTROL_CREATE).header.instance;
+    CHECK(machine != 0);
+
+    client.queue(machine, CONTROL_LOAD, rom);
+    client.queue(machine, CONTROL_SET_KEYS, bytes_of(KEYS));
+    client.queue(machine, CONTROL_STEP, bytes_of(FRAMES));
+    client.queue(machine, CONTROL_FRAME_HASH);
+    client.queue(machine, CONTROL_DESTROY);
+    client.queue(0, CONTROL_CREATE);
+    client.finish();
+
+    auto responses = receive_all(client, 6);
+    for (const ControlResponse& response : responses)
+        CHECK(response.header.status == CONTROL_OK);
+    CHECK(value_of<uint64_t>(responses[2]) == expected.frame);
+    CHECK(value_of<uint64_t>(responses[3]) == expected.hash);
+
+    // The server closes the connection after the last response
+    bool closed = false;
+    try {
+        ControlResponse response;
+        client.receive(response);
+    } catch (std::runtime_error&) {
+        closed = true;
+    }
+    CHECK(closed);
+}
+
+}
+
+int main(int argc, char** argv) {
+    if (argc != 2) {
+        std::cerr << "Usage: " << argv[0] << " <rom>" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    try {
+        std::vector<uint8_t> rom = read_file(argv[1]);
+        Expected expected = run_directly(rom);
+
+        auto socket = unique_temp_path("schip_control_test");
+        ControlServer server{socket, 2};
+        std::thread serving{[&]() { server.run(); }};
+
+        try {
+            check_round_trip(socket, rom, expected);
+            check_half_close(socket, rom, expected);
+        } catch (std::exception& err) {
+            std::cerr << "Error: " << err.what() << std::endl;
+            failures++;
+        }
+
+        server.stop();
+        serving.join();
+    } catch (std::exception& err) {
+        std::cerr << "Error: " << err.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    if (failures) {
+        std::cerr << failures << " checks failed" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    std::cout << "Control protocol works" << std::endl;
+    return EXIT_SUCCESS;
+}
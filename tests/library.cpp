@@ -0,0 +1,173 @@
+#include <algorithm>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <schip/hash.h>
+#include <schip/library.h>
+
+#include "check.h"
+
+/**
+ * Builds a library out of the conformance ROMs and looks them up again.
+ *
+ * Besides the ROMs themselves, the collection has a copy of one under
+ * another name, a different ROM under the name of one of them, an empty file
+ * and enough small generated ROMs that some two hashes are sure to start with
+ * the same digit, so that a prefix can be ambiguous.
+ */
+
+namespace {
+
+constexpr size_t GENERATED = 40;
+
+void write_file(const std::filesystem::path& path, const std::vector<Byte>& data) {
+    std::ofstream file{path, std::ios_base::out | std::ios::binary | std::ios::trunc};
+    file.write(reinterpret_cast<const char*>(data.data()), data.size());
+    if (!file)
+        throw std::runtime_error("Cannot write " + path.string());
+}
+
+std::string hex(uint64_t hash, size_t digits = 16) {
+    char text[17];
+    std::snprintf(text, sizeof(text), "%016llx", static_cast<unsigned long long>(hash));
+    return std::string(text, digits);
+}
+
+// The number of leading hex digits two hashes have in common
+size_t common_digits(uint64_t a, uint64_t b) {
+    size_t digits = 0;
+    while (digits < 16 && hex(a)[digits] == hex(b)[digits])
+        digits++;
+    return digits;
+}
+
+void check_library(const std::filesystem::path& archive, const std::map<std::string, std::vector<Byte>>& roms) {
+    RomLibrary library{archive};
+    auto entries = library.entries();
+
+    CHECK(entries.size() == roms.size());
+    CHECK(std::is_sorted(entries.begin(), entries.end(),
+                         [](const RomEntry& a, const RomEntry& b) { return a.hash < b.hash; }));
+
+    for (const auto& [name, data] : roms) {
+        uint64_t hash = hash_block(data.data(), data.size());
+        const RomEntry* entry = library.find(hash);
+
+        CHECK(entry != nullptr);
+        if (!entry)
+            continue;
+
+        auto rom = library.rom(*entry);
+        CHECK(std::equal(rom.begin(), rom.end(), data.begin(), data.end()));
+        CHECK(library.find(hex(hash)) == entry);
+
+        // flow.ch8 is the name of two different ROMs
+        if (name == "flow.ch8")
+            CHECK(library.find(name) == nullptr);
+        else
+            CHECK(library.find(name) == entry);
+    }
+
+    // The copy is found under both names, and named after the file found first
+    const RomEntry* alu = library.find("alu.ch8");
+    CHECK(alu != nullptr && library.find("alu-copy.ch8") == alu);
+    CHECK(alu != nullptr && library.name(*alu) == "alu.ch8");
+
+    // Every hash is found by the shortest prefix that no other hash has
+    size_t ambiguous = 0;
+    for (size_t n = 0; n < entries.size(); n++) {
+        size_t digits = 0;
+        if (n > 0)
+            digits = std::max(digits, common_digits(entries[n].hash, entries[n - 1].hash));
+        if (n + 1 < entries.size())
+            digits = std::max(digits, common_digits(entries[n].hash, entries[n + 1].hash));
+
+        CHECK(library.find(hex(entries[n].hash, digits + 1)) == &entries[n]);
+
+        // And not by a prefix it shares with another hash
+        if (digits > 0) {
+            CHECK(library.find(hex(entries[n].hash, digits)) == nullptr);
+            ambiguous++;
+        }
+    }
+
+    // There are more ROMs than hex digits, so some must share their first one
+    CHECK(ambiguous > 0);
+
+    CHECK(library.find("") == nullptr);
+    CHECK(library.find("nothing.ch8") == nullptr);
+    CHECK(library.find("0123456789abcdef0") == nullptr);
+}
+
+}
+
+int main(int argc, char** argv) {
+    if (argc != 2) {
+        std::cerr << "Usage: " << argv[0] << " <rom dir>" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    auto dir = unique_temp_path("schip_library_test");
+
+    try {
+        std::filesystem::create_directories(dir / "a");
+        std::filesystem::create_directories(dir / "b");
+
+        // Every ROM the library should have, by a name it can be found under
+        std::map<std::string, std::vector<Byte>> roms;
+        for (const auto& file : std::filesystem::directory_iterator(argv[1])) {
+            if (file.path().extension() != ".ch8")
+                continue;
+
+            std::vector<Byte> data = read_rom_file(file.path());
+            roms[file.path().filename().string()] = data;
+            write_file(dir / "a" / file.path().filename(), data);
+        }
+
+        if (!roms.contains("alu.ch8") || !roms.contains("flow.ch8") || !roms.contains("sprites.ch8"))
+            throw std::runtime_error(std::string("The conformance ROMs are not in ") + argv[1]);
+
+        write_file(dir / "b" / "alu-copy.ch8", roms["alu.ch8"]);
+        write_file(dir / "b" / "flow.ch8", roms["sprites.ch8"]);
+        write_file(dir / "b" / "empty.ch8", {});
+
+        // Jumps to itself, followed by a different byte each
+        for (size_t n = 0; n < GENERATED; n++) {
+            std::string name = "gen" + std::to_string(n) + ".ch8";
+            roms[name] = {0x12, 0x00, static_cast<Byte>(n)};
+            write_file(dir / "b" / name, roms[name]);
+        }
+
+        LibraryBuildOptions options;
+        options.threads = 2;
+        options.frames = 30;
+
+        size_t files = roms.size() + 3;
+        LibraryBuildStats stats = build_library({dir / "a", dir / "b"}, dir / "test.sl", options);
+        CHECK(stats.files == files);
+        CHECK(stats.roms == roms.size());
+        // alu-copy.ch8 is alu.ch8 and b/flow.ch8 is sprites.ch8
+        CHECK(stats.duplicates == 2);
+        CHECK(stats.skipped == 1);
+
+        check_library(dir / "test.sl", roms);
+    } catch (std::exception& err) {
+        std::cerr << "Error: " << err.what() << std::endl;
+        failures++;
+    }
+
+    std::filesystem::remove_all(dir);
+
+    if (failures) {
+        std::cerr << failures << " checks failed" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    std::cout << "The library finds every ROM" << std::endl;
+    return EXIT_SUCCESS;
+}
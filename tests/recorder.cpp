@@ -0,0 +1,161 @@
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <schip/recorder.h>
+
+#include "check.h"
+
+/**
+ * Records frames into a delta recording and reads them back, which must
+ * give every frame bit for bit.
+ *
+ * The frames run past two keyframes and include frames that did not change,
+ * which have no payload, blank and full frames, whose runs are longer than
+ * one PackBits run can be, noise, which is all literals, and small changes
+ * in both resolutions.
+ */
+
+namespace {
+
+// Past the keyframes at 600 and 1200
+constexpr size_t FRAMES = 2 * FrameRecorder::keyframe_interval + 100;
+
+// Pixels are 0 or 1, which is what the reader gives back
+std::vector<RecordedFrame> make_frames() {
+    std::mt19937 random{1234};
+    std::vector<RecordedFrame> frames(FRAMES);
+    FramePixels pixels{};
+
+    for (size_t n = 0; n < FRAMES; n++) {
+        if (n % 50 >= 10 && n % 50 < 13) {
+            // Unchanged
+        } else if (n % 97 == 0) {
+            pixels.fill(1);
+        } else if (n % 89 == 0) {
+            pixels.fill(0);
+        } else if (n % 89 == 1) {
+            pixels.fill(1);
+        } else if (n % 31 == 0) {
+            for (char& pixel : pixels)
+                pixel = random() & 1;
+        } else {
+            for (int flips = random() % 40; flips > 0; flips--)
+                pixels[random() % pixels.size()] ^= 1;
+        }
+
+        frames[n].frame = 3 * n + 7;
+        frames[n].extended = (n / 100) % 2;
+        frames[n].pixels = pixels;
+    }
+
+    return frames;
+}
+
+template <typename T>
+T read_le(const std::vector<uint8_t>& data, size_t pos) {
+    T value = 0;
+    for (size_t i = 0; i < sizeof(T); i++)
+        value |= static_cast<T>(data[pos + i]) << (i * 8);
+    return value;
+}
+
+// Walks the records of the file to see that the recording has what this test is about
+void check_records(const std::filesystem::path& filename) {
+    std::ifstream file{filename, std::ios_base::in | std::ios::binary};
+    std::vector<uint8_t> data{std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>()};
+
+    size_t keyframes = 0, empty = 0, long_runs = 0;
+    size_t pos = 20;
+
+    while (pos + 11 <= data.size()) {
+        uint8_t flags = data[pos + 8];
+        uint16_t size = read_le<uint16_t>(data, pos + 9);
+        pos += 11;
+
+        keyframes += (flags & 2) != 0;
+        empty += size == 0;
+
+        // A run longer than 128 bytes, the longest one PackBits header can
+        // repeat, takes two headers of 128 for the same byte
+        int previous = -1;
+        for (size_t n = pos; n + 1 < pos + size && n + 1 < data.size();) {
+            uint8_t header = data[n];
+            if (header > 128) {
+                int run = header == 0x81 ? data[n + 1] : -1;
+                long_runs += run >= 0 && run == previous;
+                previous = run;
+                n += 2;
+            } else {
+                previous = -1;
+                n += header < 128 ? header + 2 : 1;
+            }
+        }
+
+        pos += size;
+    }
+
+    CHECK(pos == data.size());
+    CHECK(keyframes == 3);
+    CHECK(empty > 0);
+    CHECK(long_runs > 0);
+}
+
+}
+
+int main() {
+    auto filename = unique_temp_path("schip_recorder_test");
+
+    try {
+        std::vector<RecordedFrame> frames = make_frames();
+
+        {
+            FrameRecorder recorder{filename, RECORDING_DELTA};
+            for (const RecordedFrame& frame : frames)
+                recorder.push_wait(frame.frame, frame.pixels, frame.extended);
+
+            recorder.finish();
+            CHECK(recorder.written() == FRAMES);
+            CHECK(recorder.dropped() == 0);
+        }
+
+        check_records(filename);
+
+        RecordingReader reader{filename};
+        auto frame = std::make_unique<RecordedFrame>();
+        size_t read = 0;
+
+        while (reader.next(*frame)) {
+            if (read < frames.size()) {
+                const RecordedFrame& expected = frames[read];
+                if (frame->frame != expected.frame || frame->extended != expected.extended
+                    || frame->pixels != expected.pixels) {
+                    std::cerr << "Frame " << read << " did not read back the same" << std::endl;
+                    failures++;
+                }
+            }
+            read++;
+        }
+
+        CHECK(read == frames.size());
+    } catch (std::exception& err) {
+        std::cerr << "Error: " << err.what() << std::endl;
+        failures++;
+    }
+
+    std::filesystem::remove(filename);
+
+    if (failures) {
+        std::cerr << failures << " checks failed" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    std::cout << FRAMES << " frames read back the same" << std::endl;
+    return EXIT_SUCCESS;
+}
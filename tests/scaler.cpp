@@ -0,0 +1,136 @@
+#include <algorithm>
+#include <array>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <schip/scaler.h>
+
+#include "check.h"
+
+/**
+ * Scales frames with every kernel this CPU has and compares the images with
+ * the ones of the plain C++ kernel, which must be the same pixel for pixel.
+ *
+ * The frames are blank, full, noise, which has every pattern Scale2x looks
+ * for, and diagonal lines, which is what it rounds off, in both resolutions
+ * and at every scale up to 9 with nearest and up to 16 with Scale2x.
+ */
+
+namespace {
+
+using Frame = std::array<char, PPU::screen_width * PPU::screen_height>;
+
+// The highest scales every frame is tried at, which take the wider kernels
+// through every remainder of their width. max_scale is only tried with noise.
+constexpr unsigned MAX_NEAREST_SCALE = 9;
+constexpr unsigned MAX_SCALE2X_SCALE = 16;
+
+// Bytes that differ from each other, so that mixed up channels show
+constexpr uint32_t FOREGROUND = 0xff3377bb;
+constexpr uint32_t BACKGROUND = 0x80102030;
+
+std::vector<std::pair<std::string, Frame>> make_frames() {
+    std::mt19937 random{1234};
+    std::vector<std::pair<std::string, Frame>> frames;
+
+    Frame frame{};
+    frames.emplace_back("blank", frame);
+
+    frame.fill(1);
+    frames.emplace_back("full", frame);
+
+    // Any value but 0 is a pixel that is on
+    for (char& pixel : frame)
+        pixel = random() % 3 ? 0 : static_cast<char>(random());
+    frames.emplace_back("noise", frame);
+
+    frame.fill(0);
+    for (unsigned y = 0; y < PPU::screen_height; y++) {
+        for (unsigned x = 0; x < PPU::screen_width; x++)
+            frame[y * PPU::screen_width + x] = (x + y) % 7 == 0 || (x + 2 * PPU::screen_height - y) % 11 == 0;
+    }
+    frames.emplace_back("lines", frame);
+
+    return frames;
+}
+
+// Scales a frame with the scalar kernel and every other one, and compares the images
+size_t check_kernels(const std::vector<ScaleKernel>& kernels, ScaleFilter filter, unsigned scale,
+                     const std::string& name, const Frame& frame, bool extended) {
+    ScaleOptions options;
+    options.filter = filter;
+    options.scale = scale;
+    options.foreground = FOREGROUND;
+    options.background = BACKGROUND;
+    options.kernel = SCALE_KERNEL_SCALAR;
+
+    FrameScaler reference{options};
+    auto expected = reference.scale(frame, extended);
+
+    for (ScaleKernel kernel : kernels) {
+        options.kernel = kernel;
+        FrameScaler scaler{options};
+        CHECK(scaler.kernel() == kernel);
+
+        auto image = scaler.scale(frame, extended);
+        CHECK(image.size() == expected.size());
+
+        if (std::memcmp(image.data(), expected.data(), image.size_bytes()) != 0) {
+            size_t at = std::mismatch(image.begin(), image.end(), expected.begin()).first - image.begin();
+            std::cerr << FrameScaler::kernel_name(kernel) << " differs from scalar for " << name
+                      << (extended ? " in high" : " in low") << " resolution with "
+                      << (filter == SCALE_2X ? "scale2x" : "nearest") << " at scale " << scale << ", first at "
+                      << at % scaler.width() << "," << at / scaler.width() << std::endl;
+            failures++;
+        }
+    }
+
+    return kernels.size();
+}
+
+}
+
+int main() {
+    std::vector<ScaleKernel> kernels;
+    for (ScaleKernel kernel : {SCALE_KERNEL_SSE2, SCALE_KERNEL_AVX2}) {
+        if (FrameScaler::supports(kernel))
+            kernels.push_back(kernel);
+    }
+
+    CHECK(FrameScaler::supports(FrameScaler::best_kernel()));
+    CHECK(FrameScaler{ScaleOptions{}}.kernel() == FrameScaler::best_kernel());
+
+    auto frames = make_frames();
+    size_t images = 0;
+
+    for (ScaleFilter filter : {SCALE_NEAREST, SCALE_2X}) {
+        // Scale2x needs an even scale
+        unsigned step = filter == SCALE_2X ? 2 : 1;
+        unsigned highest = filter == SCALE_2X ? MAX_SCALE2X_SCALE : MAX_NEAREST_SCALE;
+
+        for (unsigned scale = step; scale <= highest; scale += step) {
+            for (const auto& [name, frame] : frames) {
+                for (bool extended : {false, true})
+                    images += check_kernels(kernels, filter, scale, name, frame, extended);
+            }
+        }
+
+        images += check_kernels(kernels, filter, FrameScaler::max_scale, frames[2].first, frames[2].second, true);
+    }
+
+    if (failures) {
+        std::cerr << failures << " checks failed" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    std::cout << "Compared " << images << " images of";
+    for (ScaleKernel kernel : kernels)
+        std::cout << ' ' << FrameScaler::kernel_name(kernel);
+    std::cout << (kernels.empty() ? " no kernel but scalar, which this CPU is left with" : " with scalar")
+              << std::endl;
+    return EXIT_SUCCESS;
+}
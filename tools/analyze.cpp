@@ -0,0 +1,152 @@
+#include <chrono>
+#include <filesystem>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <schip/analyzer.h>
+
+/**
+ * Statically analyzes ROM collections into code/data maps.
+ *
+ * analyze writes a map for every distinct ROM, named after its hash like the
+ * entries of a ROM library, and counts the ROMs that may change their own
+ * code. show prints a map with one character per byte of the ROM.
+ */
+
+namespace {
+
+void print_help(const char* program) {
+    std::cerr << "Usage: " << program << " analyze [--threads <n>] <output dir> <rom or dir>..." << std::endl;
+    std::cerr << "       " << program << " show <map>" << std::endl << std::endl;
+    std::cerr << "  --threads <n>       How many threads to analyze the ROMs on (default: all cores)" << std::endl;
+}
+
+std::string describe_flags(uint16_t flags) {
+    std::string text;
+    if (flags & MAP_WRITES_CODE)
+        text += " writes-code";
+    if (flags & MAP_UNKNOWN_WRITES)
+        text += " unknown-writes";
+    if (flags & MAP_UNRESOLVED_JUMPS)
+        text += " unresolved-jumps";
+    if (flags & MAP_INVALID_CODE)
+        text += " invalid-code";
+    return text.empty() ? " none" : text;
+}
+
+// The character show prints for a byte, with the most telling flag winning
+char describe_byte(uint8_t flags) {
+    if ((flags & MAP_CODE) && (flags & MAP_WRITTEN))
+        return 'M';
+    if (flags & MAP_CODE)
+        return 'C';
+    if (flags & MAP_SPRITE)
+        return 'S';
+    if (flags & MAP_WRITTEN)
+        return 'W';
+    if (flags & MAP_READ)
+        return 'D';
+    return '.';
+}
+
+int analyze(const std::vector<std::string_view>& paths, const AnalyzeOptions& options) {
+    using clock = std::chrono::steady_clock;
+
+    if (paths.size() < 2)
+        throw std::invalid_argument("An output directory and at least one ROM or directory must be given");
+
+    std::vector<std::filesystem::path> inputs(paths.begin() + 1, paths.end());
+
+    auto start = clock::now();
+    AnalyzeStats stats = analyze_roms(inputs, paths[0], options);
+    std::chrono::duration<double> elapsed = clock::now() - start;
+
+    std::cout << "Analyzed " << stats.roms << " ROMs from " << stats.files << " files into " << paths[0] << " in "
+              << elapsed.count() * 1000 << " ms (" << stats.duplicates << " duplicates, " << stats.skipped
+              << " files that are not ROMs)" << std::endl;
+    std::cout << stats.self_modifying << " ROMs may change their own code" << std::endl;
+
+    return EXIT_SUCCESS;
+}
+
+int show(const std::vector<std::string_view>& paths) {
+    if (paths.size() != 1)
+        throw std::invalid_argument("One map must be given");
+
+    RomMap map = read_rom_map(paths[0]);
+
+    size_t code = 0, sprites = 0;
+    for (uint8_t flags : map.bytes) {
+        code += (flags & MAP_CODE) != 0;
+        sprites += (flags & MAP_SPRITE) != 0;
+    }
+
+    std::cout << "ROM " << std::hex << std::setw(16) << std::setfill('0') << map.hash << std::dec
+              << std::setfill(' ') << ", " << map.bytes.size() << " bytes, " << code << " of code, " << sprites
+              << " of sprites" << std::endl;
+    std::cout << "Flags:" << describe_flags(map.flags) << std::endl;
+
+    if (!map.code_writes.empty()) {
+        std::cout << "Code writes at" << std::hex;
+        for (Addr pc : map.code_writes)
+            std::cout << ' ' << std::setw(3) << std::setfill('0') << pc;
+        std::cout << std::dec << std::setfill(' ') << std::endl;
+    }
+
+    // C code, M code that is written, S sprites, W written data, D loaded data
+    for (size_t offset = 0; offset < map.bytes.size(); offset += 64) {
+        std::cout << std::hex << std::setw(3) << std::setfill('0') << USERCODE_BEG + offset << std::dec
+                  << std::setfill(' ') << ' ';
+        for (size_t n = offset; n < std::min(offset + 64, map.bytes.size()); n++)
+            std::cout << describe_byte(map.bytes[n]);
+        std::cout << std::endl;
+    }
+
+    return EXIT_SUCCESS;
+}
+
+}
+
+int main(int argc, char** argv) {
+    std::string_view command;
+    std::vector<std::string_view> paths;
+    AnalyzeOptions options;
+
+    try {
+        for (int i = 1; i < argc; i++) {
+            std::string_view arg{argv[i]};
+            bool has_value = i + 1 < argc;
+
+            if (arg == "--threads" && has_value)
+                options.threads = std::stoul(argv[++i]);
+            else if (arg.starts_with("--"))
+                throw std::invalid_argument("Unknown option " + std::string(arg));
+            else if (command.empty())
+                command = arg;
+            else
+                paths.push_back(arg);
+        }
+
+        if (command.empty())
+            throw std::invalid_argument("No command was given");
+
+        if (command != "analyze" && command != "show")
+            throw std::invalid_argument("Unknown command " + std::string(command));
+    } catch (std::exception& err) {
+        std::cerr << "Error: " << err.what() << std::endl << std::endl;
+        print_help(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    try {
+        if (command == "analyze")
+            return analyze(paths, options);
+        return show(paths);
+    } catch (std::exception& err) {
+        std::cerr << "Error: " << err.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+}
@@ -0,0 +1,170 @@
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <schip/control.h>
+#include <schip/state.h>
+
+/**
+ * Drives a farm of machines served by chip8 --control, the way a test
+ * orchestrator would.
+ *
+ * It creates machines, loads a ROM into all of them and steps them a frame
+ * at a time with different keys held on each, sending the requests for every
+ * machine in one batch per frame. At the end it fetches the framebuffer hash
+ * and registers of every machine, and reports how many requests per second
+ * the server answered.
+ */
+
+namespace {
+
+struct Counts {
+    uint64_t requests{0};
+    uint64_t round_trips{0};
+};
+
+template <typename T>
+std::vector<uint8_t> bytes_of(const T& value) {
+    auto data = reinterpret_cast<const uint8_t*>(&value);
+    return {data, data + sizeof(T)};
+}
+
+template <typename T>
+T value_of(const std::vector<uint8_t>& body) {
+    T value{};
+    std::memcpy(&value, body.data(), std::min(sizeof(T), body.size()));
+    return value;
+}
+
+// Sends everything that was queued and collects one response per request
+std::vector<ControlResponse> round_trip(ControlClient& client, size_t requests, Counts& counts) {
+    client.flush();
+
+    std::vector<ControlResponse> responses(requests);
+    for (ControlResponse& response : responses) {
+        client.receive(response);
+
+        if (response.header.status != CONTROL_OK) {
+            std::string error(response.body.begin(), response.body.end());
+            throw std::runtime_error("Request " + std::to_string(response.header.tag) + " for machine "
+                                     + std::to_string(response.header.instance) + " failed with status "
+                                     + std::to_string(response.header.status) + (error.empty() ? "" : ": " + error));
+        }
+    }
+
+    counts.requests += requests;
+    counts.round_trips++;
+    return responses;
+}
+
+}
+
+int main(int argc, char** argv) {
+    using clock = std::chrono::steady_clock;
+
+    std::vector<std::string_view> paths;
+    unsigned instances = 64;
+    unsigned frames = 600;
+
+    try {
+        for (int i = 1; i < argc; i++) {
+            std::string_view arg{argv[i]};
+            bool has_value = i + 1 < argc;
+
+            if (arg == "--instances" && has_value)
+                instances = std::clamp(std::stoul(argv[++i]), 1ul, 0xfffful);
+            else if (arg == "--frames" && has_value)
+                frames = std::stoul(argv[++i]);
+            else if (arg.starts_with("--"))
+                throw std::invalid_argument("Unknown option " + std::string(arg));
+            else
+                paths.push_back(arg);
+        }
+
+        if (paths.size() != 2)
+            throw std::invalid_argument("A socket and a ROM must be given");
+    } catch (std::exception& err) {
+        std::cerr << "Error: " << err.what() << std::endl << std::endl;
+        std::cerr << "Usage: " << argv[0] << " [--instances <n>] [--frames <n>] <socket> <rom>" << std::endl << std::endl;
+        std::cerr << "  --instances <n>     How many machines to run (default: 64)" << std::endl;
+        std::cerr << "  --frames <n>        How many frames to step every machine for (default: 600)" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    try {
+        std::ifstream file{std::string(paths[1]), std::ios_base::in | std::ios::binary};
+        if (!file)
+            throw std::runtime_error("Cannot open " + std::string(paths[1]));
+        std::vector<uint8_t> rom{std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>()};
+
+        ControlClient client{paths[0]};
+        Counts counts;
+        auto start = clock::now();
+
+        for (unsigned n = 0; n < instances; n++)
+            client.queue(0, CONTROL_CREATE);
+
+        std::vector<uint16_t> machines;
+        for (const ControlResponse& response : round_trip(client, instances, counts))
+            machines.push_back(response.header.instance);
+
+        for (uint16_t machine : machines)
+            client.queue(machine, CONTROL_LOAD, rom);
+        round_trip(client, machines.size(), counts);
+
+        // Every machine holds a different key, which changes every half second
+        for (unsigned frame = 0; frame < frames; frame++) {
+            for (size_t n = 0; n < machines.size(); n++) {
+                uint16_t keys = static_cast<uint16_t>(1 << ((frame / 30 + n) % 16));
+                client.queue(machines[n], CONTROL_SET_KEYS, bytes_of(keys));
+                client.queue(machines[n], CONTROL_STEP, bytes_of(uint32_t{1}));
+            }
+
+            round_trip(client, 2 * machines.size(), counts);
+        }
+
+        for (uint16_t machine : machines) {
+            client.queue(machine, CONTROL_FRAME_HASH);
+            client.queue(machine, CONTROL_REGISTERS);
+        }
+        auto results = round_trip(client, 2 * machines.size(), counts);
+
+        for (uint16_t machine : machines)
+            client.queue(machine, CONTROL_DESTROY);
+        round_trip(client, machines.size(), counts);
+
+        std::chrono::duration<double> elapsed = clock::now() - start;
+
+        std::map<uint64_t, unsigned> screens;
+        for (size_t n = 0; n < machines.size(); n++) {
+            auto hash = value_of<uint64_t>(results[2 * n].body);
+            auto regs = value_of<RegisterState>(results[2 * n + 1].body);
+            screens[hash]++;
+
+            if (n < 8) {
+                std::cout << "Machine " << machines[n] << ": screen " << std::hex << std::setw(16)
+                          << std::setfill('0') << hash << ", pc " << std::setw(3) << regs.pc << ", i "
+                          << std::setw(3) << regs.i << std::dec << std::setfill(' ') << std::endl;
+            }
+        }
+
+        std::cout << machines.size() << " machines ran " << frames << " frames and ended on " << screens.size()
+                  << " different screens" << std::endl;
+        std::cout << counts.requests << " requests in " << counts.round_trips << " round trips took "
+                  << elapsed.count() * 1000 << " ms (" << static_cast<uint64_t>(counts.requests / elapsed.count())
+                  << " requests/s)" << std::endl;
+    } catch (std::exception& err) {
+        std::cerr << "Error: " << err.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
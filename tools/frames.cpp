@@ -0,0 +1,178 @@
+#include <array>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <schip/recorder.h>
+
+/**
+ * Turns a recording written with --video back into one PNG file per frame.
+ *
+ * The PNG files are 8-bit greyscale and use stored deflate blocks, so no
+ * compression library is needed.
+ */
+
+namespace {
+
+constexpr std::array<uint32_t, 256> make_crc_table() {
+    std::array<uint32_t, 256> table{};
+
+    for (uint32_t n = 0; n < 256; n++) {
+        uint32_t c = n;
+        for (int k = 0; k < 8; k++)
+            c = (c & 1) ? 0xedb88320 ^ (c >> 1) : c >> 1;
+        table[n] = c;
+    }
+
+    return table;
+}
+
+constexpr auto CRC_TABLE = make_crc_table();
+
+// The largest block deflate can store without compressing
+constexpr size_t MAX_STORED = 65535;
+
+uint32_t crc32(const uint8_t* data, size_t size, uint32_t crc = 0) {
+    crc = ~crc;
+    for (size_t n = 0; n < size; n++)
+        crc = CRC_TABLE[(crc ^ data[n]) & 0xff] ^ (crc >> 8);
+    return ~crc;
+}
+
+uint32_t adler32(const std::vector<uint8_t>& data) {
+    uint32_t a = 1, b = 0;
+    for (uint8_t byte : data) {
+        a = (a + byte) % 65521;
+        b = (b + a) % 65521;
+    }
+    return (b << 16) | a;
+}
+
+void put_be(std::vector<uint8_t>& out, uint32_t value) {
+    for (int shift = 24; shift >= 0; shift -= 8)
+        out.push_back(static_cast<uint8_t>(value >> shift));
+}
+
+void write_chunk(std::ofstream& file, std::string_view type, const std::vector<uint8_t>& data) {
+    std::vector<uint8_t> chunk;
+    put_be(chunk, static_cast<uint32_t>(data.size()));
+    chunk.insert(chunk.end(), type.begin(), type.end());
+    chunk.insert(chunk.end(), data.begin(), data.end());
+    put_be(chunk, crc32(chunk.data() + 4, chunk.size() - 4));
+
+    file.write(reinterpret_cast<const char*>(chunk.data()), chunk.size());
+}
+
+void write_png(const std::filesystem::path& filename, const FramePixels& frame, unsigned scale) {
+    uint32_t width = PPU::screen_width * scale;
+    uint32_t height = PPU::screen_height * scale;
+
+    // Every row starts with filter type 0, none
+    std::vector<uint8_t> raw;
+    raw.reserve((width + 1) * height);
+
+    for (uint32_t y = 0; y < height; y++) {
+        raw.push_back(0);
+        for (uint32_t x = 0; x < width; x++)
+            raw.push_back(frame[(y / scale) * PPU::screen_width + x / scale] ? 0xff : 0x00);
+    }
+
+    std::vector<uint8_t> zlib{0x78, 0x01};
+    for (size_t pos = 0; pos < raw.size() || pos == 0; pos += MAX_STORED) {
+        size_t size = std::min(MAX_STORED, raw.size() - pos);
+        bool last = pos + size >= raw.size();
+
+        zlib.push_back(last ? 1 : 0);
+        zlib.push_back(size & 0xff);
+        zlib.push_back(size >> 8);
+        zlib.push_back(~size & 0xff);
+        zlib.push_back((~size >> 8) & 0xff);
+        zlib.insert(zlib.end(), raw.begin() + pos, raw.begin() + pos + size);
+    }
+    put_be(zlib, adler32(raw));
+
+    std::vector<uint8_t> header;
+    put_be(header, width);
+    put_be(header, height);
+    header.insert(header.end(), {8, 0, 0, 0, 0}); // 8-bit greyscale, no interlacing
+
+    std::ofstream file{filename, std::ios_base::out | std::ios::binary | std::ios::trunc};
+    if (!file)
+        throw std::runtime_error("Cannot create " + filename.string());
+
+    file.write("\x89PNG\r\n\x1a\n", 8);
+    write_chunk(file, "IHDR", header);
+    write_chunk(file, "IDAT", zlib);
+    write_chunk(file, "IEND", {});
+
+    if (!file)
+        throw std::runtime_error("Cannot write " + filename.string());
+}
+
+}
+
+int main(int argc, char** argv) {
+    std::vector<std::string_view> paths;
+    unsigned scale = 4;
+    unsigned every = 1;
+
+    try {
+        for (int i = 1; i < argc; i++) {
+            std::string_view arg{argv[i]};
+            bool has_value = i + 1 < argc;
+
+            if (arg == "--scale" && has_value)
+                scale = std::max(1ul, std::stoul(argv[++i]));
+            else if (arg == "--every" && has_value)
+                every = std::max(1ul, std::stoul(argv[++i]));
+            else if (arg.starts_with("--"))
+                throw std::invalid_argument("Unknown option " + std::string(arg));
+            else
+                paths.push_back(arg);
+        }
+
+        if (paths.size() != 2)
+            throw std::invalid_argument("A recording and an output directory must be given");
+    } catch (std::exception& err) {
+        std::cerr << "Error: " << err.what() << std::endl << std::endl;
+        std::cerr << "Usage: " << argv[0] << " [--scale <n>] [--every <n>] <recording> <output dir>" << std::endl << std::endl;
+        std::cerr << "  --scale <n>         How many image pixels wide every screen pixel is (default: 4)" << std::endl;
+        std::cerr << "  --every <n>         Only write every n-th frame (default: 1)" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    try {
+        RecordingReader reader{paths[0]};
+        std::filesystem::path outdir{paths[1]};
+        std::filesystem::create_directories(outdir);
+
+        auto frame = std::make_unique<RecordedFrame>();
+        auto expanded = std::make_unique<FramePixels>();
+        uint64_t count = 0, written = 0;
+
+        for (; reader.next(*frame); count++) {
+            if (count % every != 0)
+                continue;
+
+            std::ostringstream name;
+            name << "frame_" << std::setw(6) << std::setfill('0') << frame->frame << ".png";
+
+            expand_frame(frame->pixels, frame->extended, *expanded);
+            write_png(outdir / name.str(), *expanded, scale);
+            written++;
+        }
+
+        std::cout << "Wrote " << written << " of " << count << " frames to " << outdir.string() << std::endl;
+    } catch (std::exception& err) {
+        std::cerr << "Error: " << err.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
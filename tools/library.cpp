@@ -0,0 +1,158 @@
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include <schip/library.h>
+
+/**
+ * Builds, lists and checks ROM library archives.
+ *
+ * check runs every ROM in a library again and compares the framebuffer with
+ * the golden hash that was recorded when the library was built, which turns a
+ * ROM collection into a regression test.
+ */
+
+namespace {
+
+void print_help(const char* program) {
+    std::cerr << "Usage: " << program << " build [--threads <n>] [--frames <n>] <archive> <rom or dir>..." << std::endl;
+    std::cerr << "       " << program << " list <archive>" << std::endl;
+    std::cerr << "       " << program << " check [--threads <n>] <archive>" << std::endl << std::endl;
+    std::cerr << "  --threads <n>       How many threads to run the ROMs on (default: all cores)" << std::endl;
+    std::cerr << "  --frames <n>        How many frames each ROM is run for to find its golden hash (default: 300)" << std::endl;
+}
+
+std::string describe_flags(uint16_t flags) {
+    std::string text;
+    if (flags & ROM_HIRES)
+        text += " hires";
+    if (flags & ROM_EXITS)
+        text += " exits";
+    if (flags & ROM_FAULTS)
+        text += " faults";
+    return text;
+}
+
+int build(const std::vector<std::string_view>& paths, const LibraryBuildOptions& options) {
+    using clock = std::chrono::steady_clock;
+
+    if (paths.size() < 2)
+        throw std::invalid_argument("An archive and at least one ROM or directory must be given");
+
+    std::vector<std::filesystem::path> inputs(paths.begin() + 1, paths.end());
+
+    auto start = clock::now();
+    LibraryBuildStats stats = build_library(inputs, paths[0], options);
+    std::chrono::duration<double> elapsed = clock::now() - start;
+
+    std::cout << "Packed " << stats.roms << " ROMs from " << stats.files << " files into " << paths[0] << " in "
+              << elapsed.count() * 1000 << " ms (" << stats.duplicates << " duplicates, " << stats.skipped
+              << " files that are not ROMs)" << std::endl;
+
+    return EXIT_SUCCESS;
+}
+
+int list(const std::vector<std::string_view>& paths) {
+    if (paths.size() != 1)
+        throw std::invalid_argument("One archive must be given");
+
+    RomLibrary library{paths[0]};
+
+    for (const RomEntry& entry : library.entries()) {
+        std::cout << std::hex << std::setw(16) << std::setfill('0') << entry.hash << std::dec << std::setfill(' ')
+                  << std::setw(6) << entry.size << "  " << library.name(entry) << describe_flags(entry.flags)
+                  << std::endl;
+    }
+
+    std::cout << library.entries().size() << " ROMs" << std::endl;
+    return EXIT_SUCCESS;
+}
+
+int check(const std::vector<std::string_view>& paths, const LibraryBuildOptions& options) {
+    if (paths.size() != 1)
+        throw std::invalid_argument("One archive must be given");
+
+    RomLibrary library{paths[0]};
+    auto entries = library.entries();
+
+    std::vector<RomProfile> profiles(entries.size());
+    std::atomic<size_t> next{0};
+    std::vector<std::thread> workers;
+
+    for (unsigned t = 0; t < std::max(1u, options.threads); t++) {
+        workers.emplace_back([&]() {
+            for (size_t n = next.fetch_add(1); n < entries.size(); n = next.fetch_add(1))
+                profiles[n] = profile_rom(library.rom(entries[n]), entries[n].golden_frames);
+        });
+    }
+
+    for (auto& worker : workers)
+        worker.join();
+
+    size_t differ = 0;
+    for (size_t n = 0; n < entries.size(); n++) {
+        if (profiles[n].golden == entries[n].golden && profiles[n].flags == entries[n].flags)
+            continue;
+
+        std::cout << library.name(entries[n]) << ": expected " << std::hex << entries[n].golden
+                  << describe_flags(entries[n].flags) << " but got " << profiles[n].golden << std::dec
+                  << describe_flags(profiles[n].flags) << std::endl;
+        differ++;
+    }
+
+    std::cout << entries.size() - differ << " of " << entries.size() << " ROMs match" << std::endl;
+    return differ ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+}
+
+int main(int argc, char** argv) {
+    std::string_view command;
+    std::vector<std::string_view> paths;
+    LibraryBuildOptions options;
+
+    try {
+        for (int i = 1; i < argc; i++) {
+            std::string_view arg{argv[i]};
+            bool has_value = i + 1 < argc;
+
+            if (arg == "--threads" && has_value)
+                options.threads = std::stoul(argv[++i]);
+            else if (arg == "--frames" && has_value)
+                options.frames = std::stoul(argv[++i]);
+            else if (arg.starts_with("--"))
+                throw std::invalid_argument("Unknown option " + std::string(arg));
+            else if (command.empty())
+                command = arg;
+            else
+                paths.push_back(arg);
+        }
+
+        if (command.empty())
+            throw std::invalid_argument("No command was given");
+
+        if (command != "build" && command != "list" && command != "check")
+            throw std::invalid_argument("Unknown command " + std::string(command));
+    } catch (std::exception& err) {
+        std::cerr << "Error: " << err.what() << std::endl << std::endl;
+        print_help(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    try {
+        if (command == "build")
+            return build(paths, options);
+        if (command == "list")
+            return list(paths);
+        return check(paths, options);
+    } catch (std::exception& err) {
+        std::cerr << "Error: " << err.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+}
@@ -0,0 +1,98 @@
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+
+#include <schip/opcodes.h>
+#include <schip/trace.h>
+
+/**
+ * Prints a trace file written by the chip as a disassembly, from the oldest
+ * instruction to the newest, with the values each instruction left behind.
+ */
+
+namespace {
+
+std::string hex(unsigned value, int width) {
+    std::ostringstream out;
+    out << "0x" << std::hex << std::setw(width) << std::setfill('0') << value;
+    return out.str();
+}
+
+// Describes what an instruction wrote, as far as the record tells
+std::string effect(const TraceRecord& record) {
+    unsigned x = (record.opcode >> 8) & 0xf;
+    std::string vx = "v" + std::string(1, "0123456789abcdef"[x]) + "=" + hex(record.vx, 2);
+    std::string vf = "vf=" + hex(record.vf, 2);
+    std::string i = "i=" + hex(record.i, 3);
+
+    switch (classify(record.opcode)) {
+        case OP_LD:
+        case OP_ADD_IMM:
+        case OP_MOV:
+        case OP_RAND:
+        case OP_GET_DELAY:
+        case OP_GET_KEY:
+            return vx;
+        case OP_OR:
+        case OP_AND:
+        case OP_XOR:
+        case OP_ADD:
+        case OP_SUB:
+        case OP_SHR:
+        case OP_SBR:
+        case OP_SHL:
+            return x == 0xf ? vf : vx + " " + vf;
+        case OP_DRAW:
+            return vf;
+        case OP_LDI:
+        case OP_ADDI:
+        case OP_LD_SPRITE:
+        case OP_LD_ESPRITE:
+            return i;
+        case OP_SET_BCD:
+            return "[" + hex(record.i, 3) + "..+2]";
+        case OP_REG_DUMP:
+            return "[" + hex(record.i, 3) + "..+" + std::to_string(x) + "]";
+        case OP_REG_STORE:
+            return "v0..v" + std::string(1, "0123456789abcdef"[x]) + " from " + hex(record.i, 3);
+        default:
+            return {};
+    }
+}
+
+}
+
+int main(int argc, char** argv) {
+    if (argc != 2) {
+        std::cerr << "Usage: " << argv[0] << " <trace file>" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    try {
+        TraceFile trace = read_trace(argv[1]);
+
+        std::cout << "; " << trace.records.size() << " of " << trace.count << " instructions" << std::endl;
+
+        // Number the instructions counting back from the newest, which is 0
+        for (size_t n = 0; n < trace.records.size(); n++) {
+            const TraceRecord& record = trace.records[n];
+            bool faulted = !trace.error.empty() && n + 1 == trace.records.size();
+
+            std::string instruction = disassemble(record.opcode);
+            std::cout << std::setw(6) << static_cast<long long>(n) - static_cast<long long>(trace.records.size() - 1)
+                      << "  " << hex(record.pc, 3) << "  " << std::hex << std::setw(4) << std::setfill('0')
+                      << record.opcode << std::dec << std::setfill(' ') << "  " << std::left << std::setw(20)
+                      << instruction << std::right << (faulted ? "; fault: " + trace.error : effect(record))
+                      << std::endl;
+        }
+
+        if (!trace.error.empty())
+            std::cout << "; The chip faulted: " << trace.error << std::endl;
+    } catch (std::exception& err) {
+        std::cerr << "Error: " << err.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
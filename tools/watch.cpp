@@ -0,0 +1,105 @@
+#include <bit>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <thread>
+
+#include <schip/shm.h>
+
+/**
+ * Follows the frames an emulator started with --publish puts into shared
+ * memory, and prints how many arrive per second.
+ *
+ * Frames are read in place, the way any other consumer would: acquire the
+ * newest slot, look at it, then validate that it was not overwritten.
+ */
+
+namespace {
+
+void draw(const SharedFrameSlot& slot) {
+    int width = slot.extended ? PPU::screen_width : PPU::screen_width / 2;
+    int height = slot.extended ? PPU::screen_height : PPU::screen_height / 2;
+
+    for (int y = 0; y < height; y++) {
+        std::string line;
+        for (int x = 0; x < width; x++)
+            line += slot.pixels[y * PPU::screen_width + x] ? '#' : '.';
+        std::cout << line << std::endl;
+    }
+}
+
+}
+
+int main(int argc, char** argv) {
+    using clock = std::chrono::steady_clock;
+
+    std::string name;
+    double seconds = 0;
+    bool show = false;
+
+    for (int i = 1; i < argc; i++) {
+        std::string_view arg{argv[i]};
+
+        if (arg == "--seconds" && i + 1 < argc)
+            seconds = std::stod(argv[++i]);
+        else if (arg == "--show")
+            show = true;
+        else if (!arg.starts_with("--"))
+            name = arg;
+    }
+
+    if (name.empty()) {
+        std::cerr << "Usage: " << argv[0] << " [--seconds <s>] [--show] <name>" << std::endl << std::endl;
+        std::cerr << "  --seconds <s>       How long to watch for, 0 for no limit (default: 0)" << std::endl;
+        std::cerr << "  --show              Draw the newest frame once a second" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    try {
+        FrameSubscriber subscriber{name};
+
+        auto start = clock::now();
+        auto report = start + std::chrono::seconds(1);
+        uint64_t last = subscriber.latest();
+        uint64_t frames = 0, torn = 0, rows = 0;
+
+        while (seconds <= 0 || clock::now() - start < std::chrono::duration<double>(seconds)) {
+            SharedFrameView view;
+
+            if (subscriber.latest() != last && subscriber.acquire(view)) {
+                uint64_t frame = view.slot->frame;
+                uint64_t dirty = view.slot->dirty_rows;
+
+                if (subscriber.validate(view)) {
+                    frames += frame - last;
+                    rows += std::popcount(dirty);
+                    last = frame;
+                } else {
+                    torn++;
+                }
+            }
+
+            if (auto now = clock::now(); now >= report) {
+                std::cout << "Frame " << last << ": " << frames << " frames/s, " << rows
+                          << " changed rows, " << torn << " reads overtaken by the publisher" << std::endl;
+
+                if (show && subscriber.acquire(view)) {
+                    draw(*view.slot);
+                    if (!subscriber.validate(view))
+                        std::cout << "(the frame changed while it was drawn)" << std::endl;
+                }
+
+                frames = torn = rows = 0;
+                report += std::chrono::seconds(1);
+            }
+
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    } catch (std::exception& err) {
+        std::cerr << "Error: " << err.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}